@@ -24,6 +24,8 @@ LOCAL_SRC_FILES += \
     LocAdapterBase.cpp \
     ContextBase.cpp \
     LocDualContext.cpp \
+    LocApiSynthetic.cpp \
+    LocModuleRegistry.cpp \
     loc_core_log.cpp
 
 LOCAL_CFLAGS += \
@@ -40,6 +42,8 @@ LOCAL_COPY_HEADERS:= \
     LocAdapterBase.h \
     ContextBase.h \
     LocDualContext.h \
+    LocApiSynthetic.h \
+    LocModuleRegistry.h \
     LBSProxyBase.h \
     UlpProxyBase.h \
     gps_extended_c.h \
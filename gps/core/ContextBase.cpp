@@ -29,10 +29,11 @@
 #define LOG_NDDEBUG 0
 #define LOG_TAG "LocSvc_CtxBase"
 
-#include <dlfcn.h>
 #include <cutils/sched_policy.h>
 #include <unistd.h>
 #include <ContextBase.h>
+#include <LocApiSynthetic.h>
+#include <LocModuleRegistry.h>
 #include <msg_q.h>
 #include <loc_target.h>
 #include <log_util.h>
@@ -44,13 +45,11 @@ LBSProxyBase* ContextBase::getLBSProxy(const char* libName)
 {
     LBSProxyBase* proxy = NULL;
     LOC_LOGD("%s:%d]: getLBSProxy libname: %s\n", __func__, __LINE__, libName);
-    void* lib = dlopen(libName, RTLD_NOW);
+    getLBSProxy_t* getter =
+        (getLBSProxy_t*)LocModuleRegistry::getSymbol(libName, "getLBSProxy");
 
-    if ((void*)NULL != lib) {
-        getLBSProxy_t* getter = (getLBSProxy_t*)dlsym(lib, "getLBSProxy");
-        if (NULL != getter) {
-            proxy = (*getter)();
-        }
+    if (NULL != getter) {
+        proxy = (*getter)();
     }
     if (NULL == proxy) {
         proxy = new LBSProxyBase();
@@ -63,14 +62,19 @@ LocApiBase* ContextBase::createLocApi(LOC_API_ADAPTER_EVENT_MASK_T exMask)
 {
     LocApiBase* locApi = NULL;
 
+    // synthetic reports in place of the modem, for load testing
+    if (LocApiSynthetic::isEnabled()) {
+        LOC_LOGD("%s:%d]: using LocApiSynthetic", __func__, __LINE__);
+        locApi = new LocApiSynthetic(mMsgTask, exMask, this);
+    }
     // first if can not be MPQ
-    if (TARGET_MPQ != loc_get_target()) {
+    else if (TARGET_MPQ != loc_get_target()) {
         if (NULL == (locApi = mLBSProxy->getLocApi(mMsgTask, exMask, this))) {
-            void *handle = NULL;
             //try to see if LocApiV02 is present
-            if((handle = dlopen("libloc_api_v02.so", RTLD_NOW)) != NULL) {
+            if(LocModuleRegistry::getHandle("libloc_api_v02.so") != NULL) {
                 LOC_LOGD("%s:%d]: libloc_api_v02.so is present", __func__, __LINE__);
-                getLocApi_t* getter = (getLocApi_t*)dlsym(handle, "getLocApi");
+                getLocApi_t* getter = (getLocApi_t*)
+                    LocModuleRegistry::getSymbol("libloc_api_v02.so", "getLocApi");
                 if(getter != NULL) {
                     LOC_LOGD("%s:%d]: getter is not NULL for LocApiV02", __func__, __LINE__);
                     locApi = (*getter)(mMsgTask, exMask, this);
@@ -80,13 +84,11 @@ LocApiBase* ContextBase::createLocApi(LOC_API_ADAPTER_EVENT_MASK_T exMask)
             else {
                 LOC_LOGD("%s:%d]: libloc_api_v02.so is NOT present. Trying RPC",
                          __func__, __LINE__);
-                handle = dlopen("libloc_api-rpc-qc.so", RTLD_NOW);
-                if (NULL != handle) {
-                    getLocApi_t* getter = (getLocApi_t*)dlsym(handle, "getLocApi");
-                    if (NULL != getter) {
-                        LOC_LOGD("%s:%d]: getter is not NULL in RPC", __func__, __LINE__);
-                        locApi = (*getter)(mMsgTask, exMask, this);
-                    }
+                getLocApi_t* getter = (getLocApi_t*)
+                    LocModuleRegistry::getSymbol("libloc_api-rpc-qc.so", "getLocApi");
+                if (NULL != getter) {
+                    LOC_LOGD("%s:%d]: getter is not NULL in RPC", __func__, __LINE__);
+                    locApi = (*getter)(mMsgTask, exMask, this);
                 }
             }
         }
@@ -110,6 +110,15 @@ public:
     virtual bool requestNiNotify(GpsNiNotification &notify,
                                  const void* data);
     inline virtual bool isInSession() { return false; }
+    // Whether a position report of this status and accuracy would be
+    // used at all. Called on the LocApi's indication thread before the
+    // report is converted, so it may only look at state that is safe
+    // to read there.
+    inline virtual bool isPositionWanted(enum loc_sess_status status,
+                                         bool hasAccuracy,
+                                         float accuracy) {
+        return true;
+    }
     ContextBase* getContext() const { return mContext; }
     virtual void reportGpsMeasurementData(GpsData &gpsMeasurementData);
 };
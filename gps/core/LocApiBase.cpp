@@ -30,9 +30,11 @@
 #define LOG_TAG "LocSvc_LocApiBase"
 
 #include <dlfcn.h>
+#include <sched.h>
 #include <LocApiBase.h>
 #include <LocAdapterBase.h>
 #include <log_util.h>
+#include <loc_fix_trace.h>
 #include <LocDualContext.h>
 
 namespace loc_core {
@@ -40,6 +42,29 @@ namespace loc_core {
 #define TO_ALL_LOCADAPTERS(call) TO_ALL_ADAPTERS(mLocAdapters, (call))
 #define TO_1ST_HANDLING_LOCADAPTERS(call) TO_1ST_HANDLING_ADAPTER(mLocAdapters, (call))
 
+// deliver only to the adapters that registered for the event. The call
+// refers to the adapter as adapters[i].
+#define TO_SUBSCRIBED_LOCADAPTERS(event, call)                              \
+    {                                                                       \
+        int active = acquireSubscribers();                                  \
+        LocAdapterBase* const* adapters = mSubscribers[active][(event)];    \
+        TO_ALL_ADAPTERS(adapters, (call));                                  \
+        releaseSubscribers(active);                                         \
+    }
+#define TO_1ST_HANDLING_SUBSCRIBED_LOCADAPTERS(event, call)                 \
+    {                                                                       \
+        int active = acquireSubscribers();                                  \
+        LocAdapterBase* const* adapters = mSubscribers[active][(event)];    \
+        TO_1ST_HANDLING_ADAPTER(adapters, (call));                          \
+        releaseSubscribers(active);                                         \
+    }
+
+// mSubscribersState layout: the active copy in bit 0, the readers of
+// copy 0 in bits 1-15 and the readers of copy 1 in bits 16-30
+#define SUBSCRIBERS_ACTIVE 0x1
+#define SUBSCRIBERS_READER(copy) ((copy) ? 0x10000 : 0x2)
+#define SUBSCRIBERS_READERS(copy) ((copy) ? 0x7fff0000 : 0xfffe)
+
 int hexcode(char *hexstring, int string_size,
             const char *data, int data_size)
 {
@@ -129,9 +154,12 @@ LocApiBase::LocApiBase(const MsgTask* msgTask,
                        LOC_API_ADAPTER_EVENT_MASK_T excludedMask,
                        ContextBase* context) :
     mExcludedMask(excludedMask), mMsgTask(msgTask),
-    mMask(0), mSupportedMsg(0), mContext(context)
+    mMask(0), mSupportedMsg(0), mContext(context),
+    mSubscribersState(0)
 {
     memset(mLocAdapters, 0, sizeof(mLocAdapters));
+    memset(mSubscribers, 0, sizeof(mSubscribers));
+    pthread_mutex_init(&mSubscribersLock, NULL);
 }
 
 LOC_API_ADAPTER_EVENT_MASK_T LocApiBase::getEvtMask()
@@ -161,8 +189,8 @@ void LocApiBase::addAdapter(LocAdapterBase* adapter)
     for (int i = 0; i < MAX_ADAPTERS && mLocAdapters[i] != adapter; i++) {
         if (mLocAdapters[i] == NULL) {
             mLocAdapters[i] = adapter;
-            mMsgTask->sendMsg(new LocOpenMsg(this,
-                                             (adapter->getEvtMask())));
+            updateSubscribers();
+            mMsgTask->sendMsg(new LocOpenMsg(this, getEvtMask()));
             break;
         }
     }
@@ -192,6 +220,7 @@ void LocApiBase::removeAdapter(LocAdapterBase* adapter)
             mLocAdapters[j] = mLocAdapters[i];
             // this makes sure that we exit the for loop
             mLocAdapters[i] = NULL;
+            updateSubscribers();
 
             // if we have an empty list of adapters
             if (0 == i) {
@@ -206,9 +235,70 @@ void LocApiBase::removeAdapter(LocAdapterBase* adapter)
 
 void LocApiBase::updateEvtMask()
 {
+    updateSubscribers();
     mMsgTask->sendMsg(new LocOpenMsg(this, getEvtMask()));
 }
 
+int LocApiBase::acquireSubscribers()
+{
+    int32_t state;
+    // counted against the copy that is active at the time, atomically,
+    // so a rebuild waiting for a copy to drain never sees a new reader
+    do {
+        state = android_atomic_acquire_load(&mSubscribersState);
+    } while (android_atomic_acquire_cas(
+                 state,
+                 state + SUBSCRIBERS_READER(state & SUBSCRIBERS_ACTIVE),
+                 &mSubscribersState));
+    return state & SUBSCRIBERS_ACTIVE;
+}
+
+void LocApiBase::releaseSubscribers(int active)
+{
+    android_atomic_add(-SUBSCRIBERS_READER(active), &mSubscribersState);
+}
+
+void LocApiBase::updateSubscribers()
+{
+    pthread_mutex_lock(&mSubscribersLock);
+
+    // fill in the list not in use, then switch over to it. Deliveries
+    // that started before the last switch may still be walking it.
+    // A delivery must not rebuild the lists, it would wait for itself.
+    int32_t state = android_atomic_acquire_load(&mSubscribersState);
+    int next = 1 - (state & SUBSCRIBERS_ACTIVE);
+    while (0 != (state & SUBSCRIBERS_READERS(next))) {
+        sched_yield();
+        state = android_atomic_acquire_load(&mSubscribersState);
+    }
+
+    for (int event = 0; event < LOC_API_ADAPTER_EVENT_MAX; event++) {
+        LOC_API_ADAPTER_EVENT_MASK_T mask = (1 << event);
+        // both NMEA rates are delivered through reportNmea()
+        if (LOC_API_ADAPTER_REPORT_NMEA_1HZ == event ||
+            LOC_API_ADAPTER_REPORT_NMEA_POSITION == event) {
+            mask = LOC_API_ADAPTER_BIT_NMEA_1HZ_REPORT |
+                   LOC_API_ADAPTER_BIT_NMEA_POSITION_REPORT;
+        }
+
+        int count = 0;
+        for (int i = 0; i < MAX_ADAPTERS && NULL != mLocAdapters[i]; i++) {
+            if (mLocAdapters[i]->checkMask(mask)) {
+                mSubscribers[next][event][count++] = mLocAdapters[i];
+            }
+        }
+        mSubscribers[next][event][count] = NULL;
+    }
+
+    // publishes the new lists; readers keep coming and going meanwhile
+    do {
+        state = android_atomic_acquire_load(&mSubscribersState);
+    } while (android_atomic_release_cas(state, state ^ SUBSCRIBERS_ACTIVE,
+                                        &mSubscribersState));
+
+    pthread_mutex_unlock(&mSubscribersLock);
+}
+
 void LocApiBase::handleEngineUpEvent()
 {
     // This will take care of renegotiating the loc handle
@@ -226,6 +316,20 @@ void LocApiBase::handleEngineDownEvent()
     TO_ALL_LOCADAPTERS(mLocAdapters[i]->handleEngineDownEvent());
 }
 
+bool LocApiBase::isPositionWanted(enum loc_sess_status status,
+                                  bool hasAccuracy, float accuracy)
+{
+    bool wanted = false;
+
+    TO_SUBSCRIBED_LOCADAPTERS(
+        LOC_API_ADAPTER_REPORT_POSITION,
+        wanted = wanted ||
+                 adapters[i]->isPositionWanted(status, hasAccuracy, accuracy)
+    );
+
+    return wanted;
+}
+
 void LocApiBase::reportPosition(UlpLocation &location,
                                 GpsLocationExtended &locationExtended,
                                 void* locationExt,
@@ -243,13 +347,15 @@ void LocApiBase::reportPosition(UlpLocation &location,
              location.gpsLocation.bearing, location.gpsLocation.accuracy,
              location.gpsLocation.timestamp, location.rawDataSize,
              location.rawData, status, loc_technology_mask);
-    // loop through adapters, and deliver to all adapters.
-    TO_ALL_LOCADAPTERS(
-        mLocAdapters[i]->reportPosition(location,
-                                        locationExtended,
-                                        locationExt,
-                                        status,
-                                        loc_technology_mask)
+    loc_fix_trace_stamp(loc_fix_trace_current(), LOC_FIX_TRACE_FAN_OUT);
+    // loop through adapters, and deliver to the registered adapters.
+    TO_SUBSCRIBED_LOCADAPTERS(
+        LOC_API_ADAPTER_REPORT_POSITION,
+        adapters[i]->reportPosition(location,
+                                    locationExtended,
+                                    locationExt,
+                                    status,
+                                    loc_technology_mask)
     );
 }
 
@@ -271,24 +377,27 @@ void LocApiBase::reportSv(HaxxSvStatus &svStatus,
                  svStatus.sv_list[i].elevation,
                  svStatus.sv_list[i].azimuth);
     }
-    // loop through adapters, and deliver to all adapters.
-    TO_ALL_LOCADAPTERS(
-        mLocAdapters[i]->reportSv(svStatus,
-                                     locationExtended,
-                                     svExt)
+    // loop through adapters, and deliver to the registered adapters.
+    TO_SUBSCRIBED_LOCADAPTERS(
+        LOC_API_ADAPTER_REPORT_SATELLITE,
+        adapters[i]->reportSv(svStatus,
+                              locationExtended,
+                              svExt)
     );
 }
 
 void LocApiBase::reportStatus(GpsStatusValue status)
 {
-    // loop through adapters, and deliver to all adapters.
-    TO_ALL_LOCADAPTERS(mLocAdapters[i]->reportStatus(status));
+    // loop through adapters, and deliver to the registered adapters.
+    TO_SUBSCRIBED_LOCADAPTERS(LOC_API_ADAPTER_REPORT_STATUS,
+                              adapters[i]->reportStatus(status));
 }
 
 void LocApiBase::reportNmea(const char* nmea, int length)
 {
-    // loop through adapters, and deliver to all adapters.
-    TO_ALL_LOCADAPTERS(mLocAdapters[i]->reportNmea(nmea, length));
+    // loop through adapters, and deliver to the registered adapters.
+    TO_SUBSCRIBED_LOCADAPTERS(LOC_API_ADAPTER_REPORT_NMEA_1HZ,
+                              adapters[i]->reportNmea(nmea, length));
 }
 
 void LocApiBase::reportXtraServer(const char* url1, const char* url2,
@@ -301,38 +410,50 @@ void LocApiBase::reportXtraServer(const char* url1, const char* url2,
 
 void LocApiBase::requestXtraData()
 {
-    // loop through adapters, and deliver to the first handling adapter.
-    TO_1ST_HANDLING_LOCADAPTERS(mLocAdapters[i]->requestXtraData());
+    // loop through the registered adapters, and deliver to the first
+    // handling adapter.
+    TO_1ST_HANDLING_SUBSCRIBED_LOCADAPTERS(LOC_API_ADAPTER_REQUEST_ASSISTANCE_DATA,
+                                           adapters[i]->requestXtraData());
 }
 
 void LocApiBase::requestTime()
 {
-    // loop through adapters, and deliver to the first handling adapter.
-    TO_1ST_HANDLING_LOCADAPTERS(mLocAdapters[i]->requestTime());
+    // loop through the registered adapters, and deliver to the first
+    // handling adapter.
+    TO_1ST_HANDLING_SUBSCRIBED_LOCADAPTERS(LOC_API_ADAPTER_REQUEST_ASSISTANCE_DATA,
+                                           adapters[i]->requestTime());
 }
 
 void LocApiBase::requestLocation()
 {
-    // loop through adapters, and deliver to the first handling adapter.
-    TO_1ST_HANDLING_LOCADAPTERS(mLocAdapters[i]->requestLocation());
+    // loop through the registered adapters, and deliver to the first
+    // handling adapter.
+    TO_1ST_HANDLING_SUBSCRIBED_LOCADAPTERS(LOC_API_ADAPTER_REQUEST_ASSISTANCE_DATA,
+                                           adapters[i]->requestLocation());
 }
 
 void LocApiBase::requestATL(int connHandle, AGpsType agps_type)
 {
-    // loop through adapters, and deliver to the first handling adapter.
-    TO_1ST_HANDLING_LOCADAPTERS(mLocAdapters[i]->requestATL(connHandle, agps_type));
+    // loop through the registered adapters, and deliver to the first
+    // handling adapter.
+    TO_1ST_HANDLING_SUBSCRIBED_LOCADAPTERS(LOC_API_ADAPTER_REQUEST_LOCATION_SERVER,
+                                           adapters[i]->requestATL(connHandle, agps_type));
 }
 
 void LocApiBase::releaseATL(int connHandle)
 {
-    // loop through adapters, and deliver to the first handling adapter.
-    TO_1ST_HANDLING_LOCADAPTERS(mLocAdapters[i]->releaseATL(connHandle));
+    // loop through the registered adapters, and deliver to the first
+    // handling adapter.
+    TO_1ST_HANDLING_SUBSCRIBED_LOCADAPTERS(LOC_API_ADAPTER_REQUEST_LOCATION_SERVER,
+                                           adapters[i]->releaseATL(connHandle));
 }
 
 void LocApiBase::requestSuplES(int connHandle)
 {
-    // loop through adapters, and deliver to the first handling adapter.
-    TO_1ST_HANDLING_LOCADAPTERS(mLocAdapters[i]->requestSuplES(connHandle));
+    // loop through the registered adapters, and deliver to the first
+    // handling adapter.
+    TO_1ST_HANDLING_SUBSCRIBED_LOCADAPTERS(LOC_API_ADAPTER_REQUEST_LOCATION_SERVER,
+                                           adapters[i]->requestSuplES(connHandle));
 }
 
 void LocApiBase::reportDataCallOpened()
@@ -349,8 +470,10 @@ void LocApiBase::reportDataCallClosed()
 
 void LocApiBase::requestNiNotify(GpsNiNotification &notify, const void* data)
 {
-    // loop through adapters, and deliver to the first handling adapter.
-    TO_1ST_HANDLING_LOCADAPTERS(mLocAdapters[i]->requestNiNotify(notify, data));
+    // loop through the registered adapters, and deliver to the first
+    // handling adapter.
+    TO_1ST_HANDLING_SUBSCRIBED_LOCADAPTERS(LOC_API_ADAPTER_REQUEST_NI_NOTIFY_VERIFY,
+                                           adapters[i]->requestNiNotify(notify, data));
 }
 
 void LocApiBase::saveSupportedMsgList(uint64_t supportedMsgList)
@@ -366,8 +489,9 @@ LocApiProxyBase* LocApiBase :: getLocApiProxy()
 
 void LocApiBase::reportGpsMeasurementData(GpsData &gpsMeasurementData)
 {
-    // loop through adapters, and deliver to all adapters.
-    TO_ALL_LOCADAPTERS(mLocAdapters[i]->reportGpsMeasurementData(gpsMeasurementData));
+    // loop through adapters, and deliver to the registered adapters.
+    TO_SUBSCRIBED_LOCADAPTERS(LOC_API_ADAPTER_GNSS_MEASUREMENT,
+                              adapters[i]->reportGpsMeasurementData(gpsMeasurementData));
 }
 
 enum loc_api_adapter_err LocApiBase::
@@ -31,6 +31,8 @@
 
 #include <stddef.h>
 #include <ctype.h>
+#include <pthread.h>
+#include <cutils/atomic.h>
 #include <gps_extended.h>
 #include <MsgTask.h>
 #include <log_util.h>
@@ -81,6 +83,15 @@ class LocApiBase {
     ContextBase *mContext;
     LocAdapterBase* mLocAdapters[MAX_ADAPTERS];
     uint64_t mSupportedMsg;
+    // per event type, NULL terminated lists of the adapters whose event
+    // mask asks for that event. Two copies: deliveries walk the active
+    // copy, a rebuild fills the other one once its last reader has left,
+    // then switches over.
+    LocAdapterBase* mSubscribers[2][LOC_API_ADAPTER_EVENT_MAX][MAX_ADAPTERS + 1];
+    // the active copy in bit 0, and the number of deliveries walking each
+    // copy, in one word so a delivery can only join the active copy
+    volatile int32_t mSubscribersState;
+    pthread_mutex_t mSubscribersLock;
 
 protected:
     virtual enum loc_api_adapter_err
@@ -92,7 +103,10 @@ protected:
     LocApiBase(const MsgTask* msgTask,
                LOC_API_ADAPTER_EVENT_MASK_T excludedMask,
                ContextBase* context = NULL);
-    inline virtual ~LocApiBase() { close(); }
+    inline virtual ~LocApiBase() {
+        close();
+        pthread_mutex_destroy(&mSubscribersLock);
+    }
     bool isInSession();
     const LOC_API_ADAPTER_EVENT_MASK_T mExcludedMask;
 
@@ -103,10 +117,22 @@ public:
 
     void addAdapter(LocAdapterBase* adapter);
     void removeAdapter(LocAdapterBase* adapter);
+    // rebuilds the per event adapter lists from the adapters' event masks
+    void updateSubscribers();
+    // a hint only, the lists may change before the event is delivered
+    inline bool hasSubscribers(enum loc_api_adapter_event_index event) const {
+        int active = android_atomic_acquire_load(&mSubscribersState) & 1;
+        return NULL != mSubscribers[active][event][0];
+    }
+    // enter and leave the active subscriber lists, for a delivery
+    int acquireSubscribers();
+    void releaseSubscribers(int active);
 
     // upward calls
     void handleEngineUpEvent();
     void handleEngineDownEvent();
+    bool isPositionWanted(enum loc_sess_status status,
+                          bool hasAccuracy, float accuracy);
     void reportPosition(UlpLocation &location,
                         GpsLocationExtended &locationExtended,
                         void* locationExt,
@@ -215,6 +241,13 @@ public:
                                  size_t length,
                                  uint32_t slotBitMask);
     inline virtual void setInSession(bool inSession) {}
+    /*
+      Configuration requests issued between these two calls may be
+      deferred by the LocApi and sent to the modem together on
+      endConfigBatch(). Setters return success for deferred requests.
+     */
+    inline virtual void beginConfigBatch() {}
+    inline virtual void endConfigBatch() {}
     inline bool isMessageSupported (LocCheckingMessagesID msgID) const {
         if (msgID > (sizeof(mSupportedMsg) << 3)) {
             return false;
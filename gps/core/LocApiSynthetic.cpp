@@ -0,0 +1,512 @@
+/* Copyright (c) 2014, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation, nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#define LOG_NDDEBUG 0
+#define LOG_TAG "LocSvc_LocApiSynthetic"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <LocApiSynthetic.h>
+#include <log_util.h>
+#include <loc_cfg.h>
+#include <loc_fix_trace.h>
+
+#define GPS_CONF_FILE "/etc/gps.conf"
+
+namespace loc_core {
+
+/* Rates are in Hz. A fix rate of 0 follows the interval of the session,
+   the other streams are off at 0. With SYNTHETIC_RAMP_SEC set the fix
+   rate is doubled every SYNTHETIC_RAMP_SEC seconds for as long as the
+   MsgTask queueing delay stays under SYNTHETIC_MAX_QUEUE_MS, and the
+   last rate that did is logged as the sustained rate. */
+struct LocApiSyntheticConfig {
+    uint32_t SYNTHETIC_LOC_API;
+    uint32_t SYNTHETIC_FIX_RATE_HZ;
+    uint32_t SYNTHETIC_SV_RATE_HZ;
+    uint32_t SYNTHETIC_NMEA_RATE_HZ;
+    uint32_t SYNTHETIC_MEAS_RATE_HZ;
+    uint32_t SYNTHETIC_NUM_SV;
+    uint32_t SYNTHETIC_RAMP_SEC;
+    uint32_t SYNTHETIC_MAX_QUEUE_MS;
+};
+
+static LocApiSyntheticConfig sConfig;
+static pthread_once_t sConfigOnce = PTHREAD_ONCE_INIT;
+
+static const loc_param_s_type sConfigTable[] =
+{
+    {"SYNTHETIC_LOC_API",      &sConfig.SYNTHETIC_LOC_API,      NULL, 'n'},
+    {"SYNTHETIC_FIX_RATE_HZ",  &sConfig.SYNTHETIC_FIX_RATE_HZ,  NULL, 'n'},
+    {"SYNTHETIC_SV_RATE_HZ",   &sConfig.SYNTHETIC_SV_RATE_HZ,   NULL, 'n'},
+    {"SYNTHETIC_NMEA_RATE_HZ", &sConfig.SYNTHETIC_NMEA_RATE_HZ, NULL, 'n'},
+    {"SYNTHETIC_MEAS_RATE_HZ", &sConfig.SYNTHETIC_MEAS_RATE_HZ, NULL, 'n'},
+    {"SYNTHETIC_NUM_SV",       &sConfig.SYNTHETIC_NUM_SV,       NULL, 'n'},
+    {"SYNTHETIC_RAMP_SEC",     &sConfig.SYNTHETIC_RAMP_SEC,     NULL, 'n'},
+    {"SYNTHETIC_MAX_QUEUE_MS", &sConfig.SYNTHETIC_MAX_QUEUE_MS, NULL, 'n'},
+};
+
+static void readConfig()
+{
+    memset(&sConfig, 0, sizeof(sConfig));
+    sConfig.SYNTHETIC_SV_RATE_HZ = 1;
+    sConfig.SYNTHETIC_NMEA_RATE_HZ = 1;
+    sConfig.SYNTHETIC_NUM_SV = 12;
+    sConfig.SYNTHETIC_MAX_QUEUE_MS = 100;
+    UTIL_READ_CONF(GPS_CONF_FILE, sConfigTable);
+
+    if (sConfig.SYNTHETIC_NUM_SV > GPS_MAX_SVS) {
+        sConfig.SYNTHETIC_NUM_SV = GPS_MAX_SVS;
+    }
+    if (sConfig.SYNTHETIC_NUM_SV > GPS_MAX_MEASUREMENT) {
+        sConfig.SYNTHETIC_NUM_SV = GPS_MAX_MEASUREMENT;
+    }
+}
+
+static int64_t nowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int64_t utcTimeMs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+struct LocApiSyntheticProbe : public LocMsg {
+    LocApiSynthetic* mLocApi;
+    const int64_t mSentNs;
+    inline LocApiSyntheticProbe(LocApiSynthetic* locApi, int64_t sentNs) :
+        LocMsg(), mLocApi(locApi), mSentNs(sentNs)
+    {
+        locallog();
+    }
+    inline virtual void proc() const {
+        mLocApi->handleProbe(mSentNs, nowNs());
+    }
+    inline void locallog() const {
+        LOC_LOGV("LocApiSyntheticProbe");
+    }
+    inline virtual void log() const {
+        locallog();
+    }
+};
+
+/* Runs on its own thread for the length of a session. Each stream is
+   scheduled on absolute CLOCK_MONOTONIC times, so the rates hold however
+   long the reports take to return; a stream that falls more than a
+   second behind is counted as missed and restarted from now. */
+class LocApiSyntheticGenerator : public LocRunnable {
+    static const int64_t MAX_SLEEP_NS = 100000000;
+    static const int64_t STATS_PERIOD_NS = 1000000000;
+    static const uint32_t MAX_RATE_HZ = 1000000;
+    enum { FIX, SV, NMEA, MEAS, NUM_STREAMS };
+    struct Stream {
+        uint32_t rateHz;
+        int64_t nextNs;
+        uint32_t count;
+        uint32_t missed;
+    };
+
+    LocApiSynthetic* mLocApi;
+    Stream mStreams[NUM_STREAMS];
+    uint32_t mNumFixes;
+    int64_t mStartNs;
+    int64_t mStatsNs;
+    int64_t mRampNs;
+    uint32_t mSustainedRateHz;
+    bool mRamping;
+
+    static inline int64_t periodNs(uint32_t rateHz) {
+        return 1000000000LL / rateHz;
+    }
+
+    void reportFix() {
+        UlpLocation location;
+        GpsLocationExtended locationExtended;
+        // walk north east from the origin at about 10 m/s
+        double t = (double)mNumFixes++ * periodNs(mStreams[FIX].rateHz) / 1e9;
+
+        memset(&location, 0, sizeof(location));
+        location.size = sizeof(location);
+        location.position_source = ULP_LOCATION_IS_FROM_GNSS;
+        location.gpsLocation.size = sizeof(location.gpsLocation);
+        location.gpsLocation.flags = GPS_LOCATION_HAS_LAT_LONG |
+                                     GPS_LOCATION_HAS_ALTITUDE |
+                                     GPS_LOCATION_HAS_SPEED |
+                                     GPS_LOCATION_HAS_BEARING |
+                                     GPS_LOCATION_HAS_ACCURACY;
+        location.gpsLocation.latitude = 37.3861 + fmod(t * 0.00007, 1.0);
+        location.gpsLocation.longitude = -122.0839 + fmod(t * 0.00007, 1.0);
+        location.gpsLocation.altitude = 30.0;
+        location.gpsLocation.speed = 10.0;
+        location.gpsLocation.bearing = 45.0;
+        location.gpsLocation.accuracy = 5.0;
+        location.gpsLocation.timestamp = utcTimeMs();
+
+        memset(&locationExtended, 0, sizeof(locationExtended));
+        locationExtended.size = sizeof(locationExtended);
+
+        // traced from here as a QMI position report is from decode
+        loc_fix_trace_begin();
+        mLocApi->reportPosition(location, locationExtended, NULL,
+                                LOC_SESS_SUCCESS,
+                                LOC_POS_TECH_MASK_SATELLITE);
+        loc_fix_trace_clear();
+    }
+
+    void reportSv() {
+        HaxxSvStatus svStatus;
+        GpsLocationExtended locationExtended;
+
+        memset(&svStatus, 0, sizeof(svStatus));
+        svStatus.size = sizeof(svStatus);
+        svStatus.num_svs = sConfig.SYNTHETIC_NUM_SV;
+        for (int i = 0; i < svStatus.num_svs; i++) {
+            svStatus.sv_list[i].size = sizeof(svStatus.sv_list[i]);
+            svStatus.sv_list[i].prn = i + 1;
+            svStatus.sv_list[i].snr = 25 + (i * 7) % 20;
+            svStatus.sv_list[i].elevation = 10 + (i * 13) % 80;
+            svStatus.sv_list[i].azimuth = (i * 37) % 360;
+            svStatus.ephemeris_mask |= (1u << i);
+            svStatus.almanac_mask |= (1u << i);
+            svStatus.gps_used_in_fix_mask |= (1u << i);
+        }
+
+        memset(&locationExtended, 0, sizeof(locationExtended));
+        locationExtended.size = sizeof(locationExtended);
+
+        mLocApi->reportSv(svStatus, locationExtended, NULL);
+    }
+
+    void reportNmea() {
+        char sentence[128];
+        int64_t utcMs = utcTimeMs();
+        int secOfDay = (int)((utcMs / 1000) % 86400);
+        unsigned char checksum = 0;
+
+        int length = snprintf(sentence, sizeof(sentence),
+                              "$GPGGA,%02d%02d%02d.%02d,3723.166,N,12205.034,W,"
+                              "1,%02u,0.9,30.0,M,,M,,",
+                              secOfDay / 3600, (secOfDay / 60) % 60,
+                              secOfDay % 60, (int)(utcMs % 1000) / 10,
+                              sConfig.SYNTHETIC_NUM_SV);
+        for (int i = 1; i < length; i++) {
+            checksum ^= sentence[i];
+        }
+        length += snprintf(sentence + length, sizeof(sentence) - length,
+                           "*%02X", checksum);
+
+        mLocApi->reportNmea(sentence, length);
+    }
+
+    void reportMeasurement() {
+        GpsData gpsData;
+
+        memset(&gpsData, 0, sizeof(gpsData));
+        gpsData.size = sizeof(gpsData);
+        gpsData.measurement_count = sConfig.SYNTHETIC_NUM_SV;
+        for (size_t i = 0; i < gpsData.measurement_count; i++) {
+            GpsMeasurement& measurement = gpsData.measurements[i];
+            measurement.size = sizeof(measurement);
+            measurement.prn = i + 1;
+            measurement.state = GPS_MEASUREMENT_STATE_CODE_LOCK |
+                                GPS_MEASUREMENT_STATE_BIT_SYNC |
+                                GPS_MEASUREMENT_STATE_SUBFRAME_SYNC;
+            measurement.c_n0_dbhz = 25 + (i * 7) % 20;
+            measurement.pseudorange_rate_mps = -500.0 + (i * 97) % 1000;
+            measurement.pseudorange_rate_uncertainty_mps = 0.1;
+        }
+        gpsData.clock.size = sizeof(gpsData.clock);
+        gpsData.clock.type = GPS_CLOCK_TYPE_LOCAL_HW_TIME;
+        gpsData.clock.time_ns = nowNs();
+
+        mLocApi->reportGpsMeasurementData(gpsData);
+    }
+
+    void report(int stream) {
+        switch (stream) {
+        case FIX:
+            reportFix();
+            break;
+        case SV:
+            reportSv();
+            break;
+        case NMEA:
+            reportNmea();
+            break;
+        case MEAS:
+            reportMeasurement();
+            break;
+        }
+    }
+
+    void ramp(int64_t now, int64_t queueDelayNs) {
+        if (queueDelayNs < (int64_t)sConfig.SYNTHETIC_MAX_QUEUE_MS * 1000000) {
+            mSustainedRateHz = mStreams[FIX].rateHz;
+            if (mSustainedRateHz * 2 <= MAX_RATE_HZ) {
+                mStreams[FIX].rateHz = mSustainedRateHz * 2;
+                mStreams[FIX].nextNs = now;
+                LOC_LOGI("%s:%d]: fix rate raised to %u Hz",
+                         __func__, __LINE__, mStreams[FIX].rateHz);
+                return;
+            }
+        } else {
+            LOC_LOGI("%s:%d]: queue delay %lld ms at %u Hz",
+                     __func__, __LINE__, (long long)(queueDelayNs / 1000000),
+                     mStreams[FIX].rateHz);
+            mStreams[FIX].rateHz = mSustainedRateHz;
+            mStreams[FIX].nextNs = now;
+        }
+        LOC_LOGI("%s:%d]: sustained fix rate %u Hz",
+                 __func__, __LINE__, mSustainedRateHz);
+        mRamping = false;
+    }
+
+    void logStats(int64_t now) {
+        int64_t elapsedNs = now - mStatsNs;
+        int64_t queueDelayNs = mLocApi->getQueueDelayNs(now);
+        uint32_t rateHz[NUM_STREAMS];
+        uint32_t missed = 0;
+
+        for (int i = 0; i < NUM_STREAMS; i++) {
+            rateHz[i] = elapsedNs > 0 ?
+                (uint32_t)(mStreams[i].count * 1000000000ULL / elapsedNs) : 0;
+            missed += mStreams[i].missed;
+            mStreams[i].count = 0;
+            mStreams[i].missed = 0;
+        }
+        LOC_LOGI("%s:%d]: fix %u Hz sv %u Hz nmea %u Hz meas %u Hz, "
+                 "missed %u, queue delay %lld us", __func__, __LINE__,
+                 rateHz[FIX], rateHz[SV], rateHz[NMEA], rateHz[MEAS],
+                 missed, (long long)(queueDelayNs / 1000));
+
+        if (mRamping && now - mRampNs >=
+            (int64_t)sConfig.SYNTHETIC_RAMP_SEC * 1000000000LL) {
+            ramp(now, queueDelayNs);
+            mRampNs = now;
+        }
+
+        mLocApi->sendProbe(now);
+        mStatsNs = now;
+    }
+
+public:
+    inline LocApiSyntheticGenerator(LocApiSynthetic* locApi,
+                                    uint32_t fixRateHz) :
+        LocRunnable(), mLocApi(locApi), mNumFixes(0), mStartNs(0),
+        mStatsNs(0), mRampNs(0), mSustainedRateHz(0),
+        mRamping(0 != sConfig.SYNTHETIC_RAMP_SEC)
+    {
+        memset(mStreams, 0, sizeof(mStreams));
+        mStreams[FIX].rateHz = fixRateHz;
+        mStreams[SV].rateHz = sConfig.SYNTHETIC_SV_RATE_HZ;
+        mStreams[NMEA].rateHz = sConfig.SYNTHETIC_NMEA_RATE_HZ;
+        mStreams[MEAS].rateHz = sConfig.SYNTHETIC_MEAS_RATE_HZ;
+        for (int i = 0; i < NUM_STREAMS; i++) {
+            if (mStreams[i].rateHz > MAX_RATE_HZ) {
+                mStreams[i].rateHz = MAX_RATE_HZ;
+            }
+        }
+        // the ramp only ever falls back to a rate that was sustained, and
+        // the configured rate is the floor
+        mSustainedRateHz = mStreams[FIX].rateHz;
+    }
+
+    virtual ~LocApiSyntheticGenerator() {
+        LOC_LOGI("%s:%d]: %u fixes in %lld ms", __func__, __LINE__,
+                 mNumFixes, (long long)((nowNs() - mStartNs) / 1000000));
+    }
+
+    virtual void prerun() {
+        mStartNs = mStatsNs = mRampNs = nowNs();
+        for (int i = 0; i < NUM_STREAMS; i++) {
+            mStreams[i].nextNs = mStartNs;
+        }
+        mLocApi->sendProbe(mStartNs);
+    }
+
+    virtual bool run() {
+        int64_t now = nowNs();
+        int64_t dueNs = mStatsNs + STATS_PERIOD_NS;
+
+        for (int i = 0; i < NUM_STREAMS; i++) {
+            if (mStreams[i].rateHz > 0 && mStreams[i].nextNs < dueNs) {
+                dueNs = mStreams[i].nextNs;
+            }
+        }
+
+        if (dueNs > now) {
+            // sleep in steps so a stop is not held up by a low rate
+            struct timespec ts;
+            if (dueNs - now > MAX_SLEEP_NS) {
+                dueNs = now + MAX_SLEEP_NS;
+            }
+            ts.tv_sec = dueNs / 1000000000;
+            ts.tv_nsec = dueNs % 1000000000;
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+            return true;
+        }
+
+        for (int i = 0; i < NUM_STREAMS; i++) {
+            Stream& stream = mStreams[i];
+            if (stream.rateHz > 0 && stream.nextNs <= now) {
+                report(i);
+                stream.count++;
+                stream.nextNs += periodNs(stream.rateHz);
+                if (now - stream.nextNs > STATS_PERIOD_NS) {
+                    stream.missed += (now - stream.nextNs) /
+                                     periodNs(stream.rateHz);
+                    stream.nextNs = now;
+                }
+            }
+        }
+
+        if (now - mStatsNs >= STATS_PERIOD_NS) {
+            logStats(now);
+        }
+        return true;
+    }
+};
+
+LocApiSynthetic::LocApiSynthetic(const MsgTask* msgTask,
+                                 LOC_API_ADAPTER_EVENT_MASK_T exMask,
+                                 ContextBase* context) :
+    LocApiBase(msgTask, exMask, context),
+    mProbeSentNs(0), mQueueDelayNs(0)
+{
+    pthread_once(&sConfigOnce, readConfig);
+    pthread_mutex_init(&mProbeLock, NULL);
+    LOC_LOGI("%s:%d]: fix %u Hz sv %u Hz nmea %u Hz meas %u Hz, %u SVs",
+             __func__, __LINE__, sConfig.SYNTHETIC_FIX_RATE_HZ,
+             sConfig.SYNTHETIC_SV_RATE_HZ, sConfig.SYNTHETIC_NMEA_RATE_HZ,
+             sConfig.SYNTHETIC_MEAS_RATE_HZ, sConfig.SYNTHETIC_NUM_SV);
+}
+
+LocApiSynthetic::~LocApiSynthetic()
+{
+    mGenerator.stop();
+    pthread_mutex_destroy(&mProbeLock);
+}
+
+bool LocApiSynthetic::isEnabled()
+{
+    pthread_once(&sConfigOnce, readConfig);
+    return 0 != sConfig.SYNTHETIC_LOC_API;
+}
+
+bool LocApiSynthetic::sendProbe(int64_t nowNs)
+{
+    bool send = false;
+
+    // one probe at a time; one still queued is itself the measure
+    pthread_mutex_lock(&mProbeLock);
+    if (0 == mProbeSentNs) {
+        mProbeSentNs = nowNs;
+        send = true;
+    }
+    pthread_mutex_unlock(&mProbeLock);
+
+    if (send) {
+        sendMsg(new LocApiSyntheticProbe(this, nowNs));
+    }
+    return send;
+}
+
+void LocApiSynthetic::handleProbe(int64_t sentNs, int64_t nowNs)
+{
+    pthread_mutex_lock(&mProbeLock);
+    mQueueDelayNs = nowNs - sentNs;
+    mProbeSentNs = 0;
+    pthread_mutex_unlock(&mProbeLock);
+}
+
+int64_t LocApiSynthetic::getQueueDelayNs(int64_t nowNs)
+{
+    int64_t queueDelayNs;
+
+    pthread_mutex_lock(&mProbeLock);
+    queueDelayNs = mQueueDelayNs;
+    if (0 != mProbeSentNs && nowNs - mProbeSentNs > queueDelayNs) {
+        queueDelayNs = nowNs - mProbeSentNs;
+    }
+    pthread_mutex_unlock(&mProbeLock);
+    return queueDelayNs;
+}
+
+enum loc_api_adapter_err
+LocApiSynthetic::close()
+{
+    mGenerator.stop();
+    return LOC_API_ADAPTER_ERR_SUCCESS;
+}
+
+enum loc_api_adapter_err
+LocApiSynthetic::startFix(const LocPosMode& posMode)
+{
+    uint32_t fixRateHz = sConfig.SYNTHETIC_FIX_RATE_HZ;
+
+    if (mGenerator.isRunning()) {
+        return LOC_API_ADAPTER_ERR_SUCCESS;
+    }
+
+    if (0 == fixRateHz) {
+        fixRateHz = (posMode.min_interval > 0 && posMode.min_interval < 1000) ?
+            1000 / posMode.min_interval : 1;
+    }
+
+    LocApiSyntheticGenerator* generator =
+        new LocApiSyntheticGenerator(this, fixRateHz);
+    if (!mGenerator.start("LocApiSynthetic", generator)) {
+        delete generator;
+        return LOC_API_ADAPTER_ERR_FAILURE;
+    }
+
+    reportStatus(GPS_STATUS_ENGINE_ON);
+    reportStatus(GPS_STATUS_SESSION_BEGIN);
+    return LOC_API_ADAPTER_ERR_SUCCESS;
+}
+
+enum loc_api_adapter_err
+LocApiSynthetic::stopFix()
+{
+    if (mGenerator.isRunning()) {
+        mGenerator.stop();
+        reportStatus(GPS_STATUS_SESSION_END);
+        reportStatus(GPS_STATUS_ENGINE_OFF);
+    }
+    return LOC_API_ADAPTER_ERR_SUCCESS;
+}
+
+} // namespace loc_core
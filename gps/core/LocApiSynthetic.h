@@ -0,0 +1,80 @@
+/* Copyright (c) 2014, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation, nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#ifndef LOC_API_SYNTHETIC_H
+#define LOC_API_SYNTHETIC_H
+
+#include <pthread.h>
+#include <LocApiBase.h>
+#include <LocThread.h>
+
+namespace loc_core {
+
+/* A LocApi with no engine behind it. While a session is running it
+   reports fixes, SV status, NMEA and measurements at the rates set in
+   gps.conf, up to kHz, to load the adapters, MsgTask and the callback
+   fan-out above it. Once a second it also sends a probe message through
+   MsgTask to measure how long reports wait in the queue, which tells
+   the sustained rate apart from one the AP side cannot keep up with.
+   ContextBase::createLocApi() picks it in place of libloc_api_v02 when
+   SYNTHETIC_LOC_API is set in gps.conf. */
+class LocApiSynthetic : public LocApiBase {
+    friend class LocApiSyntheticGenerator;
+    friend struct LocApiSyntheticProbe;
+    LocThread mGenerator;
+    pthread_mutex_t mProbeLock;
+    // CLOCK_MONOTONIC time the outstanding probe was sent, 0 if none
+    int64_t mProbeSentNs;
+    // time the last handled probe waited in the MsgTask queue
+    int64_t mQueueDelayNs;
+
+    bool sendProbe(int64_t nowNs);
+    void handleProbe(int64_t sentNs, int64_t nowNs);
+    int64_t getQueueDelayNs(int64_t nowNs);
+
+protected:
+    virtual enum loc_api_adapter_err
+        close();
+
+public:
+    LocApiSynthetic(const MsgTask* msgTask,
+                    LOC_API_ADAPTER_EVENT_MASK_T exMask,
+                    ContextBase* context);
+    virtual ~LocApiSynthetic();
+
+    static bool isEnabled();
+
+    virtual enum loc_api_adapter_err
+        startFix(const LocPosMode& posMode);
+    virtual enum loc_api_adapter_err
+        stopFix();
+};
+
+} // namespace loc_core
+
+#endif //LOC_API_SYNTHETIC_H
@@ -0,0 +1,257 @@
+/* Copyright (c) 2014, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation, nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#define LOG_NDDEBUG 0
+#define LOG_TAG "LocSvc_ModuleRegistry"
+
+#include <dlfcn.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <LocModuleRegistry.h>
+#include <LocThread.h>
+#include <log_util.h>
+#include <platform_lib_includes.h>
+
+namespace loc_core {
+
+#define MODULE_MAX_LIBS        8
+#define MODULE_MAX_SYMBOLS     4
+#define MODULE_NAME_LEN        64
+
+typedef const void* (getInterface_t)(void);
+
+typedef struct {
+    char name[MODULE_NAME_LEN];
+    void* sym;
+    // the dlsym() is done
+    bool resolved;
+    // for a getter, the table it returned once called
+    bool calling;
+    bool called;
+    const void* table;
+} LocModuleSymbol;
+
+typedef struct {
+    char name[MODULE_NAME_LEN];
+    void* handle;
+    // the dlopen() is done
+    bool loaded;
+    LocModuleSymbol symbols[MODULE_MAX_SYMBOLS];
+    int numSymbols;
+} LocModule;
+
+// All under module_lock. The lock is not held across dlopen(), dlsym() or
+// a getter, which take the dynamic loader's lock or may run a library's
+// constructors; an entry being filled in is marked instead, and whoever
+// else asks for it waits on module_cond, so each is still done once.
+static pthread_mutex_t module_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t module_cond = PTHREAD_COND_INITIALIZER;
+static LocModule modules[MODULE_MAX_LIBS];
+static int num_modules = 0;
+static LocThread* preload_thread = NULL;
+
+static LocModule* module_get_locked(const char* libName)
+{
+    for (int i = 0; i < num_modules; i++) {
+        if (0 == strcmp(modules[i].name, libName)) {
+            while (!modules[i].loaded) {
+                pthread_cond_wait(&module_cond, &module_lock);
+            }
+            return &modules[i];
+        }
+    }
+
+    if (num_modules >= MODULE_MAX_LIBS || strlen(libName) >= MODULE_NAME_LEN) {
+        LOC_LOGE("%s:%d]: no room for %s\n", __func__, __LINE__, libName);
+        return NULL;
+    }
+
+    LocModule* module = &modules[num_modules++];
+    strlcpy(module->name, libName, sizeof(module->name));
+    module->loaded = false;
+    pthread_mutex_unlock(&module_lock);
+
+    // dlerror() is per thread
+    dlerror();
+    void* handle = dlopen(libName, RTLD_NOW);
+    if (NULL == handle) {
+        const char* error = dlerror();
+        LOC_LOGE("%s:%d]: dlopen %s failed: %s\n", __func__, __LINE__,
+                 libName, (NULL != error) ? error : "");
+    } else {
+        LOC_LOGD("%s:%d]: %s loaded\n", __func__, __LINE__, libName);
+    }
+
+    pthread_mutex_lock(&module_lock);
+    module->handle = handle;
+    module->loaded = true;
+    pthread_cond_broadcast(&module_cond);
+    return module;
+}
+
+static LocModuleSymbol* symbol_get_locked(LocModule* module, const char* symName)
+{
+    for (int i = 0; i < module->numSymbols; i++) {
+        if (0 == strcmp(module->symbols[i].name, symName)) {
+            while (!module->symbols[i].resolved) {
+                pthread_cond_wait(&module_cond, &module_lock);
+            }
+            return &module->symbols[i];
+        }
+    }
+
+    if (module->numSymbols >= MODULE_MAX_SYMBOLS ||
+        strlen(symName) >= MODULE_NAME_LEN) {
+        LOC_LOGE("%s:%d]: no room for %s in %s\n", __func__, __LINE__,
+                 symName, module->name);
+        return NULL;
+    }
+
+    LocModuleSymbol* symbol = &module->symbols[module->numSymbols++];
+    strlcpy(symbol->name, symName, sizeof(symbol->name));
+    symbol->sym = NULL;
+    symbol->resolved = false;
+    symbol->calling = false;
+    symbol->called = false;
+    symbol->table = NULL;
+    if (NULL == module->handle) {
+        symbol->resolved = true;
+        return symbol;
+    }
+    pthread_mutex_unlock(&module_lock);
+
+    void* sym = dlsym(module->handle, symName);
+    if (NULL == sym) {
+        LOC_LOGE("%s:%d]: dlsym %s in %s failed\n", __func__, __LINE__,
+                 symName, module->name);
+    }
+
+    pthread_mutex_lock(&module_lock);
+    symbol->sym = sym;
+    symbol->resolved = true;
+    pthread_cond_broadcast(&module_cond);
+    return symbol;
+}
+
+void* LocModuleRegistry::getHandle(const char* libName)
+{
+    void* handle = NULL;
+
+    pthread_mutex_lock(&module_lock);
+    LocModule* module = module_get_locked(libName);
+    if (NULL != module) {
+        handle = module->handle;
+    }
+    pthread_mutex_unlock(&module_lock);
+
+    return handle;
+}
+
+void* LocModuleRegistry::getSymbol(const char* libName, const char* symName)
+{
+    void* sym = NULL;
+
+    pthread_mutex_lock(&module_lock);
+    LocModule* module = module_get_locked(libName);
+    if (NULL != module) {
+        LocModuleSymbol* symbol = symbol_get_locked(module, symName);
+        if (NULL != symbol) {
+            sym = symbol->sym;
+        }
+    }
+    pthread_mutex_unlock(&module_lock);
+
+    return sym;
+}
+
+// a getter must not ask for its own interface, it would wait for itself
+const void* LocModuleRegistry::getInterface(const char* libName,
+                                            const char* getterName)
+{
+    const void* table = NULL;
+
+    pthread_mutex_lock(&module_lock);
+    LocModule* module = module_get_locked(libName);
+    LocModuleSymbol* symbol = (NULL != module) ?
+                              symbol_get_locked(module, getterName) : NULL;
+    if (NULL != symbol && NULL != symbol->sym) {
+        if (!symbol->called && !symbol->calling) {
+            symbol->calling = true;
+            pthread_mutex_unlock(&module_lock);
+            const void* called = (*(getInterface_t*)symbol->sym)();
+            pthread_mutex_lock(&module_lock);
+            symbol->table = called;
+            symbol->called = true;
+            pthread_cond_broadcast(&module_cond);
+        }
+        while (!symbol->called) {
+            pthread_cond_wait(&module_cond, &module_lock);
+        }
+        table = symbol->table;
+    }
+    pthread_mutex_unlock(&module_lock);
+
+    return table;
+}
+
+class LocModulePreloader : public LocRunnable {
+    const LocModuleSpec* const mModules;
+public:
+    inline LocModulePreloader(const LocModuleSpec* modules) :
+        LocRunnable(), mModules(modules) {}
+    virtual bool run() {
+        for (const LocModuleSpec* spec = mModules; NULL != spec->libName; spec++) {
+            if (NULL != spec->getterName) {
+                LocModuleRegistry::getInterface(spec->libName, spec->getterName);
+            } else {
+                LocModuleRegistry::getHandle(spec->libName);
+            }
+        }
+        LOC_LOGD("%s:%d]: preload done\n", __func__, __LINE__);
+        return false;
+    }
+};
+
+// modules must outlive the preload, a static table is expected
+void LocModuleRegistry::preload(const LocModuleSpec* modules)
+{
+    pthread_mutex_lock(&module_lock);
+    if (NULL == preload_thread) {
+        preload_thread = new LocThread();
+        LocRunnable* preloader = new LocModulePreloader(modules);
+        if (!preload_thread->start("LocModulePreload", preloader, false)) {
+            LOC_LOGE("%s:%d]: failed to start the preload thread\n",
+                     __func__, __LINE__);
+            delete preloader;
+        }
+    }
+    pthread_mutex_unlock(&module_lock);
+}
+
+} // namespace loc_core
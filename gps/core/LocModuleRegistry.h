@@ -0,0 +1,64 @@
+/* Copyright (c) 2014, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation, nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#ifndef LOC_MODULE_REGISTRY_H
+#define LOC_MODULE_REGISTRY_H
+
+#include <stddef.h>
+
+namespace loc_core {
+
+typedef struct {
+    const char* libName;
+    // a const void* (*)(void) in the library that returns its interface
+    // table, or NULL to only load the library
+    const char* getterName;
+} LocModuleSpec;
+
+/* Extension libraries, each dlopen'ed once per process. Handles, symbols
+   and interface tables are cached, and so is a library or symbol that is
+   not there, so a missing library costs one dlopen in all. Handles are
+   never closed. Safe to call from any thread; a caller asking for a
+   library the preload thread is loading waits for it rather than loading
+   it again. */
+class LocModuleRegistry {
+public:
+    // the library's handle, or NULL if it could not be loaded
+    static void* getHandle(const char* libName);
+    // the symbol, or NULL if the library or the symbol is not there
+    static void* getSymbol(const char* libName, const char* symName);
+    // the table returned by the library's getterName(), called only once
+    static const void* getInterface(const char* libName,
+                                    const char* getterName);
+    // loads the modules, up to a NULL libName, on a detached thread
+    static void preload(const LocModuleSpec* modules);
+};
+
+} // namespace loc_core
+
+#endif //LOC_MODULE_REGISTRY_H
@@ -295,6 +295,41 @@ typedef struct {
 
 } HaxxSvStatus;
 
+/** Name of the AP side fix batching extension, see LocBatchingInterface. */
+#define LOC_BATCHING_INTERFACE "loc-batching"
+
+/** Wake up the AP to deliver a full batch. Without it the batch is kept
+ *  across suspend, and the oldest fixes are dropped when it is full. */
+#define LOC_BATCH_WAKEUP_ON_FIFO_FULL   0x01
+
+/** Represents how fixes are batched. */
+typedef struct {
+    /** set to sizeof(LocBatchOptions) */
+    size_t          size;
+    /** Contains LOC_BATCH_* bits. */
+    uint32_t        flags;
+    /** Number of fixes in a batch, 0 for AP_BATCH_SIZE in gps.conf */
+    uint32_t        max_fixes;
+    /** Longest a fix waits to be delivered in milliseconds,
+     *  0 for AP_BATCH_MAX_DELAY_SEC in gps.conf */
+    uint32_t        max_delay_ms;
+} LocBatchOptions;
+
+/** Extended interface for AP side fix batching. Batched fixes are
+ *  delivered through the location callback, one after the other. */
+typedef struct {
+    /** set to sizeof(LocBatchingInterface) */
+    size_t          size;
+    /** Batches the fixes of the tracking sessions from now on.
+     *  Returns 0 on success. */
+    int (*start_batching)(const LocBatchOptions* options);
+    /** Delivers the batched fixes, and goes back to reporting each fix.
+     *  Returns 0 on success. */
+    int (*stop_batching)(void);
+    /** Delivers the batched fixes now. Returns 0 on success. */
+    int (*flush_batch)(void);
+} LocBatchingInterface;
+
 enum loc_sess_status {
     LOC_SESS_SUCCESS,
     LOC_SESS_INTERMEDIATE,
@@ -31,6 +31,9 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <stddef.h>
@@ -100,6 +103,13 @@ typedef struct {
     ds_caller_data caller_data;
 } ds_client_session_data;
 
+/*Emergency profile found by the last lookup. The profile list rarely
+  changes, so it is reused until a call fails to start with it.*/
+static pthread_mutex_t ds_client_profile_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool ds_client_profile_cached = false;
+static int ds_client_cached_profile_index = 0;
+static int ds_client_cached_pdp_type = 0;
+
 void net_ev_cb(dsi_hndl_t handle, void* user_data,
                dsi_net_evt_t evt, dsi_evt_payload_t *payload_ptr)
 {
@@ -408,38 +418,6 @@ err:
     return ret;
 }
 
-/*This function obtains settings for the profile specified by
- the profile_identifier*/
-static ds_client_status_enum_type ds_client_get_profile_settings(
-    qmi_client_type *ds_client_handle,
-    ds_client_resp_union_type *profile_settings_resp_msg,
-    wds_profile_identifier_type_v01 *profile_identifier)
-{
-    ds_client_status_enum_type ret = E_DS_CLIENT_SUCCESS;
-    ds_client_req_union_type req_union;
-
-    LOC_LOGD("%s:%d]:Enter\n", __func__, __LINE__);
-    //Since it's a union containing a pointer to a structure,
-    //following entities have the same address
-    //- req_union
-    //- req_union.p_get_profile_settings_req
-    //- req_union.p_get_profile_settings_req->profile
-    //so we can very well assign req_union = profile_identifier
-    req_union.p_get_profile_settings_req =
-        (wds_get_profile_settings_req_msg_v01 *)profile_identifier;
-    ret = ds_client_send_qmi_sync_req(ds_client_handle,
-                                       QMI_WDS_GET_PROFILE_SETTINGS_REQ_V01,
-                                       profile_settings_resp_msg, &req_union);
-    if(ret != E_DS_CLIENT_SUCCESS) {
-        LOC_LOGE("%s:%d]: ds_client_send_qmi_req failed. ret: %d\n",
-                 __func__, __LINE__, ret);
-        goto err;
-    }
-err:
-    LOC_LOGD("%s:%d]:Exit\n", __func__, __LINE__);
-    return ret;
-}
-
 /*
   Starts data call using the handle and the profile index
 */
@@ -478,6 +456,10 @@ ds_client_start_call(dsClientHandleType client_handle, int profile_index, int pd
     }
     else {
         LOC_LOGE("%s:%d]: Could not send req to start data call \n", __func__, __LINE__);
+        //the profile may have changed, look it up again next time
+        pthread_mutex_lock(&ds_client_profile_lock);
+        ds_client_profile_cached = false;
+        pthread_mutex_unlock(&ds_client_profile_lock);
         ret = E_DS_CLIENT_FAILURE_GENERAL;
         goto err;
     }
@@ -488,45 +470,181 @@ err:
 
 }
 
-/*Function to open an emergency call. Does the following things:
+/*Converts the PDP type of a profile into the dsi IP version*/
+static int ds_client_get_ip_version(wds_get_profile_settings_resp_msg_v01 *settings)
+{
+    int ip_version = DSI_IP_VERSION_4;
+    if(settings->pdp_type_valid) {
+        LOC_LOGD("%s:%d]: pdp_type: %d\n", __func__, __LINE__,
+                 (int)settings->pdp_type);
+        switch(settings->pdp_type) {
+        case WDS_PDP_TYPE_PDP_IPV4_V01:
+            ip_version = DSI_IP_VERSION_4;
+            break;
+        case WDS_PDP_TYPE_PDP_IPV6_V01:
+            ip_version = DSI_IP_VERSION_6;
+            break;
+        case WDS_PDP_TYPE_PDP_IPV4V6_V01:
+            ip_version = DSI_IP_VERSION_4_6;
+            break;
+        default:
+            LOC_LOGE("%s:%d]: pdp_type unknown. Setting default as ipv4/v6\n",
+                     __func__, __LINE__);
+            ip_version = DSI_IP_VERSION_4;
+        }
+    }
+    else {
+        LOC_LOGD("%s:%d]: pdp type not valid in profile setting. Default ipv4\n",
+                 __func__, __LINE__);
+    }
+    return ip_version;
+}
+
+struct ds_client_probe_data_s;
+
+/*One profile settings request in flight*/
+typedef struct
+{
+    struct ds_client_probe_data_s *probe;
+    wds_profile_identifier_type_v01 profile_identifier;
+    bool done;
+    qmi_client_error_type transp_err;
+    wds_get_profile_settings_resp_msg_v01 settings;
+}ds_client_probe_slot;
+
+/*The settings of all profiles are requested at once; this keeps
+  count of the responses still to come*/
+typedef struct ds_client_probe_data_s
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t pending;
+    ds_client_probe_slot *slots;
+}ds_client_probe_data;
+
+static void ds_client_probe_cb(qmi_client_type user_handle,
+                               unsigned int msg_id,
+                               void *resp_c_struct,
+                               unsigned int resp_c_struct_len,
+                               void *resp_cb_data,
+                               qmi_client_error_type transp_err)
+{
+    ds_client_probe_slot *slot = (ds_client_probe_slot *)resp_cb_data;
+    (void)user_handle;
+    (void)msg_id;
+    (void)resp_c_struct;
+    (void)resp_c_struct_len;
+
+    pthread_mutex_lock(&slot->probe->lock);
+    slot->transp_err = transp_err;
+    slot->done = true;
+    slot->probe->pending--;
+    pthread_cond_signal(&slot->probe->cond);
+    pthread_mutex_unlock(&slot->probe->lock);
+}
+
+/*Requests the settings of every profile in the list concurrently, then
+  picks the first profile in list order that supports emergency calls.
+  The probe must stay allocated until the qmi client is released, as a
+  response that timed out may still be in flight until then.*/
+static ds_client_status_enum_type ds_client_probe_profiles(
+    qmi_client_type *p_wds_qmi_client,
+    wds_get_profile_list_resp_msg_v01 *profile_list,
+    ds_client_probe_data *probe,
+    int *profile_index,
+    int *pdp_type)
+{
+    ds_client_status_enum_type ret = E_DS_CLIENT_FAILURE_GENERAL;
+    ds_client_probe_slot *slots = probe->slots;
+    qmi_txn_handle txn_handle;
+    struct timespec deadline;
+    uint32_t i;
+    int wait_ret = 0;
+
+    pthread_mutex_lock(&probe->lock);
+    for(i=0; i < profile_list->profile_list_len; i++) {
+        slots[i].probe = probe;
+        slots[i].profile_identifier.profile_type =
+            profile_list->profile_list[i].profile_type;
+        slots[i].profile_identifier.profile_index =
+            profile_list->profile_list[i].profile_index;
+        //the request struct only holds the profile identifier
+        if(qmi_client_send_msg_async(*p_wds_qmi_client,
+                                     QMI_WDS_GET_PROFILE_SETTINGS_REQ_V01,
+                                     &slots[i].profile_identifier,
+                                     sizeof(wds_get_profile_settings_req_msg_v01),
+                                     &slots[i].settings,
+                                     sizeof(slots[i].settings),
+                                     ds_client_probe_cb,
+                                     &slots[i],
+                                     &txn_handle) == QMI_NO_ERR) {
+            probe->pending++;
+        }
+        else {
+            LOC_LOGE("%s:%d]: Could not request settings of profile %d\n",
+                     __func__, __LINE__, i);
+        }
+    }
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += DS_CLIENT_SYNC_MSG_TIMEOUT / 1000;
+    while(probe->pending > 0 && wait_ret != ETIMEDOUT) {
+        wait_ret = pthread_cond_timedwait(&probe->cond, &probe->lock, &deadline);
+    }
+    if(probe->pending > 0) {
+        LOC_LOGE("%s:%d]: %d profile settings requests timed out\n",
+                 __func__, __LINE__, probe->pending);
+    }
+
+    for(i=0; i < profile_list->profile_list_len; i++) {
+        wds_get_profile_settings_resp_msg_v01 *settings = &slots[i].settings;
+        if(!slots[i].done || slots[i].transp_err != QMI_NO_ERR ||
+           settings->resp.error != QMI_ERR_NONE_V01) {
+            continue;
+        }
+        LOC_LOGD("%s:%d]: Got profile setting for profile %d; name: %s\n",
+                 __func__, __LINE__, i, settings->profile_name);
+        if(settings->support_emergency_calls_valid) {
+            if(settings->support_emergency_calls) {
+                LOC_LOGD("%s:%d]: Found emergency profile in profile %d"
+                         , __func__, __LINE__, i);
+                *profile_index = slots[i].profile_identifier.profile_index;
+                *pdp_type = ds_client_get_ip_version(settings);
+                ret = E_DS_CLIENT_SUCCESS;
+                break;
+            }
+            else
+                LOC_LOGE("%s:%d]: Emergency profile valid but not supported in profile: %d "
+                         , __func__, __LINE__, i);
+        }
+    }
+    pthread_mutex_unlock(&probe->lock);
+
+    return ret;
+}
+
+/*Looks up the profile that supports emergency calls:
  - Obtains a handle to the WDS service
  - Obtains a list of profiles configured in the modem
- - Queries each profile and obtains settings to check if emergency calls
-   are supported
- - Returns the profile index that supports emergency calls
- - Returns handle to dsi_netctrl*/
-ds_client_status_enum_type
-ds_client_open_call(dsClientHandleType *client_handle,
-                    ds_client_cb_data *callback,
-                    void *caller_cookie,
-                    int *profile_index,
-                    int *pdp_type)
+ - Queries the settings of all profiles to check if emergency calls
+   are supported*/
+static ds_client_status_enum_type ds_client_lookup_emergency_profile(
+    int *profile_index,
+    int *pdp_type)
 {
     ds_client_status_enum_type ret = E_DS_CLIENT_FAILURE_GENERAL;
     ds_client_resp_union_type profile_list_resp_msg;
-    ds_client_resp_union_type profile_settings_resp_msg;
-    wds_profile_identifier_type_v01 profile_identifier;
-    uint32_t i=0;
-    dsi_hndl_t dsi_handle;
-    ds_client_session_data **ds_global_data = (ds_client_session_data **)client_handle;
-    unsigned char call_profile_index_found = 0;
-    uint32_t emergency_profile_index=0;
+    ds_client_probe_data *probe = NULL;
     qmi_client_type wds_qmi_client;
+    uint32_t profile_list_len;
 
     profile_list_resp_msg.p_get_profile_list_resp = NULL;
-    profile_settings_resp_msg.p_get_profile_setting_resp = NULL;
-
-    LOC_LOGD("%s:%d]:Enter\n", __func__, __LINE__);
-    if(callback == NULL || ds_global_data == NULL) {
-        LOC_LOGE("%s:%d]: Null callback parameter\n", __func__, __LINE__);
-        goto err;
-    }
 
     ret = ds_client_qmi_ctrl_point_init(&wds_qmi_client);
     if(ret != E_DS_CLIENT_SUCCESS) {
         LOC_LOGE("%s:%d]: ds_client_qmi_ctrl_point_init failed. ret: %d\n",
                  __func__, __LINE__, ret);
-        goto err;
+        return ret;
     }
 
     //Allocate memory for the response msg to obtain a list of profiles
@@ -536,7 +654,7 @@ ds_client_open_call(dsClientHandleType *client_handle,
         LOC_LOGE("%s:%d]: Could not allocate memory for"
                  "p_get_profile_list_resp\n", __func__, __LINE__);
         ret = E_DS_CLIENT_FAILURE_NOT_ENOUGH_MEMORY;
-        goto err;
+        goto release;
     }
 
     LOC_LOGD("%s:%d]: Getting profile list\n", __func__, __LINE__);
@@ -546,134 +664,125 @@ ds_client_open_call(dsClientHandleType *client_handle,
     if(ret != E_DS_CLIENT_SUCCESS) {
         LOC_LOGE("%s:%d]: ds_client_get_profile_list failed. ret: %d\n",
                  __func__, __LINE__, ret);
-        goto err;
+        goto release;
     }
+    profile_list_len = profile_list_resp_msg.p_get_profile_list_resp->profile_list_len;
     LOC_LOGD("%s:%d]: Got profile list; length = %d\n", __func__, __LINE__,
-             profile_list_resp_msg.p_get_profile_list_resp->profile_list_len);
-
-    //Allocate memory for the response msg to obtain profile settings
-    //We allocate memory for only one response msg and keep re-using it
-    profile_settings_resp_msg.p_get_profile_setting_resp =
-        (wds_get_profile_settings_resp_msg_v01 *)
-        calloc(1, sizeof(wds_get_profile_settings_resp_msg_v01));
-    if(profile_settings_resp_msg.p_get_profile_setting_resp == NULL) {
+             profile_list_len);
+    if(profile_list_len == 0) {
+        ret = E_DS_CLIENT_FAILURE_GENERAL;
+        goto release;
+    }
+
+    probe = (ds_client_probe_data *)calloc(1, sizeof(ds_client_probe_data));
+    if(probe != NULL) {
+        probe->slots = (ds_client_probe_slot *)
+            calloc(profile_list_len, sizeof(ds_client_probe_slot));
+    }
+    if(probe == NULL || probe->slots == NULL) {
         LOC_LOGE("%s:%d]: Could not allocate memory for"
-                 "p_get_profile_setting_resp\n", __func__, __LINE__);
+                 "profile settings\n", __func__, __LINE__);
         ret = E_DS_CLIENT_FAILURE_NOT_ENOUGH_MEMORY;
-        goto err;
+        goto release;
     }
+    pthread_mutex_init(&probe->lock, NULL);
+    pthread_cond_init(&probe->cond, NULL);
 
-    //Loop over the list of profiles to find a profile that supports
-    //emergency calls
-    for(i=0; i < profile_list_resp_msg.p_get_profile_list_resp->profile_list_len; i++) {
-        /*QMI_WDS_GET_PROFILE_SETTINGS_REQ requires an input data
-          structure that is of type wds_profile_identifier_type_v01
-          We have to fill that structure for each profile from the
-          info obtained from the profile list*/
-        //copy profile type
-        profile_identifier.profile_type =
-            profile_list_resp_msg.p_get_profile_list_resp->profile_list[i].profile_type;
-        //copy profile index
-        profile_identifier.profile_index =
-            profile_list_resp_msg.p_get_profile_list_resp->profile_list[i].profile_index;
-
-        ret = ds_client_get_profile_settings(&wds_qmi_client,
-                                             &profile_settings_resp_msg,
-                                             &profile_identifier);
-        if(ret != E_DS_CLIENT_SUCCESS) {
-            LOC_LOGE("%s:%d]: ds_client_get_profile_settings failed. ret: %d\n",
-                     __func__, __LINE__, ret);
-            goto err;
-        }
-        LOC_LOGD("%s:%d]: Got profile setting for profile %d; name: %s\n",
-                 __func__, __LINE__, i,
-                 profile_settings_resp_msg.p_get_profile_setting_resp->profile_name);
-
-        if(profile_settings_resp_msg.p_get_profile_setting_resp->support_emergency_calls_valid) {
-            if(profile_settings_resp_msg.p_get_profile_setting_resp->support_emergency_calls) {
-                LOC_LOGD("%s:%d]: Found emergency profile in profile %d"
-                         , __func__, __LINE__, i);
-                call_profile_index_found = 1;
-                emergency_profile_index = profile_identifier.profile_index;
-
-                if(profile_settings_resp_msg.p_get_profile_setting_resp->pdp_type_valid) {
-                    *pdp_type = (int)profile_settings_resp_msg.p_get_profile_setting_resp->pdp_type;
-                    LOC_LOGD("%s:%d]: pdp_type: %d\n", __func__, __LINE__, *pdp_type);
-                    switch(*pdp_type) {
-                    case WDS_PDP_TYPE_PDP_IPV4_V01:
-                        *pdp_type = DSI_IP_VERSION_4;
-                        break;
-                    case WDS_PDP_TYPE_PDP_IPV6_V01:
-                        *pdp_type = DSI_IP_VERSION_6;
-                        break;
-                    case WDS_PDP_TYPE_PDP_IPV4V6_V01:
-                        *pdp_type = DSI_IP_VERSION_4_6;
-                        break;
-                    default:
-                        LOC_LOGE("%s:%d]: pdp_type unknown. Setting default as ipv4/v6\n",
-                                 __func__, __LINE__);
-                        *pdp_type = DSI_IP_VERSION_4;
-
-                    }
-                }
-                else {
-                    LOC_LOGD("%s:%d]: pdp type not valid in profile setting. Default ipv4\n",
-                             __func__, __LINE__);
-                    *pdp_type = DSI_IP_VERSION_4;
-                }
-                //Break out of for loop since we found the emergency profile
-                break;
-            }
-            else
-                LOC_LOGE("%s:%d]: Emergency profile valid but not supported in profile: %d "
-                         , __func__, __LINE__, i);
-        }
-        //Since this struct is loaded with settings for the next profile,
-        //it is important to clear out the memory to avoid values/flags
-        //from being carried over
-        memset((void *)profile_settings_resp_msg.p_get_profile_setting_resp,
-               0, sizeof(wds_get_profile_settings_resp_msg_v01));
+    ret = ds_client_probe_profiles(&wds_qmi_client,
+                                   profile_list_resp_msg.p_get_profile_list_resp,
+                                   probe, profile_index, pdp_type);
+    if(ret != E_DS_CLIENT_SUCCESS) {
+        LOC_LOGE("%s:%d]: Could not find a profile that supports emergency calls",
+                 __func__, __LINE__);
     }
 
-    //Release qmi client handle
+release:
+    //Release qmi client handle; no response callback comes after this
     if(qmi_client_release(wds_qmi_client) != QMI_NO_ERR) {
         LOC_LOGE("%s:%d]: Could not release qmi client handle\n",
                  __func__, __LINE__);
         ret = E_DS_CLIENT_FAILURE_GENERAL;
     }
-
-    if(call_profile_index_found) {
-        *profile_index = emergency_profile_index;
-        *ds_global_data = (ds_client_session_data *)calloc(1, sizeof(ds_client_session_data));
-        if(*ds_global_data == NULL) {
-            LOC_LOGE("%s:%d]: Could not allocate memory for ds_global_data. Failing\n",
-                     __func__, __LINE__);
-            ret = E_DS_CLIENT_FAILURE_NOT_ENOUGH_MEMORY;
-            goto err;
+    if(probe != NULL) {
+        if(probe->slots != NULL) {
+            pthread_cond_destroy(&probe->cond);
+            pthread_mutex_destroy(&probe->lock);
+            free(probe->slots);
         }
+        free(probe);
+    }
+    if(profile_list_resp_msg.p_get_profile_list_resp)
+        free(profile_list_resp_msg.p_get_profile_list_resp);
+    return ret;
+}
 
-        (*ds_global_data)->caller_data.event_cb = callback->event_cb;
-        (*ds_global_data)->caller_data.caller_cookie = caller_cookie;
-        dsi_handle = dsi_get_data_srvc_hndl(net_ev_cb, &(*ds_global_data)->caller_data);
-        if(dsi_handle == NULL) {
-            LOC_LOGE("%s:%d]: Could not get data handle. Retry Later\n",
-                     __func__, __LINE__);
-            ret = E_DS_CLIENT_RETRY_LATER;
+/*Function to open an emergency call. Does the following things:
+ - Looks up the profile that supports emergency calls, unless a
+   previous lookup found it already
+ - Returns the profile index that supports emergency calls
+ - Returns handle to dsi_netctrl*/
+ds_client_status_enum_type
+ds_client_open_call(dsClientHandleType *client_handle,
+                    ds_client_cb_data *callback,
+                    void *caller_cookie,
+                    int *profile_index,
+                    int *pdp_type)
+{
+    ds_client_status_enum_type ret = E_DS_CLIENT_FAILURE_GENERAL;
+    dsi_hndl_t dsi_handle;
+    ds_client_session_data **ds_global_data = (ds_client_session_data **)client_handle;
+    bool profile_cached;
+
+    LOC_LOGD("%s:%d]:Enter\n", __func__, __LINE__);
+    if(callback == NULL || ds_global_data == NULL) {
+        LOC_LOGE("%s:%d]: Null callback parameter\n", __func__, __LINE__);
+        goto err;
+    }
+
+    pthread_mutex_lock(&ds_client_profile_lock);
+    profile_cached = ds_client_profile_cached;
+    *profile_index = ds_client_cached_profile_index;
+    *pdp_type = ds_client_cached_pdp_type;
+    pthread_mutex_unlock(&ds_client_profile_lock);
+
+    if(profile_cached) {
+        LOC_LOGD("%s:%d]: Using cached emergency profile %d\n",
+                 __func__, __LINE__, *profile_index);
+    }
+    else {
+        ret = ds_client_lookup_emergency_profile(profile_index, pdp_type);
+        if(ret != E_DS_CLIENT_SUCCESS) {
             goto err;
         }
-        else
-            (*ds_global_data)->dsi_net_handle = dsi_handle;
+        pthread_mutex_lock(&ds_client_profile_lock);
+        ds_client_cached_profile_index = *profile_index;
+        ds_client_cached_pdp_type = *pdp_type;
+        ds_client_profile_cached = true;
+        pthread_mutex_unlock(&ds_client_profile_lock);
     }
-    else {
-        LOC_LOGE("%s:%d]: Could not find a profile that supports emergency calls",
+
+    *ds_global_data = (ds_client_session_data *)calloc(1, sizeof(ds_client_session_data));
+    if(*ds_global_data == NULL) {
+        LOC_LOGE("%s:%d]: Could not allocate memory for ds_global_data. Failing\n",
                  __func__, __LINE__);
-        ret = E_DS_CLIENT_FAILURE_GENERAL;
+        ret = E_DS_CLIENT_FAILURE_NOT_ENOUGH_MEMORY;
+        goto err;
     }
+
+    (*ds_global_data)->caller_data.event_cb = callback->event_cb;
+    (*ds_global_data)->caller_data.caller_cookie = caller_cookie;
+    dsi_handle = dsi_get_data_srvc_hndl(net_ev_cb, &(*ds_global_data)->caller_data);
+    if(dsi_handle == NULL) {
+        LOC_LOGE("%s:%d]: Could not get data handle. Retry Later\n",
+                 __func__, __LINE__);
+        free(*ds_global_data);
+        *ds_global_data = NULL;
+        ret = E_DS_CLIENT_RETRY_LATER;
+        goto err;
+    }
+    (*ds_global_data)->dsi_net_handle = dsi_handle;
+    ret = E_DS_CLIENT_SUCCESS;
 err:
-    if(profile_list_resp_msg.p_get_profile_list_resp)
-        free(profile_list_resp_msg.p_get_profile_list_resp);
-    if(profile_settings_resp_msg.p_get_profile_setting_resp)
-        free(profile_settings_resp_msg.p_get_profile_setting_resp);
     LOC_LOGD("%s:%d]:Exit\n", __func__, __LINE__);
     return ret;
 }
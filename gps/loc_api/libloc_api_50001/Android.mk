@@ -21,6 +21,11 @@ LOCAL_SRC_FILES += \
     loc_eng.cpp \
     loc_eng_agps.cpp \
     loc_eng_xtra.cpp \
+    loc_eng_lkp.cpp \
+    loc_eng_ttff.cpp \
+    loc_eng_dns.cpp \
+    loc_eng_geofence.cpp \
+    loc_eng_batch.cpp \
     loc_eng_ni.cpp \
     loc_eng_log.cpp \
     loc_eng_nmea.cpp \
@@ -50,6 +55,8 @@ LOCAL_COPY_HEADERS:= \
    loc_eng.h \
    loc_eng_xtra.h \
    loc_eng_ni.h \
+   loc_eng_geofence.h \
+   loc_eng_batch.h \
    loc_eng_agps.h \
    loc_eng_msg.h \
    loc_eng_log.h
@@ -98,3 +105,39 @@ LOCAL_PRELINK_MODULE := false
 LOCAL_MODULE_RELATIVE_PATH := hw
 
 include $(BUILD_SHARED_LIBRARY)
+
+include $(CLEAR_VARS)
+
+## loopback throughput test of the AGPS_DMN_CONN_SOCKET server, run by hand
+LOCAL_MODULE := loc_dmn_conn_loopback
+LOCAL_MODULE_OWNER := qcom
+
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_SHARED_LIBRARIES := \
+    libutils \
+    libcutils \
+    liblog \
+    libloc_core \
+    libgps.utils
+
+LOCAL_SRC_FILES += \
+    loc_eng_dmn_conn_loopback.cpp \
+    loc_eng_dmn_conn.cpp \
+    loc_eng_dmn_conn_handler.cpp \
+    loc_eng_dmn_conn_thread_helper.c \
+    loc_eng_dmn_conn_glue_msg.c \
+    loc_eng_dmn_conn_glue_pipe.c
+
+LOCAL_CFLAGS += \
+     -fno-short-enums \
+     -D_ANDROID_ \
+     -DDEBUG_DMN_LOC_API
+
+LOCAL_C_INCLUDES:= \
+    $(TARGET_OUT_HEADERS)/gps.utils \
+    $(TARGET_OUT_HEADERS)/libloc_core \
+    $(LOCAL_PATH) \
+    $(TARGET_OUT_HEADERS)/libflp
+
+include $(BUILD_EXECUTABLE)
@@ -73,14 +73,29 @@ LocEngAdapter::LocEngAdapter(LOC_API_ADAPTER_EVENT_MASK_T mask,
                                                    false)
                    :context),
     mOwner(owner), mInternalAdapter(new LocInternalAdapter(this)),
-    mUlp(new UlpProxyBase()), mNavigating(false),
+    mUlp(new UlpProxyBase()), mUlpInstalled(false), mNavigating(false),
+    mClientSessions(0), mModemSession(false),
     mSupportsAgpsRequests(false),
     mSupportsPositionInjection(false),
     mSupportsTimeInjection(false),
-    mPowerVote(0)
+    mPowerVote(0),
+    mZppCacheTechMask(LOC_POS_TECH_MASK_DEFAULT), mZppCacheTimeMs(0),
+    mZppCacheTtlMs(0), mZppCacheMaxAccuracy(0), mZppCacheAgingSpeed(0),
+    mGpsMeasurementRing(sizeof(GpsData), GPS_MEASUREMENT_RING_SIZE),
+    mGpsMeasurementDropped(0)
 {
     memset(&mFixCriteria, 0, sizeof(mFixCriteria));
+    memset(&mZppCache, 0, sizeof(mZppCache));
+    memset(&mModemState, 0, sizeof(mModemState));
+    // whoever created us with a demand driven event consumes it
+    for (int i = 0; i < LOC_API_ADAPTER_EVENT_MAX; i++) {
+        mEventConsumers[i] = (mask & DEMAND_DRIVEN_EVENTS & (1 << i)) ? 1 : 0;
+    }
     mFixCriteria.mode = LOC_POSITION_MODE_INVALID;
+    for (int i = 0; i < LOC_ENG_SESSION_CLIENT_MAX; i++) {
+        mClientCriteria[i] = mFixCriteria;
+        mClientFixMs[i] = 0;
+    }
     LOC_LOGD("LocEngAdapter created");
 }
 
@@ -284,6 +299,7 @@ void LocEngAdapter::setUlpProxy(UlpProxyBase* ulp)
     }
 
     LOC_LOGV("%s] %p", __func__, ulp);
+    mUlpInstalled = (NULL != ulp);
     if (NULL == ulp) {
         LOC_LOGE("%s:%d]: ulp pointer is NULL", __func__, __LINE__);
         ulp = new UlpProxyBase();
@@ -356,6 +372,31 @@ void LocInternalAdapter::reportPosition(UlpLocation &location,
 }
 
 
+bool LocEngAdapter::isPositionWanted(enum loc_sess_status status,
+                                     bool hasAccuracy,
+                                     float accuracy)
+{
+    loc_eng_data_s_type* locEng = (loc_eng_data_s_type*)mOwner;
+
+    // ULP and the geofencer, while it has active fences, get every
+    // report; otherwise mirror the checks in LocEngReportPosition::proc().
+    // The loc_eng state is read here as a snapshot, which can only be off
+    // by a report around a change.
+    if (mUlpInstalled || loc_eng_geofence_wants_position(*locEng)) {
+        return true;
+    }
+    if (LOC_MUTE_SESS_IN_SESSION == locEng->mute_session_state) {
+        return false;
+    }
+    if (LOC_SESS_INTERMEDIATE != status || locEng->generateNmea) {
+        return true;
+    }
+    return LOC_SESS_INTERMEDIATE == locEng->intermediateFix &&
+           !(hasAccuracy &&
+             gps_conf.ACCURACY_THRES != 0 &&
+             accuracy > gps_conf.ACCURACY_THRES);
+}
+
 void LocEngAdapter::reportPosition(UlpLocation &location,
                                    GpsLocationExtended &locationExtended,
                                    void* locationExt,
@@ -375,6 +416,109 @@ void LocEngAdapter::reportPosition(UlpLocation &location,
     }
 }
 
+float LocEngAdapter::getZppCacheAccuracy(int64_t nowMs) const
+{
+    return mZppCache.accuracy +
+        (float)(nowMs - mZppCacheTimeMs) / 1000 * mZppCacheAgingSpeed;
+}
+
+enum loc_api_adapter_err
+LocEngAdapter::getZpp(GpsLocation &zppLoc, LocPosTechMask &tech_mask)
+{
+    int64_t now = elapsedMillisSinceBoot();
+
+    if (mZppCacheTimeMs != 0) {
+        float accuracy = getZppCacheAccuracy(now);
+        if (now - mZppCacheTimeMs <= (int64_t)mZppCacheTtlMs &&
+            (0 == mZppCacheMaxAccuracy || accuracy <= mZppCacheMaxAccuracy)) {
+            LOC_LOGV("%s:%d]: ZPP served from cache, age %lld ms, acc %f",
+                     __func__, __LINE__,
+                     (long long)(now - mZppCacheTimeMs), accuracy);
+            zppLoc = mZppCache;
+            zppLoc.accuracy = accuracy;
+            tech_mask = mZppCacheTechMask;
+            return LOC_API_ADAPTER_ERR_SUCCESS;
+        }
+        mZppCacheTimeMs = 0;
+    }
+
+    enum loc_api_adapter_err ret =
+        mLocApi->getBestAvailableZppFix(zppLoc, tech_mask);
+    if (LOC_API_ADAPTER_ERR_SUCCESS == ret) {
+        updateZppCache(zppLoc, tech_mask);
+    }
+    return ret;
+}
+
+void LocEngAdapter::updateZppCache(const GpsLocation &location,
+                                   LocPosTechMask tech_mask)
+{
+    if (0 == mZppCacheTtlMs ||
+        !(location.flags & GPS_LOCATION_HAS_LAT_LONG) ||
+        !(location.flags & GPS_LOCATION_HAS_ACCURACY)) {
+        return;
+    }
+
+    int64_t now = elapsedMillisSinceBoot();
+    // keep the cached position if, aged to now, it is still the better one
+    if (mZppCacheTimeMs != 0 &&
+        now - mZppCacheTimeMs <= (int64_t)mZppCacheTtlMs &&
+        getZppCacheAccuracy(now) < location.accuracy) {
+        return;
+    }
+
+    mZppCache = location;
+    mZppCacheTechMask = tech_mask;
+    mZppCacheTimeMs = now;
+}
+
+enum loc_api_adapter_err
+LocEngAdapter::setServer(const char* url, int len)
+{
+    enum loc_api_adapter_err result = mLocApi->setServer(url, len);
+    if (LOC_API_ADAPTER_ERR_SUCCESS == result &&
+        len >= 0 && len < (int)sizeof(mModemState.suplServer)) {
+        memcpy(mModemState.suplServer, url, len);
+        mModemState.suplServer[len] = '\0';
+        mModemState.suplServerLen = len;
+        mModemState.suplServerValid = true;
+    }
+    return result;
+}
+
+enum loc_api_adapter_err
+LocEngAdapter::setServer(unsigned int ip, int port, LocServerType type)
+{
+    enum loc_api_adapter_err result = mLocApi->setServer(ip, port, type);
+    if (LOC_API_ADAPTER_ERR_SUCCESS == result && type < LOC_AGPS_SUPL_SERVER) {
+        mModemState.serverValid[type] = true;
+        mModemState.serverIp[type] = ip;
+        mModemState.serverPort[type] = port;
+    }
+    return result;
+}
+
+/* Re-sends the settings recorded in mModemState, for use after the modem
+   restarted. Servers are replayed with the addresses resolved before the
+   restart, so recovery does not wait on DNS. Injected time is not kept,
+   as it is stale by then; the framework injects it again. */
+void LocEngAdapter::replayModemState()
+{
+    if (mModemState.extPowerValid) {
+        mLocApi->setExtPowerConfig(mModemState.isBatteryCharging);
+    }
+    if (mModemState.suplServerValid) {
+        mLocApi->setServer(mModemState.suplServer, mModemState.suplServerLen);
+    }
+    for (int type = 0; type < LOC_AGPS_SUPL_SERVER; type++) {
+        if (mModemState.serverValid[type]) {
+            mLocApi->setServer(mModemState.serverIp[type],
+                               mModemState.serverPort[type],
+                               (LocServerType)type);
+        }
+    }
+}
+
 void LocInternalAdapter::reportSv(HaxxSvStatus &svStatus,
                                   GpsLocationExtended &locationExtended,
                                   void* svExt){
@@ -400,10 +544,149 @@ void LocEngAdapter::setInSession(bool inSession)
     mNavigating = inSession;
     mLocApi->setInSession(inSession);
     if (!mNavigating) {
-        mFixCriteria.mode = LOC_POSITION_MODE_INVALID;
+        mClientCriteria[LOC_ENG_SESSION_AFW].mode = LOC_POSITION_MODE_INVALID;
     }
 }
 
+// The merged session runs at the shortest interval and with the best
+// accuracy and time asked for, and is single shot only if all of the
+// sessions are. Its mode comes from the client with the shortest
+// interval, the framework winning ties.
+void LocEngAdapter::mergeSessions(LocPosMode& merged) const
+{
+    bool first = true;
+
+    for (int i = 0; i < LOC_ENG_SESSION_CLIENT_MAX; i++) {
+        if (!(mClientSessions & LOC_ENG_SESSION_BIT(i))) {
+            continue;
+        }
+        const LocPosMode& criteria = mClientCriteria[i];
+        if (first) {
+            merged = criteria;
+            first = false;
+            continue;
+        }
+        if (criteria.min_interval < merged.min_interval) {
+            merged.mode = criteria.mode;
+            merged.min_interval = criteria.min_interval;
+            memcpy(merged.credentials, criteria.credentials,
+                   sizeof(merged.credentials));
+            memcpy(merged.provider, criteria.provider,
+                   sizeof(merged.provider));
+        }
+        if (GPS_POSITION_RECURRENCE_PERIODIC == criteria.recurrence) {
+            merged.recurrence = GPS_POSITION_RECURRENCE_PERIODIC;
+        }
+        // 0 is no preference
+        if (0 != criteria.preferred_accuracy &&
+            (0 == merged.preferred_accuracy ||
+             criteria.preferred_accuracy < merged.preferred_accuracy)) {
+            merged.preferred_accuracy = criteria.preferred_accuracy;
+        }
+        if (0 != criteria.preferred_time &&
+            (0 == merged.preferred_time ||
+             criteria.preferred_time < merged.preferred_time)) {
+            merged.preferred_time = criteria.preferred_time;
+        }
+    }
+}
+
+// Starts, restarts or stops the modem session to match the client
+// sessions. A running session is left alone if the merged criteria
+// have not changed.
+enum loc_api_adapter_err LocEngAdapter::updateSession()
+{
+    if (0 == mClientSessions) {
+        if (!mModemSession) {
+            return LOC_API_ADAPTER_ERR_SUCCESS;
+        }
+        LOC_LOGD("%s:%d]: stopping modem session\n", __func__, __LINE__);
+        mModemSession = false;
+        return mLocApi->stopFix();
+    }
+
+    LocPosMode merged;
+    mergeSessions(merged);
+    if (mModemSession && merged.equals(mFixCriteria)) {
+        return LOC_API_ADAPTER_ERR_SUCCESS;
+    }
+
+    LOC_LOGD("%s:%d]: %s modem session for clients 0x%x\n",
+             __func__, __LINE__, mModemSession ? "restarting" : "starting",
+             mClientSessions);
+    mFixCriteria = merged;
+    mModemSession = true;
+    return mLocApi->startFix(mFixCriteria);
+}
+
+enum loc_api_adapter_err
+LocEngAdapter::startSession(LocEngSessionClient client,
+                            const LocPosMode *posMode)
+{
+    if (NULL != posMode) {
+        mClientCriteria[client] = *posMode;
+    }
+    mClientSessions |= LOC_ENG_SESSION_BIT(client);
+    mClientFixMs[client] = 0;
+    return updateSession();
+}
+
+enum loc_api_adapter_err
+LocEngAdapter::stopSession(LocEngSessionClient client)
+{
+    if (!(mClientSessions & LOC_ENG_SESSION_BIT(client))) {
+        return LOC_API_ADAPTER_ERR_SUCCESS;
+    }
+    mClientSessions &= ~LOC_ENG_SESSION_BIT(client);
+    return updateSession();
+}
+
+enum loc_api_adapter_err LocEngAdapter::restartSession()
+{
+    mModemSession = false;
+    return updateSession();
+}
+
+enum loc_api_adapter_err
+LocEngAdapter::setPositionMode(const LocPosMode *posMode)
+{
+    if (NULL != posMode) {
+        mClientCriteria[LOC_ENG_SESSION_AFW] = *posMode;
+    }
+    if (mClientSessions & LOC_ENG_SESSION_BIT(LOC_ENG_SESSION_AFW)) {
+        return updateSession();
+    }
+    return LOC_API_ADAPTER_ERR_SUCCESS;
+}
+
+uint32_t LocEngAdapter::dispatchFix(enum loc_sess_status status) const
+{
+    if (LOC_SESS_SUCCESS != status) {
+        return mClientSessions;
+    }
+
+    // fixes come in about every merged interval, so a client due within
+    // half of one takes this fix rather than one a whole interval late
+    int64_t now = elapsedMillisSinceBoot();
+    int64_t slack = mFixCriteria.min_interval / 2;
+    uint32_t clients = 0;
+
+    for (int i = 0; i < LOC_ENG_SESSION_CLIENT_MAX; i++) {
+        if ((mClientSessions & LOC_ENG_SESSION_BIT(i)) &&
+            (0 == mClientFixMs[i] ||
+             now - mClientFixMs[i] + slack >=
+             (int64_t)mClientCriteria[i].min_interval)) {
+            clients |= LOC_ENG_SESSION_BIT(i);
+        }
+    }
+    return clients;
+}
+
+void LocEngAdapter::fixDelivered(LocEngSessionClient client)
+{
+    mClientFixMs[client] = elapsedMillisSinceBoot();
+}
+
 void LocInternalAdapter::reportStatus(GpsStatusValue status)
 {
     sendMsg(new LocEngReportStatus(mLocEngAdapter, status));
@@ -566,8 +849,33 @@ enum loc_api_adapter_err LocEngAdapter::setXtraVersionCheck(int check)
 
 void LocEngAdapter::reportGpsMeasurementData(GpsData &gpsMeasurementData)
 {
-    sendMsg(new LocEngReportGpsMeasurement(mOwner,
-                                           gpsMeasurementData));
+    GpsData* slot = (GpsData*)mGpsMeasurementRing.claim();
+    if (NULL == slot) {
+        // counted by the ring, logged when the ring is next drained
+        return;
+    }
+
+    // copy only the measurements in use
+    size_t count = gpsMeasurementData.measurement_count;
+    if (count > GPS_MAX_MEASUREMENT) {
+        count = GPS_MAX_MEASUREMENT;
+    }
+    slot->size = gpsMeasurementData.size;
+    slot->measurement_count = count;
+    memcpy(slot->measurements, gpsMeasurementData.measurements,
+           count * sizeof(GpsMeasurement));
+    slot->clock = gpsMeasurementData.clock;
+    mGpsMeasurementRing.publish();
+
+    sendMsg(new LocEngReportGpsMeasurement(this));
+}
+
+int32_t LocEngAdapter::getNewlyDroppedGpsMeasurements()
+{
+    int32_t dropped = mGpsMeasurementRing.getDropped();
+    int32_t newlyDropped = dropped - mGpsMeasurementDropped;
+    mGpsMeasurementDropped = dropped;
+    return newlyDropped;
 }
 
 /*
@@ -577,12 +885,41 @@ void LocEngAdapter::updateRegistrationMask(LOC_API_ADAPTER_EVENT_MASK_T event,
                                            loc_registration_mask_status isEnabled)
 {
     LOC_LOGD("entering %s", __func__);
-    int result = LOC_API_ADAPTER_ERR_FAILURE;
-    result = mLocApi->updateRegistrationMask(event, isEnabled);
-    if (result == LOC_API_ADAPTER_ERR_SUCCESS) {
-        LOC_LOGD("%s] update registration mask succeed.", __func__);
-    } else {
-        LOC_LOGE("%s] update registration mask failed.", __func__);
+    // the LocApi reopens with the union of all adapters' masks, so an
+    // event another adapter still wants stays registered
+    updateEvtMask(event, isEnabled);
+}
+
+void LocEngAdapter::updateConsumers(LOC_API_ADAPTER_EVENT_MASK_T events,
+                                    bool isAdded)
+{
+    LOC_API_ADAPTER_EVENT_MASK_T changed = 0;
+
+    events &= DEMAND_DRIVEN_EVENTS;
+    for (int i = 0; i < LOC_API_ADAPTER_EVENT_MAX; i++) {
+        if (0 == (events & (1 << i))) {
+            continue;
+        }
+        if (isAdded) {
+            if (0 == mEventConsumers[i]++) {
+                changed |= (1 << i);
+            }
+        } else if (mEventConsumers[i] > 0) {
+            if (0 == --mEventConsumers[i]) {
+                changed |= (1 << i);
+            }
+        }
+    }
+
+    LOC_LOGD("%s] events: %x %s, registration changed: %x", __func__,
+             events, isAdded ? "added" : "removed", changed);
+    // only our own mask changes; the modem is registered for the union
+    // of all adapters' masks, so another adapter's consumer keeps an
+    // event registered after our last one leaves
+    if (0 != changed) {
+        updateEvtMask(changed,
+                      isAdded ? LOC_REGISTRATION_MASK_ENABLED :
+                                LOC_REGISTRATION_MASK_DISABLED);
     }
 }
 
@@ -37,6 +37,7 @@
 #include <LocAdapterBase.h>
 #include <LocDualContext.h>
 #include <UlpProxyBase.h>
+#include <LocSpscRing.h>
 #include <platform_lib_includes.h>
 
 #define MAX_URL_LEN 256
@@ -45,6 +46,14 @@ using namespace loc_core;
 
 class LocEngAdapter;
 
+// Clients whose position sessions are merged into one modem session
+enum LocEngSessionClient {
+    LOC_ENG_SESSION_AFW = 0,        // framework, through loc_eng_start()
+    LOC_ENG_SESSION_GEOFENCE,       // AP side geofencer
+    LOC_ENG_SESSION_CLIENT_MAX
+};
+#define LOC_ENG_SESSION_BIT(client) (1 << (client))
+
 class LocInternalAdapter : public LocAdapterBase {
     LocEngAdapter* mLocEngAdapter;
 public:
@@ -72,16 +81,70 @@ class LocEngAdapter : public LocAdapterBase {
     void* mOwner;
     LocInternalAdapter* mInternalAdapter;
     UlpProxyBase* mUlp;
+    // false while mUlp is our own placeholder rather than a real ULP
+    bool mUlpInstalled;
+    // criteria the modem session was last started with, merged from
+    // those of the clients with a session
     LocPosMode mFixCriteria;
     bool mNavigating;
+    LocPosMode mClientCriteria[LOC_ENG_SESSION_CLIENT_MAX];
+    // when each client was last handed a fix, for decimation
+    int64_t mClientFixMs[LOC_ENG_SESSION_CLIENT_MAX];
+    // LOC_ENG_SESSION_BIT of the clients with a session
+    uint32_t mClientSessions;
+    bool mModemSession;
+    void mergeSessions(LocPosMode& merged) const;
+    enum loc_api_adapter_err updateSession();
     // mPowerVote is encoded as
     // mPowerVote & 0x20 -- powerVoteRight
     // mPowerVote & 0x10 -- power On / Off
     unsigned int mPowerVote;
     static const unsigned int POWER_VOTE_RIGHT = 0x20;
     static const unsigned int POWER_VOTE_VALUE = 0x10;
+    // Last coarse position known to the adapter, handed out by getZpp()
+    // instead of querying the modem while it is fresh and accurate enough.
+    // mZppCacheTimeMs is 0 when the cache is empty.
+    GpsLocation mZppCache;
+    LocPosTechMask mZppCacheTechMask;
+    int64_t mZppCacheTimeMs;
+    uint32_t mZppCacheTtlMs;
+    uint32_t mZppCacheMaxAccuracy;
+    uint32_t mZppCacheAgingSpeed;
+    float getZppCacheAccuracy(int64_t nowMs) const;
+    // Modem-facing settings that do not come from gps.conf, and so are
+    // not re-sent by loc_eng_reinit(). They are kept as last applied and
+    // replayed by replayModemState() when the modem restarts.
+    struct ModemState {
+        bool extPowerValid;
+        int isBatteryCharging;
+        bool suplServerValid;
+        char suplServer[MAX_URL_LEN];
+        int suplServerLen;
+        // indexed by LocServerType, SUPL excluded
+        bool serverValid[LOC_AGPS_SUPL_SERVER];
+        unsigned int serverIp[LOC_AGPS_SUPL_SERVER];
+        int serverPort[LOC_AGPS_SUPL_SERVER];
+    } mModemState;
+    // Number of live consumers of each demand driven event, e.g. the
+    // framework nmea_cb for NMEA. The event stays registered with the
+    // modem only while its count is non-zero.
+    uint8_t mEventConsumers[LOC_API_ADAPTER_EVENT_MAX];
+    // GNSS measurement epochs, filled in on the LocApi's thread and
+    // drained by LocEngReportGpsMeasurement on the MsgTask thread.
+    // Epochs arriving while it is full are dropped.
+    LocSpscRing mGpsMeasurementRing;
+    // drop count last logged, consumer side
+    int32_t mGpsMeasurementDropped;
+    static const int32_t GPS_MEASUREMENT_RING_SIZE = 4;
 
 public:
+    // events registered with the modem only while someone consumes them
+    static const LOC_API_ADAPTER_EVENT_MASK_T DEMAND_DRIVEN_EVENTS =
+        LOC_API_ADAPTER_BIT_SATELLITE_REPORT |
+        LOC_API_ADAPTER_BIT_NMEA_1HZ_REPORT |
+        LOC_API_ADAPTER_BIT_NMEA_POSITION_REPORT |
+        LOC_API_ADAPTER_BIT_GNSS_MEASUREMENT;
+
     bool mSupportsAgpsRequests;
     bool mSupportsPositionInjection;
     bool mSupportsTimeInjection;
@@ -107,16 +170,21 @@ public:
     }
     inline const MsgTask* getMsgTask() { return mMsgTask; }
 
-    inline enum loc_api_adapter_err
-        startFix()
-    {
-        return mLocApi->startFix(mFixCriteria);
-    }
-    inline enum loc_api_adapter_err
-        stopFix()
-    {
-        return mLocApi->stopFix();
-    }
+    // the modem is only restarted if the merged criteria change
+    enum loc_api_adapter_err
+        startSession(LocEngSessionClient client, const LocPosMode *posMode);
+    enum loc_api_adapter_err
+        stopSession(LocEngSessionClient client);
+    // restarts the modem session with the merged criteria, after the
+    // modem itself has restarted
+    enum loc_api_adapter_err restartSession();
+    inline bool hasClientSession() const
+    { return 0 != mClientSessions; }
+    // LOC_ENG_SESSION_BIT of the clients a fix is for; a final fix is
+    // only for the clients whose interval is about due
+    uint32_t dispatchFix(enum loc_sess_status status) const;
+    // restarts the client's interval, once a final fix is delivered to it
+    void fixDelivered(LocEngSessionClient client);
     inline enum loc_api_adapter_err
         deleteAidingData(GpsAidingData f)
     {
@@ -157,24 +225,19 @@ public:
     {
         return mLocApi->atlCloseStatus(handle, is_succ);
     }
-    inline enum loc_api_adapter_err
-        setPositionMode(const LocPosMode *posMode)
-    {
-        if (NULL != posMode) {
-            mFixCriteria = *posMode;
-        }
-        return mLocApi->setPositionMode(mFixCriteria);
-    }
-    inline enum loc_api_adapter_err
-        setServer(const char* url, int len)
-    {
-        return mLocApi->setServer(url, len);
-    }
-    inline enum loc_api_adapter_err
+    // sets the framework's criteria
+    enum loc_api_adapter_err
+        setPositionMode(const LocPosMode *posMode);
+    enum loc_api_adapter_err
+        setServer(const char* url, int len);
+    enum loc_api_adapter_err
         setServer(unsigned int ip, int port,
-                  LocServerType type)
+                  LocServerType type);
+    inline bool hasModemStateServer(LocServerType type) const
     {
-        return mLocApi->setServer(ip, port, type);
+        return (LOC_AGPS_SUPL_SERVER == type) ?
+            mModemState.suplServerValid :
+            mModemState.serverValid[type];
     }
     inline enum loc_api_adapter_err
         informNiResponse(GpsUserResponseType userResponse, const void* passThroughData)
@@ -224,13 +287,27 @@ public:
     inline virtual enum loc_api_adapter_err
         setExtPowerConfig(int isBatteryCharging)
     {
-        return mLocApi->setExtPowerConfig(isBatteryCharging);
+        enum loc_api_adapter_err result =
+            mLocApi->setExtPowerConfig(isBatteryCharging);
+        if (LOC_API_ADAPTER_ERR_SUCCESS == result) {
+            mModemState.extPowerValid = true;
+            mModemState.isBatteryCharging = isBatteryCharging;
+        }
+        return result;
     }
     inline virtual enum loc_api_adapter_err
         setAGLONASSProtocol(unsigned long aGlonassProtocol)
     {
         return mLocApi->setAGLONASSProtocol(aGlonassProtocol);
     }
+    inline void beginConfigBatch()
+    {
+        mLocApi->beginConfigBatch();
+    }
+    inline void endConfigBatch()
+    {
+        mLocApi->endConfigBatch();
+    }
     inline virtual int initDataServiceClient()
     {
         return mLocApi->initDataServiceClient();
@@ -247,10 +324,16 @@ public:
     {
         mLocApi->closeDataCall();
     }
-    inline enum loc_api_adapter_err
-        getZpp(GpsLocation &zppLoc, LocPosTechMask &tech_mask)
+    enum loc_api_adapter_err
+        getZpp(GpsLocation &zppLoc, LocPosTechMask &tech_mask);
+    void updateZppCache(const GpsLocation &location, LocPosTechMask tech_mask);
+    // ttlSec of 0 disables the cache; maxAccuracy of 0 means no limit
+    inline void setZppCacheConfig(uint32_t ttlSec, uint32_t maxAccuracy,
+                                  uint32_t agingSpeed)
     {
-        return mLocApi->getBestAvailableZppFix(zppLoc, tech_mask);
+        mZppCacheTtlMs = ttlSec * 1000;
+        mZppCacheMaxAccuracy = maxAccuracy;
+        mZppCacheAgingSpeed = agingSpeed;
     }
     enum loc_api_adapter_err setTime(GpsUtcTime time,
                                      int64_t timeReference,
@@ -262,8 +345,12 @@ public:
     {
         mLocApi->installAGpsCert(pData, length, slotBitMask);
     }
+    void replayModemState();
     virtual void handleEngineDownEvent();
     virtual void handleEngineUpEvent();
+    virtual bool isPositionWanted(enum loc_sess_status status,
+                                  bool hasAccuracy,
+                                  float accuracy);
     virtual void reportPosition(UlpLocation &location,
                                 GpsLocationExtended &locationExtended,
                                 void* locationExt,
@@ -285,9 +372,18 @@ public:
     virtual bool reportDataCallOpened();
     virtual bool reportDataCallClosed();
     virtual void reportGpsMeasurementData(GpsData &gpsMeasurementData);
+    // consumer side of the GNSS measurement ring, MsgTask thread only
+    inline GpsData* peekGpsMeasurement() {
+        return (GpsData*)mGpsMeasurementRing.peek();
+    }
+    inline void releaseGpsMeasurement() {
+        mGpsMeasurementRing.release();
+    }
+    int32_t getNewlyDroppedGpsMeasurements();
 
+    // the framework's criteria, not the merged ones
     inline const LocPosMode& getPositionMode() const
-    {return mFixCriteria;}
+    {return mClientCriteria[LOC_ENG_SESSION_AFW];}
     inline virtual bool isInSession()
     { return mNavigating; }
     void setInSession(bool inSession);
@@ -342,6 +438,14 @@ public:
     void updateRegistrationMask(LOC_API_ADAPTER_EVENT_MASK_T event,
                                 loc_registration_mask_status isEnabled);
 
+    /*
+      Add or remove a consumer of demand driven events. Events whose
+      consumer count leaves or drops to 0 are added to or removed from
+      this adapter's mask; the modem registration follows the union.
+     */
+    void updateConsumers(LOC_API_ADAPTER_EVENT_MASK_T events,
+                         bool isAdded);
+
     /*
       Set Gnss Constellation Config
      */
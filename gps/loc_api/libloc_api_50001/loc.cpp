@@ -37,12 +37,12 @@
 #include <loc_log.h>
 #include <fcntl.h>
 #include <errno.h>
-#include <dlfcn.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <LocDualContext.h>
+#include <LocModuleRegistry.h>
 #include <cutils/properties.h>
 
 using namespace loc_core;
@@ -124,6 +124,40 @@ static const GpsNiInterface sLocEngNiInterface =
    loc_ni_respond,
 };
 
+static void loc_geofence_init(GpsGeofenceCallbacks* callbacks);
+static void loc_geofence_add_area(int32_t geofence_id, double latitude,
+                                  double longitude, double radius_meters,
+                                  int last_transition, int monitor_transitions,
+                                  int notification_responsiveness_ms,
+                                  int unknown_timer_ms);
+static void loc_geofence_pause(int32_t geofence_id);
+static void loc_geofence_resume(int32_t geofence_id, int monitor_transitions);
+static void loc_geofence_remove_area(int32_t geofence_id);
+
+// AP side geofencing, for when there is no libgeofence.so
+static const GpsGeofencingInterface sLocEngGeofenceInterface =
+{
+    sizeof(GpsGeofencingInterface),
+    loc_geofence_init,
+    loc_geofence_add_area,
+    loc_geofence_pause,
+    loc_geofence_resume,
+    loc_geofence_remove_area
+};
+
+static int loc_batch_start(const LocBatchOptions* options);
+static int loc_batch_stop();
+static int loc_batch_flush();
+
+// AP side fix batching
+static const LocBatchingInterface sLocEngBatchingInterface =
+{
+    sizeof(LocBatchingInterface),
+    loc_batch_start,
+    loc_batch_stop,
+    loc_batch_flush
+};
+
 static int loc_gps_measurement_init(GpsMeasurementCallbacks* callbacks);
 static void loc_gps_measurement_close();
 
@@ -172,6 +206,16 @@ static const GnssConfigurationInterface sLocEngConfigInterface =
     loc_configuration_update
 };
 
+// Extension libraries loaded on a thread of their own from loc_init().
+// Only the ones loc_init() does not need: the context loads liblbs_core
+// and libloc_api_v02 in loc_eng_init() right after, so preloading them
+// would only make it wait for the preload thread.
+static const LocModuleSpec sLocModules[] =
+{
+    {"libgeofence.so", "gps_geofence_get_interface"},
+    {NULL, NULL}
+};
+
 static loc_eng_data_s_type loc_afw_data;
 static int gss_fd = -1;
 static int sGnssType = GNSS_UNKNOWN;
@@ -295,7 +339,10 @@ static int loc_init(GpsCallbacks* callbacks)
 
     LocCallbacks clientCallbacks = {local_loc_cb, /* location_cb */
                                     callbacks->status_cb, /* status_cb */
-                                    local_sv_cb, /* sv_status_cb */
+                                    // no wrapper without a framework callback,
+                                    // so SV reports are not registered for
+                                    callbacks->sv_status_cb ?
+                                        local_sv_cb : NULL, /* sv_status_cb */
                                     callbacks->nmea_cb, /* nmea_cb */
                                     callbacks->set_capabilities_cb, /* set_capabilities_cb */
                                     callbacks->acquire_wakelock_cb, /* acquire_wakelock_cb */
@@ -309,6 +356,7 @@ static int loc_init(GpsCallbacks* callbacks)
     gps_loc_cb = callbacks->location_cb;
     gps_sv_cb = callbacks->sv_status_cb;
 
+    LocModuleRegistry::preload(sLocModules);
     retVal = loc_eng_init(loc_afw_data, &clientCallbacks, event, NULL);
     loc_afw_data.adapter->mSupportsAgpsRequests = !loc_afw_data.adapter->hasAgpsExtendedCapabilities();
     loc_afw_data.adapter->mSupportsPositionInjection = !loc_afw_data.adapter->hasCPIExtendedCapabilities();
@@ -546,36 +594,83 @@ static void loc_delete_aiding_data(GpsAidingData f)
 const GpsGeofencingInterface* get_geofence_interface(void)
 {
     ENTRY_LOG();
-    void *handle;
-    const char *error;
-    typedef const GpsGeofencingInterface* (*get_gps_geofence_interface_function) (void);
-    get_gps_geofence_interface_function get_gps_geofence_interface;
-    static const GpsGeofencingInterface* geofence_interface = NULL;
+    const GpsGeofencingInterface* geofence_interface =
+        (const GpsGeofencingInterface*)LocModuleRegistry::getInterface(
+            "libgeofence.so", "gps_geofence_get_interface");
 
-    dlerror();    /* Clear any existing error */
+    if (NULL == geofence_interface) {
+        LOC_LOGI("%s, using AP side geofencing\n", __func__);
+        geofence_interface = &sLocEngGeofenceInterface;
+    }
+    EXIT_LOG(%d, geofence_interface == NULL);
+    return geofence_interface;
+}
 
-    handle = dlopen ("libgeofence.so", RTLD_NOW);
+static void loc_geofence_init(GpsGeofenceCallbacks* callbacks)
+{
+    ENTRY_LOG();
+    loc_eng_geofence_init(loc_afw_data, callbacks);
+    EXIT_LOG(%s, VOID_RET);
+}
 
-    if (!handle)
-    {
-        if ((error = dlerror()) != NULL)  {
-            LOC_LOGE ("%s, dlopen for libgeofence.so failed, error = %s\n", __func__, error);
-           }
-        goto exit;
-    }
-    dlerror();    /* Clear any existing error */
-    get_gps_geofence_interface = (get_gps_geofence_interface_function)dlsym(handle, "gps_geofence_get_interface");
-    if ((error = dlerror()) != NULL || NULL == get_gps_geofence_interface)  {
-        LOC_LOGE ("%s, dlsym for get_gps_geofence_interface failed, error = %s\n", __func__, error);
-        goto exit;
-     }
+static void loc_geofence_add_area(int32_t geofence_id, double latitude,
+                                  double longitude, double radius_meters,
+                                  int last_transition, int monitor_transitions,
+                                  int notification_responsiveness_ms,
+                                  int unknown_timer_ms)
+{
+    ENTRY_LOG();
+    loc_eng_geofence_add(loc_afw_data, geofence_id, latitude, longitude,
+                         radius_meters, last_transition, monitor_transitions,
+                         notification_responsiveness_ms, unknown_timer_ms);
+    EXIT_LOG(%s, VOID_RET);
+}
 
-    geofence_interface = get_gps_geofence_interface();
+static void loc_geofence_pause(int32_t geofence_id)
+{
+    ENTRY_LOG();
+    loc_eng_geofence_pause(loc_afw_data, geofence_id);
+    EXIT_LOG(%s, VOID_RET);
+}
 
-exit:
-    EXIT_LOG(%d, geofence_interface == NULL);
-    return geofence_interface;
+static void loc_geofence_resume(int32_t geofence_id, int monitor_transitions)
+{
+    ENTRY_LOG();
+    loc_eng_geofence_resume(loc_afw_data, geofence_id, monitor_transitions);
+    EXIT_LOG(%s, VOID_RET);
+}
+
+static void loc_geofence_remove_area(int32_t geofence_id)
+{
+    ENTRY_LOG();
+    loc_eng_geofence_remove(loc_afw_data, geofence_id);
+    EXIT_LOG(%s, VOID_RET);
 }
+
+static int loc_batch_start(const LocBatchOptions* options)
+{
+    ENTRY_LOG();
+    int ret_val = loc_eng_batch_start(loc_afw_data, options);
+    EXIT_LOG(%d, ret_val);
+    return ret_val;
+}
+
+static int loc_batch_stop()
+{
+    ENTRY_LOG();
+    int ret_val = loc_eng_batch_stop(loc_afw_data);
+    EXIT_LOG(%d, ret_val);
+    return ret_val;
+}
+
+static int loc_batch_flush()
+{
+    ENTRY_LOG();
+    int ret_val = loc_eng_batch_flush(loc_afw_data);
+    EXIT_LOG(%d, ret_val);
+    return ret_val;
+}
+
 /*===========================================================================
 FUNCTION    loc_get_extension
 
@@ -625,6 +720,10 @@ const void* loc_get_extension(const char* name)
            ret_val = get_geofence_interface();
        }
    }
+   else if (strcmp(name, LOC_BATCHING_INTERFACE) == 0)
+   {
+       ret_val = &sLocEngBatchingInterface;
+   }
    else if (strcmp(name, SUPL_CERTIFICATE_INTERFACE) == 0)
    {
        ret_val = &sLocEngAGpsCertInterface;
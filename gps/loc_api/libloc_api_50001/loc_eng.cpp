@@ -110,6 +110,19 @@ static const loc_param_s_type gps_conf_table[] =
   {"XTRA_SERVER_1",                  &gps_conf.XTRA_SERVER_1,                  NULL, 's'},
   {"XTRA_SERVER_2",                  &gps_conf.XTRA_SERVER_2,                  NULL, 's'},
   {"XTRA_SERVER_3",                  &gps_conf.XTRA_SERVER_3,                  NULL, 's'},
+  {"XTRA_CACHE_VALID_HOURS",         &gps_conf.XTRA_CACHE_VALID_HOURS,         NULL, 'n'},
+  {"LAST_POSITION_MAX_AGE",          &gps_conf.LAST_POSITION_MAX_AGE,          NULL, 'n'},
+  {"LAST_POSITION_AGING_SPEED",      &gps_conf.LAST_POSITION_AGING_SPEED,      NULL, 'n'},
+  {"ZPP_CACHE_TTL",                  &gps_conf.ZPP_CACHE_TTL,                  NULL, 'n'},
+  {"ZPP_CACHE_MAX_ACCURACY",         &gps_conf.ZPP_CACHE_MAX_ACCURACY,         NULL, 'n'},
+  {"DNS_CACHE_TTL",                  &gps_conf.DNS_CACHE_TTL,                  NULL, 'n'},
+  {"DNS_NEGATIVE_CACHE_TTL",         &gps_conf.DNS_NEGATIVE_CACHE_TTL,         NULL, 'n'},
+  {"AGPS_DATA_CONN_LINGER_SEC",      &gps_conf.AGPS_DATA_CONN_LINGER_SEC,      NULL, 'n'},
+  {"AGPS_DMN_CONN_SOCKET",           &gps_conf.AGPS_DMN_CONN_SOCKET,           NULL, 'n'},
+  {"AP_BATCH_SIZE",                  &gps_conf.AP_BATCH_SIZE,                  NULL, 'n'},
+  {"AP_BATCH_MAX_DELAY_SEC",         &gps_conf.AP_BATCH_MAX_DELAY_SEC,         NULL, 'n'},
+  {"AP_BATCH_MIN_INTERVAL_MSEC",     &gps_conf.AP_BATCH_MIN_INTERVAL_MSEC,     NULL, 'n'},
+  {"AP_BATCH_WAKEUP",                &gps_conf.AP_BATCH_WAKEUP,                NULL, 'n'},
   {"USE_EMERGENCY_PDN_FOR_EMERGENCY_SUPL",  &gps_conf.USE_EMERGENCY_PDN_FOR_EMERGENCY_SUPL,          NULL, 'n'},
 };
 
@@ -150,6 +163,29 @@ static void loc_default_parameters(void)
    gps_conf.A_GLONASS_POS_PROTOCOL_SELECT = 0;
    /*XTRA version check is disabled by default*/
    gps_conf.XTRA_VERSION_CHECK=0;
+   /*Cached XTRA files are reused for up to a week*/
+   gps_conf.XTRA_CACHE_VALID_HOURS = 168;
+   /*Last known position is used as a seed for up to 4 hours,
+     its uncertainty growing by 30 m/s*/
+   gps_conf.LAST_POSITION_MAX_AGE = 14400;
+   gps_conf.LAST_POSITION_AGING_SPEED = 30;
+   /*ZPP answers are reused for 30 seconds while within 5 km*/
+   gps_conf.ZPP_CACHE_TTL = 30;
+   gps_conf.ZPP_CACHE_MAX_ACCURACY = 5000;
+   /*PDE and MPC host names are resolved again after an hour,
+     or after a minute if they failed to resolve*/
+   gps_conf.DNS_CACHE_TTL = 3600;
+   gps_conf.DNS_NEGATIVE_CACHE_TTL = 60;
+   /*AGPS data connections are released as soon as they are unused*/
+   gps_conf.AGPS_DATA_CONN_LINGER_SEC = 0;
+   /*Daemons talk to the AGPS server through the q pipes*/
+   gps_conf.AGPS_DMN_CONN_SOCKET = 0;
+   /*Fixes are only batched when asked to, 20 at a time, for up to a
+     minute, waking up the AP when a batch is full*/
+   gps_conf.AP_BATCH_SIZE = 20;
+   gps_conf.AP_BATCH_MAX_DELAY_SEC = 60;
+   gps_conf.AP_BATCH_MIN_INTERVAL_MSEC = 0;
+   gps_conf.AP_BATCH_WAKEUP = 1;
    /*Use emergency PDN by default*/
    gps_conf.USE_EMERGENCY_PDN_FOR_EMERGENCY_SUPL = 1;
 
@@ -356,7 +392,10 @@ struct LocEngSetTime : public LocMsg {
         locallog();
     }
     inline virtual void proc() const {
-        mAdapter->setTime(mTime, mTimeReference, mUncertainty);
+        if (LOC_API_ADAPTER_ERR_SUCCESS ==
+            mAdapter->setTime(mTime, mTimeReference, mUncertainty)) {
+            loc_eng_ttff_mark(LOC_ENG_TTFF_TIME_INJECT);
+        }
     }
     inline void locallog() const {
         LOC_LOGV("time: %lld\n  timeReference: %lld\n  uncertainty: %d",
@@ -382,6 +421,7 @@ struct LocEngInjectLocation : public LocMsg {
     }
     inline virtual void proc() const {
         mAdapter->injectPosition(mLatitude, mLongitude, mAccuracy);
+        loc_eng_ttff_mark(LOC_ENG_TTFF_POS_INJECT);
     }
     inline void locallog() const {
         LOC_LOGV("latitude: %f\n  longitude: %f\n  accuracy: %f",
@@ -393,31 +433,25 @@ struct LocEngInjectLocation : public LocMsg {
 };
 
 //        case LOC_ENG_MSG_SET_SERVER_IPV4:
-struct LocEngSetServerIpv4 : public LocMsg {
-    LocEngAdapter* mAdapter;
-    const unsigned int mNlAddr;
-    const int mPort;
-    const LocServerType mServerType;
-    inline LocEngSetServerIpv4(LocEngAdapter* adapter,
-                               unsigned int ip,
-                               int port,
-                               LocServerType type) :
-        LocMsg(), mAdapter(adapter),
-        mNlAddr(ip), mPort(port), mServerType(type)
-    {
-        locallog();
-    }
-    inline virtual void proc() const {
-        mAdapter->setServer(mNlAddr, mPort, mServerType);
-    }
-    inline void locallog() const {
-        LOC_LOGV("LocEngSetServerIpv4 - addr: %x, port: %d, type: %s",
-                 mNlAddr, mPort, loc_get_server_type_name(mServerType));
-    }
-    inline virtual void log() const {
-        locallog();
-    }
-};
+LocEngSetServerIpv4::LocEngSetServerIpv4(LocEngAdapter* adapter,
+                                         unsigned int ip,
+                                         int port,
+                                         LocServerType type) :
+    LocMsg(), mAdapter(adapter),
+    mNlAddr(ip), mPort(port), mServerType(type)
+{
+    locallog();
+}
+void LocEngSetServerIpv4::proc() const {
+    mAdapter->setServer(mNlAddr, mPort, mServerType);
+}
+void LocEngSetServerIpv4::locallog() const {
+    LOC_LOGV("LocEngSetServerIpv4 - addr: %x, port: %d, type: %s",
+             mNlAddr, mPort, loc_get_server_type_name(mServerType));
+}
+void LocEngSetServerIpv4::log() const {
+    locallog();
+}
 
 //        case LOC_ENG_MSG_SET_SERVER_URL:
 struct LocEngSetServerUrl : public LocMsg {
@@ -530,6 +564,47 @@ struct LocEngLppConfig : public LocMsg {
     }
 };
 
+struct LocEngConfigBatch : public LocMsg {
+    LocEngAdapter* mAdapter;
+    const bool mBegin;
+    inline LocEngConfigBatch(LocEngAdapter* adapter, bool begin) :
+        LocMsg(), mAdapter(adapter), mBegin(begin)
+    {
+        locallog();
+    }
+    inline virtual void proc() const {
+        if (mBegin) {
+            mAdapter->beginConfigBatch();
+        } else {
+            mAdapter->endConfigBatch();
+        }
+    }
+    inline void locallog() const {
+        LOC_LOGV("LocEngConfigBatch - %s", mBegin ? "begin" : "end");
+    }
+    inline virtual void log() const {
+        locallog();
+    }
+};
+
+struct LocEngReplayModemState : public LocMsg {
+    LocEngAdapter* mAdapter;
+    inline LocEngReplayModemState(LocEngAdapter* adapter) :
+        LocMsg(), mAdapter(adapter)
+    {
+        locallog();
+    }
+    inline virtual void proc() const {
+        mAdapter->replayModemState();
+    }
+    inline void locallog() const {
+        LOC_LOGV("LocEngReplayModemState");
+    }
+    inline virtual void log() const {
+        locallog();
+    }
+};
+
 //        case LOC_ENG_MSG_SET_SENSOR_CONTROL_CONFIG:
 struct LocEngSensorControlConfig : public LocMsg {
     LocEngAdapter* mAdapter;
@@ -734,17 +809,33 @@ LocEngReportPosition::LocEngReportPosition(LocAdapterBase* adapter,
     mLocationExt(((loc_eng_data_s_type*)
                   ((LocEngAdapter*)
                    (mAdapter))->getOwner())->location_ext_parser(locExt)),
-    mStatus(st), mTechMask(technology)
+    mStatus(st), mTechMask(technology),
+    mTraceId(loc_fix_trace_current())
 {
+    loc_fix_trace_stamp(mTraceId, LOC_FIX_TRACE_ENQUEUE);
     locallog();
 }
 void LocEngReportPosition::proc() const {
     LocEngAdapter* adapter = (LocEngAdapter*)mAdapter;
     loc_eng_data_s_type* locEng = (loc_eng_data_s_type*)adapter->getOwner();
 
+    loc_fix_trace_stamp(mTraceId, LOC_FIX_TRACE_DEQUEUE);
+
+    // a fix goes to the framework if its interval is due; one of an NI or
+    // emergency session, or one that no client asked for, goes to it as
+    // well, even while the geofencer has a session of its own. The
+    // geofencer looks at every fix, whoever it is for; isPositionWanted()
+    // lets them all through while it has active fences.
+    bool niFix = loc_eng_ni_session_active(*locEng);
+    bool afwFix = niFix || !adapter->hasClientSession() ||
+                  (adapter->dispatchFix(mStatus) &
+                   LOC_ENG_SESSION_BIT(LOC_ENG_SESSION_AFW));
+    loc_eng_geofence_report_position(*locEng, mLocation.gpsLocation, mStatus);
+
     if (locEng->mute_session_state != LOC_MUTE_SESS_IN_SESSION) {
         bool reported = false;
-        if (locEng->location_cb != NULL) {
+        bool batched = false;
+        if (locEng->location_cb != NULL && afwFix) {
             if (LOC_SESS_FAILURE == mStatus) {
                 // in case we want to handle the failure case
                 locEng->location_cb(NULL, NULL);
@@ -771,22 +862,54 @@ void LocEngReportPosition::proc() const {
                         (gps_conf.ACCURACY_THRES != 0) &&
                         (mLocation.gpsLocation.accuracy >
                          gps_conf.ACCURACY_THRES)))) {
-                locEng->location_cb((UlpLocation*)&(mLocation),
-                                    (void*)mLocationExt);
-                reported = true;
+                loc_eng_ttff_milestone milestone =
+                    LOC_SESS_SUCCESS == mStatus ?
+                    LOC_ENG_TTFF_FIRST_FIX : LOC_ENG_TTFF_FIRST_INTERMEDIATE;
+                // a batched fix is marked when the batch is delivered
+                batched = loc_eng_batch_report_position(*locEng, mLocation,
+                                                        milestone);
+                if (!batched) {
+                    loc_fix_trace_stamp(mTraceId, LOC_FIX_TRACE_CB_ENTER);
+                    locEng->location_cb((UlpLocation*)&(mLocation),
+                                        (void*)mLocationExt);
+                    loc_fix_trace_stamp(mTraceId, LOC_FIX_TRACE_CB_RETURN);
+                    reported = true;
+                    loc_eng_ttff_mark(milestone);
+                }
             }
         }
 
+        // the interval only restarts once a fix has made it through
+        if (LOC_SESS_SUCCESS == mStatus && (reported || batched)) {
+            adapter->fixDelivered(LOC_ENG_SESSION_AFW);
+        }
+
+        if (LOC_SESS_SUCCESS == mStatus) {
+            loc_eng_lkp_update(mLocation, mTechMask);
+            adapter->updateZppCache(mLocation.gpsLocation, mTechMask);
+        }
+
+        if (reported && LOC_SESS_FAILURE != mStatus &&
+            locEng->ssr_up_time_ms != 0) {
+            int64_t now = elapsedMillisSinceBoot();
+            LOC_LOGI("LocEngReportPosition::proc() - first fix after modem "
+                     "restart #%u: down %lld ms, up to fix %lld ms, total %lld ms",
+                     locEng->ssr_count,
+                     locEng->ssr_up_time_ms - locEng->ssr_down_time_ms,
+                     now - locEng->ssr_up_time_ms,
+                     now - locEng->ssr_down_time_ms);
+            locEng->ssr_down_time_ms = 0;
+            locEng->ssr_up_time_ms = 0;
+        }
+
         // if we have reported this fix
         if (reported &&
             // and if this is a singleshot
             GPS_POSITION_RECURRENCE_SINGLE ==
             locEng->adapter->getPositionMode().recurrence) {
-            if (LOC_SESS_INTERMEDIATE == mStatus) {
-                // modem could be still working for a final fix,
-                // although we no longer need it.  So stopFix().
-                locEng->adapter->stopFix();
-            }
+            // modem could be still working for a final fix, or for
+            // other clients, although we no longer need it.
+            locEng->adapter->stopSession(LOC_ENG_SESSION_AFW);
             // turn off the session flag.
             locEng->adapter->setInSession(false);
         }
@@ -796,8 +919,9 @@ void LocEngReportPosition::proc() const {
                         locEng->generateNmea, mLocation.position_source,
                         locEng->engine_status, locEng->adapter->isInSession());
 
+        // by the time a batch is delivered, its NMEA would be stale
         if (locEng->generateNmea &&
-            locEng->adapter->isInSession())
+            locEng->adapter->isInSession() && afwFix && !batched)
         {
             unsigned char generate_nmea = reported &&
                                           (mStatus != LOC_SESS_FAILURE);
@@ -814,6 +938,7 @@ void LocEngReportPosition::proc() const {
             gp->rawDataSize = 0;
         }
     }
+    loc_fix_trace_end(mTraceId);
 }
 void LocEngReportPosition::locallog() const {
     LOC_LOGV("LocEngReportPosition");
@@ -1044,6 +1169,31 @@ struct LocEngReleaseBIT : public LocMsg {
     }
 };
 
+// releases the NIFs still lingering when the engine is cleaned up
+struct LocEngEndLinger : public LocMsg {
+    loc_eng_data_s_type* mLocEng;
+    inline LocEngEndLinger(loc_eng_data_s_type* locEng) :
+        LocMsg(), mLocEng(locEng)
+    {
+        locallog();
+    }
+    inline virtual void proc() const
+    {
+        if (NULL != mLocEng->agnss_nif) {
+            mLocEng->agnss_nif->endLinger();
+        }
+        if (NULL != mLocEng->internet_nif) {
+            mLocEng->internet_nif->endLinger();
+        }
+    }
+    inline void locallog() const {
+        LOC_LOGV("LocEngEndLinger");
+    }
+    virtual void log() const {
+        locallog();
+    }
+};
+
 //        LocEngSuplEsOpened
 LocEngSuplEsOpened::LocEngSuplEsOpened(void* locEng) :
     LocMsg(), mLocEng(locEng) {
@@ -1054,6 +1204,8 @@ void LocEngSuplEsOpened::proc() const {
     if (locEng->ds_nif) {
         AgpsStateMachine* sm = locEng->ds_nif;
         sm->onRsrcEvent(RSRC_GRANTED);
+        // DS data call up through ds_client
+        loc_eng_ttff_mark(LOC_ENG_TTFF_DATA_CALL);
     }
 }
 void LocEngSuplEsOpened::locallog() const {
@@ -1123,6 +1275,7 @@ LocEngRequestATL::LocEngRequestATL(void* locEng, int id,
 }
 void LocEngRequestATL::proc() const {
     loc_eng_data_s_type* locEng = (loc_eng_data_s_type*)mLocEng;
+    loc_eng_ttff_mark(LOC_ENG_TTFF_ATL_REQUEST);
     AgpsStateMachine* sm = (AgpsStateMachine*)
                            getAgpsStateMachine(*locEng, mType);
     if (sm) {
@@ -1149,6 +1302,8 @@ LocEngReleaseATL::LocEngReleaseATL(void* locEng, int id) :
 }
 void LocEngReleaseATL::proc() const {
     loc_eng_data_s_type* locEng = (loc_eng_data_s_type*)mLocEng;
+    // the modem releases the ATL once it is done with the SUPL server
+    loc_eng_ttff_mark(LOC_ENG_TTFF_SUPL_DONE);
 
    if (locEng->agnss_nif) {
         ATLSubscriber s1(mID, locEng->agnss_nif, locEng->adapter, false);
@@ -1250,6 +1405,8 @@ void LocEngRequestXtra::proc() const
     loc_eng_xtra_data_s_type* locEngXtra =
         &(((loc_eng_data_s_type*)mLocEng)->xtra_module_data);
 
+    loc_eng_ttff_mark(LOC_ENG_TTFF_XTRA_REQUEST);
+
     if (locEngXtra->download_request_cb != NULL) {
         CALLBACK_LOG_CALLFLOW("download_request_cb", %p, mLocEng);
         locEngXtra->download_request_cb();
@@ -1272,6 +1429,7 @@ LocEngRequestTime::LocEngRequestTime(void* locEng) :
 }
 void LocEngRequestTime::proc() const {
     loc_eng_data_s_type* locEng = (loc_eng_data_s_type*)mLocEng;
+    loc_eng_ttff_mark(LOC_ENG_TTFF_TIME_REQUEST);
     if (gps_conf.CAPABILITIES & GPS_CAPABILITY_ON_DEMAND_TIME) {
         if (locEng->request_utc_time_cb != NULL) {
             locEng->request_utc_time_cb();
@@ -1300,6 +1458,7 @@ struct LocEngDelAidData : public LocMsg {
     inline virtual void proc() const {
         mLocEng->aiding_data_for_deletion = mType;
         update_aiding_data_for_deletion(*mLocEng);
+        loc_eng_ttff_aiding_deleted(mType);
     }
     inline void locallog() const {
         LOC_LOGV("aiding data msak %d", mType);
@@ -1429,6 +1588,7 @@ struct LocEngAtlOpenSuccess : public LocMsg {
         mStateMachine->setBearer(mBearerType);
         mStateMachine->setAPN(mAPN, mLen);
         mStateMachine->onRsrcEvent(RSRC_GRANTED);
+        loc_eng_ttff_mark(LOC_ENG_TTFF_DATA_CALL);
     }
     inline void locallog() const {
         LOC_LOGV("LocEngAtlOpenSuccess agps type: %s\n  apn: %s\n"
@@ -1578,23 +1738,23 @@ struct LocEngInstallAGpsCert : public LocMsg {
     }
 };
 
-struct LocEngUpdateRegistrationMask : public LocMsg {
+struct LocEngUpdateConsumers : public LocMsg {
     loc_eng_data_s_type* mLocEng;
     LOC_API_ADAPTER_EVENT_MASK_T mMask;
-    loc_registration_mask_status mIsEnabled;
-    inline LocEngUpdateRegistrationMask(loc_eng_data_s_type* locEng,
-                                        LOC_API_ADAPTER_EVENT_MASK_T mask,
-                                        loc_registration_mask_status isEnabled) :
-        LocMsg(), mLocEng(locEng), mMask(mask), mIsEnabled(isEnabled) {
+    bool mIsAdded;
+    inline LocEngUpdateConsumers(loc_eng_data_s_type* locEng,
+                                 LOC_API_ADAPTER_EVENT_MASK_T mask,
+                                 bool isAdded) :
+        LocMsg(), mLocEng(locEng), mMask(mask), mIsAdded(isAdded) {
         locallog();
     }
     inline virtual void proc() const {
         loc_eng_data_s_type *locEng = (loc_eng_data_s_type *)mLocEng;
-        locEng->adapter->updateRegistrationMask(mMask,
-                                                mIsEnabled);
+        locEng->adapter->updateConsumers(mMask, mIsAdded);
     }
     void locallog() const {
-        LOC_LOGV("LocEngUpdateRegistrationMask\n");
+        LOC_LOGV("LocEngUpdateConsumers - mask: %x %s\n",
+                 mMask, mIsAdded ? "added" : "removed");
     }
     virtual void log() const {
         locallog();
@@ -1624,48 +1784,65 @@ struct LocEngGnssConstellationConfig : public LocMsg {
 };
 
 //        case LOC_ENG_MSG_REPORT_GNSS_MEASUREMENT:
-LocEngReportGpsMeasurement::LocEngReportGpsMeasurement(void* locEng,
-                                                       GpsData &gpsData) :
-    LocMsg(), mLocEng(locEng), mGpsData(gpsData)
+LocEngReportGpsMeasurement::LocEngReportGpsMeasurement(LocEngAdapter* adapter) :
+    LocMsg(), mAdapter(adapter)
 {
     locallog();
 }
+static void loc_eng_log_gps_measurement(const GpsData* gpsData)
+{
+    LOC_LOGV("%s:%d]: Received in GPS HAL."
+             "GNSS Measurements count: %d \n",
+             __func__, __LINE__, gpsData->measurement_count);
+    for (int i =0; i< gpsData->measurement_count && i < GPS_MAX_SVS; i++) {
+            LOC_LOGV(" GNSS measurement data in GPS HAL: \n"
+                     " GPS_HAL => Measurement ID | prn | time_offset_ns | state |"
+                     " received_gps_tow_ns| c_n0_dbhz | pseudorange_rate_mps |"
+                     " pseudorange_rate_uncertainty_mps |"
+                     " accumulated_delta_range_state | flags \n"
+                     " GPS_HAL => %d | %d | %f | %d | %lld | %f | %f | %f | %d | %d \n",
+                     i,
+                     gpsData->measurements[i].prn,
+                     gpsData->measurements[i].time_offset_ns,
+                     gpsData->measurements[i].state,
+                     gpsData->measurements[i].received_gps_tow_ns,
+                     gpsData->measurements[i].c_n0_dbhz,
+                     gpsData->measurements[i].pseudorange_rate_mps,
+                     gpsData->measurements[i].pseudorange_rate_uncertainty_mps,
+                     gpsData->measurements[i].accumulated_delta_range_state,
+                     gpsData->measurements[i].flags);
+    }
+    LOC_LOGV(" GPS_HAL => Clocks Info: type | time_ns \n"
+             " GPS_HAL => Clocks Info: %d | %lld", gpsData->clock.type,
+             gpsData->clock.time_ns);
+}
 void LocEngReportGpsMeasurement::proc() const {
-    loc_eng_data_s_type* locEng = (loc_eng_data_s_type*) mLocEng;
-    if (locEng->mute_session_state != LOC_MUTE_SESS_IN_SESSION)
-    {
-        if (locEng->gps_measurement_cb != NULL) {
-            locEng->gps_measurement_cb((GpsData*)&(mGpsData));
+    loc_eng_data_s_type* locEng = (loc_eng_data_s_type*) mAdapter->getOwner();
+    GpsData* gpsData;
+
+    // one message is sent per epoch, but an earlier message may have
+    // drained this epoch already
+    while (NULL != (gpsData = mAdapter->peekGpsMeasurement())) {
+        IF_LOC_LOGV {
+            loc_eng_log_gps_measurement(gpsData);
         }
+        if (locEng->mute_session_state != LOC_MUTE_SESS_IN_SESSION)
+        {
+            if (locEng->gps_measurement_cb != NULL) {
+                locEng->gps_measurement_cb(gpsData);
+            }
+        }
+        mAdapter->releaseGpsMeasurement();
+    }
+
+    int32_t dropped = mAdapter->getNewlyDroppedGpsMeasurements();
+    if (dropped > 0) {
+        LOC_LOGW("%s:%d]: %d GNSS measurement epochs dropped, "
+                 "the measurement ring was full", __func__, __LINE__, dropped);
     }
 }
 void LocEngReportGpsMeasurement::locallog() const {
-    IF_LOC_LOGV {
-        LOC_LOGV("%s:%d]: Received in GPS HAL."
-                 "GNSS Measurements count: %d \n",
-                 __func__, __LINE__, mGpsData.measurement_count);
-        for (int i =0; i< mGpsData.measurement_count && i < GPS_MAX_SVS; i++) {
-                LOC_LOGV(" GNSS measurement data in GPS HAL: \n"
-                         " GPS_HAL => Measurement ID | prn | time_offset_ns | state |"
-                         " received_gps_tow_ns| c_n0_dbhz | pseudorange_rate_mps |"
-                         " pseudorange_rate_uncertainty_mps |"
-                         " accumulated_delta_range_state | flags \n"
-                         " GPS_HAL => %d | %d | %f | %d | %lld | %f | %f | %f | %d | %d \n",
-                         i,
-                         mGpsData.measurements[i].prn,
-                         mGpsData.measurements[i].time_offset_ns,
-                         mGpsData.measurements[i].state,
-                         mGpsData.measurements[i].received_gps_tow_ns,
-                         mGpsData.measurements[i].c_n0_dbhz,
-                         mGpsData.measurements[i].pseudorange_rate_mps,
-                         mGpsData.measurements[i].pseudorange_rate_uncertainty_mps,
-                         mGpsData.measurements[i].accumulated_delta_range_state,
-                         mGpsData.measurements[i].flags);
-        }
-        LOC_LOGV(" GPS_HAL => Clocks Info: type | time_ns \n"
-                 " GPS_HAL => Clocks Info: %d | %lld", mGpsData.clock.type,
-                 mGpsData.clock.time_ns);
-    }
+    LOC_LOGV("LocEngReportGpsMeasurement");
 }
 inline void LocEngReportGpsMeasurement::log() const {
     locallog();
@@ -1767,12 +1944,28 @@ int loc_eng_init(loc_eng_data_s_type &loc_eng_data, LocCallbacks* callbacks,
         loc_eng_data.generateNmea = false;
     }
 
+    // only register the reports that have a framework callback to go to;
+    // SV reports also feed the NMEA we generate
+    if (NULL == loc_eng_data.nmea_cb)
+    {
+        event &= ~(LOC_API_ADAPTER_BIT_NMEA_1HZ_REPORT |
+                   LOC_API_ADAPTER_BIT_NMEA_POSITION_REPORT);
+    }
+    if (NULL == loc_eng_data.sv_status_cb &&
+        !(loc_eng_data.generateNmea && NULL != loc_eng_data.nmea_cb))
+    {
+        event &= ~LOC_API_ADAPTER_BIT_SATELLITE_REPORT;
+    }
+
     loc_eng_data.adapter =
         new LocEngAdapter(event, &loc_eng_data, context,
                           (LocThread::tCreate)callbacks->create_thread_cb);
 
     LOC_LOGD("loc_eng_init created client, id = %p\n",
              loc_eng_data.adapter);
+    loc_eng_data.adapter->setZppCacheConfig(gps_conf.ZPP_CACHE_TTL,
+                                            gps_conf.ZPP_CACHE_MAX_ACCURACY,
+                                            gps_conf.LAST_POSITION_AGING_SPEED);
     loc_eng_data.adapter->sendMsg(new LocEngInit(&loc_eng_data));
 
     EXIT_LOG(%d, ret_val);
@@ -1786,6 +1979,8 @@ static int loc_eng_reinit(loc_eng_data_s_type &loc_eng_data)
     LocEngAdapter* adapter = loc_eng_data.adapter;
 
     adapter->sendMsg(new LocEngGnssConstellationConfig(adapter));
+    // let the LocApi send the configuration below to the modem together
+    adapter->sendMsg(new LocEngConfigBatch(adapter, true));
     adapter->sendMsg(new LocEngSuplVer(adapter, gps_conf.SUPL_VER));
     adapter->sendMsg(new LocEngLppConfig(adapter, gps_conf.LPP_PROFILE));
     adapter->sendMsg(new LocEngSensorControlConfig(adapter, sap_conf.SENSOR_USAGE,
@@ -1822,11 +2017,17 @@ static int loc_eng_reinit(loc_eng_data_s_type &loc_eng_data)
                                                        sap_conf.SENSOR_GYRO_SAMPLES_PER_BATCH_HIGH,
                                                        sap_conf.SENSOR_GYRO_BATCHES_PER_SEC_HIGH,
                                                        sap_conf.SENSOR_ALGORITHM_CONFIG_MASK));
+    // settings applied at run time, only present after a modem restart
+    adapter->sendMsg(new LocEngReplayModemState(adapter));
+    adapter->sendMsg(new LocEngConfigBatch(adapter, false));
 
     adapter->sendMsg(new LocEngEnableData(adapter, NULL, 0, (agpsStatus ? 1:0)));
 
     loc_eng_xtra_version_check(loc_eng_data, gps_conf.XTRA_VERSION_CHECK);
 
+    // warm up the engine with the last XTRA file we have on disk
+    loc_eng_xtra_inject_cached_data(loc_eng_data);
+
     LOC_LOGD("loc_eng_reinit reinit() successful");
     EXIT_LOG(%d, ret_val);
     return ret_val;
@@ -1873,6 +2074,9 @@ void loc_eng_cleanup(loc_eng_data_s_type &loc_eng_data)
         loc_eng_stop(loc_eng_data);
     }
 
+    // the state machines stay, but a NIF kept up for reuse is not needed
+    loc_eng_data.adapter->sendMsg(new LocEngEndLinger(&loc_eng_data));
+
 #if 0 // can't afford to actually clean up, for many reason.
 
     LOC_LOGD("loc_eng_init: client opened. close it now.");
@@ -1924,7 +2128,13 @@ static int loc_eng_start_handler(loc_eng_data_s_type &loc_eng_data)
    int ret_val = LOC_API_ADAPTER_ERR_SUCCESS;
 
    if (!loc_eng_data.adapter->isInSession()) {
-       ret_val = loc_eng_data.adapter->startFix();
+       loc_eng_ttff_start();
+
+       // seed the engine with where we were last seen
+       loc_eng_lkp_inject(loc_eng_data);
+
+       ret_val = loc_eng_data.adapter->startSession(LOC_ENG_SESSION_AFW,
+                                                    NULL);
 
        if (ret_val == LOC_API_ADAPTER_ERR_SUCCESS ||
            ret_val == LOC_API_ADAPTER_ERR_ENGINE_DOWN ||
@@ -1932,6 +2142,8 @@ static int loc_eng_start_handler(loc_eng_data_s_type &loc_eng_data)
            ret_val == LOC_API_ADAPTER_ERR_INTERNAL)
        {
            loc_eng_data.adapter->setInSession(TRUE);
+       } else {
+           loc_eng_data.adapter->stopSession(LOC_ENG_SESSION_AFW);
        }
    }
 
@@ -1976,8 +2188,10 @@ static int loc_eng_stop_handler(loc_eng_data_s_type &loc_eng_data)
 
    if (loc_eng_data.adapter->isInSession()) {
 
-       ret_val = loc_eng_data.adapter->stopFix();
+       loc_eng_batch_session_stopped(loc_eng_data);
+       ret_val = loc_eng_data.adapter->stopSession(LOC_ENG_SESSION_AFW);
        loc_eng_data.adapter->setInSession(FALSE);
+       loc_eng_ttff_stop();
    }
 
     EXIT_LOG(%d, ret_val);
@@ -2250,15 +2464,19 @@ static void loc_eng_agps_reinit(loc_eng_data_s_type &loc_eng_data)
 {
     ENTRY_LOG();
 
-    // Set server addresses which came before init
-    if (loc_eng_data.supl_host_set)
+    // Set server addresses which came before init. After a modem
+    // restart, servers already sent are replayed by the adapter with
+    // their resolved addresses, so they are skipped here.
+    if (loc_eng_data.supl_host_set &&
+        !loc_eng_data.adapter->hasModemStateServer(LOC_AGPS_SUPL_SERVER))
     {
         loc_eng_set_server(loc_eng_data, LOC_AGPS_SUPL_SERVER,
                            loc_eng_data.supl_host_buf,
                            loc_eng_data.supl_port_buf);
     }
 
-    if (loc_eng_data.c2k_host_set)
+    if (loc_eng_data.c2k_host_set &&
+        !loc_eng_data.adapter->hasModemStateServer(LOC_AGPS_CDMA_PDE_SERVER))
     {
         loc_eng_set_server(loc_eng_data, LOC_AGPS_CDMA_PDE_SERVER,
                            loc_eng_data.c2k_host_buf,
@@ -2301,6 +2519,8 @@ void loc_eng_agps_init(loc_eng_data_s_type &loc_eng_data, AGpsExtCallbacks* call
                                                      (void *)loc_eng_data.agps_status_cb,
                                                      AGPS_TYPE_WWAN_ANY,
                                                      false);
+    loc_eng_data.internet_nif->setLinger(adapter,
+                                         gps_conf.AGPS_DATA_CONN_LINGER_SEC * 1000);
     loc_eng_data.wifi_nif = new AgpsStateMachine(servicerTypeAgps,
                                                  (void *)loc_eng_data.agps_status_cb,
                                                  AGPS_TYPE_WIFI,
@@ -2312,13 +2532,18 @@ void loc_eng_agps_init(loc_eng_data_s_type &loc_eng_data, AGpsExtCallbacks* call
                                                       (void *)loc_eng_data.agps_status_cb,
                                                       AGPS_TYPE_SUPL,
                                                       false);
+        loc_eng_data.agnss_nif->setLinger(adapter,
+                                          gps_conf.AGPS_DATA_CONN_LINGER_SEC * 1000);
 
         if (adapter->mSupportsAgpsRequests) {
             if(gps_conf.USE_EMERGENCY_PDN_FOR_EMERGENCY_SUPL) {
                 loc_eng_data.adapter->sendMsg(new LocEngDataClientInit(&loc_eng_data));
             }
             loc_eng_dmn_conn_loc_api_server_launch(callbacks->create_thread_cb,
-                                                   NULL, NULL, &loc_eng_data);
+                                                   NULL, NULL,
+                                                   gps_conf.AGPS_DMN_CONN_SOCKET ?
+                                                   GPSONE_LOC_API_SOCK_PATH : NULL,
+                                                   &loc_eng_data);
         }
         loc_eng_agps_reinit(loc_eng_data);
     }
@@ -2461,49 +2686,6 @@ int loc_eng_agps_open_failed(loc_eng_data_s_type &loc_eng_data, AGpsExtType agps
     return 0;
 }
 
-/*===========================================================================
-
-FUNCTION resolve_in_addr
-
-DESCRIPTION
-   Translates a hostname to in_addr struct
-
-DEPENDENCIES
-   n/a
-
-RETURN VALUE
-   TRUE if successful
-
-SIDE EFFECTS
-   n/a
-
-===========================================================================*/
-static boolean resolve_in_addr(const char *host_addr, struct in_addr *in_addr_ptr)
-{
-    ENTRY_LOG();
-    boolean ret_val = TRUE;
-
-    struct hostent             *hp;
-    hp = gethostbyname(host_addr);
-    if (hp != NULL) /* DNS OK */
-    {
-        memcpy(in_addr_ptr, hp->h_addr_list[0], hp->h_length);
-    }
-    else
-    {
-        /* Try IP representation */
-        if (inet_aton(host_addr, in_addr_ptr) == 0)
-        {
-            /* IP not valid */
-            LOC_LOGE("DNS query on '%s' failed\n", host_addr);
-            ret_val = FALSE;
-        }
-    }
-
-    EXIT_LOG(%s, loc_logger_boolStr[ret_val!=0]);
-    return ret_val;
-}
-
 /*===========================================================================
 FUNCTION    loc_eng_set_server
 
@@ -2545,14 +2727,9 @@ static int loc_eng_set_server(loc_eng_data_s_type &loc_eng_data,
     } else if (LOC_AGPS_CDMA_PDE_SERVER == type ||
                LOC_AGPS_CUSTOM_PDE_SERVER == type ||
                LOC_AGPS_MPC_SERVER == type) {
-        struct in_addr addr;
-        if (!resolve_in_addr(hostname, &addr))
-        {
+        ret = loc_eng_dns_set_server(adapter, type, hostname, port);
+        if (0 != ret) {
             LOC_LOGE("loc_eng_set_server, hostname %s cannot be resolved.\n", hostname);
-            ret = -2;
-        } else {
-            unsigned int ip = htonl(addr.s_addr);
-            adapter->sendMsg(new LocEngSetServerIpv4(adapter, ip, port, type));
         }
     } else {
         LOC_LOGE("loc_eng_set_server, type %d cannot be resolved.\n", type);
@@ -2602,6 +2779,10 @@ int loc_eng_set_server_proxy(loc_eng_data_s_type &loc_eng_data,
                 sizeof(loc_eng_data.c2k_host_buf));
         loc_eng_data.c2k_port_buf = port;
         loc_eng_data.c2k_host_set = 1;
+        // resolve it while the client is not open yet
+        if (NULL == loc_eng_data.adapter) {
+            loc_eng_dns_prefetch(hostname);
+        }
         break;
     default:
         LOC_LOGE("loc_eng_set_server_proxy, unknown server type = %d", (int) type);
@@ -2772,6 +2953,12 @@ static void loc_eng_report_status (loc_eng_data_s_type &loc_eng_data, GpsStatusV
         }
     }
 
+    // An NI session ends with the engine's session
+    if (status == GPS_STATUS_SESSION_END || status == GPS_STATUS_ENGINE_OFF)
+    {
+        loc_eng_ni_session_ended(loc_eng_data);
+    }
+
     // Switch off MUTE session
     if (loc_eng_data.mute_session_state == LOC_MUTE_SESS_IN_SESSION &&
         (status == GPS_STATUS_SESSION_END || status == GPS_STATUS_ENGINE_OFF))
@@ -2832,6 +3019,9 @@ SIDE EFFECTS
 void loc_eng_handle_engine_down(loc_eng_data_s_type &loc_eng_data)
 {
     ENTRY_LOG();
+    loc_eng_data.ssr_down_time_ms = elapsedMillisSinceBoot();
+    loc_eng_data.ssr_up_time_ms = 0;
+    loc_eng_data.ssr_count++;
     loc_eng_ni_reset_on_engine_restart(loc_eng_data);
     loc_eng_report_status(loc_eng_data, GPS_STATUS_ENGINE_OFF);
     EXIT_LOG(%s, VOID_RET);
@@ -2840,6 +3030,9 @@ void loc_eng_handle_engine_down(loc_eng_data_s_type &loc_eng_data)
 void loc_eng_handle_engine_up(loc_eng_data_s_type &loc_eng_data)
 {
     ENTRY_LOG();
+    if (loc_eng_data.ssr_down_time_ms != 0) {
+        loc_eng_data.ssr_up_time_ms = elapsedMillisSinceBoot();
+    }
     loc_eng_reinit(loc_eng_data);
 
     loc_eng_data.adapter->requestPowerVote();
@@ -2854,10 +3047,12 @@ void loc_eng_handle_engine_up(loc_eng_data_s_type &loc_eng_data)
     }
 
     // modem is back up.  If we crashed in the middle of navigating, we restart.
-    if (loc_eng_data.adapter->isInSession()) {
-        // This sets the copy in adapter to modem
-        loc_eng_data.adapter->setInSession(false);
-        loc_eng_data.adapter->sendMsg(new LocEngStartFix(loc_eng_data.adapter));
+    if (loc_eng_data.adapter->hasClientSession()) {
+        if (loc_eng_data.adapter->isInSession()) {
+            loc_eng_ttff_start();
+        }
+        loc_eng_lkp_inject(loc_eng_data);
+        loc_eng_data.adapter->restartSession();
     }
     EXIT_LOG(%s, VOID_RET);
 }
@@ -2954,10 +3149,8 @@ int loc_eng_gps_measurement_init(loc_eng_data_s_type &loc_eng_data,
 
     // updated the mask
     LOC_API_ADAPTER_EVENT_MASK_T event = LOC_API_ADAPTER_BIT_GNSS_MEASUREMENT;
-    loc_eng_data.adapter->sendMsg(new LocEngUpdateRegistrationMask(
-                                                        &loc_eng_data,
-                                                        event,
-                                                        LOC_REGISTRATION_MASK_ENABLED));
+    loc_eng_data.adapter->sendMsg(new LocEngUpdateConsumers(&loc_eng_data,
+                                                            event, true));
     // set up the callback
     loc_eng_data.gps_measurement_cb = callbacks->measurement_callback;
     LOC_LOGD ("%s, event masks updated successfully", __func__);
@@ -2989,10 +3182,8 @@ void loc_eng_gps_measurement_close(loc_eng_data_s_type &loc_eng_data)
 
     // updated the mask
     LOC_API_ADAPTER_EVENT_MASK_T event = LOC_API_ADAPTER_BIT_GNSS_MEASUREMENT;
-    loc_eng_data.adapter->sendMsg(new LocEngUpdateRegistrationMask(
-                                                          &loc_eng_data,
-                                                          event,
-                                                          LOC_REGISTRATION_MASK_DISABLED));
+    loc_eng_data.adapter->sendMsg(new LocEngUpdateConsumers(&loc_eng_data,
+                                                            event, false));
     // set up the callback
     loc_eng_data.gps_measurement_cb = NULL;
     EXIT_LOG(%d, 0);
@@ -51,6 +51,8 @@ typedef unsigned char boolean;
 #include <loc.h>
 #include <loc_eng_xtra.h>
 #include <loc_eng_ni.h>
+#include <loc_eng_geofence.h>
+#include <loc_eng_batch.h>
 #include <loc_eng_agps.h>
 #include <loc_cfg.h>
 #include <loc_log.h>
@@ -99,6 +101,10 @@ typedef struct loc_eng_data_s
     AGpsStatusValue                agps_status;
     loc_eng_xtra_data_s_type       xtra_module_data;
     loc_eng_ni_data_s_type         loc_eng_ni_data;
+    // AP side geofencing, created by loc_eng_geofence_init
+    LocEngGeofencer*               geofence;
+    // AP side fix batching, created on first use
+    LocEngBatcher*                 batch;
 
     // AGPS state machines
     AgpsStateMachine*              agnss_nif;
@@ -137,6 +143,11 @@ typedef struct loc_eng_data_s
 
     loc_ext_parser location_ext_parser;
     loc_ext_parser sv_ext_parser;
+
+    // Modem restart recovery, for time to first fix after restart
+    int64_t ssr_down_time_ms;
+    int64_t ssr_up_time_ms;
+    uint32_t ssr_count;
 } loc_eng_data_s_type;
 
 /* GPS.conf support */
@@ -160,6 +171,19 @@ typedef struct loc_gps_cfg_s
     uint32_t       GPS_LOCK;
     uint32_t       A_GLONASS_POS_PROTOCOL_SELECT;
     uint32_t       AGPS_CERT_WRITABLE_MASK;
+    uint32_t       XTRA_CACHE_VALID_HOURS;
+    uint32_t       LAST_POSITION_MAX_AGE;
+    uint32_t       LAST_POSITION_AGING_SPEED;
+    uint32_t       ZPP_CACHE_TTL;
+    uint32_t       ZPP_CACHE_MAX_ACCURACY;
+    uint32_t       DNS_CACHE_TTL;
+    uint32_t       DNS_NEGATIVE_CACHE_TTL;
+    uint32_t       AGPS_DATA_CONN_LINGER_SEC;
+    uint32_t       AGPS_DMN_CONN_SOCKET;
+    uint32_t       AP_BATCH_SIZE;
+    uint32_t       AP_BATCH_MAX_DELAY_SEC;
+    uint32_t       AP_BATCH_MIN_INTERVAL_MSEC;
+    uint32_t       AP_BATCH_WAKEUP;
 } loc_gps_cfg_s_type;
 
 /* NOTE: the implementaiton of the parser casts number
@@ -246,6 +270,36 @@ int  loc_eng_xtra_inject_data(loc_eng_data_s_type &loc_eng_data,
                              char* data, int length);
 int  loc_eng_xtra_request_server(loc_eng_data_s_type &loc_eng_data);
 void loc_eng_xtra_version_check(loc_eng_data_s_type &loc_eng_data, int check);
+void loc_eng_xtra_inject_cached_data(loc_eng_data_s_type &loc_eng_data);
+
+//loc_eng_lkp functions
+void loc_eng_lkp_update(const UlpLocation &location, LocPosTechMask techMask);
+void loc_eng_lkp_inject(loc_eng_data_s_type &loc_eng_data);
+
+//loc_eng_ttff functions
+enum loc_eng_ttff_milestone {
+    LOC_ENG_TTFF_START = 0,
+    LOC_ENG_TTFF_POS_INJECT,
+    LOC_ENG_TTFF_TIME_REQUEST,
+    LOC_ENG_TTFF_TIME_INJECT,
+    LOC_ENG_TTFF_XTRA_REQUEST,
+    LOC_ENG_TTFF_XTRA_INJECT,
+    LOC_ENG_TTFF_ATL_REQUEST,
+    LOC_ENG_TTFF_DATA_CALL,
+    LOC_ENG_TTFF_SUPL_DONE,
+    LOC_ENG_TTFF_FIRST_INTERMEDIATE,
+    LOC_ENG_TTFF_FIRST_FIX,
+    LOC_ENG_TTFF_MILESTONE_MAX
+};
+void loc_eng_ttff_start();
+void loc_eng_ttff_mark(loc_eng_ttff_milestone milestone);
+void loc_eng_ttff_stop();
+void loc_eng_ttff_aiding_deleted(GpsAidingData f);
+
+//loc_eng_dns functions
+void loc_eng_dns_prefetch(const char* host);
+int loc_eng_dns_set_server(LocEngAdapter* adapter, LocServerType type,
+                           const char* host, int port);
 
 //loc_eng_ni functions
 extern void loc_eng_ni_init(loc_eng_data_s_type &loc_eng_data,
@@ -256,6 +310,38 @@ extern void loc_eng_ni_request_handler(loc_eng_data_s_type &loc_eng_data,
                                    const GpsNiNotification *notif,
                                    const void* passThrough);
 extern void loc_eng_ni_reset_on_engine_restart(loc_eng_data_s_type &loc_eng_data);
+extern bool loc_eng_ni_session_active(loc_eng_data_s_type &loc_eng_data);
+extern void loc_eng_ni_session_ended(loc_eng_data_s_type &loc_eng_data);
+
+//loc_eng_geofence functions
+extern void loc_eng_geofence_init(loc_eng_data_s_type &loc_eng_data,
+                                  GpsGeofenceCallbacks* callbacks);
+extern void loc_eng_geofence_add(loc_eng_data_s_type &loc_eng_data, int32_t id,
+                                 double latitude, double longitude,
+                                 double radius, int last_transition,
+                                 int monitor_transitions,
+                                 int notification_responsiveness_ms,
+                                 int unknown_timer_ms);
+extern void loc_eng_geofence_remove(loc_eng_data_s_type &loc_eng_data,
+                                    int32_t id);
+extern void loc_eng_geofence_pause(loc_eng_data_s_type &loc_eng_data,
+                                   int32_t id);
+extern void loc_eng_geofence_resume(loc_eng_data_s_type &loc_eng_data,
+                                    int32_t id, int monitor_transitions);
+extern bool loc_eng_geofence_wants_position(loc_eng_data_s_type &loc_eng_data);
+extern void loc_eng_geofence_report_position(loc_eng_data_s_type &loc_eng_data,
+                                             const GpsLocation &location,
+                                             enum loc_sess_status status);
+
+//loc_eng_batch functions
+extern int loc_eng_batch_start(loc_eng_data_s_type &loc_eng_data,
+                               const LocBatchOptions* options);
+extern int loc_eng_batch_stop(loc_eng_data_s_type &loc_eng_data);
+extern int loc_eng_batch_flush(loc_eng_data_s_type &loc_eng_data);
+extern bool loc_eng_batch_report_position(loc_eng_data_s_type &loc_eng_data,
+                                          const UlpLocation &location,
+                                          loc_eng_ttff_milestone milestone);
+extern void loc_eng_batch_session_stopped(loc_eng_data_s_type &loc_eng_data);
 
 void loc_eng_configuration_update (loc_eng_data_s_type &loc_eng_data,
                                    const char* config_data, int32_t length);
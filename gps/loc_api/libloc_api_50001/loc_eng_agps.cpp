@@ -37,48 +37,7 @@
 #include <loc_eng_dmn_conn_handler.h>
 #include <loc_eng_dmn_conn.h>
 #include <sys/time.h>
-
-//======================================================================
-// C callbacks
-//======================================================================
-
-// This is given to linked_list_add as the dealloc callback
-// data -- an instance of Subscriber
-static void deleteObj(void* data)
-{
-    delete (Subscriber*)data;
-}
-
-// This is given to linked_list_search() as the comparison callback
-// when the state manchine needs to process for particular subscriber
-// fromCaller -- caller provides this obj
-// fromList -- linked_list_search() function take this one from list
-static bool hasSubscriber(void* fromCaller, void* fromList)
-{
-    Notification* notification = (Notification*)fromCaller;
-    Subscriber* s1 = (Subscriber*)fromList;
-
-    return s1->forMe(*notification);
-}
-
-// This is gvien to linked_list_search() to notify subscriber objs
-// when the state machine needs to inform all subscribers of resource
-// status changes, e.g. when resource is GRANTED.
-// fromCaller -- caller provides this ptr to a Notification obj.
-// fromList -- linked_list_search() function take this one from list
-static bool notifySubscriber(void* fromCaller, void* fromList)
-{
-    Notification* notification = (Notification*)fromCaller;
-    Subscriber* s1 = (Subscriber*)fromList;
-
-    // we notify every subscriber indiscriminatively
-    // each subscriber decides if this notification is interesting.
-    return s1->notifyRsrcStatus(*notification) &&
-           // if we do not want to delete the subscriber from the
-           // the list, we must set this to false so this function
-           // returns false
-           notification->postNotifyDelete;
-}
+#include <LocTimer.h>
 
 //======================================================================
 // Notification
@@ -86,8 +45,9 @@ static bool notifySubscriber(void* fromCaller, void* fromList)
 const int Notification::BROADCAST_ALL = 0x80000000;
 const int Notification::BROADCAST_ACTIVE = 0x80000001;
 const int Notification::BROADCAST_INACTIVE = 0x80000002;
-const unsigned char DSStateMachine::MAX_START_DATA_CALL_RETRIES = 4;
-const unsigned int DSStateMachine::DATA_CALL_RETRY_DELAY_MSEC = 500;
+const unsigned char DSStateMachine::MAX_START_DATA_CALL_RETRIES = 5;
+const unsigned int DSStateMachine::DATA_CALL_RETRY_DELAY_MSEC = 100;
+const unsigned int DSStateMachine::DATA_CALL_RETRY_MAX_DELAY_MSEC = 1600;
 //======================================================================
 // Subscriber:  BITSubscriber / ATLSubscriber / WIFISubscriber
 //======================================================================
@@ -236,6 +196,116 @@ void DSSubscriber :: setInactive()
     mIsInactive = true;
     ((DSStateMachine *)mStateMachine)->informStatus(RSRC_UNSUBSCRIBE, ID);
 }
+//======================================================================
+// SubscriberRegistry
+//======================================================================
+SubscriberRegistry::SubscriberRegistry() :
+    mEntries(NULL), mCapacity(0), mCount(0), mActiveCount(0)
+{
+}
+
+SubscriberRegistry::~SubscriberRegistry()
+{
+    flush();
+    delete[] mEntries;
+}
+
+Subscriber* SubscriberRegistry::find(const Subscriber* subscriber) const
+{
+    for (unsigned int i = 0; i < mCount; i++) {
+        if (mEntries[i].id == subscriber->ID &&
+            mEntries[i].subscriber->equals(subscriber)) {
+            return mEntries[i].subscriber;
+        }
+    }
+    return NULL;
+}
+
+void SubscriberRegistry::add(Subscriber* subscriber)
+{
+    if (mCount == mCapacity) {
+        unsigned int capacity = (0 == mCapacity) ? 4 : mCapacity * 2;
+        Entry* entries = new Entry[capacity];
+        if (mCount > 0) {
+            memcpy(entries, mEntries, mCount * sizeof(Entry));
+        }
+        delete[] mEntries;
+        mEntries = entries;
+        mCapacity = capacity;
+    }
+
+    memmove(&mEntries[1], &mEntries[0], mCount * sizeof(Entry));
+    mEntries[0].id = subscriber->ID;
+    mEntries[0].subscriber = subscriber;
+    mCount++;
+    mActiveCount++;
+}
+
+void SubscriberRegistry::removeAt(unsigned int index)
+{
+    delete mEntries[index].subscriber;
+    memmove(&mEntries[index], &mEntries[index + 1],
+            (mCount - index - 1) * sizeof(Entry));
+    mCount--;
+    if (index < mActiveCount) {
+        mActiveCount--;
+    }
+}
+
+void SubscriberRegistry::setInactive(Subscriber* subscriber)
+{
+    for (unsigned int i = 0; i < mActiveCount; i++) {
+        if (mEntries[i].subscriber == subscriber) {
+            // becomes the newest of the inactive ones
+            Entry entry = mEntries[i];
+            memmove(&mEntries[i], &mEntries[i + 1],
+                    (mActiveCount - i - 1) * sizeof(Entry));
+            mEntries[--mActiveCount] = entry;
+            break;
+        }
+    }
+    subscriber->setInactive();
+}
+
+void SubscriberRegistry::notify(Notification& notification)
+{
+    unsigned int begin = 0;
+    unsigned int end = mCount;
+
+    if (NULL == notification.rcver) {
+        if (Notification::BROADCAST_ACTIVE == notification.groupID) {
+            end = mActiveCount;
+        } else if (Notification::BROADCAST_INACTIVE == notification.groupID) {
+            begin = mActiveCount;
+        }
+    }
+
+    for (unsigned int i = begin; i < end;) {
+        if (NULL != notification.rcver &&
+            mEntries[i].id != notification.rcver->ID) {
+            i++;
+            continue;
+        }
+        // each subscriber decides if this notification is interesting.
+        if (mEntries[i].subscriber->notifyRsrcStatus(notification) &&
+            notification.postNotifyDelete) {
+            removeAt(i);
+            end--;
+        } else {
+            i++;
+        }
+    }
+}
+
+void SubscriberRegistry::flush()
+{
+    for (unsigned int i = 0; i < mCount; i++) {
+        delete mEntries[i].subscriber;
+    }
+    mCount = 0;
+    mActiveCount = 0;
+}
+
 //======================================================================
 // AgpsState:  AgpsReleasedState / AgpsPendingState / AgpsAcquiredState
 //======================================================================
@@ -342,7 +412,7 @@ AgpsState* AgpsPendingState::onRsrcEvent(AgpsRsrcStatus event, void* data)
     {
         Subscriber* subscriber = (Subscriber*) data;
         if (subscriber->waitForCloseComplete()) {
-            subscriber->setInactive();
+            mStateMachine->setSubscriberInactive(subscriber);
         } else {
             // auto notify this subscriber of the unsubscribe
             Notification notification(subscriber, event, true);
@@ -441,7 +511,7 @@ AgpsState* AgpsAcquiredState::onRsrcEvent(AgpsRsrcStatus event, void* data)
     {
         Subscriber* subscriber = (Subscriber*) data;
         if (subscriber->waitForCloseComplete()) {
-            subscriber->setInactive();
+            mStateMachine->setSubscriberInactive(subscriber);
         } else {
             // auto notify this subscriber of the unsubscribe
             Notification notification(subscriber, event, true);
@@ -450,11 +520,16 @@ AgpsState* AgpsAcquiredState::onRsrcEvent(AgpsRsrcStatus event, void* data)
 
         // now check if there is any subscribers left
         if (!mStateMachine->hasSubscribers()) {
-            // no more subscribers, move to RELEASED state
-            nextState = mReleasedState;
-
-            // tell connecivity service we can release NIF
-            mStateMachine->sendRsrcRequest(GPS_RELEASE_AGPS_DATA_CONN);
+            if (((AgpsStateMachine*)mStateMachine)->startLinger()) {
+                // keep the NIF up a while for the next subscriber
+                nextState = mLingeringState;
+            } else {
+                // no more subscribers, move to RELEASED state
+                nextState = mReleasedState;
+
+                // tell connecivity service we can release NIF
+                mStateMachine->sendRsrcRequest(GPS_RELEASE_AGPS_DATA_CONN);
+            }
         } else if (!mStateMachine->hasActiveSubscribers()) {
             // only inactive subscribers, move to RELEASING state
             nextState = mReleasingState;
@@ -532,7 +607,7 @@ AgpsState* AgpsReleasingState::onRsrcEvent(AgpsRsrcStatus event, void* data)
     {
         Subscriber* subscriber = (Subscriber*) data;
         if (subscriber->waitForCloseComplete()) {
-            subscriber->setInactive();
+            mStateMachine->setSubscriberInactive(subscriber);
         } else {
             // auto notify this subscriber of the unsubscribe
             Notification notification(subscriber, event, true);
@@ -577,6 +652,66 @@ AgpsState* AgpsReleasingState::onRsrcEvent(AgpsRsrcStatus event, void* data)
              whoami(), nextState->whoami(), event);
     return nextState;
 }
+// AgpsLingeringState, the NIF is up with no subscriber, until either
+// a new subscriber takes it over or the linger period is over
+class AgpsLingeringState : public AgpsState
+{
+    friend class AgpsStateMachine;
+
+    inline AgpsLingeringState(AgpsStateMachine* stateMachine) :
+        AgpsState(stateMachine)
+    { mLingeringState = this; }
+
+    inline ~AgpsLingeringState() {}
+public:
+    virtual AgpsState* onRsrcEvent(AgpsRsrcStatus event, void* data);
+    inline virtual char* whoami() {return (char*)"AgpsLingeringState";}
+};
+
+AgpsState* AgpsLingeringState::onRsrcEvent(AgpsRsrcStatus event, void* data)
+{
+    AgpsState* nextState = this;
+    LOC_LOGD("AgpsLingeringState::onRsrcEvent; event:%d\n", (int)event);
+    switch (event)
+    {
+    case RSRC_SUBSCRIBE:
+    {
+        // the NIF is still up, grant it right away
+        Subscriber* subscriber = (Subscriber*) data;
+        Notification notification(subscriber, RSRC_GRANTED, false);
+        subscriber->notifyRsrcStatus(notification);
+        mStateMachine->addSubscriber(subscriber);
+        ((AgpsStateMachine*)mStateMachine)->onLingerReused();
+        nextState = mAcquiredState;
+    }
+        break;
+
+    case RSRC_UNSUBSCRIBE:
+    {
+        // nobody to remove, but tell the client it is unsubscribed
+        Subscriber* subscriber = (Subscriber*) data;
+        Notification notification(subscriber, event, false);
+        subscriber->notifyRsrcStatus(notification);
+    }
+        break;
+
+    case RSRC_RELEASED:
+        // the NIF went down by itself, nobody to tell
+        nextState = mReleasedState;
+        break;
+
+    case RSRC_GRANTED:
+    case RSRC_DENIED:
+    default:
+        LOC_LOGW("%s: unrecognized event %d", whoami(), event);
+        // no state change.
+    }
+
+    LOC_LOGD("onRsrcEvent, old state %s, new state %s, event %d",
+             whoami(), nextState->whoami(), event);
+    return nextState;
+}
+
 //======================================================================
 //Servicer
 //======================================================================
@@ -620,6 +755,44 @@ int AGpsServicer :: requestRsrc(void *cb_data)
 // AgpsStateMachine
 //======================================================================
 
+// posted to the msg task when a linger period is over
+struct AgpsLingerExpired : public LocMsg {
+    AgpsStateMachine* mStateMachine;
+    const unsigned int mGeneration;
+    inline AgpsLingerExpired(AgpsStateMachine* stateMachine,
+                             unsigned int generation) :
+        LocMsg(), mStateMachine(stateMachine), mGeneration(generation) {
+        locallog();
+    }
+    inline virtual void proc() const {
+        mStateMachine->onLingerExpired(mGeneration);
+    }
+    inline void locallog() const {
+        LOC_LOGV("AgpsLingerExpired agps type: %s generation: %u",
+                 loc_get_agps_type_name(mStateMachine->getType()),
+                 mGeneration);
+    }
+    inline virtual void log() const {
+        locallog();
+    }
+};
+
+// fires at the end of a linger period, and hands it to the msg task
+class AgpsLingerTimer : public LocTimer {
+    LocEngAdapter* const mAdapter;
+    AgpsStateMachine* const mStateMachine;
+public:
+    // set on the msg task before each start()
+    unsigned int mGeneration;
+    inline AgpsLingerTimer(LocEngAdapter* adapter,
+                           AgpsStateMachine* stateMachine) :
+        LocTimer(), mAdapter(adapter), mStateMachine(stateMachine),
+        mGeneration(0) {}
+    inline virtual void timeOutCallback() {
+        mAdapter->sendMsg(new AgpsLingerExpired(mStateMachine, mGeneration));
+    }
+};
+
 AgpsStateMachine::AgpsStateMachine(servicerType servType,
                                    void *cb_func,
                                    AGpsExtType type,
@@ -629,19 +802,24 @@ AgpsStateMachine::AgpsStateMachine(servicerType servType,
     mAPNLen(0),
     mBearer(AGPS_APN_BEARER_INVALID),
     mEnforceSingleSubscriber(enforceSingleSubscriber),
+    mLingerMsec(0),
+    mLingerGeneration(0),
+    mLingerTimer(NULL),
+    mLingerReuses(0),
+    mLingerExpiries(0),
     mServicer(Servicer :: getServicer(servType, (void *)cb_func))
 {
-    linked_list_init(&mSubscribers);
-
     // setting up mReleasedState
     mStatePtr->mPendingState = new AgpsPendingState(this);
     mStatePtr->mAcquiredState = new AgpsAcquiredState(this);
     mStatePtr->mReleasingState = new AgpsReleasingState(this);
+    mStatePtr->mLingeringState = new AgpsLingeringState(this);
 
     // setting up mAcquiredState
     mStatePtr->mAcquiredState->mReleasedState = mStatePtr;
     mStatePtr->mAcquiredState->mPendingState = mStatePtr->mPendingState;
     mStatePtr->mAcquiredState->mReleasingState = mStatePtr->mReleasingState;
+    mStatePtr->mAcquiredState->mLingeringState = mStatePtr->mLingeringState;
 
     // setting up mPendingState
     mStatePtr->mPendingState->mAcquiredState = mStatePtr->mAcquiredState;
@@ -652,26 +830,35 @@ AgpsStateMachine::AgpsStateMachine(servicerType servType,
     mStatePtr->mReleasingState->mReleasedState = mStatePtr;
     mStatePtr->mReleasingState->mPendingState = mStatePtr->mPendingState;
     mStatePtr->mReleasingState->mAcquiredState = mStatePtr->mAcquiredState;
+
+    // setting up mLingeringState
+    mStatePtr->mLingeringState->mReleasedState = mStatePtr;
+    mStatePtr->mLingeringState->mAcquiredState = mStatePtr->mAcquiredState;
 }
 
 AgpsStateMachine::~AgpsStateMachine()
 {
     dropAllSubscribers();
+    if (NULL != mLingerTimer) {
+        mLingerTimer->stop();
+        delete mLingerTimer;
+    }
 
-    // free the 3 states.  We must read out all 3 pointers first.
+    // free the 5 states.  We must read out all 5 pointers first.
     // Otherwise we run the risk of getting pointers from already
     // freed memory.
     AgpsState* acquiredState = mStatePtr->mAcquiredState;
     AgpsState* releasedState = mStatePtr->mReleasedState;
     AgpsState* pendindState = mStatePtr->mPendingState;
     AgpsState* releasingState = mStatePtr->mReleasingState;
+    AgpsState* lingeringState = mStatePtr->mLingeringState;
 
     delete acquiredState;
     delete releasedState;
     delete pendindState;
     delete releasingState;
+    delete lingeringState;
     delete mServicer;
-    linked_list_destroy(&mSubscribers);
 
     if (NULL != mAPN) {
         delete[] mAPN;
@@ -697,6 +884,78 @@ void AgpsStateMachine::setAPN(const char* apn, unsigned int len)
     }
 }
 
+void AgpsStateMachine::setLinger(LocEngAdapter* adapter,
+                                 unsigned int lingerMsec)
+{
+    mLingerMsec = (NULL == adapter) ? 0 : lingerMsec;
+    if (NULL != mLingerTimer) {
+        mLingerTimer->stop();
+        delete mLingerTimer;
+        mLingerTimer = NULL;
+    }
+    if (0 != mLingerMsec) {
+        mLingerTimer = new AgpsLingerTimer(adapter, this);
+    }
+}
+
+bool AgpsStateMachine::startLinger()
+{
+    if (0 == mLingerMsec) {
+        return false;
+    }
+
+    // a timeout already posted by an earlier linger is told stale by
+    // its generation
+    mLingerTimer->stop();
+    mLingerTimer->mGeneration = ++mLingerGeneration;
+    if (!mLingerTimer->start(mLingerMsec, false)) {
+        LOC_LOGE("%s: could not start the linger timer", __func__);
+        return false;
+    }
+
+    LOC_LOGD("%s: %s NIF lingers for %u ms", __func__,
+             loc_get_agps_type_name(mType), mLingerMsec);
+    return true;
+}
+
+void AgpsStateMachine::onLingerReused()
+{
+    mLingerTimer->stop();
+    mLingerGeneration++;
+    mLingerReuses++;
+    LOC_LOGD("%s: %s NIF reused, %u reuses, %u expiries", __func__,
+             loc_get_agps_type_name(mType), mLingerReuses, mLingerExpiries);
+}
+
+void AgpsStateMachine::onLingerExpired(unsigned int generation)
+{
+    if (generation != mLingerGeneration ||
+        mStatePtr != mStatePtr->mLingeringState) {
+        return;
+    }
+
+    mLingerExpiries++;
+    LOC_LOGD("%s: %s NIF released, %u reuses, %u expiries", __func__,
+             loc_get_agps_type_name(mType), mLingerReuses, mLingerExpiries);
+    // tell connecivity service we can release NIF
+    sendRsrcRequest(GPS_RELEASE_AGPS_DATA_CONN);
+    mStatePtr = mStatePtr->mReleasedState;
+}
+
+void AgpsStateMachine::endLinger()
+{
+    if (NULL != mLingerTimer) {
+        mLingerTimer->stop();
+    }
+    mLingerGeneration++;
+    if (mStatePtr == mStatePtr->mLingeringState) {
+        LOC_LOGD("%s: %s NIF released", __func__,
+                 loc_get_agps_type_name(mType));
+        sendRsrcRequest(GPS_RELEASE_AGPS_DATA_CONN);
+        mStatePtr = mStatePtr->mReleasedState;
+    }
+}
+
 void AgpsStateMachine::onRsrcEvent(AgpsRsrcStatus event)
 {
     switch (event)
@@ -714,45 +973,19 @@ void AgpsStateMachine::onRsrcEvent(AgpsRsrcStatus event)
 
 void AgpsStateMachine::notifySubscribers(Notification& notification) const
 {
-    if (notification.postNotifyDelete) {
-        // just any non NULL value to get started
-        Subscriber* s = (Subscriber*)~0;
-        while (NULL != s) {
-            s = NULL;
-            // if the last param sets to true, _search will delete
-            // the node from the list for us.  But the problem is
-            // once that is done, _search returns, leaving the
-            // rest of the list unprocessed.  So we need a loop.
-            linked_list_search(mSubscribers, (void**)&s, notifySubscriber,
-                               (void*)&notification, true);
-            delete s;
-        }
-    } else {
-        // no loop needed if it the last param sets to false, which
-        // mean nothing gets deleted from the list.
-        linked_list_search(mSubscribers, NULL, notifySubscriber,
-                           (void*)&notification, false);
-    }
+    mSubscribers.notify(notification);
 }
 
 void AgpsStateMachine::addSubscriber(Subscriber* subscriber) const
 {
-    Subscriber* s = NULL;
-    Notification notification((const Subscriber*)subscriber);
-    linked_list_search(mSubscribers, (void**)&s,
-                       hasSubscriber, (void*)&notification, false);
-
-    if (NULL == s) {
-        linked_list_add(mSubscribers, subscriber->clone(), deleteObj);
+    if (NULL == mSubscribers.find(subscriber)) {
+        mSubscribers.add(subscriber->clone());
     }
 }
 
 int AgpsStateMachine::sendRsrcRequest(AGpsStatusValue action) const
 {
-    Subscriber* s = NULL;
-    Notification notification(Notification::BROADCAST_ACTIVE);
-    linked_list_search(mSubscribers, (void**)&s, hasSubscriber,
-                       (void*)&notification, false);
+    Subscriber* s = mSubscribers.firstActive();
 
     if ((NULL == s) == (GPS_RELEASE_AGPS_DATA_CONN == action)) {
         AGpsExtStatus nifRequest;
@@ -780,7 +1013,7 @@ void AgpsStateMachine::subscribeRsrc(Subscriber *subscriber)
 {
   if (mEnforceSingleSubscriber && hasSubscribers()) {
       Notification notification(Notification::BROADCAST_ALL, RSRC_DENIED, true);
-      notifySubscriber(&notification, subscriber);
+      subscriber->notifyRsrcStatus(notification);
   } else {
       mStatePtr = mStatePtr->onRsrcEvent(RSRC_SUBSCRIBE, (void*)subscriber);
   }
@@ -788,10 +1021,7 @@ void AgpsStateMachine::subscribeRsrc(Subscriber *subscriber)
 
 bool AgpsStateMachine::unsubscribeRsrc(Subscriber *subscriber)
 {
-    Subscriber* s = NULL;
-    Notification notification((const Subscriber*)subscriber);
-    linked_list_search(mSubscribers, (void**)&s,
-                       hasSubscriber, (void*)&notification, false);
+    Subscriber* s = mSubscribers.find(subscriber);
 
     if (NULL != s) {
         mStatePtr = mStatePtr->onRsrcEvent(RSRC_UNSUBSCRIBE, (void*)s);
@@ -800,23 +1030,33 @@ bool AgpsStateMachine::unsubscribeRsrc(Subscriber *subscriber)
     return false;
 }
 
-bool AgpsStateMachine::hasActiveSubscribers() const
-{
-    Subscriber* s = NULL;
-    Notification notification(Notification::BROADCAST_ACTIVE);
-    linked_list_search(mSubscribers, (void**)&s,
-                       hasSubscriber, (void*)&notification, false);
-    return NULL != s;
-}
-
 //======================================================================
 // DSStateMachine
 //======================================================================
+// posted to the msg task when a data call retry is due, so that the
+// subscribers are only ever looked at from the msg task
+struct DSRetryDataCall : public LocMsg {
+    DSStateMachine* mStateMachine;
+    inline DSRetryDataCall(DSStateMachine* stateMachine) :
+        LocMsg(), mStateMachine(stateMachine) {
+        locallog();
+    }
+    inline virtual void proc() const {
+        mStateMachine->retryCallback();
+    }
+    inline void locallog() const {
+        LOC_LOGV("DSRetryDataCall");
+    }
+    inline virtual void log() const {
+        locallog();
+    }
+};
+
 void delay_callback(void *callbackData, int result)
 {
     if(callbackData) {
         DSStateMachine *DSSMInstance = (DSStateMachine *)callbackData;
-        DSSMInstance->retryCallback();
+        DSSMInstance->onRetryTimer();
     }
     else {
         LOC_LOGE(" NULL argument received. Failing.\n");
@@ -835,12 +1075,14 @@ DSStateMachine :: DSStateMachine(servicerType type, void *cb_func,
     mRetries = 0;
 }
 
+void DSStateMachine :: onRetryTimer()
+{
+    mLocAdapter->sendMsg(new DSRetryDataCall(this));
+}
+
 void DSStateMachine :: retryCallback(void)
 {
-    DSSubscriber *subscriber = NULL;
-    Notification notification(Notification::BROADCAST_ACTIVE);
-    linked_list_search(mSubscribers, (void**)&subscriber, hasSubscriber,
-                       (void*)&notification, false);
+    DSSubscriber *subscriber = (DSSubscriber*)mSubscribers.firstActive();
     if(subscriber)
         mLocAdapter->requestSuplES(subscriber->ID);
     else
@@ -851,14 +1093,11 @@ void DSStateMachine :: retryCallback(void)
 
 int DSStateMachine :: sendRsrcRequest(AGpsStatusValue action) const
 {
-    DSSubscriber* s = NULL;
+    DSSubscriber* s = (DSSubscriber*)mSubscribers.firstActive();
     dsCbData cbData;
     int ret=-1;
     int connHandle=-1;
     LOC_LOGD("Enter DSStateMachine :: sendRsrcRequest\n");
-    Notification notification(Notification::BROADCAST_ACTIVE);
-    linked_list_search(mSubscribers, (void**)&s, hasSubscriber,
-                       (void*)&notification, false);
     if(s) {
         connHandle = s->ID;
         LOC_LOGD("DSStateMachine :: sendRsrcRequest - subscriber found\n");
@@ -882,7 +1121,15 @@ int DSStateMachine :: sendRsrcRequest(AGpsStatusValue action) const
             informStatus(RSRC_DENIED, connHandle);
         }
         else {
-            if(loc_timer_start(DATA_CALL_RETRY_DELAY_MSEC, delay_callback, (void *)this)) {
+            // the data service is often back within a few hundred ms,
+            // so start short and back off if it is not
+            unsigned int delay = DATA_CALL_RETRY_DELAY_MSEC << (mRetries - 1);
+            if (delay > DATA_CALL_RETRY_MAX_DELAY_MSEC) {
+                delay = DATA_CALL_RETRY_MAX_DELAY_MSEC;
+            }
+            LOC_LOGD("%s:%d]: Retry %d in %u ms\n", __func__, __LINE__,
+                     mRetries, delay);
+            if(NULL == loc_timer_start(delay, delay_callback, (void *)this)) {
                 LOC_LOGE("Error: Could not start delay thread\n");
                 ret = -1;
                 goto err;
@@ -958,6 +1205,7 @@ void DSStateMachine :: informStatus(AgpsRsrcStatus status, int ID) const
         mLocAdapter->requestATL(ID, AGPS_TYPE_SUPL);
         break;
     case RSRC_GRANTED:
+        ((DSStateMachine *)this)->mRetries = 0;
         mLocAdapter->atlOpenStatus(ID, 1,
                                                      NULL,
                                                      AGPS_APN_BEARER_INVALID,
@@ -37,12 +37,12 @@
 #include <hardware/gps.h>
 #include <gps_extended.h>
 #include <loc_core_log.h>
-#include <linked_list.h>
 #include <loc_timer.h>
 #include <LocEngAdapter.h>
 
 // forward declaration
 class AgpsStateMachine;
+class AgpsLingerTimer;
 class Subscriber;
 
 // NIF resource events
@@ -129,13 +129,15 @@ protected:
     AgpsState* mAcquiredState;
     AgpsState* mPendingState;
     AgpsState* mReleasingState;
+    AgpsState* mLingeringState;
 
     inline AgpsState(const AgpsStateMachine *stateMachine) :
         mStateMachine(stateMachine),
         mReleasedState(NULL),
         mAcquiredState(NULL),
         mPendingState(NULL),
-        mReleasingState(NULL) {}
+        mReleasingState(NULL),
+        mLingeringState(NULL) {}
     virtual ~AgpsState() {}
 
 public:
@@ -177,10 +179,48 @@ public:
     inline virtual char *whoami() {return (char*)"AGpsServicer";}
 };
 
+// Subscribers of a state machine, kept in one array with the active ones
+// first, newest first. Lookups compare connection IDs in place before
+// asking a subscriber, and broadcasts to active or inactive subscribers
+// only go over their own part of the array.
+class SubscriberRegistry {
+    struct Entry {
+        uint32_t id;
+        Subscriber* subscriber;
+    };
+    Entry* mEntries;
+    unsigned int mCapacity;
+    unsigned int mCount;
+    unsigned int mActiveCount;
+
+    void removeAt(unsigned int index);
+public:
+    SubscriberRegistry();
+    ~SubscriberRegistry();
+
+    inline bool empty() const { return 0 == mCount; }
+    inline bool hasActive() const { return 0 != mActiveCount; }
+    // the newest active subscriber, if any
+    inline Subscriber* firstActive() const
+    { return (0 == mActiveCount) ? NULL : mEntries[0].subscriber; }
+
+    // the subscriber that equals subscriber, if any
+    Subscriber* find(const Subscriber* subscriber) const;
+    // takes over subscriber, which must be active
+    void add(Subscriber* subscriber);
+    // sets subscriber inactive and moves it with the inactive ones
+    void setInactive(Subscriber* subscriber);
+    // notifies the subscribers the notification is for, deleting
+    // them afterwards if the notification says so
+    void notify(Notification& notification);
+    // deletes all subscribers
+    void flush();
+};
+
 class AgpsStateMachine {
 protected:
-    // a linked list of subscribers.
-    void* mSubscribers;
+    // subscribers, indexed by connection ID and active state.
+    mutable SubscriberRegistry mSubscribers;
     //handle to whoever provides the service
     Servicer *mServicer;
     // allows AgpsState to access private data
@@ -203,6 +243,15 @@ private:
     AGpsBearerType mBearer;
     // ipv4 address for routing
     bool mEnforceSingleSubscriber;
+    // how long an unused NIF is kept up, 0 to release it right away
+    unsigned int mLingerMsec;
+    // tells the timeout of the current linger from stale ones
+    unsigned int mLingerGeneration;
+    // posts the linger timeout back to the msg task
+    AgpsLingerTimer* mLingerTimer;
+    // lingering NIFs handed to a new subscriber / released unused
+    unsigned int mLingerReuses;
+    unsigned int mLingerExpiries;
 
 public:
     AgpsStateMachine(servicerType servType, void *cb_func,
@@ -216,6 +265,20 @@ public:
     inline AGpsBearerType getBearer() const { return mBearer; }
     inline AGpsExtType getType() const { return (AGpsExtType)mType; }
 
+    // keep the NIF up for lingerMsec after the last subscriber is gone,
+    // so that a subscriber coming back meanwhile gets it right away
+    void setLinger(LocEngAdapter* adapter, unsigned int lingerMsec);
+
+    // the last subscriber is gone, with the NIF still up. Returns
+    // false if the NIF is not to linger, and must be released now.
+    bool startLinger();
+    // a new subscriber takes over the lingering NIF
+    void onLingerReused();
+    // the linger period started as generation is over
+    void onLingerExpired(unsigned int generation);
+    // the engine is going away; a lingering NIF is released right away
+    void endLinger();
+
     // someone, a ATL client or BIT, is asking for NIF
     void subscribeRsrc(Subscriber *subscriber);
 
@@ -230,17 +293,18 @@ public:
     // put the data together and send the FW
     virtual int sendRsrcRequest(AGpsStatusValue action) const;
 
-    //if list is empty, linked_list_empty returns 1
-    //else if list is not empty, returns 0
-    //so hasSubscribers() returns 1 if list is not empty
-    //and returns 0 if list is empty
     inline bool hasSubscribers() const
-    { return !linked_list_empty(mSubscribers); }
+    { return !mSubscribers.empty(); }
+
+    inline bool hasActiveSubscribers() const
+    { return mSubscribers.hasActive(); }
 
-    bool hasActiveSubscribers() const;
+    // a subscriber waiting for close complete is done with NIF
+    inline void setSubscriberInactive(Subscriber* subscriber) const
+    { mSubscribers.setInactive(subscriber); }
 
     inline void dropAllSubscribers() const
-    { linked_list_flush(mSubscribers); }
+    { mSubscribers.flush(); }
 
     // private. Only a state gets to call this.
     void notifySubscribers(Notification& notification) const;
@@ -249,7 +313,9 @@ public:
 
 class DSStateMachine : public AgpsStateMachine {
     static const unsigned char MAX_START_DATA_CALL_RETRIES;
+    // the retry delay doubles from the first to the max
     static const unsigned int DATA_CALL_RETRY_DELAY_MSEC;
+    static const unsigned int DATA_CALL_RETRY_MAX_DELAY_MSEC;
     LocEngAdapter* mLocAdapter;
     unsigned char mRetries;
 public:
@@ -258,6 +324,8 @@ public:
                    LocEngAdapter* adapterHandle);
     int sendRsrcRequest(AGpsStatusValue action) const;
     void onRsrcEvent(AgpsRsrcStatus event);
+    // retry timer expired, called from the timer thread
+    void onRetryTimer();
     void retryCallback();
     void informStatus(AgpsRsrcStatus status, int ID) const;
     inline void incRetries() {mRetries++;}
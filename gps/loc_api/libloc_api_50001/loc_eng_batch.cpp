@@ -0,0 +1,427 @@
+/* Copyright (c) 2014, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation, nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#define LOG_NDDEBUG 0
+#define LOG_TAG "LocSvc_eng"
+
+#include <string.h>
+#include <loc_eng.h>
+#include <LocTimer.h>
+#include "log_util.h"
+#include "platform_lib_includes.h"
+
+using namespace loc_core;
+
+// a batched fix; local_loc_cb() only passes gpsLocation on, so the rest
+// of the UlpLocation is not kept
+typedef struct {
+    GpsLocation location;
+    uint16_t position_source;
+    // marked once the fix is delivered
+    loc_eng_ttff_milestone milestone;
+} LocEngBatchFix;
+
+class LocEngBatchTimer : public LocTimer {
+    loc_eng_data_s_type* const mLocEng;
+public:
+    inline LocEngBatchTimer(loc_eng_data_s_type* locEng) :
+        LocTimer(), mLocEng(locEng) {}
+    virtual void timeOutCallback();
+};
+
+// Everything in here is only touched on the MsgTask.
+class LocEngBatcher {
+    loc_eng_data_s_type& mLocEng;
+    LocEngBatchFix* mRing;
+    uint32_t mCapacity;
+    uint32_t mHead;
+    uint32_t mCount;
+    uint32_t mDropped;
+    // started through the extension, rather than by the session interval
+    bool mStarted;
+    uint32_t mFlags;
+    uint32_t mMaxDelayMs;
+    LocEngBatchTimer mTimer;
+    int64_t mTimerDeadlineMs;
+    bool mTimerArmed;
+
+    bool batching() const;
+    void configure(uint32_t flags, uint32_t maxFixes, uint32_t maxDelayMs);
+    void schedule();
+public:
+    LocEngBatcher(loc_eng_data_s_type& locEng);
+    ~LocEngBatcher();
+    void start(const LocBatchOptions& options);
+    void stop();
+    void flush();
+    bool reportPosition(const UlpLocation& location,
+                        loc_eng_ttff_milestone milestone);
+    void onTimer();
+};
+
+struct LocEngBatchStart : public LocMsg {
+    loc_eng_data_s_type* mLocEng;
+    const LocBatchOptions mOptions;
+    inline LocEngBatchStart(loc_eng_data_s_type* locEng,
+                            const LocBatchOptions& options) :
+        LocMsg(), mLocEng(locEng), mOptions(options)
+    {
+        locallog();
+    }
+    inline virtual void proc() const
+    {
+        if (NULL == mLocEng->batch) {
+            mLocEng->batch = new LocEngBatcher(*mLocEng);
+        }
+        mLocEng->batch->start(mOptions);
+    }
+    inline void locallog() const
+    {
+        LOC_LOGV("LocEngBatchStart: flags 0x%x, max fixes %u, "
+                 "max delay %u ms", mOptions.flags, mOptions.max_fixes,
+                 mOptions.max_delay_ms);
+    }
+    inline virtual void log() const
+    {
+        locallog();
+    }
+};
+
+struct LocEngBatchStop : public LocMsg {
+    loc_eng_data_s_type* mLocEng;
+    inline LocEngBatchStop(loc_eng_data_s_type* locEng) :
+        LocMsg(), mLocEng(locEng)
+    {
+        locallog();
+    }
+    inline virtual void proc() const
+    {
+        if (NULL != mLocEng->batch) {
+            mLocEng->batch->stop();
+        }
+    }
+    inline void locallog() const
+    {
+        LOC_LOGV("LocEngBatchStop");
+    }
+    inline virtual void log() const
+    {
+        locallog();
+    }
+};
+
+struct LocEngBatchFlush : public LocMsg {
+    loc_eng_data_s_type* mLocEng;
+    inline LocEngBatchFlush(loc_eng_data_s_type* locEng) :
+        LocMsg(), mLocEng(locEng)
+    {
+        locallog();
+    }
+    inline virtual void proc() const
+    {
+        if (NULL != mLocEng->batch) {
+            mLocEng->batch->flush();
+        }
+    }
+    inline void locallog() const
+    {
+        LOC_LOGV("LocEngBatchFlush");
+    }
+    inline virtual void log() const
+    {
+        locallog();
+    }
+};
+
+struct LocEngBatchTimeout : public LocMsg {
+    loc_eng_data_s_type* mLocEng;
+    inline LocEngBatchTimeout(loc_eng_data_s_type* locEng) :
+        LocMsg(), mLocEng(locEng)
+    {
+        locallog();
+    }
+    inline virtual void proc() const
+    {
+        mLocEng->batch->onTimer();
+    }
+    inline void locallog() const
+    {
+        LOC_LOGV("LocEngBatchTimeout");
+    }
+    inline virtual void log() const
+    {
+        locallog();
+    }
+};
+
+// called on the timer thread
+void LocEngBatchTimer::timeOutCallback()
+{
+    mLocEng->adapter->sendMsg(new LocEngBatchTimeout(mLocEng));
+}
+
+LocEngBatcher::LocEngBatcher(loc_eng_data_s_type& locEng) :
+    mLocEng(locEng), mRing(NULL), mCapacity(0), mHead(0), mCount(0),
+    mDropped(0), mStarted(false), mFlags(0), mMaxDelayMs(0),
+    mTimer(&locEng), mTimerDeadlineMs(0), mTimerArmed(false)
+{
+    configure(0, 0, 0);
+}
+
+LocEngBatcher::~LocEngBatcher()
+{
+    mTimer.stop();
+    delete[] mRing;
+}
+
+// fixes of single shot sessions go out right away; periodic ones are
+// batched once started, or if their interval is AP_BATCH_MIN_INTERVAL_MSEC
+// or longer
+bool LocEngBatcher::batching() const
+{
+    const LocPosMode& mode = mLocEng.adapter->getPositionMode();
+    if (GPS_POSITION_RECURRENCE_SINGLE == mode.recurrence ||
+        NULL == mRing) {
+        return false;
+    }
+    return mStarted ||
+           (gps_conf.AP_BATCH_MIN_INTERVAL_MSEC != 0 &&
+            mode.min_interval >= gps_conf.AP_BATCH_MIN_INTERVAL_MSEC);
+}
+
+// 0 takes the gps.conf value; the ring is only reallocated if its size
+// changes, and what it holds is delivered first
+void LocEngBatcher::configure(uint32_t flags, uint32_t maxFixes,
+                              uint32_t maxDelayMs)
+{
+    if (0 == maxFixes) {
+        maxFixes = gps_conf.AP_BATCH_SIZE;
+        if (gps_conf.AP_BATCH_WAKEUP) {
+            flags |= LOC_BATCH_WAKEUP_ON_FIFO_FULL;
+        }
+    }
+    if (0 == maxDelayMs) {
+        maxDelayMs = gps_conf.AP_BATCH_MAX_DELAY_SEC * 1000;
+    }
+    if (maxFixes > LOC_BATCH_MAX_FIXES) {
+        LOC_LOGW("%s:%d]: batch of %u fixes cut to %d\n", __func__, __LINE__,
+                 maxFixes, LOC_BATCH_MAX_FIXES);
+        maxFixes = LOC_BATCH_MAX_FIXES;
+    }
+
+    if (maxFixes != mCapacity) {
+        flush();
+        delete[] mRing;
+        mRing = NULL;
+        if (maxFixes > 0) {
+            mRing = new LocEngBatchFix[maxFixes];
+        }
+        mCapacity = maxFixes;
+    }
+    mFlags = flags;
+    mMaxDelayMs = maxDelayMs;
+    LOC_LOGD("%s:%d]: %u fixes, flags 0x%x, max delay %u ms\n",
+             __func__, __LINE__, mCapacity, mFlags, mMaxDelayMs);
+}
+
+// the timer only wakes up the AP if a full batch would
+void LocEngBatcher::schedule()
+{
+    mTimer.stop();
+    mTimerArmed = false;
+    if (0 == mMaxDelayMs) {
+        return;
+    }
+    mTimerDeadlineMs = elapsedMillisSinceBoot() + mMaxDelayMs;
+    mTimerArmed = mTimer.start(mMaxDelayMs,
+                               0 != (mFlags & LOC_BATCH_WAKEUP_ON_FIFO_FULL));
+    if (!mTimerArmed) {
+        LOC_LOGE("%s:%d]: timer not started\n", __func__, __LINE__);
+    }
+}
+
+void LocEngBatcher::start(const LocBatchOptions& options)
+{
+    configure(options.flags, options.max_fixes, options.max_delay_ms);
+    mStarted = true;
+}
+
+void LocEngBatcher::stop()
+{
+    flush();
+    mStarted = false;
+    configure(0, 0, 0);
+}
+
+void LocEngBatcher::flush()
+{
+    mTimer.stop();
+    mTimerArmed = false;
+    if (0 == mCount) {
+        return;
+    }
+
+    LOC_LOGD("%s:%d]: %u fixes, %u dropped\n",
+             __func__, __LINE__, mCount, mDropped);
+    if (NULL != mLocEng.location_cb) {
+        UlpLocation location;
+        memset(&location, 0, sizeof(location));
+        location.size = sizeof(location);
+        for (uint32_t i = 0; i < mCount; i++) {
+            const LocEngBatchFix& fix = mRing[(mHead + i) % mCapacity];
+            location.gpsLocation = fix.location;
+            location.position_source = fix.position_source;
+            mLocEng.location_cb(&location, NULL);
+            loc_eng_ttff_mark(fix.milestone);
+        }
+    }
+    mHead = 0;
+    mCount = 0;
+    mDropped = 0;
+}
+
+// returns false if the fix is to be reported right away
+bool LocEngBatcher::reportPosition(const UlpLocation& location,
+                                   loc_eng_ttff_milestone milestone)
+{
+    if (!batching()) {
+        // what is left of a batch goes out before the fix
+        flush();
+        return false;
+    }
+
+    if (mCount == mCapacity) {
+        mHead = (mHead + 1) % mCapacity;
+        mCount--;
+        mDropped++;
+    }
+    LocEngBatchFix& fix = mRing[(mHead + mCount) % mCapacity];
+    fix.location = location.gpsLocation;
+    fix.position_source = location.position_source;
+    fix.milestone = milestone;
+    mCount++;
+
+    if (mCount == mCapacity &&
+        (mFlags & LOC_BATCH_WAKEUP_ON_FIFO_FULL)) {
+        flush();
+    } else if (1 == mCount) {
+        schedule();
+    }
+    return true;
+}
+
+void LocEngBatcher::onTimer()
+{
+    if (!mTimerArmed ||
+        elapsedMillisSinceBoot() + LOC_BATCH_TIMER_SLACK_MSEC <
+        mTimerDeadlineMs) {
+        return;
+    }
+    flush();
+}
+
+/*===========================================================================
+FUNCTION    loc_eng_batch_start
+
+DESCRIPTION
+   Starts batching the fixes of periodic sessions. The batcher is created
+   on the MsgTask, as all of its state is kept there.
+
+DEPENDENCIES
+   NONE
+
+RETURN VALUE
+   0: success
+
+SIDE EFFECTS
+   N/A
+
+===========================================================================*/
+int loc_eng_batch_start(loc_eng_data_s_type &loc_eng_data,
+                        const LocBatchOptions* options)
+{
+    ENTRY_LOG_CALLFLOW();
+    int ret_val = -1;
+
+    if (NULL != options && NULL != loc_eng_data.adapter) {
+        loc_eng_data.adapter->sendMsg(new LocEngBatchStart(&loc_eng_data,
+                                                           *options));
+        ret_val = 0;
+    }
+    EXIT_LOG(%d, ret_val);
+    return ret_val;
+}
+
+int loc_eng_batch_stop(loc_eng_data_s_type &loc_eng_data)
+{
+    ENTRY_LOG_CALLFLOW();
+    int ret_val = -1;
+
+    if (NULL != loc_eng_data.adapter) {
+        loc_eng_data.adapter->sendMsg(new LocEngBatchStop(&loc_eng_data));
+        ret_val = 0;
+    }
+    EXIT_LOG(%d, ret_val);
+    return ret_val;
+}
+
+int loc_eng_batch_flush(loc_eng_data_s_type &loc_eng_data)
+{
+    ENTRY_LOG_CALLFLOW();
+    int ret_val = -1;
+
+    if (NULL != loc_eng_data.adapter) {
+        loc_eng_data.adapter->sendMsg(new LocEngBatchFlush(&loc_eng_data));
+        ret_val = 0;
+    }
+    EXIT_LOG(%d, ret_val);
+    return ret_val;
+}
+
+// called on the MsgTask, for every fix that would go to location_cb;
+// true if the fix has been batched instead
+bool loc_eng_batch_report_position(loc_eng_data_s_type &loc_eng_data,
+                                   const UlpLocation &location,
+                                   loc_eng_ttff_milestone milestone)
+{
+    if (NULL == loc_eng_data.batch) {
+        if (0 == gps_conf.AP_BATCH_MIN_INTERVAL_MSEC) {
+            return false;
+        }
+        loc_eng_data.batch = new LocEngBatcher(loc_eng_data);
+    }
+    return loc_eng_data.batch->reportPosition(location, milestone);
+}
+
+// called on the MsgTask when the tracking session stops
+void loc_eng_batch_session_stopped(loc_eng_data_s_type &loc_eng_data)
+{
+    if (NULL != loc_eng_data.batch) {
+        loc_eng_data.batch->flush();
+    }
+}
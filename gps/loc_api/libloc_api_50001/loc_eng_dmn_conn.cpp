@@ -35,7 +35,11 @@
 #include <unistd.h>
 #include <errno.h>
 #include <grp.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/un.h>
 
 #include "log_util.h"
 #include "platform_lib_includes.h"
@@ -56,50 +60,63 @@ static const char * global_quipc_ctrl_q_path = QUIPC_CTRL_Q_PATH;
 static const char * global_msapm_ctrl_q_path = MSAPM_CTRL_Q_PATH;
 static const char * global_msapu_ctrl_q_path = MSAPU_CTRL_Q_PATH;
 
-static int loc_api_server_proc_init(void *context)
+/* socket mode, when a socket path is given at launch */
+#define LOC_API_SERVER_MAX_CLIENTS 8
+#define LOC_API_SERVER_MSG_SIZE (sizeof(struct ctrl_msgbuf) + 256)
+
+static const char * global_loc_api_sock_path = NULL;
+static int loc_api_sock_fd = -1;
+static int loc_api_epoll_fd = -1;
+static int loc_api_wake_fd[2] = { -1, -1 };
+
+/* a client, and the sender it last made a request for; responses
+   to that sender go to it */
+struct loc_api_client {
+    int fd;
+    int sender_id;
+};
+static struct loc_api_client loc_api_clients[LOC_API_SERVER_MAX_CLIENTS];
+static pthread_mutex_t loc_api_clients_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* only the server thread receives, one message at a time */
+static union {
+    struct ctrl_msgbuf cmsgbuf;
+    uint8_t raw[LOC_API_SERVER_MSG_SIZE];
+} loc_api_rcv_buf;
+
+static void loc_api_server_set_perm(const char * path)
 {
-    loc_api_server_msgqid = loc_eng_dmn_conn_glue_msgget(global_loc_api_q_path, O_RDWR);
-    //change mode/group for the global_loc_api_q_path pipe
-    int result = chmod (global_loc_api_q_path, 0660);
+    int result = chmod (path, 0660);
     if (result != 0)
     {
-        LOC_LOGE("failed to change mode for %s, error = %s\n", global_loc_api_q_path, strerror(errno));
+        LOC_LOGE("failed to change mode for %s, error = %s\n", path, strerror(errno));
     }
 
     struct group * gps_group = getgrnam("gps");
     if (gps_group != NULL)
     {
-       result = chown (global_loc_api_q_path, -1, gps_group->gr_gid);
+       result = chown (path, -1, gps_group->gr_gid);
        if (result != 0)
        {
-          LOC_LOGE("chown for pipe failed, pipe %s, gid = %d, result = %d, error = %s\n",
-                   global_loc_api_q_path, gps_group->gr_gid, result, strerror(errno));
+          LOC_LOGE("chown failed, path %s, gid = %d, result = %d, error = %s\n",
+                   path, gps_group->gr_gid, result, strerror(errno));
        }
     }
     else
     {
        LOC_LOGE("getgrnam for gps failed, error code = %d\n",  errno);
     }
+}
 
-    loc_api_resp_msgqid = loc_eng_dmn_conn_glue_msgget(global_loc_api_resp_q_path, O_RDWR);
+static int loc_api_server_proc_init(void *context)
+{
+    loc_api_server_msgqid = loc_eng_dmn_conn_glue_msgget(global_loc_api_q_path, O_RDWR);
+    //change mode/group for the global_loc_api_q_path pipe
+    loc_api_server_set_perm(global_loc_api_q_path);
 
+    loc_api_resp_msgqid = loc_eng_dmn_conn_glue_msgget(global_loc_api_resp_q_path, O_RDWR);
     //change mode/group for the global_loc_api_resp_q_path pipe
-    result = chmod (global_loc_api_resp_q_path, 0660);
-    if (result != 0)
-    {
-        LOC_LOGE("failed to change mode for %s, error = %s\n", global_loc_api_resp_q_path, strerror(errno));
-    }
-
-    if (gps_group != NULL)
-    {
-       result = chown (global_loc_api_resp_q_path, -1, gps_group->gr_gid);
-       if (result != 0)
-       {
-          LOC_LOGE("chown for pipe failed, pipe %s, gid = %d, result = %d, error = %s\n",
-                   global_loc_api_resp_q_path,
-                   gps_group->gr_gid, result, strerror(errno));
-       }
-    }
+    loc_api_server_set_perm(global_loc_api_resp_q_path);
 
     quipc_msgqid = loc_eng_dmn_conn_glue_msgget(global_quipc_ctrl_q_path, O_RDWR);
     msapm_msgqid = loc_eng_dmn_conn_glue_msgget(global_msapm_ctrl_q_path , O_RDWR);
@@ -114,31 +131,9 @@ static int loc_api_server_proc_pre(void *context)
     return 0;
 }
 
-static int loc_api_server_proc(void *context)
+static int loc_api_server_dispatch(struct ctrl_msgbuf * p_cmsgbuf, int length)
 {
-    int length, sz;
     int result = 0;
-    static int cnt = 0;
-    struct ctrl_msgbuf * p_cmsgbuf;
-    struct ctrl_msgbuf cmsg_resp;
-
-    sz = sizeof(struct ctrl_msgbuf) + 256;
-    p_cmsgbuf = (struct ctrl_msgbuf *) malloc(sz);
-
-    if (!p_cmsgbuf) {
-        LOC_LOGE("%s:%d] Out of memory\n", __func__, __LINE__);
-        return -1;
-    }
-
-    cnt ++;
-    LOC_LOGD("%s:%d] %d listening on %s...\n", __func__, __LINE__, cnt, (char *) context);
-    length = loc_eng_dmn_conn_glue_msgrcv(loc_api_server_msgqid, p_cmsgbuf, sz);
-    if (length <= 0) {
-        free(p_cmsgbuf);
-        LOC_LOGE("%s:%d] fail receiving msg from gpsone_daemon, retry later\n", __func__, __LINE__);
-        usleep(1000);
-        return -1;
-    }
 
     LOC_LOGD("%s:%d] received ctrl_type = %d\n", __func__, __LINE__, p_cmsgbuf->ctrl_type);
     switch(p_cmsgbuf->ctrl_type) {
@@ -160,7 +155,26 @@ static int loc_api_server_proc(void *context)
             break;
     }
 
-    free(p_cmsgbuf);
+    return result;
+}
+
+static int loc_api_server_proc(void *context)
+{
+    int length;
+    static int cnt = 0;
+    struct ctrl_msgbuf * p_cmsgbuf = &loc_api_rcv_buf.cmsgbuf;
+
+    cnt ++;
+    LOC_LOGD("%s:%d] %d listening on %s...\n", __func__, __LINE__, cnt, (char *) context);
+    length = loc_eng_dmn_conn_glue_msgrcv(loc_api_server_msgqid, p_cmsgbuf,
+                                          sizeof(loc_api_rcv_buf));
+    if (length <= 0) {
+        LOC_LOGE("%s:%d] fail receiving msg from gpsone_daemon, retry later\n", __func__, __LINE__);
+        usleep(1000);
+        return -1;
+    }
+
+    loc_api_server_dispatch(p_cmsgbuf, length);
     return 0;
 }
 
@@ -175,19 +189,249 @@ static int loc_api_server_proc_post(void *context)
     return 0;
 }
 
+static void loc_api_sock_server_close(void)
+{
+    pthread_mutex_lock(&loc_api_clients_lock);
+    for (int i = 0; i < LOC_API_SERVER_MAX_CLIENTS; i++) {
+        if (loc_api_clients[i].fd >= 0) {
+            close(loc_api_clients[i].fd);
+            loc_api_clients[i].fd = -1;
+        }
+    }
+    pthread_mutex_unlock(&loc_api_clients_lock);
+
+    if (loc_api_sock_fd >= 0) {
+        close(loc_api_sock_fd);
+        loc_api_sock_fd = -1;
+        unlink(global_loc_api_sock_path);
+    }
+    if (loc_api_epoll_fd >= 0) {
+        close(loc_api_epoll_fd);
+        loc_api_epoll_fd = -1;
+    }
+    for (int i = 0; i < 2; i++) {
+        if (loc_api_wake_fd[i] >= 0) {
+            close(loc_api_wake_fd[i]);
+            loc_api_wake_fd[i] = -1;
+        }
+    }
+}
+
+static int loc_api_sock_server_proc_init(void *context)
+{
+    struct sockaddr_un addr;
+    struct epoll_event ev;
+
+    for (int i = 0; i < LOC_API_SERVER_MAX_CLIENTS; i++) {
+        loc_api_clients[i].fd = -1;
+        loc_api_clients[i].sender_id = -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strlcpy(addr.sun_path, global_loc_api_sock_path, sizeof(addr.sun_path));
+    unlink(global_loc_api_sock_path);
+
+    // SOCK_SEQPACKET keeps each ctrl_msgbuf a message of its own
+    loc_api_sock_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (loc_api_sock_fd < 0 ||
+        bind(loc_api_sock_fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+        listen(loc_api_sock_fd, LOC_API_SERVER_MAX_CLIENTS) < 0) {
+        LOC_LOGE("%s:%d] failed to listen on %s, error = %s\n", __func__, __LINE__,
+                 global_loc_api_sock_path, strerror(errno));
+        loc_api_sock_server_close();
+        return -1;
+    }
+    loc_api_server_set_perm(global_loc_api_sock_path);
+
+    loc_api_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (loc_api_epoll_fd < 0 || pipe2(loc_api_wake_fd, O_CLOEXEC) < 0) {
+        LOC_LOGE("%s:%d] epoll setup failed, error = %s\n", __func__, __LINE__,
+                 strerror(errno));
+        loc_api_sock_server_close();
+        return -1;
+    }
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = loc_api_sock_fd;
+    epoll_ctl(loc_api_epoll_fd, EPOLL_CTL_ADD, loc_api_sock_fd, &ev);
+    ev.data.fd = loc_api_wake_fd[0];
+    epoll_ctl(loc_api_epoll_fd, EPOLL_CTL_ADD, loc_api_wake_fd[0], &ev);
+
+    LOC_LOGD("%s:%d] listening on %s\n", __func__, __LINE__, global_loc_api_sock_path);
+    return 0;
+}
+
+static void loc_api_sock_server_accept(void)
+{
+    int fd = accept4(loc_api_sock_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (fd < 0) {
+        LOC_LOGE("%s:%d] accept failed, error = %s\n", __func__, __LINE__, strerror(errno));
+        return;
+    }
+
+    pthread_mutex_lock(&loc_api_clients_lock);
+    int i = 0;
+    while (i < LOC_API_SERVER_MAX_CLIENTS && loc_api_clients[i].fd >= 0) {
+        i++;
+    }
+    if (i < LOC_API_SERVER_MAX_CLIENTS) {
+        loc_api_clients[i].fd = fd;
+        loc_api_clients[i].sender_id = -1;
+    }
+    pthread_mutex_unlock(&loc_api_clients_lock);
+
+    if (i == LOC_API_SERVER_MAX_CLIENTS) {
+        LOC_LOGE("%s:%d] too many clients, closing %d\n", __func__, __LINE__, fd);
+        close(fd);
+        return;
+    }
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    epoll_ctl(loc_api_epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+    LOC_LOGD("%s:%d] client %d connected\n", __func__, __LINE__, fd);
+}
+
+static void loc_api_sock_server_drop(int fd)
+{
+    epoll_ctl(loc_api_epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+    pthread_mutex_lock(&loc_api_clients_lock);
+    for (int i = 0; i < LOC_API_SERVER_MAX_CLIENTS; i++) {
+        if (loc_api_clients[i].fd == fd) {
+            loc_api_clients[i].fd = -1;
+            loc_api_clients[i].sender_id = -1;
+        }
+    }
+    pthread_mutex_unlock(&loc_api_clients_lock);
+    close(fd);
+    LOC_LOGD("%s:%d] client %d disconnected\n", __func__, __LINE__, fd);
+}
+
+static void loc_api_sock_server_receive(int fd)
+{
+    struct ctrl_msgbuf * p_cmsgbuf = &loc_api_rcv_buf.cmsgbuf;
+    ssize_t length = recv(fd, loc_api_rcv_buf.raw, sizeof(loc_api_rcv_buf), 0);
+
+    if (length <= 0) {
+        loc_api_sock_server_drop(fd);
+        return;
+    }
+    if (length < (ssize_t) offsetof(struct ctrl_msgbuf, cmsg)) {
+        LOC_LOGE("%s:%d] short message, %d bytes\n", __func__, __LINE__, (int) length);
+        return;
+    }
+    p_cmsgbuf->msgsz = length;
+
+    if (GPSONE_LOC_API_IF_REQUEST == p_cmsgbuf->ctrl_type ||
+        GPSONE_LOC_API_IF_RELEASE == p_cmsgbuf->ctrl_type) {
+        if (length < (ssize_t) (offsetof(struct ctrl_msgbuf, cmsg) +
+                                sizeof(struct ctrl_msg_if_request))) {
+            LOC_LOGE("%s:%d] short if request, %d bytes\n", __func__, __LINE__,
+                     (int) length);
+            return;
+        }
+        // IF_REQUEST_SENDER_ID_* and LOC_ENG_IF_REQUEST_SENDER_ID_*
+        // have the same values
+        pthread_mutex_lock(&loc_api_clients_lock);
+        for (int i = 0; i < LOC_API_SERVER_MAX_CLIENTS; i++) {
+            if (loc_api_clients[i].fd == fd) {
+                loc_api_clients[i].sender_id =
+                    (int) p_cmsgbuf->cmsg.cmsg_if_request.sender_id;
+            }
+        }
+        pthread_mutex_unlock(&loc_api_clients_lock);
+    }
+
+    loc_api_server_dispatch(p_cmsgbuf, length);
+}
+
+static int loc_api_sock_server_proc(void *context)
+{
+    struct epoll_event events[LOC_API_SERVER_MAX_CLIENTS + 2];
+    int n = epoll_wait(loc_api_epoll_fd, events,
+                       sizeof(events) / sizeof(events[0]), -1);
+
+    if (n < 0) {
+        if (EINTR == errno) {
+            return 0;
+        }
+        LOC_LOGE("%s:%d] epoll_wait failed, error = %s\n", __func__, __LINE__,
+                 strerror(errno));
+        return -1;
+    }
+
+    for (int i = 0; i < n; i++) {
+        int fd = events[i].data.fd;
+        if (fd == loc_api_wake_fd[0]) {
+            // unblocked, thread_exit is set already
+            char c;
+            read(fd, &c, 1);
+        } else if (fd == loc_api_sock_fd) {
+            loc_api_sock_server_accept();
+        } else if (events[i].events & EPOLLIN) {
+            loc_api_sock_server_receive(fd);
+        } else {
+            loc_api_sock_server_drop(fd);
+        }
+    }
+    return 0;
+}
+
+static int loc_api_sock_server_proc_post(void *context)
+{
+    LOC_LOGD("%s:%d]\n", __func__, __LINE__);
+    loc_api_sock_server_close();
+    return 0;
+}
+
+static int loc_api_sock_server_send(int sender_id, struct ctrl_msgbuf * p_cmsgbuf)
+{
+    int result = -1;
+
+    p_cmsgbuf->msgsz = sizeof(struct ctrl_msgbuf);
+    pthread_mutex_lock(&loc_api_clients_lock);
+    for (int i = 0; i < LOC_API_SERVER_MAX_CLIENTS; i++) {
+        if (loc_api_clients[i].fd >= 0 &&
+            loc_api_clients[i].sender_id == sender_id) {
+            if (send(loc_api_clients[i].fd, p_cmsgbuf, sizeof(struct ctrl_msgbuf),
+                     MSG_DONTWAIT | MSG_NOSIGNAL) == (ssize_t) sizeof(struct ctrl_msgbuf)) {
+                result = 0;
+            } else {
+                LOC_LOGE("%s:%d] send to client %d failed, error = %s\n", __func__,
+                         __LINE__, loc_api_clients[i].fd, strerror(errno));
+            }
+        }
+    }
+    pthread_mutex_unlock(&loc_api_clients_lock);
+
+    if (result < 0) {
+        LOC_LOGE("%s:%d] no client for sender_id %d\n", __func__, __LINE__, sender_id);
+    }
+    return result;
+}
+
 static int loc_eng_dmn_conn_unblock_proc(void)
 {
     struct ctrl_msgbuf cmsgbuf;
     cmsgbuf.ctrl_type = GPSONE_UNBLOCK;
     LOC_LOGD("%s:%d]\n", __func__, __LINE__);
-    loc_eng_dmn_conn_glue_msgsnd(loc_api_server_msgqid, & cmsgbuf, sizeof(cmsgbuf));
+    if (NULL != global_loc_api_sock_path) {
+        write(loc_api_wake_fd[1], &cmsgbuf.ctrl_type, 1);
+    } else {
+        loc_eng_dmn_conn_glue_msgsnd(loc_api_server_msgqid, & cmsgbuf, sizeof(cmsgbuf));
+    }
     return 0;
 }
 
 static struct loc_eng_dmn_conn_thelper thelper;
 
 int loc_eng_dmn_conn_loc_api_server_launch(thelper_create_thread   create_thread_cb,
-    const char * loc_api_q_path, const char * resp_q_path, void *agps_handle)
+    const char * loc_api_q_path, const char * resp_q_path, const char * sock_path,
+    void *agps_handle)
 {
     int result;
 
@@ -195,14 +439,25 @@ int loc_eng_dmn_conn_loc_api_server_launch(thelper_create_thread   create_thread
 
     if (loc_api_q_path) global_loc_api_q_path = loc_api_q_path;
     if (resp_q_path)    global_loc_api_resp_q_path = resp_q_path;
-
-    result = loc_eng_dmn_conn_launch_thelper( &thelper,
-        loc_api_server_proc_init,
-        loc_api_server_proc_pre,
-        loc_api_server_proc,
-        loc_api_server_proc_post,
-        create_thread_cb,
-        (char *) global_loc_api_q_path);
+    global_loc_api_sock_path = sock_path;
+
+    if (NULL != sock_path) {
+        result = loc_eng_dmn_conn_launch_thelper( &thelper,
+            loc_api_sock_server_proc_init,
+            loc_api_server_proc_pre,
+            loc_api_sock_server_proc,
+            loc_api_sock_server_proc_post,
+            create_thread_cb,
+            (char *) global_loc_api_sock_path);
+    } else {
+        result = loc_eng_dmn_conn_launch_thelper( &thelper,
+            loc_api_server_proc_init,
+            loc_api_server_proc_pre,
+            loc_api_server_proc,
+            loc_api_server_proc_post,
+            create_thread_cb,
+            (char *) global_loc_api_q_path);
+    }
     if (result != 0) {
         LOC_LOGE("%s:%d]\n", __func__, __LINE__);
         return -1;
@@ -228,6 +483,9 @@ int loc_eng_dmn_conn_loc_api_server_data_conn(int sender_id, int status) {
   LOC_LOGD("%s:%d] quipc_msgqid = %d\n", __func__, __LINE__, quipc_msgqid);
   cmsgbuf.ctrl_type = GPSONE_LOC_API_RESPONSE;
   cmsgbuf.cmsg.cmsg_response.result = status;
+  if (NULL != global_loc_api_sock_path) {
+    return loc_api_sock_server_send(sender_id, &cmsgbuf);
+  }
   switch (sender_id) {
     case LOC_ENG_IF_REQUEST_SENDER_ID_QUIPC: {
       LOC_LOGD("%s:%d] sender_id = LOC_ENG_IF_REQUEST_SENDER_ID_QUIPC", __func__, __LINE__);
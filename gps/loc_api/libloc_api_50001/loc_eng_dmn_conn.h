@@ -38,6 +38,7 @@
 #define QUIPC_CTRL_Q_PATH "/data/misc/location/gpsone_d/quipc_ctrl_q"
 #define MSAPM_CTRL_Q_PATH "/data/misc/location/gpsone_d/msapm_ctrl_q"
 #define MSAPU_CTRL_Q_PATH "/data/misc/location/gpsone_d/msapu_ctrl_q"
+#define GPSONE_LOC_API_SOCK_PATH "/data/misc/location/gpsone_d/gpsone_loc_api_sock"
 
 #else
 
@@ -46,11 +47,16 @@
 #define QUIPC_CTRL_Q_PATH "/tmp/quipc_ctrl_q"
 #define MSAPM_CTRL_Q_PATH "/tmp/msapm_ctrl_q"
 #define MSAPU_CTRL_Q_PATH "/tmp/msapu_ctrl_q"
+#define GPSONE_LOC_API_SOCK_PATH "/tmp/gpsone_loc_api_sock"
 
 #endif
 
+/* sock_path NULL: the daemons talk through the q pipes.
+   Otherwise they connect to a SOCK_SEQPACKET unix socket at sock_path,
+   several at a time, and the q pipes are not used. */
 int loc_eng_dmn_conn_loc_api_server_launch(thelper_create_thread   create_thread_cb,
-    const char * loc_api_q_path, const char * ctrl_q_path, void *agps_handle);
+    const char * loc_api_q_path, const char * ctrl_q_path, const char * sock_path,
+    void *agps_handle);
 int loc_eng_dmn_conn_loc_api_server_unblock(void);
 int loc_eng_dmn_conn_loc_api_server_join(void);
 int loc_eng_dmn_conn_loc_api_server_data_conn(int, int);
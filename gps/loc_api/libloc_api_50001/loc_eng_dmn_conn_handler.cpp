@@ -136,7 +136,10 @@ int loc_eng_dmn_conn_loc_api_server_if_request_handler(struct ctrl_msgbuf *pmsg,
     }
 
 #else
-   loc_eng_dmn_conn_loc_api_server_data_conn(LOC_ENG_IF_REQUEST_SENDER_ID_GPSONE_DAEMON, GPSONE_LOC_API_IF_REQUEST_SUCCESS);
+   // answer the sender itself, so that several loopback clients each
+   // get their own responses
+   loc_eng_dmn_conn_loc_api_server_data_conn(
+       (int) pmsg->cmsg.cmsg_if_request.sender_id, GPSONE_LOC_API_IF_REQUEST_SUCCESS);
 #endif
     return 0;
 }
@@ -230,7 +233,10 @@ int loc_eng_dmn_conn_loc_api_server_if_release_handler(struct ctrl_msgbuf *pmsg,
       }
     }
 #else
-   loc_eng_dmn_conn_loc_api_server_data_conn(LOC_ENG_IF_REQUEST_SENDER_ID_GPSONE_DAEMON, GPSONE_LOC_API_IF_RELEASE_SUCCESS);
+   // answer the sender itself, so that several loopback clients each
+   // get their own responses
+   loc_eng_dmn_conn_loc_api_server_data_conn(
+       (int) pmsg->cmsg.cmsg_if_request.sender_id, GPSONE_LOC_API_IF_RELEASE_SUCCESS);
 #endif
     return 0;
 }
@@ -0,0 +1,204 @@
+/* Copyright (c) 2014, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation, nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/* Loopback throughput test of the daemon connection socket server, i.e.
+   the AGPS_DMN_CONN_SOCKET=1 path. The server runs in this process, built
+   with DEBUG_DMN_LOC_API so that it answers each request itself instead
+   of bringing up a data call. Each client sends IF_REQUESTs as its own
+   sender, one at a time, and waits for the response.
+
+   usage: loc_dmn_conn_loopback [-n requests per client] [-c clients]
+                                [-s socket path] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "log_util.h"
+#include "platform_lib_includes.h"
+#include "loc_eng_dmn_conn_handler.h"
+#include "loc_eng_dmn_conn.h"
+
+#ifdef _ANDROID_
+#define LOOPBACK_SOCK_PATH "/data/misc/location/gpsone_d/loopback_sock"
+#else
+#define LOOPBACK_SOCK_PATH "/tmp/loc_dmn_conn_loopback_sock"
+#endif
+
+/* one client per sender, as responses are routed by sender */
+#define LOOPBACK_MAX_CLIENTS    4
+#define LOOPBACK_CONNECT_TRIES  100
+
+static const ctrl_if_req_sender_id_e_type loopback_senders[LOOPBACK_MAX_CLIENTS] = {
+    IF_REQUEST_SENDER_ID_QUIPC,
+    IF_REQUEST_SENDER_ID_MSAPM,
+    IF_REQUEST_SENDER_ID_MSAPU,
+    IF_REQUEST_SENDER_ID_GPSONE_DAEMON
+};
+
+struct loopback_client {
+    pthread_t thread;
+    const char * sock_path;
+    ctrl_if_req_sender_id_e_type sender_id;
+    int requests;
+    int responses;
+};
+
+static int64_t loopback_now_usec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* the server thread may not be listening yet */
+static int loopback_connect(const char * sock_path)
+{
+    struct sockaddr_un addr;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strlcpy(addr.sun_path, sock_path, sizeof(addr.sun_path));
+
+    for (int i = 0; i < LOOPBACK_CONNECT_TRIES; i++) {
+        int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            return -1;
+        }
+        if (0 == connect(fd, (struct sockaddr *) &addr, sizeof(addr))) {
+            return fd;
+        }
+        close(fd);
+        usleep(10000);
+    }
+    return -1;
+}
+
+static void * loopback_client_proc(void * context)
+{
+    struct loopback_client * client = (struct loopback_client *) context;
+    struct ctrl_msgbuf request;
+    struct ctrl_msgbuf response;
+
+    int fd = loopback_connect(client->sock_path);
+    if (fd < 0) {
+        fprintf(stderr, "sender %d: cannot connect to %s: %s\n",
+                client->sender_id, client->sock_path, strerror(errno));
+        return NULL;
+    }
+
+    memset(&request, 0, sizeof(request));
+    request.msgsz = sizeof(request);
+    request.ctrl_type = GPSONE_LOC_API_IF_REQUEST;
+    request.cmsg.cmsg_if_request.type = IF_REQUEST_TYPE_ANY;
+    request.cmsg.cmsg_if_request.sender_id = client->sender_id;
+
+    for (int i = 0; i < client->requests; i++) {
+        if (send(fd, &request, sizeof(request), MSG_NOSIGNAL) != (ssize_t) sizeof(request) ||
+            recv(fd, &response, sizeof(response), 0) != (ssize_t) sizeof(response)) {
+            fprintf(stderr, "sender %d: request %d failed: %s\n",
+                    client->sender_id, i, strerror(errno));
+            break;
+        }
+        if (GPSONE_LOC_API_RESPONSE == response.ctrl_type &&
+            GPSONE_LOC_API_IF_REQUEST_SUCCESS == response.cmsg.cmsg_response.result) {
+            client->responses++;
+        }
+    }
+
+    close(fd);
+    return NULL;
+}
+
+int main(int argc, char * argv[])
+{
+    struct loopback_client clients[LOOPBACK_MAX_CLIENTS];
+    const char * sock_path = LOOPBACK_SOCK_PATH;
+    int requests = 10000;
+    int client_count = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:c:s:")) != -1) {
+        switch (opt) {
+        case 'n':
+            requests = atoi(optarg);
+            break;
+        case 'c':
+            client_count = atoi(optarg);
+            break;
+        case 's':
+            sock_path = optarg;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n requests per client] [-c clients, 1-%d]"
+                    " [-s socket path]\n", argv[0], LOOPBACK_MAX_CLIENTS);
+            return 1;
+        }
+    }
+    if (requests <= 0 || client_count < 1 || client_count > LOOPBACK_MAX_CLIENTS) {
+        fprintf(stderr, "%s: need -n > 0 and -c within 1-%d\n", argv[0],
+                LOOPBACK_MAX_CLIENTS);
+        return 1;
+    }
+
+    if (0 != loc_eng_dmn_conn_loc_api_server_launch(NULL, NULL, NULL, sock_path, NULL)) {
+        fprintf(stderr, "%s: server launch failed\n", argv[0]);
+        return 1;
+    }
+
+    int64_t start = loopback_now_usec();
+    for (int i = 0; i < client_count; i++) {
+        clients[i].sock_path = sock_path;
+        clients[i].sender_id = loopback_senders[i];
+        clients[i].requests = requests;
+        clients[i].responses = 0;
+        pthread_create(&clients[i].thread, NULL, loopback_client_proc, &clients[i]);
+    }
+    int responses = 0;
+    for (int i = 0; i < client_count; i++) {
+        pthread_join(clients[i].thread, NULL);
+        responses += clients[i].responses;
+    }
+    int64_t elapsed = loopback_now_usec() - start;
+
+    loc_eng_dmn_conn_loc_api_server_unblock();
+    loc_eng_dmn_conn_loc_api_server_join();
+
+    printf("%d clients, %d of %d requests answered in %lld ms, %.0f requests/s\n",
+           client_count, responses, client_count * requests,
+           (long long) (elapsed / 1000),
+           elapsed > 0 ? responses * 1000000.0 / elapsed : 0.0);
+    return responses == client_count * requests ? 0 : 1;
+}
@@ -0,0 +1,363 @@
+/* Copyright (c) 2014, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation, nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#define LOG_NDDEBUG 0
+#define LOG_TAG "LocSvc_eng"
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <time.h>
+#include <loc_eng.h>
+#include <loc_eng_msg.h>
+#include <LocThread.h>
+#include "log_util.h"
+#include "platform_lib_includes.h"
+
+/* hosts cached at a time; one per PDE/MPC server type and a spare */
+#define DNS_CACHE_SIZE        4
+#define DNS_HOST_LEN          101
+
+enum loc_eng_dns_state {
+    DNS_STATE_FREE = 0,
+    // queued or being resolved, no address known yet
+    DNS_STATE_PENDING,
+    DNS_STATE_RESOLVED,
+    DNS_STATE_FAILED
+};
+
+typedef struct {
+    char host[DNS_HOST_LEN];
+    loc_eng_dns_state state;
+    struct in_addr addr;
+    // elapsed realtime the answer, positive or negative, expires at
+    int64_t expiresMs;
+    // elapsed realtime the entry was last looked up, for eviction
+    int64_t usedMs;
+    bool queued;
+} LocEngDnsEntry;
+
+// A server whose address is set from a resolved host. It is set again
+// each time the host resolves to a different address.
+typedef struct {
+    LocEngAdapter* adapter;
+    char host[DNS_HOST_LEN];
+    int port;
+    struct in_addr addr;
+    bool addrSent;
+} LocEngDnsServer;
+
+// Everything below is shared by the callers and the resolver thread,
+// under dns_lock.
+static pthread_mutex_t dns_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t dns_cond = PTHREAD_COND_INITIALIZER;
+static LocEngDnsEntry dns_cache[DNS_CACHE_SIZE];
+// indexed by LocServerType, SUPL excluded as the modem resolves it
+static LocEngDnsServer* dns_servers[LOC_AGPS_SUPL_SERVER];
+static LocThread* dns_thread = NULL;
+
+static LocEngDnsEntry* dns_find(const char* host)
+{
+    for (int i = 0; i < DNS_CACHE_SIZE; i++) {
+        if (DNS_STATE_FREE != dns_cache[i].state &&
+            0 == strcmp(dns_cache[i].host, host)) {
+            return &dns_cache[i];
+        }
+    }
+    return NULL;
+}
+
+static bool dns_is_server_host(const char* host)
+{
+    for (int type = 0; type < LOC_AGPS_SUPL_SERVER; type++) {
+        if (NULL != dns_servers[type] &&
+            0 == strcmp(dns_servers[type]->host, host)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// gets the entry of host, taking over the least recently used entry
+// that no server depends on if host is not cached yet
+static LocEngDnsEntry* dns_get(const char* host)
+{
+    LocEngDnsEntry* entry = dns_find(host);
+    if (NULL == entry) {
+        for (int i = 0; i < DNS_CACHE_SIZE; i++) {
+            LocEngDnsEntry* candidate = &dns_cache[i];
+            if (DNS_STATE_FREE == candidate->state) {
+                entry = candidate;
+                break;
+            }
+            if (!candidate->queued &&
+                !dns_is_server_host(candidate->host) &&
+                (NULL == entry || candidate->usedMs < entry->usedMs)) {
+                entry = candidate;
+            }
+        }
+        if (NULL != entry) {
+            memset(entry, 0, sizeof(*entry));
+            strlcpy(entry->host, host, sizeof(entry->host));
+            entry->state = DNS_STATE_PENDING;
+        }
+    }
+    if (NULL != entry) {
+        entry->usedMs = elapsedMillisSinceBoot();
+    }
+    return entry;
+}
+
+// sets the address of the servers on host, if it has changed
+static void dns_update_servers(const LocEngDnsEntry* entry)
+{
+    for (int type = 0; type < LOC_AGPS_SUPL_SERVER; type++) {
+        LocEngDnsServer* server = dns_servers[type];
+        if (NULL != server &&
+            0 == strcmp(server->host, entry->host) &&
+            (!server->addrSent ||
+             server->addr.s_addr != entry->addr.s_addr)) {
+            server->addr = entry->addr;
+            server->addrSent = true;
+            LOC_LOGD("%s: %s resolved to %s for server type %d", __func__,
+                     entry->host, inet_ntoa(entry->addr), type);
+            server->adapter->sendMsg(
+                new LocEngSetServerIpv4(server->adapter,
+                                        htonl(entry->addr.s_addr),
+                                        server->port,
+                                        (LocServerType)type));
+        }
+    }
+}
+
+class LocEngDnsResolver : public LocRunnable {
+public:
+    // resolves one host per call: a queued one, else the first server
+    // host whose answer has expired, else waits for either
+    virtual bool run() {
+        char host[DNS_HOST_LEN];
+        LocEngDnsEntry* entry = NULL;
+
+        pthread_mutex_lock(&dns_lock);
+        while (NULL == entry) {
+            int64_t now = elapsedMillisSinceBoot();
+            int64_t nextExpiryMs = 0;
+            for (int i = 0; i < DNS_CACHE_SIZE && NULL == entry; i++) {
+                LocEngDnsEntry* candidate = &dns_cache[i];
+                if (candidate->queued) {
+                    entry = candidate;
+                } else if (DNS_STATE_FREE != candidate->state &&
+                           dns_is_server_host(candidate->host)) {
+                    if (candidate->expiresMs <= now) {
+                        entry = candidate;
+                    } else if (0 == nextExpiryMs ||
+                               candidate->expiresMs < nextExpiryMs) {
+                        nextExpiryMs = candidate->expiresMs;
+                    }
+                }
+            }
+            if (NULL == entry) {
+                if (0 == nextExpiryMs) {
+                    pthread_cond_wait(&dns_cond, &dns_lock);
+                } else {
+                    struct timespec ts;
+                    int64_t waitMs = nextExpiryMs - now;
+                    clock_gettime(CLOCK_REALTIME, &ts);
+                    ts.tv_sec += waitMs / 1000;
+                    ts.tv_nsec += (waitMs % 1000) * 1000000;
+                    if (ts.tv_nsec >= 1000000000) {
+                        ts.tv_sec++;
+                        ts.tv_nsec -= 1000000000;
+                    }
+                    pthread_cond_timedwait(&dns_cond, &dns_lock, &ts);
+                }
+            }
+        }
+        entry->queued = false;
+        strlcpy(host, entry->host, sizeof(host));
+        pthread_mutex_unlock(&dns_lock);
+
+        // the only caller of gethostbyname(), which is not reentrant
+        struct in_addr addr;
+        struct hostent* hp = gethostbyname(host);
+        if (NULL != hp && AF_INET == hp->h_addrtype &&
+            NULL != hp->h_addr_list[0]) {
+            memcpy(&addr, hp->h_addr_list[0], sizeof(addr));
+        } else {
+            hp = NULL;
+        }
+
+        pthread_mutex_lock(&dns_lock);
+        // the entry may have been handed to another host meanwhile
+        entry = dns_find(host);
+        if (NULL != entry) {
+            int64_t now = elapsedMillisSinceBoot();
+            if (NULL != hp) {
+                entry->state = DNS_STATE_RESOLVED;
+                entry->addr = addr;
+                entry->expiresMs = now + (int64_t)gps_conf.DNS_CACHE_TTL * 1000;
+                dns_update_servers(entry);
+            } else {
+                // a stale address is better than none, keep it in use
+                if (DNS_STATE_RESOLVED != entry->state) {
+                    entry->state = DNS_STATE_FAILED;
+                }
+                entry->expiresMs =
+                    now + (int64_t)gps_conf.DNS_NEGATIVE_CACHE_TTL * 1000;
+                LOC_LOGE("DNS query on '%s' failed\n", host);
+            }
+        }
+        pthread_mutex_unlock(&dns_lock);
+
+        return true;
+    }
+};
+
+// queues host for the resolver thread, starting it if needed
+static void dns_queue(LocEngDnsEntry* entry)
+{
+    entry->queued = true;
+    if (NULL == dns_thread) {
+        dns_thread = new LocThread();
+        LocRunnable* resolver = new LocEngDnsResolver();
+        if (!dns_thread->start("LocEngDns", resolver, false)) {
+            LOC_LOGE("%s: failed to start the resolver thread", __func__);
+            delete resolver;
+            delete dns_thread;
+            dns_thread = NULL;
+            entry->queued = false;
+            return;
+        }
+    }
+    pthread_cond_signal(&dns_cond);
+}
+
+/*===========================================================================
+FUNCTION    loc_eng_dns_prefetch
+
+DESCRIPTION
+   Starts resolving a server host in the background, so that the address
+   is at hand when the server is set.
+
+DEPENDENCIES
+   None
+
+RETURN VALUE
+   None
+
+SIDE EFFECTS
+   N/A
+
+===========================================================================*/
+void loc_eng_dns_prefetch(const char* host)
+{
+    struct in_addr addr;
+
+    if (NULL == host || '\0' == host[0] || inet_aton(host, &addr)) {
+        return;
+    }
+
+    pthread_mutex_lock(&dns_lock);
+    LocEngDnsEntry* entry = dns_get(host);
+    if (NULL != entry && !entry->queued &&
+        (DNS_STATE_PENDING == entry->state ||
+         entry->expiresMs <= elapsedMillisSinceBoot())) {
+        dns_queue(entry);
+    }
+    pthread_mutex_unlock(&dns_lock);
+}
+
+/*===========================================================================
+FUNCTION    loc_eng_dns_set_server
+
+DESCRIPTION
+   Sets a PDE or MPC server by host name without blocking on DNS. A
+   cached or numeric address is sent right away; otherwise, or when the
+   cached answer has expired, the host is resolved in the background and
+   the server is set once it resolves. The server is set again whenever a
+   later refresh finds a different address.
+
+DEPENDENCIES
+   None
+
+RETURN VALUE
+   0: the server was set, or will be once the host resolves
+   -2: the host recently failed to resolve; it is retried in the background
+
+SIDE EFFECTS
+   N/A
+
+===========================================================================*/
+int loc_eng_dns_set_server(LocEngAdapter* adapter, LocServerType type,
+                           const char* host, int port)
+{
+    int ret = 0;
+    struct in_addr addr;
+
+    if (type < 0 || type >= LOC_AGPS_SUPL_SERVER || NULL == host) {
+        return -2;
+    }
+
+    pthread_mutex_lock(&dns_lock);
+    if (NULL == dns_servers[type]) {
+        dns_servers[type] = new LocEngDnsServer;
+    }
+    LocEngDnsServer* server = dns_servers[type];
+    memset(server, 0, sizeof(*server));
+    server->adapter = adapter;
+    strlcpy(server->host, host, sizeof(server->host));
+    server->port = port;
+
+    if (inet_aton(host, &addr)) {
+        // nothing to resolve, nor to refresh
+        server->host[0] = '\0';
+        adapter->sendMsg(new LocEngSetServerIpv4(adapter, htonl(addr.s_addr),
+                                                 port, type));
+    } else {
+        LocEngDnsEntry* entry = dns_get(host);
+        if (NULL == entry) {
+            LOC_LOGE("%s: no room to cache %s", __func__, host);
+            ret = -2;
+        } else {
+            if (DNS_STATE_RESOLVED == entry->state) {
+                dns_update_servers(entry);
+            } else if (DNS_STATE_FAILED == entry->state) {
+                ret = -2;
+            }
+            if (!entry->queued &&
+                (DNS_STATE_PENDING == entry->state ||
+                 entry->expiresMs <= elapsedMillisSinceBoot())) {
+                dns_queue(entry);
+            }
+        }
+    }
+    pthread_mutex_unlock(&dns_lock);
+
+    return ret;
+}
@@ -0,0 +1,1174 @@
+/* Copyright (c) 2014, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation, nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#define LOG_NDDEBUG 0
+#define LOG_TAG "LocSvc_eng"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <loc_eng.h>
+#include <LocTimer.h>
+#include "log_util.h"
+#include "platform_lib_includes.h"
+
+using namespace loc_core;
+
+#define GEOFENCE_EARTH_RADIUS_M     6371000.0
+#define GEOFENCE_M_PER_DEG          (GEOFENCE_EARTH_RADIUS_M * M_PI / 180.0)
+#define GEOFENCE_GRID_ROWS          ((int32_t)(180.0 / LOC_GEOFENCE_CELL_DEG))
+#define GEOFENCE_GRID_COLS          ((int32_t)(360.0 / LOC_GEOFENCE_CELL_DEG))
+/* key of the fences that are checked on every fix; real keys are
+   row * GEOFENCE_GRID_COLS + col, far below it */
+#define GEOFENCE_CELL_ALL           0xFFFFFFFF
+#define GEOFENCE_ID_BUCKETS         1024
+#define GEOFENCE_TRANSITIONS        (GPS_GEOFENCE_ENTERED | \
+                                     GPS_GEOFENCE_EXITED | \
+                                     GPS_GEOFENCE_UNCERTAIN)
+/* A timer can fire just before it is armed again; a timeout this far
+   ahead of the deadline belongs to the previous arming. */
+#define GEOFENCE_TIMER_SLACK_MSEC   500
+
+typedef struct {
+    int32_t id;
+    double latitude;
+    double longitude;
+    double radius;
+    // GPS_GEOFENCE_ENTERED, GPS_GEOFENCE_EXITED or GPS_GEOFENCE_UNCERTAIN
+    int state;
+    int monitorTransitions;
+    int responsivenessMs;
+    int unknownTimerMs;
+    bool used;
+    bool paused;
+    bool oversize;
+    // cells the fence is indexed under, inclusive; columns are not
+    // wrapped around the antimeridian yet
+    int32_t minRow, maxRow, minCol, maxCol;
+    // watch list, of the fences that are not known to be outside
+    int watchPrev, watchNext;
+    // next in the id hash chain, or in the free list
+    int idNext;
+    // last fix the fence was checked against
+    uint32_t evalStamp;
+} LocEngGeofence;
+
+typedef struct {
+    uint32_t cell;
+    int fence;
+    int next;
+} LocEngGeofenceCell;
+
+class LocEngGeofenceTimer : public LocTimer {
+    loc_eng_data_s_type* const mLocEng;
+public:
+    inline LocEngGeofenceTimer(loc_eng_data_s_type* locEng) :
+        LocTimer(), mLocEng(locEng) {}
+    virtual void timeOutCallback();
+};
+
+// Everything in here is only touched on the MsgTask.
+class LocEngGeofencer {
+    loc_eng_data_s_type& mLocEng;
+    GpsGeofenceCallbacks mCallbacks;
+
+    LocEngGeofence* mFences;
+    int mFenceCap;
+    int mFreeFence;
+    int mIdBuckets[GEOFENCE_ID_BUCKETS];
+    LocEngGeofenceCell* mCells;
+    int mCellCap;
+    int mFreeCell;
+    int mGrid[LOC_GEOFENCE_GRID_BUCKETS];
+    int mWatch;
+    int mActive;
+    uint32_t mStamp;
+    int mMinResponsivenessMs;
+    int mMinUnknownTimerMs;
+
+    // zeroed until there is a fix, the callbacks do not take NULL
+    GpsLocation mLastFix;
+    int64_t mLastFixMs;
+    bool mAvailable;
+    int mIntervalMs;
+    // min_interval of our own session, 0 if it is not running
+    int mSessionIntervalMs;
+
+    LocEngGeofenceTimer mTimer;
+    int64_t mTimerDeadlineMs;
+    bool mTimerArmed;
+
+    static int64_t nowMs();
+    static double distance(double lat1, double lon1, double lat2, double lon2);
+    static inline uint32_t cellKey(int32_t row, int32_t col) {
+        col %= GEOFENCE_GRID_COLS;
+        if (col < 0) {
+            col += GEOFENCE_GRID_COLS;
+        }
+        return (uint32_t)row * GEOFENCE_GRID_COLS + col;
+    }
+    static inline int cellBucket(uint32_t cell) {
+        return (cell * 2654435761u) >> 20 & (LOC_GEOFENCE_GRID_BUCKETS - 1);
+    }
+    static inline int32_t cellRow(double latitude) {
+        int32_t row = (int32_t)floor((latitude + 90.0) / LOC_GEOFENCE_CELL_DEG);
+        return row < 0 ? 0 :
+            (row >= GEOFENCE_GRID_ROWS ? GEOFENCE_GRID_ROWS - 1 : row);
+    }
+    static inline int32_t cellCol(double longitude) {
+        return (int32_t)floor((longitude + 180.0) / LOC_GEOFENCE_CELL_DEG);
+    }
+
+    int find(int32_t id) const;
+    int allocFence(int32_t id);
+    void freeFence(int idx);
+    bool addCell(uint32_t cell, int idx);
+    void removeCell(uint32_t cell, int idx);
+    bool index(int idx);
+    void unindex(int idx);
+    void watchAdd(int idx);
+    void watchRemove(int idx);
+    void setState(int idx, int state, const GpsLocation* location,
+                  GpsUtcTime timestamp);
+    void updateLimits();
+    static double blockEdge(double latitude, double longitude,
+                            int32_t row, int32_t col, int32_t ring);
+    double evaluate(const GpsLocation& location);
+    double nearestBeyond(double latitude, double longitude,
+                         int32_t row, int32_t col, double nearest);
+    void checkUnknown(int64_t now);
+    void schedule(int msec);
+    void trackSoon();
+    void updateOwnSession();
+    void stopOwnSession();
+    void stopTracking();
+public:
+    LocEngGeofencer(loc_eng_data_s_type& locEng,
+                    const GpsGeofenceCallbacks& callbacks);
+    inline void setCallbacks(const GpsGeofenceCallbacks& callbacks) {
+        mCallbacks = callbacks;
+    }
+    int add(int32_t id, double latitude, double longitude, double radius,
+            int lastTransition, int monitorTransitions,
+            int responsivenessMs, int unknownTimerMs);
+    int remove(int32_t id);
+    int pause(int32_t id);
+    int resume(int32_t id, int monitorTransitions);
+    void reportPosition(const GpsLocation& location);
+    void onTimer();
+    inline bool isActive() const { return 0 != mActive; }
+};
+
+struct LocEngGeofenceInit : public LocMsg {
+    loc_eng_data_s_type* mLocEng;
+    const GpsGeofenceCallbacks mCallbacks;
+    inline LocEngGeofenceInit(loc_eng_data_s_type* locEng,
+                              const GpsGeofenceCallbacks& callbacks) :
+        LocMsg(), mLocEng(locEng), mCallbacks(callbacks)
+    {
+        locallog();
+    }
+    inline virtual void proc() const
+    {
+        if (NULL == mLocEng->geofence) {
+            mLocEng->geofence = new LocEngGeofencer(*mLocEng, mCallbacks);
+        } else {
+            mLocEng->geofence->setCallbacks(mCallbacks);
+        }
+    }
+    inline void locallog() const
+    {
+        LOC_LOGV("LocEngGeofenceInit");
+    }
+    inline virtual void log() const
+    {
+        locallog();
+    }
+};
+
+struct LocEngGeofenceAdd : public LocMsg {
+    loc_eng_data_s_type* mLocEng;
+    const int32_t mId;
+    const double mLatitude;
+    const double mLongitude;
+    const double mRadius;
+    const int mLastTransition;
+    const int mMonitorTransitions;
+    const int mResponsivenessMs;
+    const int mUnknownTimerMs;
+    inline LocEngGeofenceAdd(loc_eng_data_s_type* locEng, int32_t id,
+                             double latitude, double longitude,
+                             double radius, int lastTransition,
+                             int monitorTransitions, int responsivenessMs,
+                             int unknownTimerMs) :
+        LocMsg(), mLocEng(locEng), mId(id), mLatitude(latitude),
+        mLongitude(longitude), mRadius(radius),
+        mLastTransition(lastTransition),
+        mMonitorTransitions(monitorTransitions),
+        mResponsivenessMs(responsivenessMs), mUnknownTimerMs(unknownTimerMs)
+    {
+        locallog();
+    }
+    inline virtual void proc() const
+    {
+        if (NULL != mLocEng->geofence) {
+            mLocEng->geofence->add(mId, mLatitude, mLongitude, mRadius,
+                                   mLastTransition, mMonitorTransitions,
+                                   mResponsivenessMs, mUnknownTimerMs);
+        }
+    }
+    inline void locallog() const
+    {
+        LOC_LOGV("LocEngGeofenceAdd - id: %d\n  lat: %f\n  lon: %f\n"
+                 "  radius: %f\n  last transition: %d\n  monitor: %d\n"
+                 "  responsiveness: %d\n  unknown timer: %d",
+                 mId, mLatitude, mLongitude, mRadius, mLastTransition,
+                 mMonitorTransitions, mResponsivenessMs, mUnknownTimerMs);
+    }
+    inline virtual void log() const
+    {
+        locallog();
+    }
+};
+
+struct LocEngGeofenceRemove : public LocMsg {
+    loc_eng_data_s_type* mLocEng;
+    const int32_t mId;
+    inline LocEngGeofenceRemove(loc_eng_data_s_type* locEng, int32_t id) :
+        LocMsg(), mLocEng(locEng), mId(id)
+    {
+        locallog();
+    }
+    inline virtual void proc() const
+    {
+        if (NULL != mLocEng->geofence) {
+            mLocEng->geofence->remove(mId);
+        }
+    }
+    inline void locallog() const
+    {
+        LOC_LOGV("LocEngGeofenceRemove - id: %d", mId);
+    }
+    inline virtual void log() const
+    {
+        locallog();
+    }
+};
+
+struct LocEngGeofencePause : public LocMsg {
+    loc_eng_data_s_type* mLocEng;
+    const int32_t mId;
+    inline LocEngGeofencePause(loc_eng_data_s_type* locEng, int32_t id) :
+        LocMsg(), mLocEng(locEng), mId(id)
+    {
+        locallog();
+    }
+    inline virtual void proc() const
+    {
+        if (NULL != mLocEng->geofence) {
+            mLocEng->geofence->pause(mId);
+        }
+    }
+    inline void locallog() const
+    {
+        LOC_LOGV("LocEngGeofencePause - id: %d", mId);
+    }
+    inline virtual void log() const
+    {
+        locallog();
+    }
+};
+
+struct LocEngGeofenceResume : public LocMsg {
+    loc_eng_data_s_type* mLocEng;
+    const int32_t mId;
+    const int mMonitorTransitions;
+    inline LocEngGeofenceResume(loc_eng_data_s_type* locEng, int32_t id,
+                                int monitorTransitions) :
+        LocMsg(), mLocEng(locEng), mId(id),
+        mMonitorTransitions(monitorTransitions)
+    {
+        locallog();
+    }
+    inline virtual void proc() const
+    {
+        if (NULL != mLocEng->geofence) {
+            mLocEng->geofence->resume(mId, mMonitorTransitions);
+        }
+    }
+    inline void locallog() const
+    {
+        LOC_LOGV("LocEngGeofenceResume - id: %d\n  monitor: %d",
+                 mId, mMonitorTransitions);
+    }
+    inline virtual void log() const
+    {
+        locallog();
+    }
+};
+
+struct LocEngGeofenceTimeout : public LocMsg {
+    loc_eng_data_s_type* mLocEng;
+    inline LocEngGeofenceTimeout(loc_eng_data_s_type* locEng) :
+        LocMsg(), mLocEng(locEng)
+    {
+        locallog();
+    }
+    inline virtual void proc() const
+    {
+        mLocEng->geofence->onTimer();
+    }
+    inline void locallog() const
+    {
+        LOC_LOGV("LocEngGeofenceTimeout");
+    }
+    inline virtual void log() const
+    {
+        locallog();
+    }
+};
+
+// called on the timer thread
+void LocEngGeofenceTimer::timeOutCallback()
+{
+    mLocEng->adapter->sendMsg(new LocEngGeofenceTimeout(mLocEng));
+}
+
+LocEngGeofencer::LocEngGeofencer(loc_eng_data_s_type& locEng,
+                                 const GpsGeofenceCallbacks& callbacks) :
+    mLocEng(locEng), mCallbacks(callbacks),
+    mFences(NULL), mFenceCap(0), mFreeFence(-1),
+    mCells(NULL), mCellCap(0), mFreeCell(-1),
+    mWatch(-1), mActive(0), mStamp(0),
+    mMinResponsivenessMs(LOC_GEOFENCE_MAX_INTERVAL_MSEC),
+    mMinUnknownTimerMs(0),
+    mLastFixMs(0), mAvailable(false),
+    mIntervalMs(LOC_GEOFENCE_MIN_INTERVAL_MSEC),
+    mSessionIntervalMs(0),
+    mTimer(&locEng), mTimerDeadlineMs(0), mTimerArmed(false)
+{
+    memset(&mLastFix, 0, sizeof(mLastFix));
+    for (int i = 0; i < GEOFENCE_ID_BUCKETS; i++) {
+        mIdBuckets[i] = -1;
+    }
+    for (int i = 0; i < LOC_GEOFENCE_GRID_BUCKETS; i++) {
+        mGrid[i] = -1;
+    }
+}
+
+int64_t LocEngGeofencer::nowMs()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_BOOTTIME, &now);
+    return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+// haversine, in meters
+double LocEngGeofencer::distance(double lat1, double lon1,
+                                 double lat2, double lon2)
+{
+    double dLat = (lat2 - lat1) * M_PI / 180.0;
+    double dLon = (lon2 - lon1) * M_PI / 180.0;
+    double a = sin(dLat / 2) * sin(dLat / 2) +
+               cos(lat1 * M_PI / 180.0) * cos(lat2 * M_PI / 180.0) *
+               sin(dLon / 2) * sin(dLon / 2);
+    return 2 * GEOFENCE_EARTH_RADIUS_M * atan2(sqrt(a), sqrt(1 - a));
+}
+
+int LocEngGeofencer::find(int32_t id) const
+{
+    int idx = mIdBuckets[(uint32_t)id % GEOFENCE_ID_BUCKETS];
+    while (-1 != idx && mFences[idx].id != id) {
+        idx = mFences[idx].idNext;
+    }
+    return idx;
+}
+
+int LocEngGeofencer::allocFence(int32_t id)
+{
+    if (-1 == mFreeFence) {
+        if (mFenceCap >= LOC_GEOFENCE_MAX_FENCES) {
+            return -1;
+        }
+        int cap = (0 == mFenceCap) ? 64 : mFenceCap * 2;
+        if (cap > LOC_GEOFENCE_MAX_FENCES) {
+            cap = LOC_GEOFENCE_MAX_FENCES;
+        }
+        LocEngGeofence* fences =
+            (LocEngGeofence*)realloc(mFences, cap * sizeof(LocEngGeofence));
+        if (NULL == fences) {
+            return -1;
+        }
+        for (int i = cap - 1; i >= mFenceCap; i--) {
+            fences[i].used = false;
+            fences[i].idNext = mFreeFence;
+            mFreeFence = i;
+        }
+        mFences = fences;
+        mFenceCap = cap;
+    }
+
+    int idx = mFreeFence;
+    mFreeFence = mFences[idx].idNext;
+    memset(&mFences[idx], 0, sizeof(LocEngGeofence));
+    mFences[idx].id = id;
+    mFences[idx].used = true;
+    mFences[idx].watchPrev = mFences[idx].watchNext = -1;
+
+    int* bucket = &mIdBuckets[(uint32_t)id % GEOFENCE_ID_BUCKETS];
+    mFences[idx].idNext = *bucket;
+    *bucket = idx;
+    return idx;
+}
+
+void LocEngGeofencer::freeFence(int idx)
+{
+    int* link = &mIdBuckets[(uint32_t)mFences[idx].id % GEOFENCE_ID_BUCKETS];
+    while (*link != idx) {
+        link = &mFences[*link].idNext;
+    }
+    *link = mFences[idx].idNext;
+
+    mFences[idx].used = false;
+    mFences[idx].idNext = mFreeFence;
+    mFreeFence = idx;
+}
+
+bool LocEngGeofencer::addCell(uint32_t cell, int idx)
+{
+    if (-1 == mFreeCell) {
+        int cap = (0 == mCellCap) ? 256 : mCellCap * 2;
+        LocEngGeofenceCell* cells =
+            (LocEngGeofenceCell*)realloc(mCells, cap * sizeof(LocEngGeofenceCell));
+        if (NULL == cells) {
+            return false;
+        }
+        for (int i = cap - 1; i >= mCellCap; i--) {
+            cells[i].next = mFreeCell;
+            mFreeCell = i;
+        }
+        mCells = cells;
+        mCellCap = cap;
+    }
+
+    int entry = mFreeCell;
+    mFreeCell = mCells[entry].next;
+    int* bucket = &mGrid[cellBucket(cell)];
+    mCells[entry].cell = cell;
+    mCells[entry].fence = idx;
+    mCells[entry].next = *bucket;
+    *bucket = entry;
+    return true;
+}
+
+void LocEngGeofencer::removeCell(uint32_t cell, int idx)
+{
+    int* link = &mGrid[cellBucket(cell)];
+    while (-1 != *link) {
+        int entry = *link;
+        if (mCells[entry].cell == cell && mCells[entry].fence == idx) {
+            *link = mCells[entry].next;
+            mCells[entry].next = mFreeCell;
+            mFreeCell = entry;
+            return;
+        }
+        link = &mCells[entry].next;
+    }
+}
+
+// puts the fence in every cell its bounding box overlaps
+bool LocEngGeofencer::index(int idx)
+{
+    LocEngGeofence* f = &mFences[idx];
+    double dLat = f->radius / GEOFENCE_M_PER_DEG;
+    double maxLat = fabs(f->latitude) + dLat;
+    double cosLat = (maxLat < 90.0) ? cos(maxLat * M_PI / 180.0) : 0;
+    double dLon = (cosLat > 0) ? dLat / cosLat : 360.0;
+
+    f->oversize = true;
+    if (dLon < 180.0) {
+        f->minRow = cellRow(f->latitude - dLat);
+        f->maxRow = cellRow(f->latitude + dLat);
+        f->minCol = cellCol(f->longitude - dLon);
+        f->maxCol = cellCol(f->longitude + dLon);
+        f->oversize = (f->maxRow - f->minRow + 1) * (f->maxCol - f->minCol + 1) >
+                      LOC_GEOFENCE_MAX_CELLS_PER_FENCE;
+    }
+
+    if (f->oversize) {
+        return addCell(GEOFENCE_CELL_ALL, idx);
+    }
+    for (int32_t row = f->minRow; row <= f->maxRow; row++) {
+        for (int32_t col = f->minCol; col <= f->maxCol; col++) {
+            if (!addCell(cellKey(row, col), idx)) {
+                // take back the cells added so far
+                for (int32_t r = f->minRow; r <= row; r++) {
+                    for (int32_t c = f->minCol;
+                         c <= f->maxCol && (r < row || c < col); c++) {
+                        removeCell(cellKey(r, c), idx);
+                    }
+                }
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void LocEngGeofencer::unindex(int idx)
+{
+    const LocEngGeofence* f = &mFences[idx];
+    if (f->oversize) {
+        removeCell(GEOFENCE_CELL_ALL, idx);
+        return;
+    }
+    for (int32_t row = f->minRow; row <= f->maxRow; row++) {
+        for (int32_t col = f->minCol; col <= f->maxCol; col++) {
+            removeCell(cellKey(row, col), idx);
+        }
+    }
+}
+
+void LocEngGeofencer::watchAdd(int idx)
+{
+    if (-1 != mFences[idx].watchPrev || mWatch == idx) {
+        return;
+    }
+    mFences[idx].watchPrev = -1;
+    mFences[idx].watchNext = mWatch;
+    if (-1 != mWatch) {
+        mFences[mWatch].watchPrev = idx;
+    }
+    mWatch = idx;
+}
+
+void LocEngGeofencer::watchRemove(int idx)
+{
+    LocEngGeofence* f = &mFences[idx];
+    if (-1 == f->watchPrev && mWatch != idx) {
+        return;
+    }
+    if (-1 != f->watchPrev) {
+        mFences[f->watchPrev].watchNext = f->watchNext;
+    } else {
+        mWatch = f->watchNext;
+    }
+    if (-1 != f->watchNext) {
+        mFences[f->watchNext].watchPrev = f->watchPrev;
+    }
+    f->watchPrev = f->watchNext = -1;
+}
+
+void LocEngGeofencer::setState(int idx, int state, const GpsLocation* location,
+                               GpsUtcTime timestamp)
+{
+    LocEngGeofence* f = &mFences[idx];
+    if (f->state == state) {
+        return;
+    }
+    f->state = state;
+    if (GPS_GEOFENCE_EXITED == state) {
+        watchRemove(idx);
+    } else {
+        watchAdd(idx);
+    }
+
+    if (f->monitorTransitions & state) {
+        LOC_LOGD("%s:%d]: fence %d transition %d\n", __func__, __LINE__,
+                 f->id, state);
+        mCallbacks.geofence_transition_callback(f->id, (GpsLocation*)location,
+                                                state, timestamp);
+    }
+}
+
+// the smallest responsiveness and unknown timer of the active fences
+void LocEngGeofencer::updateLimits()
+{
+    mMinResponsivenessMs = LOC_GEOFENCE_MAX_INTERVAL_MSEC;
+    mMinUnknownTimerMs = 0;
+    for (int i = 0; i < mFenceCap; i++) {
+        const LocEngGeofence* f = &mFences[i];
+        if (f->used && !f->paused) {
+            if (f->responsivenessMs > 0 &&
+                f->responsivenessMs < mMinResponsivenessMs) {
+                mMinResponsivenessMs = f->responsivenessMs;
+            }
+            if (f->unknownTimerMs > 0 &&
+                (0 == mMinUnknownTimerMs ||
+                 f->unknownTimerMs < mMinUnknownTimerMs)) {
+                mMinUnknownTimerMs = f->unknownTimerMs;
+            }
+        }
+    }
+}
+
+/* Distance from the fix to the edge of the block of cells ring cells
+   around its own, in every direction. A fence indexed in none of these
+   cells has its boundary at least this far. The east west extent is taken
+   at the poleward edge of the block, where it is narrowest. */
+double LocEngGeofencer::blockEdge(double latitude, double longitude,
+                                  int32_t row, int32_t col, int32_t ring)
+{
+    double rowBase = row * LOC_GEOFENCE_CELL_DEG - 90.0;
+    double colBase = col * LOC_GEOFENCE_CELL_DEG - 180.0;
+    double poleward = fabs(latitude) + (ring + 1) * LOC_GEOFENCE_CELL_DEG;
+    double edge = HUGE_VAL;
+
+    // there are no cells beyond the poles
+    if (row - ring > 0) {
+        edge = (latitude - (rowBase - ring * LOC_GEOFENCE_CELL_DEG)) *
+               GEOFENCE_M_PER_DEG;
+    }
+    if (row + ring < GEOFENCE_GRID_ROWS - 1) {
+        edge = fmin(edge, (rowBase + (ring + 1) * LOC_GEOFENCE_CELL_DEG -
+                           latitude) * GEOFENCE_M_PER_DEG);
+    }
+    if (poleward < 90.0) {
+        edge = fmin(edge,
+                    fmin(longitude - (colBase - ring * LOC_GEOFENCE_CELL_DEG),
+                         colBase + (ring + 1) * LOC_GEOFENCE_CELL_DEG -
+                         longitude) *
+                    GEOFENCE_M_PER_DEG * cos(poleward * M_PI / 180.0));
+    } else {
+        edge = 0;
+    }
+    return edge;
+}
+
+/* Checks the fix against the fences in the 3x3 cells around it, the
+   oversize fences and the watch list. Any other fence is outside and has
+   its boundary beyond the 3x3 block; if that is closer than any boundary
+   found, the search goes on further out for the real distance. */
+double LocEngGeofencer::evaluate(const GpsLocation& location)
+{
+    double latitude = location.latitude;
+    double longitude = location.longitude;
+    // a fix this close outside a fence does not tell it has been left
+    double band = (location.flags & GPS_LOCATION_HAS_ACCURACY) ?
+                  location.accuracy : 0;
+    int32_t row = cellRow(latitude);
+    int32_t col = cellCol(longitude);
+    double nearest = HUGE_VAL;
+
+    uint32_t cells[10];
+    int numCells = 0;
+    for (int32_t r = row - 1; r <= row + 1; r++) {
+        if (r >= 0 && r < GEOFENCE_GRID_ROWS) {
+            for (int32_t c = col - 1; c <= col + 1; c++) {
+                cells[numCells++] = cellKey(r, c);
+            }
+        }
+    }
+    cells[numCells++] = GEOFENCE_CELL_ALL;
+
+    // the watch list is walked last, as setState() takes fences off it
+    mStamp++;
+    for (int i = 0; i <= numCells; i++) {
+        int next = (i < numCells) ? mGrid[cellBucket(cells[i])] : mWatch;
+        while (-1 != next) {
+            int idx;
+            if (i < numCells) {
+                int entry = next;
+                next = mCells[entry].next;
+                if (mCells[entry].cell != cells[i]) {
+                    continue;
+                }
+                idx = mCells[entry].fence;
+            } else {
+                idx = next;
+                next = mFences[idx].watchNext;
+            }
+
+            LocEngGeofence* f = &mFences[idx];
+            if (f->evalStamp == mStamp) {
+                continue;
+            }
+            f->evalStamp = mStamp;
+
+            double d = distance(latitude, longitude,
+                                f->latitude, f->longitude);
+            nearest = fmin(nearest, fabs(d - f->radius));
+            if (d <= f->radius) {
+                setState(idx, GPS_GEOFENCE_ENTERED, &location,
+                         location.timestamp);
+            } else if (d > f->radius + band) {
+                setState(idx, GPS_GEOFENCE_EXITED, &location,
+                         location.timestamp);
+            }
+        }
+    }
+
+    if (nearest > blockEdge(latitude, longitude, row, col, 1)) {
+        nearest = nearestBeyond(latitude, longitude, row, col, nearest);
+    }
+    return nearest;
+}
+
+/* Distance to the nearest boundary of the fences outside the 3x3 block,
+   which the fix is outside of. The search widens ring by ring until the
+   rest of the fences are further than the nearest boundary found, or than
+   the fences' longest fix interval can cover; a search that gets that far
+   out checks every fence instead. */
+double LocEngGeofencer::nearestBeyond(double latitude, double longitude,
+                                      int32_t row, int32_t col,
+                                      double nearest)
+{
+    double reach = (double)mMinResponsivenessMs * LOC_GEOFENCE_SPEED_MPS /
+                   1000;
+    int32_t ring;
+
+    for (ring = 2; ring <= LOC_GEOFENCE_MAX_RINGS; ring++) {
+        double edge = blockEdge(latitude, longitude, row, col, ring - 1);
+        if (edge >= nearest || edge >= reach) {
+            return fmin(nearest, edge);
+        }
+
+        for (int32_t r = row - ring; r <= row + ring; r++) {
+            if (r < 0 || r >= GEOFENCE_GRID_ROWS) {
+                continue;
+            }
+            // the whole row at the top and bottom, the two ends otherwise
+            int32_t step = (r == row - ring || r == row + ring) ? 1 : 2 * ring;
+            for (int32_t c = col - ring; c <= col + ring; c += step) {
+                uint32_t cell = cellKey(r, c);
+                for (int entry = mGrid[cellBucket(cell)]; -1 != entry;
+                     entry = mCells[entry].next) {
+                    if (mCells[entry].cell != cell) {
+                        continue;
+                    }
+                    LocEngGeofence* f = &mFences[mCells[entry].fence];
+                    if (f->evalStamp == mStamp) {
+                        continue;
+                    }
+                    f->evalStamp = mStamp;
+                    nearest = fmin(nearest,
+                                   fabs(distance(latitude, longitude,
+                                                 f->latitude, f->longitude) -
+                                        f->radius));
+                }
+            }
+        }
+    }
+
+    double edge = blockEdge(latitude, longitude, row, col,
+                            LOC_GEOFENCE_MAX_RINGS);
+    if (edge >= nearest || edge >= reach) {
+        return fmin(nearest, edge);
+    }
+    for (int i = 0; i < mFenceCap; i++) {
+        LocEngGeofence* f = &mFences[i];
+        if (f->used && !f->paused && f->evalStamp != mStamp) {
+            f->evalStamp = mStamp;
+            nearest = fmin(nearest,
+                           fabs(distance(latitude, longitude,
+                                         f->latitude, f->longitude) -
+                                f->radius));
+        }
+    }
+    return nearest;
+}
+
+// fences not decided by a fix for their unknown timer become uncertain
+void LocEngGeofencer::checkUnknown(int64_t now)
+{
+    int64_t gap = now - mLastFixMs;
+    if (0 == mMinUnknownTimerMs || gap < mMinUnknownTimerMs) {
+        return;
+    }
+
+    if (mAvailable) {
+        mAvailable = false;
+        LOC_LOGD("%s:%d]: no fix for %lld ms\n", __func__, __LINE__,
+                 (long long)gap);
+        mCallbacks.geofence_status_callback(GPS_GEOFENCE_UNAVAILABLE,
+                                            &mLastFix);
+    }
+
+    for (int i = 0; i < mFenceCap; i++) {
+        const LocEngGeofence* f = &mFences[i];
+        if (f->used && !f->paused && f->unknownTimerMs > 0 &&
+            gap >= f->unknownTimerMs) {
+            setState(i, GPS_GEOFENCE_UNCERTAIN, &mLastFix, mLastFix.timestamp);
+        }
+    }
+}
+
+// a fence whose state is to be settled wants a fix at the shortest interval
+void LocEngGeofencer::trackSoon()
+{
+    mIntervalMs = LOC_GEOFENCE_MIN_INTERVAL_MSEC;
+    updateOwnSession();
+    schedule(mIntervalMs + LOC_GEOFENCE_FIX_TIMEOUT_MSEC);
+}
+
+void LocEngGeofencer::schedule(int msec)
+{
+    mTimer.stop();
+    mTimerDeadlineMs = nowMs() + msec;
+    mTimerArmed = mTimer.start(msec, true);
+    if (!mTimerArmed) {
+        LOC_LOGE("%s:%d]: timer not started\n", __func__, __LINE__);
+    }
+}
+
+// Keeps one session running at no more than mIntervalMs. Its interval
+// is mIntervalMs rounded down to a power of 2 times the minimum, and is
+// only changed when mIntervalMs drops below it or grows to 4 times it,
+// so that an interval changing a little with every fix does not restart
+// the modem each time.
+void LocEngGeofencer::updateOwnSession()
+{
+    if (0 != mSessionIntervalMs &&
+        mIntervalMs >= mSessionIntervalMs &&
+        mIntervalMs < 4 * mSessionIntervalMs) {
+        return;
+    }
+
+    int intervalMs = LOC_GEOFENCE_MIN_INTERVAL_MSEC;
+    while (intervalMs * 2 <= mIntervalMs) {
+        intervalMs *= 2;
+    }
+    LOC_LOGD("%s:%d]: interval %d ms\n", __func__, __LINE__, intervalMs);
+    LocPosMode mode((gps_conf.CAPABILITIES & GPS_CAPABILITY_MSB) ?
+                    LOC_POSITION_MODE_MS_BASED :
+                    LOC_POSITION_MODE_STANDALONE,
+                    GPS_POSITION_RECURRENCE_PERIODIC,
+                    intervalMs,
+                    LOC_GEOFENCE_MAX_ACCURACY_M,
+                    LOC_GEOFENCE_FIX_TIMEOUT_MSEC, NULL, NULL);
+    mSessionIntervalMs = intervalMs;
+    if (LOC_API_ADAPTER_ERR_SUCCESS !=
+        mLocEng.adapter->startSession(LOC_ENG_SESSION_GEOFENCE, &mode)) {
+        LOC_LOGE("%s:%d]: startSession failed\n", __func__, __LINE__);
+        // tried again when the next fix is overdue
+        mSessionIntervalMs = 0;
+    }
+}
+
+// the framework's own session, if there is one, is left running
+void LocEngGeofencer::stopOwnSession()
+{
+    if (0 != mSessionIntervalMs) {
+        mLocEng.adapter->stopSession(LOC_ENG_SESSION_GEOFENCE);
+    }
+    mSessionIntervalMs = 0;
+}
+
+void LocEngGeofencer::stopTracking()
+{
+    mTimer.stop();
+    mTimerArmed = false;
+    stopOwnSession();
+}
+
+int LocEngGeofencer::add(int32_t id, double latitude, double longitude,
+                         double radius, int lastTransition,
+                         int monitorTransitions, int responsivenessMs,
+                         int unknownTimerMs)
+{
+    int result = GPS_GEOFENCE_OPERATION_SUCCESS;
+    int idx = -1;
+
+    if (monitorTransitions & ~GEOFENCE_TRANSITIONS) {
+        result = GPS_GEOFENCE_ERROR_INVALID_TRANSITION;
+    } else if (radius <= 0 || fabs(latitude) > 90.0 ||
+               fabs(longitude) > 180.0) {
+        result = GPS_GEOFENCE_ERROR_GENERIC;
+    } else if (-1 != find(id)) {
+        result = GPS_GEOFENCE_ERROR_ID_EXISTS;
+    } else if (-1 == (idx = allocFence(id))) {
+        result = GPS_GEOFENCE_ERROR_TOO_MANY_GEOFENCES;
+    } else {
+        LocEngGeofence* f = &mFences[idx];
+        f->latitude = latitude;
+        f->longitude = longitude;
+        f->radius = radius;
+        f->monitorTransitions = monitorTransitions;
+        f->responsivenessMs = responsivenessMs;
+        f->unknownTimerMs = unknownTimerMs;
+        f->state = (GPS_GEOFENCE_ENTERED == lastTransition ||
+                    GPS_GEOFENCE_EXITED == lastTransition) ?
+                   lastTransition : GPS_GEOFENCE_UNCERTAIN;
+
+        if (!index(idx)) {
+            freeFence(idx);
+            result = GPS_GEOFENCE_ERROR_GENERIC;
+        } else {
+            if (GPS_GEOFENCE_EXITED != f->state) {
+                watchAdd(idx);
+            }
+            if (0 == mActive++) {
+                mLastFixMs = nowMs();
+            }
+            updateLimits();
+        }
+    }
+
+    LOC_LOGD("%s:%d]: id %d, result %d, %d active\n", __func__, __LINE__,
+             id, result, mActive);
+    mCallbacks.geofence_add_callback(id, result);
+
+    // a new fence wants a fix soon, to settle its state
+    if (GPS_GEOFENCE_OPERATION_SUCCESS == result) {
+        trackSoon();
+    }
+    return result;
+}
+
+int LocEngGeofencer::remove(int32_t id)
+{
+    int result = GPS_GEOFENCE_OPERATION_SUCCESS;
+    int idx = find(id);
+
+    if (-1 == idx) {
+        result = GPS_GEOFENCE_ERROR_ID_UNKNOWN;
+    } else {
+        if (!mFences[idx].paused) {
+            unindex(idx);
+            watchRemove(idx);
+            mActive--;
+        }
+        freeFence(idx);
+        updateLimits();
+        if (0 == mActive) {
+            stopTracking();
+        }
+    }
+
+    mCallbacks.geofence_remove_callback(id, result);
+    return result;
+}
+
+int LocEngGeofencer::pause(int32_t id)
+{
+    int result = GPS_GEOFENCE_OPERATION_SUCCESS;
+    int idx = find(id);
+
+    if (-1 == idx) {
+        result = GPS_GEOFENCE_ERROR_ID_UNKNOWN;
+    } else if (!mFences[idx].paused) {
+        unindex(idx);
+        watchRemove(idx);
+        mFences[idx].paused = true;
+        mActive--;
+        updateLimits();
+        if (0 == mActive) {
+            stopTracking();
+        }
+    }
+
+    mCallbacks.geofence_pause_callback(id, result);
+    return result;
+}
+
+int LocEngGeofencer::resume(int32_t id, int monitorTransitions)
+{
+    int result = GPS_GEOFENCE_OPERATION_SUCCESS;
+    int idx = find(id);
+
+    if (-1 == idx) {
+        result = GPS_GEOFENCE_ERROR_ID_UNKNOWN;
+    } else if (monitorTransitions & ~GEOFENCE_TRANSITIONS) {
+        result = GPS_GEOFENCE_ERROR_INVALID_TRANSITION;
+    } else {
+        LocEngGeofence* f = &mFences[idx];
+        f->monitorTransitions = monitorTransitions;
+        if (f->paused) {
+            if (!index(idx)) {
+                result = GPS_GEOFENCE_ERROR_GENERIC;
+            } else {
+                // where it is now is not known
+                f->paused = false;
+                f->state = GPS_GEOFENCE_UNCERTAIN;
+                watchAdd(idx);
+                if (0 == mActive++) {
+                    mLastFixMs = nowMs();
+                }
+                updateLimits();
+                trackSoon();
+            }
+        }
+    }
+
+    mCallbacks.geofence_resume_callback(id, result);
+    return result;
+}
+
+void LocEngGeofencer::reportPosition(const GpsLocation& location)
+{
+    if (0 == mActive ||
+        !(location.flags & GPS_LOCATION_HAS_LAT_LONG) ||
+        ((location.flags & GPS_LOCATION_HAS_ACCURACY) &&
+         location.accuracy > LOC_GEOFENCE_MAX_ACCURACY_M)) {
+        return;
+    }
+
+    mLastFix = location;
+    mLastFixMs = nowMs();
+    if (!mAvailable) {
+        mAvailable = true;
+        mCallbacks.geofence_status_callback(GPS_GEOFENCE_AVAILABLE,
+                                            &mLastFix);
+    }
+
+    double nearest = evaluate(location);
+    double interval = nearest * 1000 / LOC_GEOFENCE_SPEED_MPS;
+    if (interval > mMinResponsivenessMs) {
+        interval = mMinResponsivenessMs;
+    }
+    if (interval < LOC_GEOFENCE_MIN_INTERVAL_MSEC) {
+        interval = LOC_GEOFENCE_MIN_INTERVAL_MSEC;
+    }
+    mIntervalMs = (int)interval;
+
+    LOC_LOGV("%s:%d]: nearest boundary %.0f m, next fix in %d ms\n",
+             __func__, __LINE__, nearest, mIntervalMs);
+    updateOwnSession();
+    schedule(mIntervalMs + LOC_GEOFENCE_FIX_TIMEOUT_MSEC);
+}
+
+void LocEngGeofencer::onTimer()
+{
+    int64_t now = nowMs();
+    if (!mTimerArmed ||
+        now + GEOFENCE_TIMER_SLACK_MSEC < mTimerDeadlineMs) {
+        return;
+    }
+    mTimerArmed = false;
+    if (0 == mActive) {
+        return;
+    }
+
+    // the next fix is overdue; the session keeps running, and is only
+    // started again if it could not be started before
+    checkUnknown(now);
+    LOC_LOGW("%s:%d]: no fix in %lld ms\n", __func__, __LINE__,
+             (long long)(now - mLastFixMs));
+    updateOwnSession();
+    schedule(LOC_GEOFENCE_FIX_TIMEOUT_MSEC);
+}
+
+/*===========================================================================
+FUNCTION    loc_eng_geofence_init
+
+DESCRIPTION
+   Initializes the AP side geofencing. The geofencer itself is created on
+   the MsgTask, as all of its state is kept there.
+
+DEPENDENCIES
+   NONE
+
+RETURN VALUE
+   None
+
+SIDE EFFECTS
+   N/A
+
+===========================================================================*/
+void loc_eng_geofence_init(loc_eng_data_s_type &loc_eng_data,
+                           GpsGeofenceCallbacks* callbacks)
+{
+    ENTRY_LOG_CALLFLOW();
+
+    if (NULL == callbacks || NULL == loc_eng_data.adapter) {
+        EXIT_LOG(%s, "loc_eng_geofence_init: failed, no cb or not inited.");
+        return;
+    }
+
+    loc_eng_data.adapter->sendMsg(new LocEngGeofenceInit(&loc_eng_data,
+                                                         *callbacks));
+    EXIT_LOG(%s, VOID_RET);
+}
+
+void loc_eng_geofence_add(loc_eng_data_s_type &loc_eng_data, int32_t id,
+                          double latitude, double longitude, double radius,
+                          int last_transition, int monitor_transitions,
+                          int notification_responsiveness_ms,
+                          int unknown_timer_ms)
+{
+    ENTRY_LOG_CALLFLOW();
+    if (NULL != loc_eng_data.adapter) {
+        loc_eng_data.adapter->sendMsg(
+            new LocEngGeofenceAdd(&loc_eng_data, id, latitude, longitude,
+                                  radius, last_transition,
+                                  monitor_transitions,
+                                  notification_responsiveness_ms,
+                                  unknown_timer_ms));
+    }
+    EXIT_LOG(%s, VOID_RET);
+}
+
+void loc_eng_geofence_remove(loc_eng_data_s_type &loc_eng_data, int32_t id)
+{
+    ENTRY_LOG_CALLFLOW();
+    if (NULL != loc_eng_data.adapter) {
+        loc_eng_data.adapter->sendMsg(new LocEngGeofenceRemove(&loc_eng_data,
+                                                               id));
+    }
+    EXIT_LOG(%s, VOID_RET);
+}
+
+void loc_eng_geofence_pause(loc_eng_data_s_type &loc_eng_data, int32_t id)
+{
+    ENTRY_LOG_CALLFLOW();
+    if (NULL != loc_eng_data.adapter) {
+        loc_eng_data.adapter->sendMsg(new LocEngGeofencePause(&loc_eng_data,
+                                                              id));
+    }
+    EXIT_LOG(%s, VOID_RET);
+}
+
+void loc_eng_geofence_resume(loc_eng_data_s_type &loc_eng_data, int32_t id,
+                             int monitor_transitions)
+{
+    ENTRY_LOG_CALLFLOW();
+    if (NULL != loc_eng_data.adapter) {
+        loc_eng_data.adapter->sendMsg(
+            new LocEngGeofenceResume(&loc_eng_data, id, monitor_transitions));
+    }
+    EXIT_LOG(%s, VOID_RET);
+}
+
+// may be called off the MsgTask, so this is only a snapshot
+bool loc_eng_geofence_wants_position(loc_eng_data_s_type &loc_eng_data)
+{
+    LocEngGeofencer* geofence = loc_eng_data.geofence;
+    return NULL != geofence && geofence->isActive();
+}
+
+// called on the MsgTask, for every fix reported
+void loc_eng_geofence_report_position(loc_eng_data_s_type &loc_eng_data,
+                                      const GpsLocation &location,
+                                      enum loc_sess_status status)
+{
+    if (NULL != loc_eng_data.geofence && LOC_SESS_FAILURE != status) {
+        loc_eng_data.geofence->reportPosition(location);
+    }
+}
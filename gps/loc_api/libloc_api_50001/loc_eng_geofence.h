@@ -0,0 +1,60 @@
+/* Copyright (c) 2014, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation, nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef LOC_ENG_GEOFENCE_H
+#define LOC_ENG_GEOFENCE_H
+
+/* AP side geofencing, used when there is no libgeofence.so. Fences are
+   kept in a grid of LOC_GEOFENCE_CELL_DEG cells, so a fix is only checked
+   against the fences in the cells around it, the fences it is inside of,
+   and the fences whose state is not known yet. */
+
+#define LOC_GEOFENCE_MAX_FENCES            4096
+/* grid cell size, about 1.1 km north to south */
+#define LOC_GEOFENCE_CELL_DEG              0.01
+/* a fence that spans more cells is checked on every fix instead */
+#define LOC_GEOFENCE_MAX_CELLS_PER_FENCE   16
+/* rings of cells searched around a fix far from any fence, before all
+   fences are checked instead */
+#define LOC_GEOFENCE_MAX_RINGS             16
+/* hash buckets of the grid, a power of 2 */
+#define LOC_GEOFENCE_GRID_BUCKETS          4096
+/* fixes less accurate than this are not used */
+#define LOC_GEOFENCE_MAX_ACCURACY_M        200
+/* the fix interval is the time it takes to reach the nearest fence
+   boundary at this speed, within the bounds below */
+#define LOC_GEOFENCE_SPEED_MPS             30
+#define LOC_GEOFENCE_MIN_INTERVAL_MSEC     1000
+#define LOC_GEOFENCE_MAX_INTERVAL_MSEC     (15 * 60 * 1000)
+/* how long past its interval a fix is waited for */
+#define LOC_GEOFENCE_FIX_TIMEOUT_MSEC      (60 * 1000)
+
+class LocEngGeofencer;
+
+#endif /* LOC_ENG_GEOFENCE_H */
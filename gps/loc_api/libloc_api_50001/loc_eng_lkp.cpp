@@ -0,0 +1,193 @@
+/* Copyright (c) 2014, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation, nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#define LOG_NDDEBUG 0
+#define LOG_TAG "LocSvc_eng"
+
+#include <math.h>
+#include <time.h>
+#include <loc_eng.h>
+#include <loc_misc_utils.h>
+#include "log_util.h"
+#include "platform_lib_includes.h"
+
+#define LKP_FILE              "/data/misc/location/last_position.bin"
+#define LKP_MAGIC             0x4C4B5030 /* "LKP0" */
+#define LKP_VERSION           2
+/* a fix is written to flash at most this often, unless it is
+   substantially more accurate than the one already stored */
+#define LKP_SAVE_INTERVAL_MS  (60 * 1000)
+/* ignore seeds whose aged uncertainty has grown beyond this */
+#define LKP_MAX_UNCERTAINTY   (500 * 1000)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    double latitude;
+    double longitude;
+    float accuracy;
+    uint16_t source;
+    LocPosTechMask techMask;
+    int64_t timestamp;    // UTC, in milliseconds
+    uint32_t crc32;
+} LocEngLastPosition;
+
+// Only touched from the MsgTask thread
+static LocEngLastPosition lkp_cache;
+static bool lkp_cache_loaded = false;
+static int64_t lkp_last_save_ms = 0;
+
+static bool lkp_valid(const LocEngLastPosition &pos)
+{
+    return LKP_MAGIC == pos.magic &&
+           LKP_VERSION == pos.version &&
+           loc_util_crc32(0, &pos, offsetof(LocEngLastPosition, crc32)) ==
+           pos.crc32;
+}
+
+static void lkp_load()
+{
+    if (!lkp_cache_loaded) {
+        FILE* file = fopen(LKP_FILE, "rb");
+        if (NULL == file ||
+            fread(&lkp_cache, sizeof(lkp_cache), 1, file) != 1 ||
+            !lkp_valid(lkp_cache)) {
+            memset(&lkp_cache, 0, sizeof(lkp_cache));
+        }
+        if (NULL != file) {
+            fclose(file);
+        }
+        lkp_cache_loaded = true;
+    }
+}
+
+/*===========================================================================
+FUNCTION    loc_eng_lkp_update
+
+DESCRIPTION
+   Records a final fix as the last known position. The file on flash is
+   rewritten at most once every LKP_SAVE_INTERVAL_MS, unless the new fix
+   halves the uncertainty of the stored one.
+
+DEPENDENCIES
+   Must be called from the MsgTask thread.
+
+RETURN VALUE
+   none
+
+SIDE EFFECTS
+   N/A
+
+===========================================================================*/
+void loc_eng_lkp_update(const UlpLocation &location, LocPosTechMask techMask)
+{
+    const GpsLocation &gpsLocation = location.gpsLocation;
+    if (0 == gps_conf.LAST_POSITION_MAX_AGE ||
+        !(gpsLocation.flags & GPS_LOCATION_HAS_LAT_LONG) ||
+        !(gpsLocation.flags & GPS_LOCATION_HAS_ACCURACY) ||
+        gpsLocation.accuracy <= 0 || gpsLocation.timestamp <= 0) {
+        return;
+    }
+
+    lkp_load();
+    int64_t now = elapsedMillisSinceBoot();
+    bool save = !lkp_valid(lkp_cache) ||
+                0 == lkp_last_save_ms ||
+                now - lkp_last_save_ms >= LKP_SAVE_INTERVAL_MS ||
+                gpsLocation.accuracy * 2 < lkp_cache.accuracy;
+
+    lkp_cache.magic = LKP_MAGIC;
+    lkp_cache.version = LKP_VERSION;
+    lkp_cache.latitude = gpsLocation.latitude;
+    lkp_cache.longitude = gpsLocation.longitude;
+    lkp_cache.accuracy = gpsLocation.accuracy;
+    lkp_cache.source = location.position_source;
+    lkp_cache.techMask = techMask;
+    lkp_cache.timestamp = gpsLocation.timestamp;
+    lkp_cache.crc32 = loc_util_crc32(0, &lkp_cache,
+                                     offsetof(LocEngLastPosition, crc32));
+
+    if (save &&
+        0 == loc_util_write_file_atomic(LKP_FILE, &lkp_cache,
+                                        sizeof(lkp_cache), 0600)) {
+        lkp_last_save_ms = now;
+    }
+}
+
+/*===========================================================================
+FUNCTION    loc_eng_lkp_inject
+
+DESCRIPTION
+   Injects the last known position as a coarse seed, with its uncertainty
+   grown by LAST_POSITION_AGING_SPEED meters for every second elapsed since
+   the fix was taken. Nothing is injected if the position is older than
+   LAST_POSITION_MAX_AGE seconds, or if the system time looks wrong.
+
+DEPENDENCIES
+   Must be called from the MsgTask thread.
+
+RETURN VALUE
+   none
+
+SIDE EFFECTS
+   N/A
+
+===========================================================================*/
+void loc_eng_lkp_inject(loc_eng_data_s_type &loc_eng_data)
+{
+    LocEngAdapter* adapter = loc_eng_data.adapter;
+    if (0 == gps_conf.LAST_POSITION_MAX_AGE ||
+        !adapter->mSupportsPositionInjection) {
+        return;
+    }
+
+    lkp_load();
+    if (!lkp_valid(lkp_cache)) {
+        return;
+    }
+
+    int64_t ageMs = (int64_t)time(NULL) * 1000 - lkp_cache.timestamp;
+    if (ageMs < 0 || ageMs > (int64_t)gps_conf.LAST_POSITION_MAX_AGE * 1000) {
+        LOC_LOGV("%s:%d]: last position too old, age %lld ms",
+                 __func__, __LINE__, (long long)ageMs);
+        return;
+    }
+
+    float accuracy = lkp_cache.accuracy +
+        (float)ageMs / 1000 * gps_conf.LAST_POSITION_AGING_SPEED;
+    if (accuracy > LKP_MAX_UNCERTAINTY) {
+        return;
+    }
+
+    LOC_LOGD("%s:%d]: lat %f lon %f acc %f, age %lld ms, source 0x%x",
+             __func__, __LINE__, lkp_cache.latitude, lkp_cache.longitude,
+             accuracy, (long long)ageMs, lkp_cache.source);
+    adapter->injectPosition(lkp_cache.latitude, lkp_cache.longitude, accuracy);
+    loc_eng_ttff_mark(LOC_ENG_TTFF_POS_INJECT);
+}
@@ -38,6 +38,7 @@
 #include <loc_eng_log.h>
 #include <loc_eng.h>
 #include <MsgTask.h>
+#include <loc_fix_trace.h>
 #include <LocEngAdapter.h>
 
 #ifndef SSID_BUF_SIZE
@@ -91,6 +92,8 @@ struct LocEngReportPosition : public LocMsg {
     const void* mLocationExt;
     const enum loc_sess_status mStatus;
     const LocPosTechMask mTechMask;
+    // loc_fix_trace ID of the report, 0 if not traced
+    const uint32_t mTraceId;
     LocEngReportPosition(LocAdapterBase* adapter,
                          UlpLocation &loc,
                          GpsLocationExtended &locExtended,
@@ -280,6 +283,20 @@ struct LocEngUp : public LocMsg {
     virtual void log() const;
 };
 
+struct LocEngSetServerIpv4 : public LocMsg {
+    LocEngAdapter* mAdapter;
+    const unsigned int mNlAddr;
+    const int mPort;
+    const LocServerType mServerType;
+    LocEngSetServerIpv4(LocEngAdapter* adapter,
+                        unsigned int ip,
+                        int port,
+                        LocServerType type);
+    virtual void proc() const;
+    void locallog() const;
+    virtual void log() const;
+};
+
 struct LocEngGetZpp : public LocMsg {
     LocEngAdapter* mAdapter;
     LocEngGetZpp(LocEngAdapter* adapter);
@@ -289,11 +306,10 @@ struct LocEngGetZpp : public LocMsg {
     void send() const;
 };
 
+// drains the adapter's GNSS measurement ring
 struct LocEngReportGpsMeasurement : public LocMsg {
-    void* mLocEng;
-    const GpsData mGpsData;
-    LocEngReportGpsMeasurement(void* locEng,
-                               GpsData &gpsData);
+    LocEngAdapter* mAdapter;
+    LocEngReportGpsMeasurement(LocEngAdapter* adapter);
     virtual void proc() const;
     void locallog() const;
     virtual void log() const;
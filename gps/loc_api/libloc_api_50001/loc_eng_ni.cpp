@@ -42,6 +42,7 @@
 #include <MsgTask.h>
 
 #include <loc_eng.h>
+#include <LocTimer.h>
 
 #include "log_util.h"
 #include "platform_lib_includes.h"
@@ -53,13 +54,36 @@ using namespace loc_core;
  *                             DATA DECLARATION
  *
  *============================================================================*/
+/* A timer can fire just before its slot is reused; a timeout this far
+   ahead of the slot's deadline belongs to the previous session. */
+#define LOC_NI_TIMER_SLACK_MSEC            1000
 
 /*=============================================================================
  *
  *                             FUNCTION DECLARATIONS
  *
  *============================================================================*/
-static void* ni_thread_proc(void *args);
+static void loc_eng_ni_timeout_handler(loc_eng_data_s_type &loc_eng_data,
+                                       int slot);
+static void loc_eng_ni_response_handler(loc_eng_data_s_type &loc_eng_data,
+                                        int notif_id,
+                                        GpsUserResponseType user_response);
+
+static int64_t ni_boottime_msec()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_BOOTTIME, &now);
+    return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+class LocEngNiSessionTimer : public LocTimer {
+    loc_eng_data_s_type* const mLocEng;
+    const int mSlot;
+public:
+    inline LocEngNiSessionTimer(loc_eng_data_s_type* locEng, int slot) :
+        LocTimer(), mLocEng(locEng), mSlot(slot) {}
+    virtual void timeOutCallback();
+};
 
 struct LocEngInformNiResponse : public LocMsg {
     LocEngAdapter* mAdapter;
@@ -97,13 +121,97 @@ struct LocEngInformNiResponse : public LocMsg {
     }
 };
 
+struct LocEngNiTimeout : public LocMsg {
+    loc_eng_data_s_type* mLocEng;
+    const int mSlot;
+    inline LocEngNiTimeout(loc_eng_data_s_type* locEng, int slot) :
+        LocMsg(), mLocEng(locEng), mSlot(slot)
+    {
+        locallog();
+    }
+    inline virtual void proc() const
+    {
+        loc_eng_ni_timeout_handler(*mLocEng, mSlot);
+    }
+    inline void locallog() const
+    {
+        LOC_LOGV("LocEngNiTimeout - slot: %d", mSlot);
+    }
+    inline virtual void log() const
+    {
+        locallog();
+    }
+};
+
+struct LocEngNiRespond : public LocMsg {
+    loc_eng_data_s_type* mLocEng;
+    const int mNotifId;
+    const GpsUserResponseType mResponse;
+    inline LocEngNiRespond(loc_eng_data_s_type* locEng, int notif_id,
+                           GpsUserResponseType resp) :
+        LocMsg(), mLocEng(locEng), mNotifId(notif_id), mResponse(resp)
+    {
+        locallog();
+    }
+    inline virtual void proc() const
+    {
+        loc_eng_ni_response_handler(*mLocEng, mNotifId, mResponse);
+    }
+    inline void locallog() const
+    {
+        LOC_LOGV("LocEngNiRespond - id: %d\n  response: %s",
+                 mNotifId, loc_get_ni_response_name(mResponse));
+    }
+    inline virtual void log() const
+    {
+        locallog();
+    }
+};
+
+// called on the timer thread, the session itself is left to the MsgTask
+void LocEngNiSessionTimer::timeOutCallback()
+{
+    mLocEng->adapter->sendMsg(new LocEngNiTimeout(mLocEng, mSlot));
+}
+
+/*===========================================================================
+
+FUNCTION ni_end_session
+
+DESCRIPTION
+   Stops the session's timer, sends the response for the request unless it
+   is GPS_NI_RESPONSE_IGNORE, and frees the slot.
+
+===========================================================================*/
+static void ni_end_session(loc_eng_ni_session_s_type* pSession,
+                           GpsUserResponseType resp)
+{
+    pSession->timer->stop();
+
+    if (resp != GPS_NI_RESPONSE_IGNORE) {
+        LOC_LOGD("ni_end_session: id %d, resp %d\n", pSession->reqID, resp);
+        pSession->adapter->sendMsg(new LocEngInformNiResponse(pSession->adapter,
+                                                              resp,
+                                                              pSession->rawRequest));
+    } else {
+        LOC_LOGD("ni_end_session: id %d ignored\n", pSession->reqID);
+        free(pSession->rawRequest);
+    }
+
+    pSession->rawRequest = NULL;
+    pSession->reqID = 0;
+    pSession->expireTimeMs = 0;
+}
+
 /*===========================================================================
 
 FUNCTION loc_eng_ni_request_handler
 
 DESCRIPTION
-   Displays the NI request and awaits user input. If a previous request is
-   in session, it is ignored.
+   Displays the NI request and awaits user input. Each request gets its own
+   slot in the session table and its own no response timeout. A new non
+   emergency request is ignored while an emergency one is in progress, and
+   any request is ignored if the table is full.
 
 RETURN VALUE
    none
@@ -117,40 +225,38 @@ void loc_eng_ni_request_handler(loc_eng_data_s_type &loc_eng_data,
     char lcs_addr[32]; // Decoded LCS address for UMTS CP NI
     loc_eng_ni_data_s_type* loc_eng_ni_data_p = &loc_eng_data.loc_eng_ni_data;
     loc_eng_ni_session_s_type* pSession = NULL;
+    bool esInProgress = false;
 
     if (NULL == loc_eng_data.ni_notify_cb) {
         EXIT_LOG(%s, "loc_eng_ni_init hasn't happened yet.");
         return;
     }
 
-    if (notif->ni_type == GPS_NI_TYPE_EMERGENCY_SUPL) {
-        if (NULL != loc_eng_ni_data_p->sessionEs.rawRequest) {
-            LOC_LOGW("loc_eng_ni_request_handler, supl es NI in progress, new supl es NI ignored, type: %d",
-                     notif->ni_type);
-            if (NULL != passThrough) {
-                free((void*)passThrough);
+    for (int i = 0; i < LOC_NI_MAX_SESSIONS; i++) {
+        loc_eng_ni_session_s_type* pSlot = &loc_eng_ni_data_p->sessions[i];
+        if (NULL != pSlot->rawRequest) {
+            if (pSlot->niType == GPS_NI_TYPE_EMERGENCY_SUPL) {
+                esInProgress = true;
             }
-        } else {
-            pSession = &loc_eng_ni_data_p->sessionEs;
-        }
-    } else {
-        if (NULL != loc_eng_ni_data_p->session.rawRequest ||
-            NULL != loc_eng_ni_data_p->sessionEs.rawRequest) {
-            LOC_LOGW("loc_eng_ni_request_handler, supl NI in progress, new supl NI ignored, type: %d",
-                     notif->ni_type);
-            if (NULL != passThrough) {
-                free((void*)passThrough);
-            }
-        } else {
-            pSession = &loc_eng_ni_data_p->session;
+        } else if (NULL == pSession) {
+            pSession = pSlot;
         }
     }
 
+    if (notif->ni_type != GPS_NI_TYPE_EMERGENCY_SUPL && esInProgress) {
+        LOC_LOGW("loc_eng_ni_request_handler, supl es NI in progress, new supl NI ignored, type: %d",
+                 notif->ni_type);
+        pSession = NULL;
+    } else if (NULL == pSession) {
+        LOC_LOGW("loc_eng_ni_request_handler, %d NI in progress, new NI ignored, type: %d",
+                 LOC_NI_MAX_SESSIONS, notif->ni_type);
+    }
 
     if (pSession) {
         /* Save request */
         pSession->rawRequest = (void*)passThrough;
         pSession->reqID = ++loc_eng_ni_data_p->reqIDCounter;
+        pSession->niType = notif->ni_type;
         pSession->adapter = loc_eng_data.adapter;
 
         /* Fill in notification */
@@ -170,102 +276,105 @@ void loc_eng_ni_request_handler(loc_eng_data_s_type &loc_eng_data,
             LOC_LOGI("              extras: %s", notif->extras);
         }
 
-        /* For robustness, spawn a thread at this point to timeout to clear up the notification status, even though
+        /* For robustness, arm a timer at this point to timeout to clear up the notification status, even though
          * the OEM layer in java does not do so.
          **/
-        pSession->respTimeLeft = 5 + (notif->timeout != 0 ? notif->timeout : LOC_NI_NO_RESPONSE_TIME);
-        LOC_LOGI("Automatically sends 'no response' in %d seconds (to clear status)\n", pSession->respTimeLeft);
+        int respTimeLeft = 5 + (notif->timeout != 0 ? notif->timeout : LOC_NI_NO_RESPONSE_TIME);
+        LOC_LOGI("Automatically sends 'no response' in %d seconds (to clear status)\n", respTimeLeft);
 
-        int rc = 0;
-        rc = pthread_create(&pSession->thread, NULL, ni_thread_proc, pSession);
-        if (rc)
+        pSession->expireTimeMs = ni_boottime_msec() + respTimeLeft * 1000;
+        if (!pSession->timer->start(respTimeLeft * 1000, true))
         {
-            LOC_LOGE("Loc NI thread is not created.\n");
-        }
-        rc = pthread_detach(pSession->thread);
-        if (rc)
-        {
-            LOC_LOGE("Loc NI thread is not detached.\n");
+            LOC_LOGE("Loc NI timer is not started.\n");
         }
 
         CALLBACK_LOG_CALLFLOW("ni_notify_cb - id", %d, notif->notification_id);
         loc_eng_data.ni_notify_cb((GpsNiNotification*)notif);
+    } else if (NULL != passThrough) {
+        free((void*)passThrough);
     }
     EXIT_LOG(%s, VOID_RET);
 }
 
 /*===========================================================================
 
-FUNCTION ni_thread_proc
+FUNCTION loc_eng_ni_timeout_handler
+
+DESCRIPTION
+   Sends 'no response' for a session the user has not answered in time.
 
 ===========================================================================*/
-static void* ni_thread_proc(void *args)
+static void loc_eng_ni_timeout_handler(loc_eng_data_s_type &loc_eng_data,
+                                       int slot)
 {
     ENTRY_LOG();
+    loc_eng_ni_session_s_type* pSession =
+        &loc_eng_data.loc_eng_ni_data.sessions[slot];
+
+    // the session may have been answered, or the engine restarted, after
+    // the timer fired but before this message got to run
+    if (NULL == pSession->rawRequest ||
+        ni_boottime_msec() + LOC_NI_TIMER_SLACK_MSEC < pSession->expireTimeMs) {
+        EXIT_LOG(%s, "stale NI timeout");
+        return;
+    }
+
+    LOC_LOGD("loc_eng_ni_timeout_handler: notif %d timed out\n", pSession->reqID);
+    ni_end_session(pSession, GPS_NI_RESPONSE_NORESP);
+
+    EXIT_LOG(%s, VOID_RET);
+}
 
-    loc_eng_ni_session_s_type* pSession = (loc_eng_ni_session_s_type*)args;
-    int rc = 0;          /* return code from pthread calls */
+/*===========================================================================
 
-    struct timeval present_time;
-    struct timespec expire_time;
+FUNCTION loc_eng_ni_response_handler
 
-    LOC_LOGD("Starting Loc NI thread...\n");
-    pthread_mutex_lock(&pSession->tLock);
-    /* Calculate absolute expire time */
-    gettimeofday(&present_time, NULL);
-    expire_time.tv_sec  = present_time.tv_sec + pSession->respTimeLeft;
-    expire_time.tv_nsec = present_time.tv_usec * 1000;
-    LOC_LOGD("ni_thread_proc-Time out set for abs time %ld with delay %d sec\n",
-             (long) expire_time.tv_sec, pSession->respTimeLeft );
+DESCRIPTION
+   Sends the user response for a session. Accepting an emergency request
+   drops all of the non emergency ones in progress.
 
-    while (!pSession->respRecvd)
-    {
-        rc = pthread_cond_timedwait(&pSession->tCond,
-                                    &pSession->tLock,
-                                    &expire_time);
-        if (rc == ETIMEDOUT)
-        {
-            pSession->resp = GPS_NI_RESPONSE_NORESP;
-            LOC_LOGD("ni_thread_proc-Thread time out after valting for specified time. Ret Val %d\n",rc );
-            break;
-        }
-    }
-    LOC_LOGD("ni_thread_proc-Java layer has sent us a user response and return value from "
-             "pthread_cond_timedwait = %d\n",rc );
-    pSession->respRecvd = FALSE; /* Reset the user response flag for the next session*/
-
-    LOC_LOGD("pSession->resp is %d\n",pSession->resp);
-
-    // adding this check to support modem restart, in which case, we need the thread
-    // to exit without calling sending data. We made sure that rawRequest is NULL in
-    // loc_eng_ni_reset_on_engine_restart()
-    LocEngAdapter* adapter = pSession->adapter;
-    LocEngInformNiResponse *msg = NULL;
-
-    if (NULL != pSession->rawRequest) {
-        if (pSession->resp != GPS_NI_RESPONSE_IGNORE) {
-            LOC_LOGD("pSession->resp != GPS_NI_RESPONSE_IGNORE \n");
-            msg = new LocEngInformNiResponse(adapter,
-                                             pSession->resp,
-                                             pSession->rawRequest);
-        } else {
-            LOC_LOGD("this is the ignore reply for SUPL ES\n");
-            free(pSession->rawRequest);
+===========================================================================*/
+static void loc_eng_ni_response_handler(loc_eng_data_s_type &loc_eng_data,
+                                        int notif_id,
+                                        GpsUserResponseType user_response)
+{
+    ENTRY_LOG();
+    loc_eng_ni_data_s_type* loc_eng_ni_data_p = &loc_eng_data.loc_eng_ni_data;
+    loc_eng_ni_session_s_type* pSession = NULL;
+
+    for (int i = 0; i < LOC_NI_MAX_SESSIONS && NULL == pSession; i++) {
+        if (notif_id == loc_eng_ni_data_p->sessions[i].reqID &&
+            NULL != loc_eng_ni_data_p->sessions[i].rawRequest) {
+            pSession = &loc_eng_ni_data_p->sessions[i];
         }
-        pSession->rawRequest = NULL;
     }
-    pthread_mutex_unlock(&pSession->tLock);
 
-    pSession->respTimeLeft = 0;
-    pSession->reqID = 0;
+    if (pSession) {
+        LOC_LOGI("loc_eng_ni_respond: send user response %d for notif %d", user_response, notif_id);
 
-    if (NULL != msg) {
-        LOC_LOGD("ni_thread_proc: adapter->sendMsg(msg)\n");
-        adapter->sendMsg(msg);
+        // ignore any SUPL NI non-Es session if a SUPL NI ES is accepted
+        if (pSession->niType == GPS_NI_TYPE_EMERGENCY_SUPL &&
+            user_response == GPS_NI_RESPONSE_ACCEPT) {
+            for (int i = 0; i < LOC_NI_MAX_SESSIONS; i++) {
+                loc_eng_ni_session_s_type* pSlot = &loc_eng_ni_data_p->sessions[i];
+                if (NULL != pSlot->rawRequest &&
+                    pSlot->niType != GPS_NI_TYPE_EMERGENCY_SUPL) {
+                    ni_end_session(pSlot, (GpsUserResponseType)GPS_NI_RESPONSE_IGNORE);
+                }
+            }
+        }
+
+        // the engine positions for an accepted or unanswered request
+        if (user_response != GPS_NI_RESPONSE_DENY) {
+            loc_eng_ni_data_p->sessionRunning = true;
+        }
+        ni_end_session(pSession, user_response);
+    }
+    else {
+        LOC_LOGE("loc_eng_ni_respond: notif_id %d not an active session", notif_id);
     }
 
     EXIT_LOG(%s, VOID_RET);
-    return NULL;
 }
 
 void loc_eng_ni_reset_on_engine_restart(loc_eng_data_s_type &loc_eng_data)
@@ -279,31 +388,57 @@ void loc_eng_ni_reset_on_engine_restart(loc_eng_data_s_type &loc_eng_data)
     }
 
     // only if modem has requested but then died.
-    if (NULL != loc_eng_ni_data_p->sessionEs.rawRequest) {
-        free(loc_eng_ni_data_p->sessionEs.rawRequest);
-        loc_eng_ni_data_p->sessionEs.rawRequest = NULL;
-
-        pthread_mutex_lock(&loc_eng_ni_data_p->sessionEs.tLock);
-        // the goal is to wake up ni_thread_proc
-        // and let it exit.
-        loc_eng_ni_data_p->sessionEs.respRecvd = TRUE;
-        pthread_cond_signal(&loc_eng_ni_data_p->sessionEs.tCond);
-        pthread_mutex_unlock(&loc_eng_ni_data_p->sessionEs.tLock);
+    for (int i = 0; i < LOC_NI_MAX_SESSIONS; i++) {
+        loc_eng_ni_session_s_type* pSession = &loc_eng_ni_data_p->sessions[i];
+        if (NULL != pSession->rawRequest) {
+            ni_end_session(pSession, (GpsUserResponseType)GPS_NI_RESPONSE_IGNORE);
+        }
     }
+    loc_eng_ni_data_p->sessionRunning = false;
+
+    EXIT_LOG(%s, VOID_RET);
+}
 
-    if (NULL != loc_eng_ni_data_p->session.rawRequest) {
-        free(loc_eng_ni_data_p->session.rawRequest);
-        loc_eng_ni_data_p->session.rawRequest = NULL;
+/*===========================================================================
+FUNCTION    loc_eng_ni_session_active
+
+DESCRIPTION
+   Tells if an NI session is open, i.e. a request is awaiting the user's
+   response, or an answered one is still being served by the engine.
 
-        pthread_mutex_lock(&loc_eng_ni_data_p->session.tLock);
-        // the goal is to wake up ni_thread_proc
-        // and let it exit.
-        loc_eng_ni_data_p->session.respRecvd = TRUE;
-        pthread_cond_signal(&loc_eng_ni_data_p->session.tCond);
-        pthread_mutex_unlock(&loc_eng_ni_data_p->session.tLock);
+RETURN VALUE
+   true if an NI session is open
+
+===========================================================================*/
+bool loc_eng_ni_session_active(loc_eng_data_s_type &loc_eng_data)
+{
+    loc_eng_ni_data_s_type* loc_eng_ni_data_p = &loc_eng_data.loc_eng_ni_data;
+
+    if (loc_eng_ni_data_p->sessionRunning) {
+        return true;
+    }
+    for (int i = 0; i < LOC_NI_MAX_SESSIONS; i++) {
+        if (NULL != loc_eng_ni_data_p->sessions[i].rawRequest) {
+            return true;
+        }
     }
+    return false;
+}
 
-    EXIT_LOG(%s, VOID_RET);
+/*===========================================================================
+FUNCTION    loc_eng_ni_session_ended
+
+DESCRIPTION
+   Called when the engine ends its session, which also ends the one it was
+   serving for an answered NI request.
+
+RETURN VALUE
+   None
+
+===========================================================================*/
+void loc_eng_ni_session_ended(loc_eng_data_s_type &loc_eng_data)
+{
+    loc_eng_data.loc_eng_ni_data.sessionRunning = false;
 }
 
 /*===========================================================================
@@ -334,19 +469,14 @@ void loc_eng_ni_init(loc_eng_data_s_type &loc_eng_data, GpsNiExtCallbacks *callb
         EXIT_LOG(%s, "loc_eng_ni_init: already inited.");
     } else {
         loc_eng_ni_data_s_type* loc_eng_ni_data_p = &loc_eng_data.loc_eng_ni_data;
-        loc_eng_ni_data_p->sessionEs.respTimeLeft = 0;
-        loc_eng_ni_data_p->sessionEs.respRecvd = FALSE;
-        loc_eng_ni_data_p->sessionEs.rawRequest = NULL;
-        loc_eng_ni_data_p->sessionEs.reqID = 0;
-        pthread_cond_init(&loc_eng_ni_data_p->sessionEs.tCond, NULL);
-        pthread_mutex_init(&loc_eng_ni_data_p->sessionEs.tLock, NULL);
-
-        loc_eng_ni_data_p->session.respTimeLeft = 0;
-        loc_eng_ni_data_p->session.respRecvd = FALSE;
-        loc_eng_ni_data_p->session.rawRequest = NULL;
-        loc_eng_ni_data_p->session.reqID = 0;
-        pthread_cond_init(&loc_eng_ni_data_p->session.tCond, NULL);
-        pthread_mutex_init(&loc_eng_ni_data_p->session.tLock, NULL);
+        for (int i = 0; i < LOC_NI_MAX_SESSIONS; i++) {
+            loc_eng_ni_data_p->sessions[i].rawRequest = NULL;
+            loc_eng_ni_data_p->sessions[i].reqID = 0;
+            loc_eng_ni_data_p->sessions[i].expireTimeMs = 0;
+            loc_eng_ni_data_p->sessions[i].timer =
+                new LocEngNiSessionTimer(&loc_eng_data, i);
+        }
+        loc_eng_ni_data_p->sessionRunning = false;
 
         loc_eng_data.ni_notify_cb = callbacks->notify_cb;
         EXIT_LOG(%s, VOID_RET);
@@ -357,7 +487,8 @@ void loc_eng_ni_init(loc_eng_data_s_type &loc_eng_data, GpsNiExtCallbacks *callb
 FUNCTION    loc_eng_ni_respond
 
 DESCRIPTION
-   This function receives user response from upper layer framework
+   This function receives user response from upper layer framework, and
+   hands it to the MsgTask where the session table is kept
 
 DEPENDENCIES
    NONE
@@ -373,42 +504,15 @@ void loc_eng_ni_respond(loc_eng_data_s_type &loc_eng_data,
                         int notif_id, GpsUserResponseType user_response)
 {
     ENTRY_LOG_CALLFLOW();
-    loc_eng_ni_data_s_type* loc_eng_ni_data_p = &loc_eng_data.loc_eng_ni_data;
-    loc_eng_ni_session_s_type* pSession = NULL;
 
-    if (NULL == loc_eng_data.ni_notify_cb) {
+    if (NULL == loc_eng_data.ni_notify_cb || NULL == loc_eng_data.adapter) {
         EXIT_LOG(%s, "loc_eng_ni_init hasn't happened yet.");
         return;
     }
 
-    if (notif_id == loc_eng_ni_data_p->sessionEs.reqID &&
-        NULL != loc_eng_ni_data_p->sessionEs.rawRequest) {
-        pSession = &loc_eng_ni_data_p->sessionEs;
-        // ignore any SUPL NI non-Es session if a SUPL NI ES is accepted
-        if (user_response == GPS_NI_RESPONSE_ACCEPT &&
-            NULL != loc_eng_ni_data_p->session.rawRequest) {
-                pthread_mutex_lock(&loc_eng_ni_data_p->session.tLock);
-                loc_eng_ni_data_p->session.resp = GPS_NI_RESPONSE_IGNORE;
-                loc_eng_ni_data_p->session.respRecvd = TRUE;
-                pthread_cond_signal(&loc_eng_ni_data_p->session.tCond);
-                pthread_mutex_unlock(&loc_eng_ni_data_p->session.tLock);
-        }
-    } else if (notif_id == loc_eng_ni_data_p->session.reqID &&
-        NULL != loc_eng_ni_data_p->session.rawRequest) {
-        pSession = &loc_eng_ni_data_p->session;
-    }
-
-    if (pSession) {
-        LOC_LOGI("loc_eng_ni_respond: send user response %d for notif %d", user_response, notif_id);
-        pthread_mutex_lock(&pSession->tLock);
-        pSession->resp = user_response;
-        pSession->respRecvd = TRUE;
-        pthread_cond_signal(&pSession->tCond);
-        pthread_mutex_unlock(&pSession->tLock);
-    }
-    else {
-        LOC_LOGE("loc_eng_ni_respond: notif_id %d not an active session", notif_id);
-    }
+    loc_eng_data.adapter->sendMsg(new LocEngNiRespond(&loc_eng_data,
+                                                      notif_id,
+                                                      user_response));
 
     EXIT_LOG(%s, VOID_RET);
 }
@@ -36,23 +36,24 @@
 #define LOC_NI_NO_RESPONSE_TIME            20                      /* secs */
 #define LOC_NI_NOTIF_KEY_ADDRESS           "Address"
 #define GPS_NI_RESPONSE_IGNORE             4
+#define LOC_NI_MAX_SESSIONS                8
+
+class LocEngNiSessionTimer;
 
 typedef struct {
-    pthread_t               thread;            /* NI thread */
-    int                     respTimeLeft;       /* examine time for NI response */
-    bool                    respRecvd;   /* NI User reponse received or not from Java layer*/
-    void*                   rawRequest;
+    void*                   rawRequest;    /* NULL if the slot is free */
     int                     reqID;         /* ID to check against response */
-    GpsUserResponseType     resp;
-    pthread_cond_t          tCond;
-    pthread_mutex_t         tLock;
+    GpsNiType               niType;
+    int64_t                 expireTimeMs;  /* CLOCK_BOOTTIME of the no response timeout */
     LocEngAdapter*          adapter;
+    LocEngNiSessionTimer*   timer;         /* created once by loc_eng_ni_init */
 } loc_eng_ni_session_s_type;
 
+/* All of the session table is only touched on the MsgTask. */
 typedef struct {
-    loc_eng_ni_session_s_type session;    /* SUPL NI Session */
-    loc_eng_ni_session_s_type sessionEs;  /* Emergency SUPL NI Session */
+    loc_eng_ni_session_s_type sessions[LOC_NI_MAX_SESSIONS];
     int reqIDCounter;
+    bool sessionRunning;   /* an answered request is served until the engine's session ends */
 } loc_eng_ni_data_s_type;
 
 
@@ -0,0 +1,347 @@
+/* Copyright (c) 2014, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation, nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#define LOG_NDDEBUG 0
+#define LOG_TAG "LocSvc_eng"
+
+#include <stdio.h>
+#include <time.h>
+#include <loc_eng.h>
+#include <loc_misc_utils.h>
+#include "log_util.h"
+#include "platform_lib_includes.h"
+
+#define TTFF_FILE             "/data/misc/location/ttff_history.bin"
+#define TTFF_MAGIC            0x54544630 /* "TTF0" */
+#define TTFF_VERSION          1
+/* sessions kept in the rolling history */
+#define TTFF_HISTORY_SIZE     16
+/* ephemeris older than this no longer helps, the start is a warm one */
+#define TTFF_EPHEMERIS_AGE_MS (4 * 60 * 60 * 1000LL)
+#define TTFF_NOT_REACHED      (-1)
+
+enum loc_eng_ttff_start_type {
+    TTFF_START_HOT = 0,
+    TTFF_START_WARM,
+    TTFF_START_COLD,
+    TTFF_START_TYPE_MAX
+};
+
+typedef struct {
+    int64_t startUtcMs;
+    // time from the start of the session, TTFF_NOT_REACHED if never reached
+    int32_t milestoneMs[LOC_ENG_TTFF_MILESTONE_MAX];
+    uint8_t startType;
+    uint8_t reserved[3];
+} LocEngTtffSession;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t next;
+    uint32_t count;
+    // UTC time of the last final fix, 0 if none since aiding data deletion
+    int64_t lastFixUtcMs;
+    LocEngTtffSession sessions[TTFF_HISTORY_SIZE];
+    uint32_t crc32;
+} LocEngTtffHistory;
+
+static const char* const milestone_names[LOC_ENG_TTFF_MILESTONE_MAX] = {
+    "start",
+    "pos inject",
+    "time request",
+    "time inject",
+    "xtra request",
+    "xtra inject",
+    "atl request",
+    "data call",
+    "supl done",
+    "first intermediate",
+    "first fix",
+};
+
+static const char* const start_type_names[TTFF_START_TYPE_MAX] = {
+    "hot", "warm", "cold"
+};
+
+// Only touched from the MsgTask thread
+static LocEngTtffHistory ttff_history;
+static bool ttff_history_loaded = false;
+static LocEngTtffSession ttff_session;
+static int64_t ttff_start_ms = 0;
+static bool ttff_active = false;
+
+static bool ttff_valid(const LocEngTtffHistory &history)
+{
+    return TTFF_MAGIC == history.magic &&
+           TTFF_VERSION == history.version &&
+           history.next < TTFF_HISTORY_SIZE &&
+           history.count <= TTFF_HISTORY_SIZE &&
+           loc_util_crc32(0, &history, offsetof(LocEngTtffHistory, crc32)) ==
+           history.crc32;
+}
+
+static void ttff_load()
+{
+    if (!ttff_history_loaded) {
+        FILE* file = fopen(TTFF_FILE, "rb");
+        if (NULL == file ||
+            fread(&ttff_history, sizeof(ttff_history), 1, file) != 1 ||
+            !ttff_valid(ttff_history)) {
+            memset(&ttff_history, 0, sizeof(ttff_history));
+            ttff_history.magic = TTFF_MAGIC;
+            ttff_history.version = TTFF_VERSION;
+        }
+        if (NULL != file) {
+            fclose(file);
+        }
+        ttff_history_loaded = true;
+    }
+}
+
+static void ttff_save()
+{
+    ttff_history.crc32 = loc_util_crc32(0, &ttff_history,
+                                        offsetof(LocEngTtffHistory, crc32));
+    loc_util_write_file_atomic(TTFF_FILE, &ttff_history,
+                               sizeof(ttff_history), 0600);
+}
+
+// logs each milestone reached, with the time since the start and since
+// the milestone before it
+static void ttff_log_session(const LocEngTtffSession &session)
+{
+    char buf[512];
+    int len = 0;
+    int32_t prevMs = 0;
+
+    for (int i = LOC_ENG_TTFF_START + 1;
+         i < LOC_ENG_TTFF_MILESTONE_MAX && len < (int)sizeof(buf); i++) {
+        int32_t ms = session.milestoneMs[i];
+        if (TTFF_NOT_REACHED == ms) {
+            continue;
+        }
+        len += snprintf(buf + len, sizeof(buf) - len, "%s%s %d (+%d)",
+                        len > 0 ? ", " : "", milestone_names[i],
+                        ms, ms - prevMs);
+        prevMs = ms;
+    }
+    if (TTFF_NOT_REACHED == session.milestoneMs[LOC_ENG_TTFF_FIRST_FIX]) {
+        LOC_LOGI("%s:%d]: %s start, stopped without a fix: %s",
+                 __func__, __LINE__, start_type_names[session.startType],
+                 len > 0 ? buf : "none");
+    } else {
+        LOC_LOGI("%s:%d]: %s start, ttff %d ms: %s", __func__, __LINE__,
+                 start_type_names[session.startType],
+                 session.milestoneMs[LOC_ENG_TTFF_FIRST_FIX], buf);
+    }
+}
+
+// logs, per start type, the mean time to each milestone over the history
+static void ttff_log_history()
+{
+    for (int type = 0; type < TTFF_START_TYPE_MAX; type++) {
+        int64_t sumMs[LOC_ENG_TTFF_MILESTONE_MAX] = { 0 };
+        uint32_t num[LOC_ENG_TTFF_MILESTONE_MAX] = { 0 };
+        uint32_t sessions = 0;
+        char buf[512];
+        int len = 0;
+
+        for (uint32_t s = 0; s < ttff_history.count; s++) {
+            const LocEngTtffSession &session = ttff_history.sessions[s];
+            if (session.startType != type) {
+                continue;
+            }
+            sessions++;
+            for (int i = 0; i < LOC_ENG_TTFF_MILESTONE_MAX; i++) {
+                if (TTFF_NOT_REACHED != session.milestoneMs[i]) {
+                    sumMs[i] += session.milestoneMs[i];
+                    num[i]++;
+                }
+            }
+        }
+        if (0 == sessions) {
+            continue;
+        }
+
+        for (int i = LOC_ENG_TTFF_START + 1;
+             i < LOC_ENG_TTFF_MILESTONE_MAX && len < (int)sizeof(buf); i++) {
+            if (num[i] > 0) {
+                len += snprintf(buf + len, sizeof(buf) - len, "%s%s %lld (%u)",
+                                len > 0 ? ", " : "", milestone_names[i],
+                                (long long)(sumMs[i] / num[i]), num[i]);
+            }
+        }
+        LOC_LOGI("%s:%d]: %s starts: %u sessions, mean ms (count): %s",
+                 __func__, __LINE__, start_type_names[type], sessions,
+                 len > 0 ? buf : "none");
+    }
+}
+
+static void ttff_end_session()
+{
+    ttff_active = false;
+    ttff_log_session(ttff_session);
+
+    ttff_history.sessions[ttff_history.next] = ttff_session;
+    ttff_history.next = (ttff_history.next + 1) % TTFF_HISTORY_SIZE;
+    if (ttff_history.count < TTFF_HISTORY_SIZE) {
+        ttff_history.count++;
+    }
+    if (TTFF_NOT_REACHED != ttff_session.milestoneMs[LOC_ENG_TTFF_FIRST_FIX]) {
+        ttff_history.lastFixUtcMs = (int64_t)time(NULL) * 1000;
+    }
+    ttff_save();
+    ttff_log_history();
+}
+
+/*===========================================================================
+FUNCTION    loc_eng_ttff_start
+
+DESCRIPTION
+   Starts timing a new session. The start is classed as cold if there has
+   been no fix since the aiding data was deleted, warm if the last fix is
+   older than the ephemeris, and hot otherwise.
+
+DEPENDENCIES
+   Must be called from the MsgTask thread.
+
+RETURN VALUE
+   none
+
+SIDE EFFECTS
+   N/A
+
+===========================================================================*/
+void loc_eng_ttff_start()
+{
+    ttff_load();
+
+    int64_t nowUtcMs = (int64_t)time(NULL) * 1000;
+    memset(&ttff_session, 0, sizeof(ttff_session));
+    for (int i = 0; i < LOC_ENG_TTFF_MILESTONE_MAX; i++) {
+        ttff_session.milestoneMs[i] = TTFF_NOT_REACHED;
+    }
+    ttff_session.milestoneMs[LOC_ENG_TTFF_START] = 0;
+    ttff_session.startUtcMs = nowUtcMs;
+    if (0 == ttff_history.lastFixUtcMs) {
+        ttff_session.startType = TTFF_START_COLD;
+    } else if (nowUtcMs - ttff_history.lastFixUtcMs > TTFF_EPHEMERIS_AGE_MS ||
+               nowUtcMs < ttff_history.lastFixUtcMs) {
+        ttff_session.startType = TTFF_START_WARM;
+    } else {
+        ttff_session.startType = TTFF_START_HOT;
+    }
+    ttff_start_ms = elapsedMillisSinceBoot();
+    ttff_active = true;
+}
+
+/*===========================================================================
+FUNCTION    loc_eng_ttff_mark
+
+DESCRIPTION
+   Records the first time a milestone is reached in the current session.
+   The first final fix ends the session, which is then logged with a per
+   milestone breakdown and added to the history on flash.
+
+DEPENDENCIES
+   Must be called from the MsgTask thread.
+
+RETURN VALUE
+   none
+
+SIDE EFFECTS
+   N/A
+
+===========================================================================*/
+void loc_eng_ttff_mark(loc_eng_ttff_milestone milestone)
+{
+    if (!ttff_active || milestone >= LOC_ENG_TTFF_MILESTONE_MAX ||
+        TTFF_NOT_REACHED != ttff_session.milestoneMs[milestone]) {
+        return;
+    }
+
+    ttff_session.milestoneMs[milestone] =
+        (int32_t)(elapsedMillisSinceBoot() - ttff_start_ms);
+    LOC_LOGV("%s:%d]: %s at %d ms", __func__, __LINE__,
+             milestone_names[milestone], ttff_session.milestoneMs[milestone]);
+
+    if (LOC_ENG_TTFF_FIRST_FIX == milestone) {
+        ttff_end_session();
+    }
+}
+
+/*===========================================================================
+FUNCTION    loc_eng_ttff_stop
+
+DESCRIPTION
+   Ends a session stopped before its first final fix; it is kept in the
+   history as one that never got a fix.
+
+DEPENDENCIES
+   Must be called from the MsgTask thread.
+
+RETURN VALUE
+   none
+
+SIDE EFFECTS
+   N/A
+
+===========================================================================*/
+void loc_eng_ttff_stop()
+{
+    if (ttff_active) {
+        ttff_end_session();
+    }
+}
+
+/*===========================================================================
+FUNCTION    loc_eng_ttff_aiding_deleted
+
+DESCRIPTION
+   Makes the next start a cold one once the ephemeris or almanac is deleted.
+
+DEPENDENCIES
+   Must be called from the MsgTask thread.
+
+RETURN VALUE
+   none
+
+SIDE EFFECTS
+   N/A
+
+===========================================================================*/
+void loc_eng_ttff_aiding_deleted(GpsAidingData f)
+{
+    if (f & (GPS_DELETE_EPHEMERIS | GPS_DELETE_ALMANAC)) {
+        ttff_load();
+        ttff_history.lastFixUtcMs = 0;
+        ttff_save();
+    }
+}
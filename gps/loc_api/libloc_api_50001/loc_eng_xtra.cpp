@@ -30,11 +30,29 @@
 #define LOG_NDDEBUG 0
 #define LOG_TAG "LocSvc_eng"
 
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
 #include <loc_eng.h>
 #include <MsgTask.h>
+#include <loc_misc_utils.h>
 #include "log_util.h"
 #include "platform_lib_includes.h"
 
+#define XTRA_CACHE_FOLDER        "/data/misc/location/xtra"
+#define XTRA_CACHE_INDEX_FILE    XTRA_CACHE_FOLDER "/xtra_cache.idx"
+#define XTRA_CACHE_DATA_FILE_FMT XTRA_CACHE_FOLDER "/xtra_cache_%d.bin"
+#define XTRA_CACHE_MAGIC         0x58545243 /* "XTRC" */
+#define XTRA_CACHE_VERSION       1
+#define XTRA_CACHE_SLOTS         2
+#define XTRA_CACHE_MAX_LEN       (512 * 1024)
+
+#define GPS_EPOCH_UTC_SEC        315964800 /* 1980-01-06 00:00:00 UTC */
+#define GPS_LEAP_SECONDS         18
+#define GPS_SEC_PER_WEEK         604800
+
 using namespace loc_core;
 
 struct LocEngRequestXtraServer : public LocMsg {
@@ -55,6 +73,231 @@ struct LocEngRequestXtraServer : public LocMsg {
     }
 };
 
+/* On-disk XTRA cache. The index records, for each of the data slots,
+   the GPS week / time of week at which the file was downloaded, the GPS
+   week / time of week until which it is considered usable, and the length
+   and CRC of the data file. Slots are written alternately so that the last
+   good file survives an interrupted write. */
+typedef struct {
+    uint32_t valid;
+    uint32_t gpsWeek;
+    uint32_t gpsTowSec;
+    uint32_t expiryWeek;
+    uint32_t expiryTowSec;
+    uint32_t length;
+    uint32_t crc32;
+} XtraCacheSlot;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    XtraCacheSlot slots[XTRA_CACHE_SLOTS];
+    uint32_t crc32;
+} XtraCacheIndex;
+
+static uint64_t xtra_cache_gps_sec(uint32_t week, uint32_t tow)
+{
+    return (uint64_t)week * GPS_SEC_PER_WEEK + tow;
+}
+
+static uint64_t xtra_cache_gps_now()
+{
+    time_t now = time(NULL);
+    if (now < GPS_EPOCH_UTC_SEC) {
+        return 0;
+    }
+    return (uint64_t)(now - GPS_EPOCH_UTC_SEC + GPS_LEAP_SECONDS);
+}
+
+static bool xtra_cache_read_index(XtraCacheIndex &index)
+{
+    bool ret = false;
+    FILE* file = fopen(XTRA_CACHE_INDEX_FILE, "rb");
+    if (NULL != file) {
+        if (fread(&index, sizeof(index), 1, file) == 1 &&
+            XTRA_CACHE_MAGIC == index.magic &&
+            XTRA_CACHE_VERSION == index.version &&
+            loc_util_crc32(0, &index, offsetof(XtraCacheIndex, crc32)) ==
+            index.crc32) {
+            ret = true;
+        }
+        fclose(file);
+    }
+    if (!ret) {
+        memset(&index, 0, sizeof(index));
+        index.magic = XTRA_CACHE_MAGIC;
+        index.version = XTRA_CACHE_VERSION;
+    }
+    return ret;
+}
+
+static bool xtra_cache_write_index(XtraCacheIndex &index)
+{
+    index.crc32 = loc_util_crc32(0, &index, offsetof(XtraCacheIndex, crc32));
+    return 0 == loc_util_write_file_atomic(XTRA_CACHE_INDEX_FILE, &index,
+                                           sizeof(index), 0600);
+}
+
+// returns the slot holding the most recently downloaded file that has
+// not expired yet, or -1 if there is none
+static int xtra_cache_freshest_slot(const XtraCacheIndex &index, uint64_t now)
+{
+    int freshest = -1;
+    for (int i = 0; i < XTRA_CACHE_SLOTS; i++) {
+        const XtraCacheSlot &slot = index.slots[i];
+        if (slot.valid &&
+            now < xtra_cache_gps_sec(slot.expiryWeek, slot.expiryTowSec) &&
+            (freshest < 0 ||
+             xtra_cache_gps_sec(slot.gpsWeek, slot.gpsTowSec) >
+             xtra_cache_gps_sec(index.slots[freshest].gpsWeek,
+                                index.slots[freshest].gpsTowSec))) {
+            freshest = i;
+        }
+    }
+    return freshest;
+}
+
+/*===========================================================================
+FUNCTION    xtra_cache_save
+
+DESCRIPTION
+   Saves an XTRA file that the engine accepted into the cache slot that does
+   not hold the freshest file, then points the index at it.
+
+DEPENDENCIES
+   N/A
+
+RETURN VALUE
+   none
+
+SIDE EFFECTS
+   N/A
+
+===========================================================================*/
+static void xtra_cache_save(const char* data, int length)
+{
+    if (0 == gps_conf.XTRA_CACHE_VALID_HOURS) {
+        return;
+    }
+    if (NULL == data || length <= 0 || length > XTRA_CACHE_MAX_LEN) {
+        LOC_LOGE("%s:%d]: invalid xtra data %p len %d",
+                 __func__, __LINE__, data, length);
+        return;
+    }
+
+    uint64_t now = xtra_cache_gps_now();
+    if (0 == now) {
+        LOC_LOGW("%s:%d]: system time not set, xtra not cached",
+                 __func__, __LINE__);
+        return;
+    }
+
+    struct stat s;
+    if (stat(XTRA_CACHE_FOLDER, &s) < 0 &&
+        (ENOENT != errno || mkdir(XTRA_CACHE_FOLDER, 0700) < 0)) {
+        LOC_LOGE("%s:%d]: XTRA_CACHE_FOLDER invalid", __func__, __LINE__);
+        return;
+    }
+
+    XtraCacheIndex index;
+    xtra_cache_read_index(index);
+
+    int freshest = xtra_cache_freshest_slot(index, now);
+    int slot = (freshest < 0) ? 0 : (freshest + 1) % XTRA_CACHE_SLOTS;
+    char fileName[64];
+    snprintf(fileName, sizeof(fileName), XTRA_CACHE_DATA_FILE_FMT, slot);
+
+    // invalidate the slot before touching its data file
+    index.slots[slot].valid = 0;
+    if (!xtra_cache_write_index(index) ||
+        0 != loc_util_write_file_atomic(fileName, data, length, 0600)) {
+        LOC_LOGE("%s:%d]: failed to write xtra cache slot %d",
+                 __func__, __LINE__, slot);
+        return;
+    }
+
+    uint64_t expiry = now + (uint64_t)gps_conf.XTRA_CACHE_VALID_HOURS * 3600;
+    index.slots[slot].gpsWeek = now / GPS_SEC_PER_WEEK;
+    index.slots[slot].gpsTowSec = now % GPS_SEC_PER_WEEK;
+    index.slots[slot].expiryWeek = expiry / GPS_SEC_PER_WEEK;
+    index.slots[slot].expiryTowSec = expiry % GPS_SEC_PER_WEEK;
+    index.slots[slot].length = length;
+    index.slots[slot].crc32 = loc_util_crc32(0, data, length);
+    index.slots[slot].valid = 1;
+
+    if (xtra_cache_write_index(index)) {
+        LOC_LOGD("%s:%d]: xtra cached in slot %d, week %u tow %u, len %d",
+                 __func__, __LINE__, slot, index.slots[slot].gpsWeek,
+                 index.slots[slot].gpsTowSec, length);
+    }
+}
+
+/*===========================================================================
+FUNCTION    xtra_cache_load
+
+DESCRIPTION
+   Loads the freshest cached XTRA file that is still within its validity
+   window and passes the integrity check. Slots failing the check are
+   dropped from the index.
+
+DEPENDENCIES
+   N/A
+
+RETURN VALUE
+   length of the data placed in *data (caller frees with delete[]), or 0
+
+SIDE EFFECTS
+   N/A
+
+===========================================================================*/
+static int xtra_cache_load(char** data)
+{
+    XtraCacheIndex index;
+    uint64_t now = xtra_cache_gps_now();
+    int length = 0;
+
+    *data = NULL;
+    if (0 == now || !xtra_cache_read_index(index)) {
+        return 0;
+    }
+
+    for (int slot = xtra_cache_freshest_slot(index, now);
+         slot >= 0 && 0 == length;
+         slot = xtra_cache_freshest_slot(index, now)) {
+        const XtraCacheSlot &entry = index.slots[slot];
+        char fileName[64];
+        snprintf(fileName, sizeof(fileName), XTRA_CACHE_DATA_FILE_FMT, slot);
+
+        FILE* file = NULL;
+        char* buf = NULL;
+        if (entry.length > 0 && entry.length <= XTRA_CACHE_MAX_LEN &&
+            NULL != (file = fopen(fileName, "rb"))) {
+            buf = new char[entry.length];
+            if (fread(buf, 1, entry.length, file) == entry.length &&
+                fgetc(file) == EOF &&
+                loc_util_crc32(0, buf, entry.length) == entry.crc32) {
+                *data = buf;
+                length = entry.length;
+            } else {
+                delete[] buf;
+            }
+            fclose(file);
+        }
+
+        if (0 == length) {
+            LOC_LOGW("%s:%d]: xtra cache slot %d corrupted, dropped",
+                     __func__, __LINE__, slot);
+            index.slots[slot].valid = 0;
+            xtra_cache_write_index(index);
+        } else {
+            LOC_LOGD("%s:%d]: xtra cache slot %d loaded, week %u tow %u",
+                     __func__, __LINE__, slot, entry.gpsWeek, entry.gpsTowSec);
+        }
+    }
+
+    return length;
+}
+
 struct LocEngInjectXtraData : public LocMsg {
     LocEngAdapter* mAdapter;
     char* mData;
@@ -72,7 +315,10 @@ struct LocEngInjectXtraData : public LocMsg {
         delete[] mData;
     }
     inline virtual void proc() const {
-        mAdapter->setXtraData(mData, mLen);
+        if (LOC_API_ADAPTER_ERR_SUCCESS == mAdapter->setXtraData(mData, mLen)) {
+            loc_eng_ttff_mark(LOC_ENG_TTFF_XTRA_INJECT);
+            xtra_cache_save(mData, mLen);
+        }
     }
     inline  void locallog() const {
         LOC_LOGV("length: %d\n  data: %p", mLen, mData);
@@ -82,6 +328,32 @@ struct LocEngInjectXtraData : public LocMsg {
     }
 };
 
+struct LocEngInjectCachedXtra : public LocMsg {
+    LocEngAdapter* mAdapter;
+    inline LocEngInjectCachedXtra(LocEngAdapter* adapter) :
+        LocMsg(), mAdapter(adapter)
+    {
+        locallog();
+    }
+    inline virtual void proc() const {
+        char* data = NULL;
+        int length = xtra_cache_load(&data);
+        if (length > 0) {
+            if (LOC_API_ADAPTER_ERR_SUCCESS ==
+                mAdapter->setXtraData(data, length)) {
+                loc_eng_ttff_mark(LOC_ENG_TTFF_XTRA_INJECT);
+            }
+            delete[] data;
+        }
+    }
+    inline void locallog() const {
+        LOC_LOGV("LocEngInjectCachedXtra");
+    }
+    inline virtual void log() const {
+        locallog();
+    }
+};
+
 struct LocEngSetXtraVersionCheck : public LocMsg {
     LocEngAdapter *mAdapter;
     int mCheck;
@@ -211,3 +483,31 @@ void loc_eng_xtra_version_check(loc_eng_data_s_type &loc_eng_data,
     adapter->sendMsg(new LocEngSetXtraVersionCheck(adapter, check));
     EXIT_LOG(%d, 0);
 }
+
+/*===========================================================================
+FUNCTION    loc_eng_xtra_inject_cached_data
+
+DESCRIPTION
+   Injects the freshest valid XTRA file from the on-disk cache, if any.
+   Called whenever the engine comes up, so assistance data is available
+   before the framework completes a new download.
+
+DEPENDENCIES
+   N/A
+
+RETURN VALUE
+   none
+
+SIDE EFFECTS
+   N/A
+
+===========================================================================*/
+void loc_eng_xtra_inject_cached_data(loc_eng_data_s_type &loc_eng_data)
+{
+    ENTRY_LOG();
+    if (gps_conf.XTRA_CACHE_VALID_HOURS != 0) {
+        LocEngAdapter *adapter = loc_eng_data.adapter;
+        adapter->sendMsg(new LocEngInjectCachedXtra(adapter));
+    }
+    EXIT_LOG(%s, VOID_RET);
+}
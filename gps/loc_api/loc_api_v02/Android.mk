@@ -28,6 +28,8 @@ LOCAL_SRC_FILES = \
     LocApiV02.cpp \
     loc_api_v02_log.c \
     loc_api_v02_client.c \
+    loc_api_v02_sim.c \
+    loc_api_v02_capture.c \
     loc_api_sync_req.c \
     location_service_v02.c
 
@@ -33,17 +33,23 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <time.h>
 
 #include <hardware/gps.h>
 
 #ifndef USE_GLIB
 #include <utils/SystemClock.h>
 #endif /* USE_GLIB */
+#include <cutils/properties.h>
 #include <LocApiV02.h>
 #include <loc_api_v02_log.h>
 #include <loc_api_sync_req.h>
+#include <loc_api_v02_capture.h>
 #include <loc_util_log.h>
 #include <gps_extended.h>
+#include <loc_target.h>
+#include <loc_misc_utils.h>
+#include <loc_fix_trace.h>
 #include "platform_lib_includes.h"
 
 using namespace loc_core;
@@ -77,6 +83,21 @@ using namespace loc_core;
 /* number of QMI_LOC messages that need to be checked*/
 #define NUMBER_OF_MSG_TO_BE_CHECKED        (3)
 
+/* supported message list of the modem build last probed. Bump the
+   version whenever the list of checked messages changes. */
+#define SUPPORTED_MSG_CACHE_FILE    "/data/misc/location/qmi_supported_msg.bin"
+#define SUPPORTED_MSG_CACHE_MAGIC   0x514D5347 /* "QMSG" */
+#define SUPPORTED_MSG_CACHE_VERSION 1
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t modemBuildCrc;
+  uint32_t reserved;
+  uint64_t supportedMsgList;
+  uint32_t crc32;
+} SupportedMsgCache;
+
 /* static event callbacks that call the LocApiV02 callbacks*/
 
 /* global event callback, call the eventCb function in loc api adapter v02
@@ -169,6 +190,8 @@ LocApiV02 :: LocApiV02(const MsgTask* msgTask,
     dsClientHandle(NULL), mGnssMeasurementSupported(sup_unknown),
     mQmiMask(0), mInSession(false), mEngineOn(false)
 {
+  memset(&mConfigBatch, 0, sizeof(mConfigBatch));
+  memset(&mOpenTiming, 0, sizeof(mOpenTiming));
   // initialize loc_sync_req interface
   loc_sync_req_init();
 }
@@ -187,13 +210,303 @@ LocApiBase* getLocApi(const MsgTask *msgTask,
     return new LocApiV02(msgTask, exMask, context);
 }
 
+/* feeds a capture of indications back through locClientInjectInd(), so
+   they are decoded and handled by eventCb() as if the modem sent them.
+   One record is replayed per run(), so stopping the thread takes effect
+   between records. With real time, records are spaced as captured;
+   otherwise they are replayed as fast as they are handled. Throughput
+   and the distribution of the time taken to handle each indication are
+   logged at the end. */
+class LocApiV02Replay : public LocRunnable {
+  static const int64_t MAX_SLEEP_NS = 100000000;
+  const locClientHandleType mClientHandle;
+  const bool mRealTime;
+  locCaptureReaderT mReader;
+  const locCaptureRecordT* mRecord;
+  const void* mPayload;
+  uint32_t* mLatencyUs;
+  uint32_t mMaxRecords;
+  uint32_t mNumRecords;
+  uint32_t mNumFailed;
+  uint64_t mFirstRecordNs;
+  uint64_t mStartNs;
+
+  static uint64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+  }
+  static int compareLatency(const void* a, const void* b) {
+    uint32_t la = *(const uint32_t*)a;
+    uint32_t lb = *(const uint32_t*)b;
+    return (la < lb) ? -1 : ((la > lb) ? 1 : 0);
+  }
+  inline uint32_t percentile(uint32_t pct) const {
+    return mLatencyUs[((mNumRecords - 1) * pct) / 100];
+  }
+public:
+  inline LocApiV02Replay(locClientHandleType clientHandle, bool realTime,
+                         const locCaptureReaderT& reader) :
+    LocRunnable(), mClientHandle(clientHandle), mRealTime(realTime),
+    mReader(reader), mRecord(NULL), mPayload(NULL), mLatencyUs(NULL),
+    mMaxRecords(0), mNumRecords(0), mNumFailed(0),
+    mFirstRecordNs(0), mStartNs(0) {}
+
+  virtual ~LocApiV02Replay() {
+    if (mNumRecords > 0) {
+      uint64_t elapsedUs = (nowNs() - mStartNs) / 1000;
+      qsort(mLatencyUs, mNumRecords, sizeof(mLatencyUs[0]), compareLatency);
+      LOC_LOGI("%s:%d]: replayed %u indications (%u failed) in %llu us, "
+               "%llu ind/s; handling us p50 %u p90 %u p99 %u max %u",
+               __func__, __LINE__, mNumRecords, mNumFailed, elapsedUs,
+               (elapsedUs > 0) ? (mNumRecords * 1000000ull) / elapsedUs : 0,
+               percentile(50), percentile(90), percentile(99),
+               mLatencyUs[mNumRecords - 1]);
+    }
+    free(mLatencyUs);
+    locCaptureReaderClose(&mReader);
+  }
+
+  virtual void prerun() {
+    locCaptureReaderT counter = mReader;
+    const locCaptureRecordT* record;
+    const void* payload;
+
+    // size the latency samples to the capture up front
+    while (locCaptureReaderNext(&counter, &record, &payload)) {
+      mMaxRecords++;
+    }
+    mLatencyUs = (uint32_t*)calloc(mMaxRecords + 1, sizeof(uint32_t));
+    mStartNs = nowNs();
+  }
+
+  virtual bool run() {
+    if (NULL == mRecord &&
+        !locCaptureReaderNext(&mReader, &mRecord, &mPayload)) {
+      return false;
+    }
+
+    if (mRealTime) {
+      if (0 == mFirstRecordNs) {
+        mFirstRecordNs = mRecord->timestampNs;
+      }
+      int64_t waitNs = (int64_t)(mRecord->timestampNs - mFirstRecordNs) -
+                       (int64_t)(nowNs() - mStartNs);
+      if (waitNs > 0) {
+        // sleep in steps so a stop is not held up by a long gap
+        struct timespec ts;
+        if (waitNs > MAX_SLEEP_NS) {
+          waitNs = MAX_SLEEP_NS;
+        }
+        ts.tv_sec = waitNs / 1000000000;
+        ts.tv_nsec = waitNs % 1000000000;
+        nanosleep(&ts, NULL);
+        return true;
+      }
+    }
+
+    uint64_t startNs = nowNs();
+    if (eLOC_CLIENT_SUCCESS != locClientInjectInd(mClientHandle,
+                                                  mRecord->msgId, mPayload,
+                                                  mRecord->len)) {
+      mNumFailed++;
+    }
+    if (NULL != mLatencyUs && mNumRecords < mMaxRecords) {
+      mLatencyUs[mNumRecords++] = (uint32_t)((nowNs() - startNs) / 1000);
+    }
+    mRecord = NULL;
+    return true;
+  }
+};
+
+void LocApiV02 :: startReplay()
+{
+  bool realTime = false;
+  const char* fileName = locCaptureGetReplayFile(&realTime);
+  locCaptureReaderT reader;
+
+  if (NULL == fileName || mReplayThread.isRunning() ||
+      !locCaptureReaderOpen(&reader, fileName)) {
+    return;
+  }
+
+  LOC_LOGI("%s:%d]: replaying %s %s", __func__, __LINE__, fileName,
+           realTime ? "in real time" : "as fast as possible");
+  LocApiV02Replay* replay = new LocApiV02Replay(clientHandle, realTime,
+                                                reader);
+  if (!mReplayThread.start("LocApiV02Replay", replay)) {
+    delete replay;
+  }
+}
+
+/* identifies the modem build from the baseband properties, returns
+   false if the modem version is not known */
+static bool getModemBuildCrc(uint32_t &modemBuildCrc)
+{
+  char baseband[PROPERTY_VALUE_MAX];
+  char version[PROPERTY_VALUE_MAX];
+
+  loc_get_target_baseband(baseband, sizeof(baseband));
+  property_get("gsm.version.baseband", version, "");
+  if ('\0' == version[0]) {
+    return false;
+  }
+
+  modemBuildCrc = loc_util_crc32(0, baseband, strlen(baseband));
+  modemBuildCrc = loc_util_crc32(modemBuildCrc, version, strlen(version));
+  return true;
+}
+
+bool LocApiV02 :: loadSupportedMsgList(uint64_t &supportedMsgList)
+{
+  SupportedMsgCache cache;
+  uint32_t modemBuildCrc = 0;
+  bool ret = false;
+
+  if (!getModemBuildCrc(modemBuildCrc)) {
+    return false;
+  }
+
+  FILE* file = fopen(SUPPORTED_MSG_CACHE_FILE, "rb");
+  if (NULL != file) {
+    if (fread(&cache, sizeof(cache), 1, file) == 1 &&
+        SUPPORTED_MSG_CACHE_MAGIC == cache.magic &&
+        SUPPORTED_MSG_CACHE_VERSION == cache.version &&
+        modemBuildCrc == cache.modemBuildCrc &&
+        loc_util_crc32(0, &cache, offsetof(SupportedMsgCache, crc32)) ==
+        cache.crc32) {
+      supportedMsgList = cache.supportedMsgList;
+      ret = true;
+    }
+    fclose(file);
+  }
+  return ret;
+}
+
+void LocApiV02 :: storeSupportedMsgList(uint64_t supportedMsgList)
+{
+  SupportedMsgCache cache;
+
+  memset(&cache, 0, sizeof(cache));
+  if (!getModemBuildCrc(cache.modemBuildCrc)) {
+    return;
+  }
+  cache.magic = SUPPORTED_MSG_CACHE_MAGIC;
+  cache.version = SUPPORTED_MSG_CACHE_VERSION;
+  cache.supportedMsgList = supportedMsgList;
+  cache.crc32 = loc_util_crc32(0, &cache, offsetof(SupportedMsgCache, crc32));
+
+  if (0 != loc_util_write_file_atomic(SUPPORTED_MSG_CACHE_FILE, &cache,
+                                      sizeof(cache), 0600)) {
+    LOC_LOGE("%s:%d]: failed to store supported msg list", __func__, __LINE__);
+  }
+}
+
+/* probe the modem for the QMI_LOC messages we depend on, returns false
+   if the modem could not be fully queried, in which case supportedMsgList
+   only holds what was learned and must not be stored */
+bool LocApiV02 :: querySupportedMsgList(uint64_t &supportedMsgList)
+{
+    locClientStatusEnumType status = eLOC_CLIENT_SUCCESS;
+    bool complete = true;
+    supportedMsgList = 0;
+    const uint32_t msgArray[NUMBER_OF_MSG_TO_BE_CHECKED] =
+    {
+        // For - LOC_API_ADAPTER_MESSAGE_LOCATION_BATCHING
+        QMI_LOC_GET_BATCH_SIZE_REQ_V02,
+
+        // For - LOC_API_ADAPTER_MESSAGE_BATCHED_GENFENCE_BREACH
+        QMI_LOC_EVENT_GEOFENCE_BATCHED_BREACH_NOTIFICATION_IND_V02,
+
+        // For - LOC_API_ADAPTER_MESSAGE_DISTANCE_BASE_TRACKING
+        QMI_LOC_START_DBT_REQ_V02
+    };
+
+    // check the modem
+    status = locClientSupportMsgCheck(clientHandle,
+                                      msgArray,
+                                      NUMBER_OF_MSG_TO_BE_CHECKED,
+                                      &supportedMsgList);
+    if (eLOC_CLIENT_SUCCESS != status) {
+        LOC_LOGE("%s:%d]: Failed to checking QMI_LOC message supported. \n",
+                 __func__, __LINE__);
+        return false;
+    }
+
+    /** if batching is supported , check if the adaptive batching or
+        distance-based batching is supported. */
+    uint32_t messageChecker = 1 << LOC_API_ADAPTER_MESSAGE_LOCATION_BATCHING;
+    if ((messageChecker & supportedMsgList) == messageChecker) {
+        locClientReqUnionType req_union;
+        locClientStatusEnumType status = eLOC_CLIENT_SUCCESS;
+        qmiLocQueryAonConfigReqMsgT_v02 queryAonConfigReq;
+        qmiLocQueryAonConfigIndMsgT_v02 queryAonConfigInd;
+
+        memset(&queryAonConfigReq, 0, sizeof(queryAonConfigReq));
+        memset(&queryAonConfigInd, 0, sizeof(queryAonConfigInd));
+        queryAonConfigReq.transactionId = LOC_API_V02_DEF_SESSION_ID;
+
+        req_union.pQueryAonConfigReq = &queryAonConfigReq;
+        status = loc_sync_send_req(clientHandle,
+                                   QMI_LOC_QUERY_AON_CONFIG_REQ_V02,
+                                   req_union,
+                                   LOC_ENGINE_SYNC_REQUEST_TIMEOUT,
+                                   QMI_LOC_QUERY_AON_CONFIG_IND_V02,
+                                   &queryAonConfigInd);
+
+        if (status == eLOC_CLIENT_FAILURE_UNSUPPORTED) {
+            LOC_LOGE("%s:%d]: Query AON config is not supported.\n", __func__, __LINE__);
+        } else {
+            if (status != eLOC_CLIENT_SUCCESS ||
+                queryAonConfigInd.status != eQMI_LOC_SUCCESS_V02) {
+                LOC_LOGE("%s:%d]: Query AON config failed."
+                         " status: %s, ind status:%s\n",
+                         __func__, __LINE__,
+                         loc_get_v02_client_status_name(status),
+                         loc_get_v02_qmi_status_name(queryAonConfigInd.status));
+                complete = false;
+            } else {
+                LOC_LOGD("%s:%d]: Query AON config succeeded.\n", __func__, __LINE__);
+                if (queryAonConfigInd.aonCapability_valid) {
+                    if (queryAonConfigInd.aonCapability |
+                        QMI_LOC_MASK_AON_TIME_BASED_BATCHING_SUPPORTED_V02) {
+                        LOC_LOGD("%s:%d]: LB 1.0 is supported.\n", __func__, __LINE__);
+                    }
+                    if (queryAonConfigInd.aonCapability |
+                        QMI_LOC_MASK_AON_AUTO_BATCHING_SUPPORTED_V02) {
+                        LOC_LOGD("%s:%d]: LB 1.5 is supported.\n", __func__, __LINE__);
+                        supportedMsgList |=
+                            (1 << LOC_API_ADAPTER_MESSAGE_ADAPTIVE_LOCATION_BATCHING);
+                    }
+                    if (queryAonConfigInd.aonCapability |
+                        QMI_LOC_MASK_AON_DISTANCE_BASED_BATCHING_SUPPORTED_V02) {
+                        LOC_LOGD("%s:%d]: LB 2.0 is supported.\n", __func__, __LINE__);
+                        supportedMsgList |=
+                            (1 << LOC_API_ADAPTER_MESSAGE_DISTANCE_BASE_LOCATION_BATCHING);
+                    }
+                    if (queryAonConfigInd.aonCapability |
+                        QMI_LOC_MASK_AON_DISTANCE_BASED_TRACKING_SUPPORTED_V02) {
+                        LOC_LOGD("%s:%d]: DBT 2.0 is supported.\n", __func__, __LINE__);
+                    }
+                } else {
+                    LOC_LOGE("%s:%d]: AON capability is invalid.\n", __func__, __LINE__);
+                }
+            }
+        }
+    }
+    LOC_LOGV("%s:%d]: supportedMsgList is %lld. \n",
+             __func__, __LINE__, supportedMsgList);
+    return complete;
+}
+
 /* Initialize a loc api v02 client AND
    check which loc message are supported by modem */
 enum loc_api_adapter_err
 LocApiV02 :: open(LOC_API_ADAPTER_EVENT_MASK_T mask)
 {
   enum loc_api_adapter_err rtv = LOC_API_ADAPTER_ERR_SUCCESS;
-  LOC_API_ADAPTER_EVENT_MASK_T newMask = mMask | (mask & ~mExcludedMask);
+  // mask is the full set the adapters want, so bits can be dropped too
+  LOC_API_ADAPTER_EVENT_MASK_T newMask = mask & ~mExcludedMask;
   locClientEventMaskType qmiMask = convertMask(newMask);
   LOC_LOGD("%s:%d]: Enter mMask: %x; mask: %x; newMask: %x mQmiMask: %lld qmiMask: %lld",
            __func__, __LINE__, mMask, mask, newMask, mQmiMask, qmiMask);
@@ -208,10 +521,14 @@ LocApiV02 :: open(LOC_API_ADAPTER_EVENT_MASK_T mask)
        the locClientOpen() function will block if the
        service is unavailable for a fixed time out */
 
+    memset(&mOpenTiming, 0, sizeof(mOpenTiming));
+    mOpenTiming.startMs = elapsedMillisSinceBoot();
+
     // it is important to cap the mask here, because not all LocApi's
     // can enable the same bits, e.g. foreground and bckground.
     status = locClientOpen(adjustMaskForNoSession(qmiMask), &globalCallbacks,
                            &clientHandle, (void *)this);
+    mOpenTiming.clientOpenMs = elapsedMillisSinceBoot() - mOpenTiming.startMs;
     mMask = newMask;
     mQmiMask = qmiMask;
     if (eLOC_CLIENT_SUCCESS != status ||
@@ -224,92 +541,21 @@ LocApiV02 :: open(LOC_API_ADAPTER_EVENT_MASK_T mask)
       rtv = LOC_API_ADAPTER_ERR_FAILURE;
     } else {
         uint64_t supportedMsgList = 0;
-        const uint32_t msgArray[NUMBER_OF_MSG_TO_BE_CHECKED] =
-        {
-            // For - LOC_API_ADAPTER_MESSAGE_LOCATION_BATCHING
-            QMI_LOC_GET_BATCH_SIZE_REQ_V02,
-
-            // For - LOC_API_ADAPTER_MESSAGE_BATCHED_GENFENCE_BREACH
-            QMI_LOC_EVENT_GEOFENCE_BATCHED_BREACH_NOTIFICATION_IND_V02,
-
-            // For - LOC_API_ADAPTER_MESSAGE_DISTANCE_BASE_TRACKING
-            QMI_LOC_START_DBT_REQ_V02
-        };
-
-        // check the modem
-        status = locClientSupportMsgCheck(clientHandle,
-                                          msgArray,
-                                          NUMBER_OF_MSG_TO_BE_CHECKED,
-                                          &supportedMsgList);
-        if (eLOC_CLIENT_SUCCESS != status) {
-            LOC_LOGE("%s:%d]: Failed to checking QMI_LOC message supported. \n",
-                     __func__, __LINE__);
-        }
-
-        /** if batching is supported , check if the adaptive batching or
-            distance-based batching is supported. */
-        uint32_t messageChecker = 1 << LOC_API_ADAPTER_MESSAGE_LOCATION_BATCHING;
-        if ((messageChecker & supportedMsgList) == messageChecker) {
-            locClientReqUnionType req_union;
-            locClientStatusEnumType status = eLOC_CLIENT_SUCCESS;
-            qmiLocQueryAonConfigReqMsgT_v02 queryAonConfigReq;
-            qmiLocQueryAonConfigIndMsgT_v02 queryAonConfigInd;
-
-            memset(&queryAonConfigReq, 0, sizeof(queryAonConfigReq));
-            memset(&queryAonConfigInd, 0, sizeof(queryAonConfigInd));
-            queryAonConfigReq.transactionId = LOC_API_V02_DEF_SESSION_ID;
-
-            req_union.pQueryAonConfigReq = &queryAonConfigReq;
-            status = loc_sync_send_req(clientHandle,
-                                       QMI_LOC_QUERY_AON_CONFIG_REQ_V02,
-                                       req_union,
-                                       LOC_ENGINE_SYNC_REQUEST_TIMEOUT,
-                                       QMI_LOC_QUERY_AON_CONFIG_IND_V02,
-                                       &queryAonConfigInd);
-
-            if (status == eLOC_CLIENT_FAILURE_UNSUPPORTED) {
-                LOC_LOGE("%s:%d]: Query AON config is not supported.\n", __func__, __LINE__);
-            } else {
-                if (status != eLOC_CLIENT_SUCCESS ||
-                    queryAonConfigInd.status != eQMI_LOC_SUCCESS_V02) {
-                    LOC_LOGE("%s:%d]: Query AON config failed."
-                             " status: %s, ind status:%s\n",
-                             __func__, __LINE__,
-                             loc_get_v02_client_status_name(status),
-                             loc_get_v02_qmi_status_name(queryAonConfigInd.status));
-                } else {
-                    LOC_LOGD("%s:%d]: Query AON config succeeded.\n", __func__, __LINE__);
-                    if (queryAonConfigInd.aonCapability_valid) {
-                        if (queryAonConfigInd.aonCapability |
-                            QMI_LOC_MASK_AON_TIME_BASED_BATCHING_SUPPORTED_V02) {
-                            LOC_LOGD("%s:%d]: LB 1.0 is supported.\n", __func__, __LINE__);
-                        }
-                        if (queryAonConfigInd.aonCapability |
-                            QMI_LOC_MASK_AON_AUTO_BATCHING_SUPPORTED_V02) {
-                            LOC_LOGD("%s:%d]: LB 1.5 is supported.\n", __func__, __LINE__);
-                            supportedMsgList |=
-                                (1 << LOC_API_ADAPTER_MESSAGE_ADAPTIVE_LOCATION_BATCHING);
-                        }
-                        if (queryAonConfigInd.aonCapability |
-                            QMI_LOC_MASK_AON_DISTANCE_BASED_BATCHING_SUPPORTED_V02) {
-                            LOC_LOGD("%s:%d]: LB 2.0 is supported.\n", __func__, __LINE__);
-                            supportedMsgList |=
-                                (1 << LOC_API_ADAPTER_MESSAGE_DISTANCE_BASE_LOCATION_BATCHING);
-                        }
-                        if (queryAonConfigInd.aonCapability |
-                            QMI_LOC_MASK_AON_DISTANCE_BASED_TRACKING_SUPPORTED_V02) {
-                            LOC_LOGD("%s:%d]: DBT 2.0 is supported.\n", __func__, __LINE__);
-                        }
-                    } else {
-                        LOC_LOGE("%s:%d]: AON capability is invalid.\n", __func__, __LINE__);
-                    }
-                }
-            }
+        int64_t checkStartMs = elapsedMillisSinceBoot();
+
+        // a modem running the build we probed before supports the same
+        // messages, so the probe only runs again when the build changes;
+        // a partial answer is used, but probed again on the next open
+        if (loadSupportedMsgList(supportedMsgList)) {
+            LOC_LOGD("%s:%d]: cached supportedMsgList is %lld. \n",
+                     __func__, __LINE__, supportedMsgList);
+        } else if (querySupportedMsgList(supportedMsgList)) {
+            storeSupportedMsgList(supportedMsgList);
         }
-        LOC_LOGV("%s:%d]: supportedMsgList is %lld. \n",
-                 __func__, __LINE__, supportedMsgList);
+        mOpenTiming.msgCheckMs = elapsedMillisSinceBoot() - checkStartMs;
         // save the supported message list
         saveSupportedMsgList(supportedMsgList);
+        startReplay();
     }
   } else if (newMask != mMask) {
     // it is important to cap the mask here, because not all LocApi's
@@ -328,7 +574,14 @@ LocApiV02 :: open(LOC_API_ADAPTER_EVENT_MASK_T mask)
            __func__, __LINE__, mMask, mask, mQmiMask, qmiMask);
 
   if (LOC_API_ADAPTER_ERR_SUCCESS == rtv) {
+      int64_t measSupportStartMs = elapsedMillisSinceBoot();
       cacheGnssMeasurementSupport();
+      if (mOpenTiming.startMs != 0 && 0 == mOpenTiming.measSupportMs) {
+          mOpenTiming.measSupportMs =
+              elapsedMillisSinceBoot() - measSupportStartMs;
+      }
+  } else {
+      mOpenTiming.startMs = 0;
   }
 
   return rtv;
@@ -362,6 +615,9 @@ locClientEventMaskType LocApiV02 :: adjustMaskForNoSession(locClientEventMaskTyp
 
 enum loc_api_adapter_err LocApiV02 :: close()
 {
+  // the replay uses the client handle
+  mReplayThread.stop();
+
   enum loc_api_adapter_err rtv =
       // success if either client is already invalid, or
       // we successfully close the handle
@@ -1302,6 +1558,11 @@ enum loc_api_adapter_err LocApiV02 :: setSUPLVersion(uint32_t version)
    supl_config_req.suplVersion = (version == 0x00020000)?
      eQMI_LOC_SUPL_VERSION_2_0_V02 : eQMI_LOC_SUPL_VERSION_1_0_V02;
 
+  if (mConfigBatch.active) {
+    mergeProtocolConfig(supl_config_req);
+    return LOC_API_ADAPTER_ERR_SUCCESS;
+  }
+
   req_union.pSetProtocolConfigParametersReq = &supl_config_req;
 
   result = loc_sync_send_req(clientHandle,
@@ -1339,6 +1600,11 @@ enum loc_api_adapter_err LocApiV02 :: setLPPConfig(uint32_t profile)
 
   lpp_config_req.lppConfig = profile;
 
+  if (mConfigBatch.active) {
+    mergeProtocolConfig(lpp_config_req);
+    return LOC_API_ADAPTER_ERR_SUCCESS;
+  }
+
   req_union.pSetProtocolConfigParametersReq = &lpp_config_req;
 
   result = loc_sync_send_req(clientHandle,
@@ -1383,6 +1649,12 @@ enum loc_api_adapter_err LocApiV02 :: setSensorControlConfig(
       eQMI_LOC_SENSOR_CONFIG_USE_PROVIDER_SSC_V02 :
       eQMI_LOC_SENSOR_CONFIG_USE_PROVIDER_NATIVE_V02;
 
+  if (mConfigBatch.active) {
+    mConfigBatch.sensorControl = sensor_config_req;
+    mConfigBatch.hasSensorControl = true;
+    return LOC_API_ADAPTER_ERR_SUCCESS;
+  }
+
   req_union.pSetSensorControlConfigReq = &sensor_config_req;
 
   result = loc_sync_send_req(clientHandle,
@@ -1440,6 +1712,12 @@ enum loc_api_adapter_err LocApiV02 :: setSensorProperties(bool gyroBiasVarianceR
   sensor_prop_req.velocityRandomWalkSpectralDensity_valid = velocityBiasVarianceRandomWalk_valid;
   sensor_prop_req.velocityRandomWalkSpectralDensity = velocityBiasVarianceRandomWalk;
 
+  if (mConfigBatch.active) {
+    mConfigBatch.sensorProperties = sensor_prop_req;
+    mConfigBatch.hasSensorProperties = true;
+    return LOC_API_ADAPTER_ERR_SUCCESS;
+  }
+
   req_union.pSetSensorPropertiesReq = &sensor_prop_req;
 
   result = loc_sync_send_req(clientHandle,
@@ -1512,6 +1790,12 @@ enum loc_api_adapter_err LocApiV02 :: setSensorPerfControlConfig(int controlMode
   sensor_perf_config_req.algorithmConfig_valid = 1;
   sensor_perf_config_req.algorithmConfig = algorithmConfig;
 
+  if (mConfigBatch.active) {
+    mConfigBatch.sensorPerfControl = sensor_perf_config_req;
+    mConfigBatch.hasSensorPerfControl = true;
+    return LOC_API_ADAPTER_ERR_SUCCESS;
+  }
+
   req_union.pSetSensorPerformanceControlConfigReq = &sensor_perf_config_req;
 
   result = loc_sync_send_req(clientHandle,
@@ -1571,6 +1855,12 @@ enum loc_api_adapter_err LocApiV02 :: setExtPowerConfig(int isBatteryCharging)
       break;
   }
 
+  if (mConfigBatch.active) {
+    mConfigBatch.extPower = ext_pwr_req;
+    mConfigBatch.hasExtPower = true;
+    return LOC_API_ADAPTER_ERR_SUCCESS;
+  }
+
   req_union.pSetExternalPowerConfigReq = &ext_pwr_req;
 
   result = loc_sync_send_req(clientHandle,
@@ -1603,6 +1893,11 @@ enum loc_api_adapter_err LocApiV02 :: setAGLONASSProtocol(unsigned long aGlonass
   aGlonassProtocol_req.assistedGlonassProtocolMask_valid = 1;
   aGlonassProtocol_req.assistedGlonassProtocolMask = aGlonassProtocol;
 
+  if (mConfigBatch.active) {
+    mergeProtocolConfig(aGlonassProtocol_req);
+    return LOC_API_ADAPTER_ERR_SUCCESS;
+  }
+
   req_union.pSetProtocolConfigParametersReq = &aGlonassProtocol_req;
 
   LOC_LOGD("%s:%d]: aGlonassProtocolMask = 0x%x\n",  __func__, __LINE__,
@@ -1785,6 +2080,39 @@ void LocApiV02 :: reportPosition (
 {
     UlpLocation location;
     LocPosTechMask tech_Mask = LOC_POS_TECH_MASK_DEFAULT;
+    bool hasAccuracy = false;
+    float accuracy = 0;
+    loc_fix_trace_stamp(loc_fix_trace_current(), LOC_FIX_TRACE_LOC_API);
+
+    // Uncertainty (circular), needed up front to filter the report
+    if (location_report_ptr->horUncCircular_valid) {
+        hasAccuracy = true;
+        accuracy = location_report_ptr->horUncCircular;
+    } else if (location_report_ptr->horUncEllipseSemiMinor_valid &&
+               location_report_ptr->horUncEllipseSemiMajor_valid) {
+        hasAccuracy = true;
+        accuracy =
+            sqrt((location_report_ptr->horUncEllipseSemiMinor *
+                  location_report_ptr->horUncEllipseSemiMinor) +
+                 (location_report_ptr->horUncEllipseSemiMajor *
+                  location_report_ptr->horUncEllipseSemiMajor));
+    }
+
+    // skip the conversion of a report no adapter would use,
+    // e.g. an intermediate fix above ACCURACY_THRES
+    if ((location_report_ptr->sessionStatus == eQMI_LOC_SESS_STATUS_SUCCESS_V02 ||
+         location_report_ptr->sessionStatus == eQMI_LOC_SESS_STATUS_IN_PROGRESS_V02) &&
+        !isPositionWanted(location_report_ptr->sessionStatus ==
+                          eQMI_LOC_SESS_STATUS_IN_PROGRESS_V02 ?
+                          LOC_SESS_INTERMEDIATE : LOC_SESS_SUCCESS,
+                          hasAccuracy, accuracy))
+    {
+        LOC_LOGV("%s:%d]: dropping unwanted position report, status = %d, "
+                 "accuracy = %f\n", __func__, __LINE__,
+                 location_report_ptr->sessionStatus, accuracy);
+        return;
+    }
+
     LOC_LOGD("Reporting postion from V2 Adapter\n");
     memset(&location, 0, sizeof (UlpLocation));
     location.size = sizeof(location);
@@ -1835,17 +2163,9 @@ void LocApiV02 :: reportPosition (
             }
 
             // Uncertainty (circular)
-            if (location_report_ptr->horUncCircular_valid) {
-                location.gpsLocation.flags |= GPS_LOCATION_HAS_ACCURACY;
-                location.gpsLocation.accuracy = location_report_ptr->horUncCircular;
-            } else if (location_report_ptr->horUncEllipseSemiMinor_valid &&
-                       location_report_ptr->horUncEllipseSemiMajor_valid) {
+            if (hasAccuracy) {
                 location.gpsLocation.flags |= GPS_LOCATION_HAS_ACCURACY;
-                location.gpsLocation.accuracy =
-                    sqrt((location_report_ptr->horUncEllipseSemiMinor *
-                          location_report_ptr->horUncEllipseSemiMinor) +
-                         (location_report_ptr->horUncEllipseSemiMajor *
-                          location_report_ptr->horUncEllipseSemiMajor));
+                location.gpsLocation.accuracy = accuracy;
             }
 
             // Technology Mask
@@ -2486,166 +2806,146 @@ void LocApiV02 :: reportGnssMeasurementData(
 {
     LOC_LOGV ("%s:%d]: entering\n", __func__, __LINE__);
 
-    GpsData gpsMeasurementData;
-    memset (&gpsMeasurementData, 0, sizeof(GpsData));
-
-    int svMeasurment_len = 0;
-
-    // size
-    gpsMeasurementData.size = sizeof(GpsData);
-
-    // number of measurements
-    if (gnss_measurement_report_ptr.svMeasurement_valid) {
-        svMeasurment_len =
-            gnss_measurement_report_ptr.svMeasurement_len;
-        gpsMeasurementData.measurement_count = svMeasurment_len;
-        LOC_LOGV ("%s:%d]: there are %d SV measurements\n",
-                  __func__, __LINE__, svMeasurment_len);
-    } else {
-        LOC_LOGV ("%s:%d]: there is no valid SV measurements\n",
+    // GpsMeasurement has no constellation, so only GPS can be reported
+    if (!gnss_measurement_report_ptr.svMeasurement_valid ||
+        0 == gnss_measurement_report_ptr.svMeasurement_len ||
+        gnss_measurement_report_ptr.system != eQMI_LOC_SV_SYSTEM_GPS_V02) {
+        LOC_LOGV ("%s:%d]: There is no GPS measurement.\n",
                   __func__, __LINE__);
+        return;
     }
 
-    if (svMeasurment_len != 0 &&
-        gnss_measurement_report_ptr.system == eQMI_LOC_SV_SYSTEM_GPS_V02) {
-
-        // the array of measurements
-        int index = 0;
-        while(svMeasurment_len > 0) {
-            convertGpsMeasurements(gpsMeasurementData.measurements[index],
-                                   gnss_measurement_report_ptr.svMeasurement[index]);
-            index++;
-            svMeasurment_len--;
-        }
-
-        // the GPS clock time reading
-        convertGpsClock(gpsMeasurementData.clock,
-                        gnss_measurement_report_ptr);
+    GpsData gpsMeasurementData;
+    // only the header and the measurements in use are cleared, the rest
+    // of the array is not copied on
+    memset(&gpsMeasurementData.clock, 0, sizeof(gpsMeasurementData.clock));
+    gpsMeasurementData.size = sizeof(GpsData);
 
-        // calling the base
-        LOC_LOGV ("%s:%d]: calling LocApiBase::reportGpsMeasurementData.\n",
-                  __func__, __LINE__);
-        LocApiBase::reportGpsMeasurementData(gpsMeasurementData);
-    } else {
-        LOC_LOGV ("%s:%d]: There is no GPS measurement.\n",
-                  __func__, __LINE__);
-    }
-}
+    convertGpsMeasurements(gpsMeasurementData, gnss_measurement_report_ptr);
+    LOC_LOGV ("%s:%d]: there are %d SV measurements\n",
+              __func__, __LINE__, gpsMeasurementData.measurement_count);
+
+    // the GPS clock time reading
+    convertGpsClock(gpsMeasurementData.clock,
+                    gnss_measurement_report_ptr);
+
+    // calling the base
+    LOC_LOGV ("%s:%d]: calling LocApiBase::reportGpsMeasurementData.\n",
+              __func__, __LINE__);
+    LocApiBase::reportGpsMeasurementData(gpsMeasurementData);
+}
+
+/* The fields of the QMI measurements the conversion works on, copied
+   into one array per field, so that each conversion step below is a
+   plain loop over arrays rather than a walk over the QMI structs. */
+struct LocGpsMeasurementColumns {
+    uint64_t validMask[GPS_MAX_MEASUREMENT];
+    double svTimeMs[GPS_MAX_MEASUREMENT];
+    double svTimeSubMs[GPS_MAX_MEASUREMENT];
+    double svTimeUncMs[GPS_MAX_MEASUREMENT];
+    double cNo[GPS_MAX_MEASUREMENT];
+    // results
+    double towNs[GPS_MAX_MEASUREMENT];
+    double towUncNs[GPS_MAX_MEASUREMENT];
+    double cN0DbHz[GPS_MAX_MEASUREMENT];
+};
 
 /*convert GpsMeasurement type from QMI LOC to loc eng format*/
-void LocApiV02 :: convertGpsMeasurements (GpsMeasurement& gpsMeasurement,
-    const qmiLocSVMeasurementStructT_v02& gnss_measurement_info)
+void LocApiV02 :: convertGpsMeasurements (GpsData& gpsData,
+    const qmiLocEventGnssSvMeasInfoIndMsgT_v02& gnss_measurement_report)
 {
-    LOC_LOGV ("%s:%d]: entering\n", __func__, __LINE__);
-
-    // size
-    gpsMeasurement.size = sizeof(GpsMeasurement);
-
-    // flag initiation
-    int flags = 0;
-
-    // prn
-    gpsMeasurement.prn = gnss_measurement_info.gnssSvId;
-
-    // time_offset_ns
-    gpsMeasurement.time_offset_ns = 0;
-
-    // state & received_gps_tow_ns & received_gps_tow_uncertainty_ns
-    uint64_t validMask = gnss_measurement_info.measurementStatus &
-                         gnss_measurement_info.validMeasStatusMask;
+    LocGpsMeasurementColumns cols;
+    const qmiLocSVMeasurementStructT_v02* meas =
+        gnss_measurement_report.svMeasurement;
+    uint32_t count = gnss_measurement_report.svMeasurement_len;
     uint64_t bitSynMask = QMI_LOC_MASK_MEAS_STATUS_BE_CONFIRM_V02 |
                           QMI_LOC_MASK_MEAS_STATUS_SB_VALID_V02;
-    double gpsTowUncNs = (double)gnss_measurement_info.svTimeSpeed.svTimeUncMs * 1e6;
-
-    if (validMask & QMI_LOC_MASK_MEAS_STATUS_MS_VALID_V02) {
-        /* sub-frame decode & TOW decode */
-        gpsMeasurement.state = GPS_MEASUREMENT_STATE_SUBFRAME_SYNC |
-                                GPS_MEASUREMENT_STATE_TOW_DECODED |
-                                GPS_MEASUREMENT_STATE_BIT_SYNC |
-                                GPS_MEASUREMENT_STATE_CODE_LOCK;
-        gpsMeasurement.received_gps_tow_ns =
-            ((double)gnss_measurement_info.svTimeSpeed.svTimeMs +
-             (double)gnss_measurement_info.svTimeSpeed.svTimeSubMs) * 1e6;
-        gpsMeasurement.received_gps_tow_uncertainty_ns = gpsTowUncNs;
-
-    } else if ((validMask & bitSynMask) == bitSynMask) {
-        /* bit sync */
-        gpsMeasurement.state = GPS_MEASUREMENT_STATE_BIT_SYNC |
-                                GPS_MEASUREMENT_STATE_CODE_LOCK;
-        gpsMeasurement.received_gps_tow_ns =
-            fmod(((double)gnss_measurement_info.svTimeSpeed.svTimeMs +
-                  (double)gnss_measurement_info.svTimeSpeed.svTimeSubMs), 20) * 1e6;
-        gpsMeasurement.received_gps_tow_uncertainty_ns = gpsTowUncNs;
-
-    } else if (validMask & QMI_LOC_MASK_MEAS_STATUS_SM_VALID_V02) {
-        /* code lock */
-        gpsMeasurement.state = GPS_MEASUREMENT_STATE_CODE_LOCK;
-        gpsMeasurement.received_gps_tow_ns =
-             (double)gnss_measurement_info.svTimeSpeed.svTimeSubMs * 1e6;
-        gpsMeasurement.received_gps_tow_uncertainty_ns = gpsTowUncNs;
+    uint32_t i;
 
-    } else {
-        /* by default */
-        gpsMeasurement.state = GPS_MEASUREMENT_STATE_UNKNOWN;
-        gpsMeasurement.received_gps_tow_ns = 0;
-        gpsMeasurement.received_gps_tow_uncertainty_ns = 0;
+    if (count > QMI_LOC_SV_MEAS_LIST_MAX_SIZE_V02) {
+        count = QMI_LOC_SV_MEAS_LIST_MAX_SIZE_V02;
+    }
+    if (count > GPS_MAX_MEASUREMENT) {
+        count = GPS_MAX_MEASUREMENT;
+    }
+    gpsData.measurement_count = count;
+    memset(gpsData.measurements, 0, count * sizeof(GpsMeasurement));
+
+    // gather
+    for (i = 0; i < count; i++) {
+        cols.validMask[i] = meas[i].measurementStatus &
+                            meas[i].validMeasStatusMask;
+        cols.svTimeMs[i] = meas[i].svTimeSpeed.svTimeMs;
+        cols.svTimeSubMs[i] = meas[i].svTimeSpeed.svTimeSubMs;
+        cols.svTimeUncMs[i] = meas[i].svTimeSpeed.svTimeUncMs;
+        cols.cNo[i] = meas[i].CNo;
     }
 
-    // c_n0_dbhz
-    gpsMeasurement.c_n0_dbhz = gnss_measurement_info.CNo/10.0;
-
-    // pseudorange_rate_mps
-    gpsMeasurement.pseudorange_rate_mps =
-        gnss_measurement_info.svTimeSpeed.dopplerShift;
-
-    // pseudorange_rate_uncertainty_mps
-    gpsMeasurement.pseudorange_rate_uncertainty_mps =
-        gnss_measurement_info.svTimeSpeed.dopplerShiftUnc;
-
-    // accumulated_delta_range_state
-    gpsMeasurement.accumulated_delta_range_state = GPS_ADR_STATE_UNKNOWN;
+    // convert
+    for (i = 0; i < count; i++) {
+        cols.towUncNs[i] = cols.svTimeUncMs[i] * 1e6;
+    }
+    for (i = 0; i < count; i++) {
+        cols.cN0DbHz[i] = cols.cNo[i] / 10.0;
+    }
+    for (i = 0; i < count; i++) {
+        cols.towNs[i] = (cols.svTimeMs[i] + cols.svTimeSubMs[i]) * 1e6;
+    }
 
-    gpsMeasurement.flags = flags;
+    // scatter, with the state deciding how much of the TOW is known
+    for (i = 0; i < count; i++) {
+        GpsMeasurement& gpsMeasurement = gpsData.measurements[i];
+
+        gpsMeasurement.size = sizeof(GpsMeasurement);
+        gpsMeasurement.prn = meas[i].gnssSvId;
+        gpsMeasurement.c_n0_dbhz = cols.cN0DbHz[i];
+        gpsMeasurement.pseudorange_rate_mps =
+            meas[i].svTimeSpeed.dopplerShift;
+        gpsMeasurement.pseudorange_rate_uncertainty_mps =
+            meas[i].svTimeSpeed.dopplerShiftUnc;
+        gpsMeasurement.accumulated_delta_range_state = GPS_ADR_STATE_UNKNOWN;
+
+        if (cols.validMask[i] & QMI_LOC_MASK_MEAS_STATUS_MS_VALID_V02) {
+            /* sub-frame decode & TOW decode */
+            gpsMeasurement.state = GPS_MEASUREMENT_STATE_SUBFRAME_SYNC |
+                                   GPS_MEASUREMENT_STATE_TOW_DECODED |
+                                   GPS_MEASUREMENT_STATE_BIT_SYNC |
+                                   GPS_MEASUREMENT_STATE_CODE_LOCK;
+            gpsMeasurement.received_gps_tow_ns = cols.towNs[i];
+            gpsMeasurement.received_gps_tow_uncertainty_ns = cols.towUncNs[i];
+        } else if ((cols.validMask[i] & bitSynMask) == bitSynMask) {
+            /* bit sync */
+            gpsMeasurement.state = GPS_MEASUREMENT_STATE_BIT_SYNC |
+                                   GPS_MEASUREMENT_STATE_CODE_LOCK;
+            gpsMeasurement.received_gps_tow_ns =
+                fmod(cols.svTimeMs[i] + cols.svTimeSubMs[i], 20) * 1e6;
+            gpsMeasurement.received_gps_tow_uncertainty_ns = cols.towUncNs[i];
+        } else if (cols.validMask[i] & QMI_LOC_MASK_MEAS_STATUS_SM_VALID_V02) {
+            /* code lock */
+            gpsMeasurement.state = GPS_MEASUREMENT_STATE_CODE_LOCK;
+            gpsMeasurement.received_gps_tow_ns = cols.svTimeSubMs[i] * 1e6;
+            gpsMeasurement.received_gps_tow_uncertainty_ns = cols.towUncNs[i];
+        } else {
+            /* by default */
+            gpsMeasurement.state = GPS_MEASUREMENT_STATE_UNKNOWN;
+        }
 
-    LOC_LOGV(" %s:%d]: GNSS measurement raw data received form modem: \n"
-             " Input => gnssSvId | CNo "
-             "| measurementStatus | dopplerShift |"
-             " dopplerShiftUnc| svTimeMs | svTimeSubMs | svTimeUncMs"
-             " | validMeasStatusMask | \n"
-             " Input => %d | %d | 0x%04x%04x | %f | %f | %u | %f | %f | 0x%04x%04x |\n",
-             __func__, __LINE__,
-             gnss_measurement_info.gnssSvId,                                    // %d
-             gnss_measurement_info.CNo,                                         // %d
-             (uint32_t)(gnss_measurement_info.measurementStatus >> 32),         // %04x Upper 32
-             (uint32_t)(gnss_measurement_info.measurementStatus & 0xFFFFFFFF),  // %04x Lower 32
-             gnss_measurement_info.svTimeSpeed.dopplerShift,                    // %f
-             gnss_measurement_info.svTimeSpeed.dopplerShiftUnc,                 // %f
-             gnss_measurement_info.svTimeSpeed.svTimeMs,                        // %u
-             gnss_measurement_info.svTimeSpeed.svTimeSubMs,                     // %f
-             gnss_measurement_info.svTimeSpeed.svTimeUncMs,                     // %f
-             (uint32_t)(gnss_measurement_info.validMeasStatusMask >> 32),       // %04x Upper 32
-             (uint32_t)(gnss_measurement_info.validMeasStatusMask & 0xFFFFFFFF) // %04x Lower 32
-            );
-
-    LOC_LOGV(" %s:%d]: GNSS measurement data after conversion: \n"
-             " Output => size | prn | time_offset_ns | state |"
-             " received_gps_tow_ns| received_gps_tow_uncertainty_ns |c_n0_dbhz |"
-             " pseudorange_rate_mps | pseudorange_rate_uncertainty_mps |"
-             " accumulated_delta_range_state | flags \n"
-             " Output => %d | %d | %f | %d | %lld | %lld | %f | %f | %f | %d | %d \n",
-             __func__, __LINE__,
-             gpsMeasurement.size,                              // %d
-             gpsMeasurement.prn,                               // %d
-             gpsMeasurement.time_offset_ns,                    // %f
-             gpsMeasurement.state,                             // %d
-             gpsMeasurement.received_gps_tow_ns,               // %lld
-             gpsMeasurement.received_gps_tow_uncertainty_ns,   // %lld
-             gpsMeasurement.c_n0_dbhz,                         // %f
-             gpsMeasurement.pseudorange_rate_mps,              // %f
-             gpsMeasurement.pseudorange_rate_uncertainty_mps,  // %f
-             gpsMeasurement.accumulated_delta_range_state,     // %d
-             gpsMeasurement.flags                              // %d
-            );
+        LOC_LOGV(" %s:%d]: GNSS measurement %d: gnssSvId %d | CNo %d |"
+                 " measurementStatus 0x%llx | validMeasStatusMask 0x%llx =>"
+                 " state %d | received_gps_tow_ns %lld |"
+                 " received_gps_tow_uncertainty_ns %lld | c_n0_dbhz %f |"
+                 " pseudorange_rate_mps %f | pseudorange_rate_uncertainty_mps %f\n",
+                 __func__, __LINE__, i,
+                 meas[i].gnssSvId, meas[i].CNo,
+                 (unsigned long long)meas[i].measurementStatus,
+                 (unsigned long long)meas[i].validMeasStatusMask,
+                 gpsMeasurement.state,
+                 (long long)gpsMeasurement.received_gps_tow_ns,
+                 (long long)gpsMeasurement.received_gps_tow_uncertainty_ns,
+                 gpsMeasurement.c_n0_dbhz,
+                 gpsMeasurement.pseudorange_rate_mps,
+                 gpsMeasurement.pseudorange_rate_uncertainty_mps);
+    }
 }
 
 /*convert GpsClock type from QMI LOC to loc eng format*/
@@ -2717,16 +3017,24 @@ void LocApiV02 :: eventCb(locClientHandleType clientHandle,
   LOC_LOGD("%s:%d]: event id = %d\n", __func__, __LINE__,
                 eventId);
 
+  // reports no adapter has registered for are dropped here, before
+  // they are converted
   switch(eventId)
   {
     //Position Report
     case QMI_LOC_EVENT_POSITION_REPORT_IND_V02:
-      reportPosition(eventPayload.pPositionReportEvent);
+      if (hasSubscribers(LOC_API_ADAPTER_REPORT_POSITION))
+      {
+        reportPosition(eventPayload.pPositionReportEvent);
+      }
       break;
 
     // Satellite report
     case QMI_LOC_EVENT_GNSS_SV_INFO_IND_V02:
-      reportSv(eventPayload.pGnssSvInfoReportEvent);
+      if (hasSubscribers(LOC_API_ADAPTER_REPORT_SATELLITE))
+      {
+        reportSv(eventPayload.pGnssSvInfoReportEvent);
+      }
       break;
 
     // Status report
@@ -2740,7 +3048,10 @@ void LocApiV02 :: eventCb(locClientHandleType clientHandle,
 
     // NMEA
     case QMI_LOC_EVENT_NMEA_IND_V02:
-      reportNmea(eventPayload.pNmeaReportEvent);
+      if (hasSubscribers(LOC_API_ADAPTER_REPORT_NMEA_1HZ))
+      {
+        reportNmea(eventPayload.pNmeaReportEvent);
+      }
       break;
 
     // XTRA request
@@ -2777,7 +3088,10 @@ void LocApiV02 :: eventCb(locClientHandleType clientHandle,
 
     // GNSS Measurement Report
     case QMI_LOC_EVENT_GNSS_MEASUREMENT_REPORT_IND_V02:
-      reportGnssMeasurementData(*eventPayload.pGnssSvRawInfoEvent);
+      if (hasSubscribers(LOC_API_ADAPTER_GNSS_MEASUREMENT))
+      {
+        reportGnssMeasurementData(*eventPayload.pGnssSvRawInfoEvent);
+      }
       break;
   }
 }
@@ -3393,3 +3707,189 @@ void LocApiV02 :: cacheGnssMeasurementSupport()
 
     LOC_LOGV("%s:%d]: mGnssMeasurementSupported is %d\n", __func__, __LINE__, mGnssMeasurementSupported);
 }
+
+void LocApiV02 :: mergeProtocolConfig(
+  const qmiLocSetProtocolConfigParametersReqMsgT_v02 &protocolConfig)
+{
+  qmiLocSetProtocolConfigParametersReqMsgT_v02 &merged =
+    mConfigBatch.protocolConfig;
+
+  if (protocolConfig.suplVersion_valid) {
+    merged.suplVersion_valid = 1;
+    merged.suplVersion = protocolConfig.suplVersion;
+  }
+  if (protocolConfig.lppConfig_valid) {
+    merged.lppConfig_valid = 1;
+    merged.lppConfig = protocolConfig.lppConfig;
+  }
+  if (protocolConfig.assistedGlonassProtocolMask_valid) {
+    merged.assistedGlonassProtocolMask_valid = 1;
+    merged.assistedGlonassProtocolMask =
+      protocolConfig.assistedGlonassProtocolMask;
+  }
+  mConfigBatch.hasProtocolConfig = true;
+}
+
+/* A modem rejecting one of the merged protocol settings fails them all,
+   so each is sent again on its own, as it was before batching. */
+void LocApiV02 :: resendProtocolConfig()
+{
+  const qmiLocSetProtocolConfigParametersReqMsgT_v02 &merged =
+    mConfigBatch.protocolConfig;
+  qmiLocSetProtocolConfigParametersReqMsgT_v02 reqs[3];
+  uint32_t num = 0;
+
+  memset(reqs, 0, sizeof(reqs));
+  if (merged.suplVersion_valid) {
+    reqs[num].suplVersion_valid = 1;
+    reqs[num++].suplVersion = merged.suplVersion;
+  }
+  if (merged.lppConfig_valid) {
+    reqs[num].lppConfig_valid = 1;
+    reqs[num++].lppConfig = merged.lppConfig;
+  }
+  if (merged.assistedGlonassProtocolMask_valid) {
+    reqs[num].assistedGlonassProtocolMask_valid = 1;
+    reqs[num++].assistedGlonassProtocolMask =
+      merged.assistedGlonassProtocolMask;
+  }
+  if (num < 2) {
+    return;
+  }
+
+  for (uint32_t i = 0; i < num; i++) {
+    locClientReqUnionType req_union;
+    qmiLocSetProtocolConfigParametersIndMsgT_v02 ind;
+    memset(&ind, 0, sizeof(ind));
+    req_union.pSetProtocolConfigParametersReq = &reqs[i];
+
+    locClientStatusEnumType result =
+      loc_sync_send_req(clientHandle,
+                        QMI_LOC_SET_PROTOCOL_CONFIG_PARAMETERS_REQ_V02,
+                        req_union, LOC_ENGINE_SYNC_REQUEST_TIMEOUT,
+                        QMI_LOC_SET_PROTOCOL_CONFIG_PARAMETERS_IND_V02,
+                        &ind);
+    if (result != eLOC_CLIENT_SUCCESS ||
+        eQMI_LOC_SUCCESS_V02 != ind.status) {
+      LOC_LOGE("%s:%d]: setting %u of %u failed, status = %s, "
+               "ind..status = %s", __func__, __LINE__, i + 1, num,
+               loc_get_v02_client_status_name(result),
+               loc_get_v02_qmi_status_name(ind.status));
+    }
+  }
+}
+
+void LocApiV02 :: beginConfigBatch()
+{
+  memset(&mConfigBatch, 0, sizeof(mConfigBatch));
+  mConfigBatch.active = true;
+}
+
+/* send the deferred configuration, all requests in flight at once */
+void LocApiV02 :: endConfigBatch()
+{
+  loc_sync_req_batch_entry_s_type entries[5];
+  qmiLocStatusEnumT_v02* indStatus[5];
+  qmiLocSetProtocolConfigParametersIndMsgT_v02 protocol_config_ind;
+  qmiLocSetSensorControlConfigIndMsgT_v02 sensor_config_ind;
+  qmiLocSetSensorPropertiesIndMsgT_v02 sensor_prop_ind;
+  qmiLocSetSensorPerformanceControlConfigIndMsgT_v02 sensor_perf_config_ind;
+  qmiLocGetExternalPowerConfigIndMsgT_v02 ext_pwr_ind;
+  uint32_t num = 0;
+  int protocolEntry = -1;
+  int64_t startMs = elapsedMillisSinceBoot();
+
+  if (!mConfigBatch.active) {
+    return;
+  }
+  mConfigBatch.active = false;
+
+  memset(entries, 0, sizeof(entries));
+  memset(&protocol_config_ind, 0, sizeof(protocol_config_ind));
+  memset(&sensor_config_ind, 0, sizeof(sensor_config_ind));
+  memset(&sensor_prop_ind, 0, sizeof(sensor_prop_ind));
+  memset(&sensor_perf_config_ind, 0, sizeof(sensor_perf_config_ind));
+  memset(&ext_pwr_ind, 0, sizeof(ext_pwr_ind));
+
+  if (mConfigBatch.hasProtocolConfig) {
+    protocolEntry = num;
+    entries[num].req_id = QMI_LOC_SET_PROTOCOL_CONFIG_PARAMETERS_REQ_V02;
+    entries[num].req_payload.pSetProtocolConfigParametersReq =
+      &mConfigBatch.protocolConfig;
+    entries[num].ind_id = QMI_LOC_SET_PROTOCOL_CONFIG_PARAMETERS_IND_V02;
+    entries[num].ind_payload_ptr = &protocol_config_ind;
+    indStatus[num++] = &protocol_config_ind.status;
+  }
+  if (mConfigBatch.hasSensorControl) {
+    entries[num].req_id = QMI_LOC_SET_SENSOR_CONTROL_CONFIG_REQ_V02;
+    entries[num].req_payload.pSetSensorControlConfigReq =
+      &mConfigBatch.sensorControl;
+    entries[num].ind_id = QMI_LOC_SET_SENSOR_CONTROL_CONFIG_IND_V02;
+    entries[num].ind_payload_ptr = &sensor_config_ind;
+    indStatus[num++] = &sensor_config_ind.status;
+  }
+  if (mConfigBatch.hasSensorProperties) {
+    entries[num].req_id = QMI_LOC_SET_SENSOR_PROPERTIES_REQ_V02;
+    entries[num].req_payload.pSetSensorPropertiesReq =
+      &mConfigBatch.sensorProperties;
+    entries[num].ind_id = QMI_LOC_SET_SENSOR_PROPERTIES_IND_V02;
+    entries[num].ind_payload_ptr = &sensor_prop_ind;
+    indStatus[num++] = &sensor_prop_ind.status;
+  }
+  if (mConfigBatch.hasSensorPerfControl) {
+    entries[num].req_id =
+      QMI_LOC_SET_SENSOR_PERFORMANCE_CONTROL_CONFIGURATION_REQ_V02;
+    entries[num].req_payload.pSetSensorPerformanceControlConfigReq =
+      &mConfigBatch.sensorPerfControl;
+    entries[num].ind_id =
+      QMI_LOC_SET_SENSOR_PERFORMANCE_CONTROL_CONFIGURATION_IND_V02;
+    entries[num].ind_payload_ptr = &sensor_perf_config_ind;
+    indStatus[num++] = &sensor_perf_config_ind.status;
+  }
+  if (mConfigBatch.hasExtPower) {
+    entries[num].req_id = QMI_LOC_SET_EXTERNAL_POWER_CONFIG_REQ_V02;
+    entries[num].req_payload.pSetExternalPowerConfigReq =
+      &mConfigBatch.extPower;
+    entries[num].ind_id = QMI_LOC_SET_EXTERNAL_POWER_CONFIG_IND_V02;
+    entries[num].ind_payload_ptr = &ext_pwr_ind;
+    indStatus[num++] = &ext_pwr_ind.status;
+  }
+
+  if (num > 0) {
+    if (LOC_CLIENT_INVALID_HANDLE_VALUE == clientHandle) {
+      LOC_LOGE("%s:%d]: client not open, %u config requests dropped",
+               __func__, __LINE__, num);
+    } else {
+      loc_sync_send_req_batch(clientHandle, entries, num,
+                              LOC_ENGINE_SYNC_REQUEST_TIMEOUT);
+    }
+  }
+
+  for (uint32_t i = 0; i < num; i++) {
+    if (entries[i].status != eLOC_CLIENT_SUCCESS ||
+        eQMI_LOC_SUCCESS_V02 != *indStatus[i]) {
+      LOC_LOGE("%s:%d]: %s failed, status = %s, ind..status = %s",
+               __func__, __LINE__,
+               loc_get_v02_event_name(entries[i].req_id),
+               loc_get_v02_client_status_name(entries[i].status),
+               loc_get_v02_qmi_status_name(*indStatus[i]));
+      if ((int)i == protocolEntry) {
+        resendProtocolConfig();
+      }
+    }
+  }
+
+  int64_t configMs = elapsedMillisSinceBoot() - startMs;
+  LOC_LOGD("%s:%d]: %u config requests sent in %lld ms",
+           __func__, __LINE__, num, configMs);
+
+  if (mOpenTiming.startMs != 0) {
+    LOC_LOGI("%s:%d]: open-to-ready %lld ms: client open %lld, "
+             "msg check %lld, meas support %lld, config %lld",
+             __func__, __LINE__,
+             elapsedMillisSinceBoot() - mOpenTiming.startMs,
+             mOpenTiming.clientOpenMs, mOpenTiming.msgCheckMs,
+             mOpenTiming.measSupportMs, configMs);
+    mOpenTiming.startMs = 0;
+  }
+}
@@ -33,6 +33,7 @@
 #include <stdbool.h>
 #include "ds_client.h"
 #include <LocApiBase.h>
+#include <LocThread.h>
 #include <loc_api_v02_client.h>
 
 using namespace loc_core;
@@ -60,6 +61,36 @@ private:
   bool mInSession;
   bool mEngineOn;
 
+  /* configuration requests deferred between beginConfigBatch()
+     and endConfigBatch() */
+  struct ConfigBatch {
+    bool active;
+    bool hasProtocolConfig;
+    qmiLocSetProtocolConfigParametersReqMsgT_v02 protocolConfig;
+    bool hasSensorControl;
+    qmiLocSetSensorControlConfigReqMsgT_v02 sensorControl;
+    bool hasSensorProperties;
+    qmiLocSetSensorPropertiesReqMsgT_v02 sensorProperties;
+    bool hasSensorPerfControl;
+    qmiLocSetSensorPerformanceControlConfigReqMsgT_v02 sensorPerfControl;
+    bool hasExtPower;
+    qmiLocSetExternalPowerConfigReqMsgT_v02 extPower;
+  } mConfigBatch;
+
+  /* time spent in each step of the last client open, reported together
+     with the configuration time once the first config batch is sent.
+     startMs is 0 once reported. */
+  struct OpenTiming {
+    int64_t startMs;
+    int64_t clientOpenMs;
+    int64_t msgCheckMs;
+    int64_t measSupportMs;
+  } mOpenTiming;
+
+  /* replays a capture of indications, if QMI_REPLAY_FILE is set */
+  LocThread mReplayThread;
+  void startReplay();
+
   /* Convert event mask from loc eng to loc_api_v02 format */
   static locClientEventMaskType convertMask(LOC_API_ADAPTER_EVENT_MASK_T mask);
 
@@ -78,8 +109,8 @@ private:
       qmiLocNiNotifyVerifyEnumT_v02 notif_priv);
 
   /*convert GpsMeasurement type from QMI LOC to loc eng format*/
-  static void convertGpsMeasurements (GpsMeasurement& gpsMeasurement,
-      const qmiLocSVMeasurementStructT_v02& gnss_measurement_info);
+  static void convertGpsMeasurements (GpsData& gpsData,
+      const qmiLocEventGnssSvMeasInfoIndMsgT_v02& gnss_measurement_report);
 
   /*convert GpsClock type from QMI LOC to loc eng format*/
   static void convertGpsClock (GpsClock& gpsClock,
@@ -128,6 +159,12 @@ private:
   bool registerEventMask(locClientEventMaskType qmiMask);
   locClientEventMaskType adjustMaskForNoSession(locClientEventMaskType qmiMask);
   void cacheGnssMeasurementSupport();
+  bool querySupportedMsgList(uint64_t &supportedMsgList);
+  bool loadSupportedMsgList(uint64_t &supportedMsgList);
+  void storeSupportedMsgList(uint64_t supportedMsgList);
+  void mergeProtocolConfig(
+    const qmiLocSetProtocolConfigParametersReqMsgT_v02 &protocolConfig);
+  void resendProtocolConfig();
 
 protected:
   virtual enum loc_api_adapter_err
@@ -236,6 +273,11 @@ public:
     Set Gnss Constellation Config
   */
   virtual bool gnssConstellationConfig();
+
+  /* defer the configuration requests and send them concurrently,
+     the SUPL, LPP and A-GLONASS settings being merged into one */
+  virtual void beginConfigBatch();
+  virtual void endConfigBatch();
 };
 
 extern "C" LocApiBase* getLocApi(const MsgTask* msgTask,
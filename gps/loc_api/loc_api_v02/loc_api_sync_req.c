@@ -47,6 +47,8 @@
 #include "loc_util_log.h"
 
 #define LOC_SYNC_REQ_BUFFER_SIZE 8
+/* sync slots a batch leaves to concurrent loc_sync_send_req() calls */
+#define LOC_SYNC_REQ_BATCH_RESERVED 2
 #define GPS_CONF_FILE "/etc/gps.conf"
 pthread_mutex_t  loc_sync_call_mutex = PTHREAD_MUTEX_INITIALIZER;
 
@@ -381,12 +383,48 @@ static int loc_sync_select_ind(
 }
 
 
+/*===========================================================================
+
+FUNCTION    loc_sync_get_expire_time
+
+DESCRIPTION
+   Computes the absolute time timeout_msec milliseconds from now, as
+   expected by pthread_cond_timedwait().
+
+DEPENDENCIES
+   N/A
+
+RETURN VALUE
+   none
+
+SIDE EFFECTS
+   N/A
+
+===========================================================================*/
+static void loc_sync_get_expire_time(
+      uint32_t timeout_msec,
+      struct timespec *expire_time
+)
+{
+   struct timeval present_time;
+
+   gettimeofday(&present_time, NULL);
+   expire_time->tv_sec  = present_time.tv_sec + timeout_msec / 1000;
+   expire_time->tv_nsec = present_time.tv_usec * 1000 +
+                          (timeout_msec % 1000) * 1000000;
+   if (expire_time->tv_nsec >= 1000000000)
+   {
+      expire_time->tv_sec++;
+      expire_time->tv_nsec -= 1000000000;
+   }
+}
+
 /*===========================================================================
 
 FUNCTION    loc_sync_wait_for_ind
 
 DESCRIPTION
-   Waits for a selected indication. The wait expires in timeout_seconds seconds.
+   Waits for a selected indication. The wait expires at expire_time.
    If the function is called before an existing wait has finished, it will
    immediately return error.
 
@@ -402,7 +440,7 @@ SIDE EFFECTS
 ===========================================================================*/
 static int loc_sync_wait_for_ind(
       int select_id,        /* ID from loc_sync_select_ind() */
-      int timeout_seconds,  /* Timeout in this number of seconds  */
+      const struct timespec *expire_time, /* absolute time the wait ends */
       uint32_t ind_id
 )
 {
@@ -419,9 +457,6 @@ static int loc_sync_wait_for_ind(
    int ret_val = 0;  /* the return value of this function: 0 = no error */
    int rc;          /* return code from pthread calls */
 
-   struct timeval present_time;
-   struct timespec expire_time;
-
    pthread_mutex_lock(&slot->sync_req_lock);
 
   do
@@ -440,18 +475,12 @@ static int loc_sync_wait_for_ind(
          break;
       }
 
-      /* Calculate absolute expire time */
-      gettimeofday(&present_time, NULL);
-      expire_time.tv_sec  = present_time.tv_sec;
-      expire_time.tv_nsec = present_time.tv_usec * 1000;
-      expire_time.tv_sec += timeout_seconds;
-
       /* Take new wait request */
       slot->ind_is_waiting = true;
 
       /* Waiting */
       rc = pthread_cond_timedwait(&slot->ind_arrived_cond,
-            &slot->sync_req_lock, &expire_time);
+            &slot->sync_req_lock, expire_time);
 
       slot->ind_is_waiting = false;
 
@@ -517,9 +546,12 @@ locClientStatusEnumType loc_sync_send_req
       }
       else
       {
+         struct timespec expire_time;
+         loc_sync_get_expire_time(timeout_msec, &expire_time);
+
          // Wait for the indication callback
          if (( rc = loc_sync_wait_for_ind( select_id,
-                                           timeout_msec / 1000,
+                                           &expire_time,
                                            ind_id) ) < 0)
          {
             if ( rc == -ETIMEDOUT)
@@ -544,4 +576,119 @@ locClientStatusEnumType loc_sync_send_req
    return status;
 }
 
+/* number of sync slots not in use */
+static int loc_sync_free_slots(void)
+{
+   int i, num_free = 0;
+
+   pthread_mutex_lock(&loc_sync_call_mutex);
+   for (i = 0; i < LOC_SYNC_REQ_BUFFER_SIZE; i++)
+   {
+      if (!loc_sync_array.slot_in_use[i]) num_free++;
+   }
+   pthread_mutex_unlock(&loc_sync_call_mutex);
+
+   return num_free;
+}
+
+/*===========================================================================
 
+FUNCTION    loc_sync_send_req_batch
+
+DESCRIPTION
+   Synchronous batch of req calls (thread safe). The indications of all
+   entries are selected and all requests are sent before waiting, so the
+   modem processes them back to back and the whole batch completes in
+   about the time of the slowest request. All waits share one deadline,
+   timeout_msec from the call. A batch always leaves
+   LOC_SYNC_REQ_BATCH_RESERVED slots free, so concurrent callers are not
+   starved; entries that cannot get a slot are sent one by one once the
+   rest of the batch has completed.
+
+   The status of each request is returned in its entry.
+
+DEPENDENCIES
+   No two entries may wait on the same indication.
+
+RETURN VALUE
+   none
+
+SIDE EFFECTS
+   N/A
+
+===========================================================================*/
+void loc_sync_send_req_batch
+(
+      locClientHandleType               client_handle,
+      loc_sync_req_batch_entry_s_type   *entries,
+      uint32_t                          num_entries,
+      uint32_t                          timeout_msec
+)
+{
+   int select_ids[LOC_SYNC_REQ_BUFFER_SIZE - LOC_SYNC_REQ_BATCH_RESERVED];
+   uint32_t num_selected = 0;
+   struct timespec expire_time;
+   uint32_t i;
+   int rc;
+
+   // select and send as many requests as there are free slots, less
+   // those left to other callers
+   for (i = 0;
+        i < num_entries &&
+        i < LOC_SYNC_REQ_BUFFER_SIZE - LOC_SYNC_REQ_BATCH_RESERVED;
+        i++)
+   {
+      if (loc_sync_free_slots() <= LOC_SYNC_REQ_BATCH_RESERVED)
+      {
+         break;
+      }
+      select_ids[i] = loc_sync_select_ind(client_handle,
+                                          entries[i].ind_id,
+                                          entries[i].req_id,
+                                          entries[i].ind_payload_ptr);
+      if (select_ids[i] < 0)
+      {
+         break;
+      }
+
+      entries[i].status = locClientSendReq(client_handle,
+                                           entries[i].req_id,
+                                           entries[i].req_payload);
+      LOC_LOGV("%s:%d]: select_id = %d, locClientSendReq returned %d\n",
+               __func__, __LINE__, select_ids[i], entries[i].status);
+      if (entries[i].status != eLOC_CLIENT_SUCCESS)
+      {
+         loc_free_slot(select_ids[i]);
+         select_ids[i] = -1;
+      }
+   }
+   num_selected = i;
+
+   loc_sync_get_expire_time(timeout_msec, &expire_time);
+
+   for (i = 0; i < num_selected; i++)
+   {
+      if (select_ids[i] >= 0 &&
+          (rc = loc_sync_wait_for_ind(select_ids[i], &expire_time,
+                                      entries[i].ind_id)) < 0)
+      {
+         entries[i].status = (rc == -ETIMEDOUT) ?
+            eLOC_CLIENT_FAILURE_TIMEOUT : eLOC_CLIENT_FAILURE_INTERNAL;
+         LOC_LOGE("%s:%d]: loc_api_wait_for_ind failed, err %d, "
+                  "select id %d, status %s", __func__, __LINE__, rc,
+                  select_ids[i],
+                  loc_get_v02_client_status_name(entries[i].status));
+      }
+   }
+
+   // out of slots, the rest go one at a time
+   for (i = num_selected; i < num_entries; i++)
+   {
+      entries[i].status = loc_sync_send_req(client_handle,
+                                            entries[i].req_id,
+                                            entries[i].req_payload,
+                                            timeout_msec,
+                                            entries[i].ind_id,
+                                            entries[i].ind_payload_ptr);
+   }
+}
@@ -83,6 +83,25 @@ extern locClientStatusEnumType loc_sync_send_req
       void                      *ind_payload_ptr /* can be NULL*/
 );
 
+/* One request of a batch sent with loc_sync_send_req_batch() */
+typedef struct {
+      uint32_t                  req_id;        /* req id */
+      locClientReqUnionType     req_payload;
+      uint32_t                  ind_id;        /* ind ID to block for */
+      void                      *ind_payload_ptr; /* can be NULL */
+      locClientStatusEnumType   status;        /* result of this request */
+} loc_sync_req_batch_entry_s_type;
+
+/* Sends all requests of a batch before waiting on any of their indications,
+   so the round-trips overlap. Entries must wait on distinct indications. */
+extern void loc_sync_send_req_batch
+(
+      locClientHandleType               client_handle,
+      loc_sync_req_batch_entry_s_type   *entries,
+      uint32_t                          num_entries,
+      uint32_t                          timeout_msec
+);
+
 #ifdef __cplusplus
 }
 #endif
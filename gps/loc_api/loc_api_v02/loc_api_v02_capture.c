@@ -0,0 +1,360 @@
+/* Copyright (c) 2014, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation, nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <loc_cfg.h>
+#include "loc_api_v02_capture.h"
+
+/* Logging */
+// Uncomment to log verbose logs
+#define LOG_NDEBUG 1
+
+// log debug logs
+#define LOG_NDDEBUG 1
+#define LOG_TAG "LocSvc_api_v02"
+#include "loc_util_log.h"
+
+#define GPS_CONF_FILE "/etc/gps.conf"
+
+typedef struct
+{
+  char     QMI_CAPTURE_FILE[LOC_MAX_PARAM_STRING + 1];
+  uint32_t QMI_CAPTURE_MAX_SIZE_KB;
+  char     QMI_REPLAY_FILE[LOC_MAX_PARAM_STRING + 1];
+  uint32_t QMI_REPLAY_REAL_TIME;
+} locCaptureConfigType;
+
+static locCaptureConfigType captureConf;
+static pthread_once_t captureConfOnce = PTHREAD_ONCE_INIT;
+
+static const loc_param_s_type captureConfTable[] =
+{
+  {"QMI_CAPTURE_FILE",        &captureConf.QMI_CAPTURE_FILE,        NULL, 's'},
+  {"QMI_CAPTURE_MAX_SIZE_KB", &captureConf.QMI_CAPTURE_MAX_SIZE_KB, NULL, 'n'},
+  {"QMI_REPLAY_FILE",         &captureConf.QMI_REPLAY_FILE,         NULL, 's'},
+  {"QMI_REPLAY_REAL_TIME",    &captureConf.QMI_REPLAY_REAL_TIME,    NULL, 'n'},
+};
+
+// indications are staged in memory on the QMI callback thread and
+// written out by the capture thread, so a slow file system never holds
+// up indication delivery
+#define LOC_CAPTURE_STAGE_SIZE (128 * 1024)
+
+static pthread_mutex_t captureLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t captureCond = PTHREAD_COND_INITIALIZER;
+static int captureFd = -1;
+static uint64_t captureSize = 0;
+static bool captureFull = false;
+static uint8_t captureStage[2][LOC_CAPTURE_STAGE_SIZE];
+// the buffer locCaptureInd() appends to, the other is being written
+static uint8_t *captureFill = captureStage[0];
+static size_t captureFillLen = 0;
+static uint32_t captureDropped = 0;
+
+static uint64_t locCaptureNowNs(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void* locCaptureWriter(void *arg)
+{
+  uint8_t *pBuf;
+  size_t len;
+  (void)arg;
+
+  for (;;)
+  {
+    pthread_mutex_lock(&captureLock);
+    while (0 == captureFillLen)
+    {
+      pthread_cond_wait(&captureCond, &captureLock);
+    }
+    pBuf = captureFill;
+    len = captureFillLen;
+    captureFill = (captureFill == captureStage[0]) ?
+                  captureStage[1] : captureStage[0];
+    captureFillLen = 0;
+    pthread_mutex_unlock(&captureLock);
+
+    if (write(captureFd, pBuf, len) != (ssize_t)len)
+    {
+      LOC_LOGE("%s:%d]: write %s failed, errno = %d\n", __func__, __LINE__,
+               captureConf.QMI_CAPTURE_FILE, errno);
+    }
+  }
+  return NULL;
+}
+
+static void locCaptureReadConf(void)
+{
+  locCaptureFileHeaderT header;
+  pthread_attr_t attr;
+  pthread_t thread;
+  int rc;
+
+  memset(&captureConf, 0, sizeof(captureConf));
+  captureConf.QMI_CAPTURE_MAX_SIZE_KB = 4096;
+  UTIL_READ_CONF(GPS_CONF_FILE, captureConfTable);
+
+  if ('\0' == captureConf.QMI_CAPTURE_FILE[0])
+  {
+    return;
+  }
+
+  // the capture file is truncated on open, so never capture while
+  // replaying, the replay file may well be the last capture
+  if (0 == strcmp(captureConf.QMI_CAPTURE_FILE,
+                  captureConf.QMI_REPLAY_FILE))
+  {
+    LOC_LOGE("%s:%d]: QMI_CAPTURE_FILE and QMI_REPLAY_FILE are both %s,"
+             " capture disabled\n", __func__, __LINE__,
+             captureConf.QMI_CAPTURE_FILE);
+    return;
+  }
+  if ('\0' != captureConf.QMI_REPLAY_FILE[0])
+  {
+    LOC_LOGW("%s:%d]: replaying %s, capture disabled\n", __func__, __LINE__,
+             captureConf.QMI_REPLAY_FILE);
+    return;
+  }
+
+  // a new file per run; a capture is one contiguous session
+  captureFd = open(captureConf.QMI_CAPTURE_FILE,
+                   O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0660);
+  if (captureFd < 0)
+  {
+    LOC_LOGE("%s:%d]: open %s failed, errno = %d\n", __func__, __LINE__,
+             captureConf.QMI_CAPTURE_FILE, errno);
+    return;
+  }
+
+  header.magic = LOC_CAPTURE_MAGIC;
+  header.version = LOC_CAPTURE_VERSION;
+  header.startNs = locCaptureNowNs();
+  if (write(captureFd, &header, sizeof(header)) != (ssize_t)sizeof(header))
+  {
+    LOC_LOGE("%s:%d]: write %s failed\n", __func__, __LINE__,
+             captureConf.QMI_CAPTURE_FILE);
+    close(captureFd);
+    captureFd = -1;
+    return;
+  }
+
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  rc = pthread_create(&thread, &attr, locCaptureWriter, NULL);
+  pthread_attr_destroy(&attr);
+  if (0 != rc)
+  {
+    LOC_LOGE("%s:%d]: capture thread failed, rc = %d\n", __func__,
+             __LINE__, rc);
+    close(captureFd);
+    captureFd = -1;
+    return;
+  }
+
+  captureSize = sizeof(header);
+  LOC_LOGI("%s:%d]: capturing indications to %s\n", __func__, __LINE__,
+           captureConf.QMI_CAPTURE_FILE);
+}
+
+void locCaptureInd(uint32_t msgId, const void *pBuf, uint32_t len)
+{
+  locCaptureRecordT record;
+  uint32_t padLen;
+  size_t total;
+  uint8_t *pDst;
+
+  pthread_once(&captureConfOnce, locCaptureReadConf);
+  if (captureFd < 0)
+  {
+    return;
+  }
+
+  if (NULL == pBuf)
+  {
+    len = 0;
+  }
+  padLen = LOC_CAPTURE_ALIGN(len) - len;
+  total = sizeof(record) + len + padLen;
+
+  record.timestampNs = locCaptureNowNs();
+  record.msgId = msgId;
+  record.len = len;
+
+  pthread_mutex_lock(&captureLock);
+  if (captureSize + total >
+      (uint64_t)captureConf.QMI_CAPTURE_MAX_SIZE_KB * 1024)
+  {
+    if (!captureFull)
+    {
+      LOC_LOGW("%s:%d]: capture file full at %llu bytes\n", __func__,
+               __LINE__, (unsigned long long)captureSize);
+      captureFull = true;
+    }
+  }
+  else if (captureFillLen + total > LOC_CAPTURE_STAGE_SIZE)
+  {
+    // the capture thread is behind; the capture keeps going but has a
+    // hole, which replay cannot tell from a quiet modem
+    if (0 == captureDropped++ % 100)
+    {
+      LOC_LOGW("%s:%d]: capture thread behind, %u indications dropped\n",
+               __func__, __LINE__, captureDropped);
+    }
+  }
+  else
+  {
+    pDst = captureFill + captureFillLen;
+    memcpy(pDst, &record, sizeof(record));
+    if (len > 0)
+    {
+      memcpy(pDst + sizeof(record), pBuf, len);
+    }
+    memset(pDst + sizeof(record) + len, 0, padLen);
+    captureFillLen += total;
+    captureSize += total;
+    pthread_cond_signal(&captureCond);
+  }
+  pthread_mutex_unlock(&captureLock);
+}
+
+const char* locCaptureGetReplayFile(bool *pRealTime)
+{
+  pthread_once(&captureConfOnce, locCaptureReadConf);
+  if ('\0' == captureConf.QMI_REPLAY_FILE[0])
+  {
+    return NULL;
+  }
+  if (NULL != pRealTime)
+  {
+    *pRealTime = (0 != captureConf.QMI_REPLAY_REAL_TIME);
+  }
+  return captureConf.QMI_REPLAY_FILE;
+}
+
+bool locCaptureReaderOpen(locCaptureReaderT *pReader, const char *pFileName)
+{
+  struct stat st;
+  const locCaptureFileHeaderT *pHeader;
+
+  memset(pReader, 0, sizeof(*pReader));
+  pReader->fd = open(pFileName, O_RDONLY);
+  if (pReader->fd < 0)
+  {
+    LOC_LOGE("%s:%d]: open %s failed, errno = %d\n", __func__, __LINE__,
+             pFileName, errno);
+    return false;
+  }
+
+  if (fstat(pReader->fd, &st) < 0 ||
+      st.st_size < (off_t)sizeof(locCaptureFileHeaderT))
+  {
+    LOC_LOGE("%s:%d]: %s is not a capture file\n", __func__, __LINE__,
+             pFileName);
+    close(pReader->fd);
+    pReader->fd = -1;
+    return false;
+  }
+
+  pReader->size = st.st_size;
+  pReader->base = (const uint8_t *)mmap(NULL, pReader->size, PROT_READ,
+                                        MAP_PRIVATE, pReader->fd, 0);
+  if (MAP_FAILED == (void *)pReader->base)
+  {
+    LOC_LOGE("%s:%d]: mmap %s failed, errno = %d\n", __func__, __LINE__,
+             pFileName, errno);
+    close(pReader->fd);
+    pReader->fd = -1;
+    pReader->base = NULL;
+    return false;
+  }
+
+  pHeader = (const locCaptureFileHeaderT *)pReader->base;
+  if (LOC_CAPTURE_MAGIC != pHeader->magic ||
+      LOC_CAPTURE_VERSION != pHeader->version)
+  {
+    LOC_LOGE("%s:%d]: %s has magic %x version %u\n", __func__, __LINE__,
+             pFileName, pHeader->magic, pHeader->version);
+    locCaptureReaderClose(pReader);
+    return false;
+  }
+
+  pReader->offset = sizeof(locCaptureFileHeaderT);
+  return true;
+}
+
+bool locCaptureReaderNext(locCaptureReaderT *pReader,
+                          const locCaptureRecordT **ppRecord,
+                          const void **ppPayload)
+{
+  const locCaptureRecordT *pRecord;
+  size_t recordLen;
+
+  if (NULL == pReader->base ||
+      pReader->offset + sizeof(locCaptureRecordT) > pReader->size)
+  {
+    return false;
+  }
+
+  pRecord = (const locCaptureRecordT *)(pReader->base + pReader->offset);
+  recordLen = sizeof(locCaptureRecordT) + LOC_CAPTURE_ALIGN(pRecord->len);
+  if (pReader->offset + sizeof(locCaptureRecordT) + pRecord->len >
+      pReader->size)
+  {
+    return false;
+  }
+
+  *ppRecord = pRecord;
+  *ppPayload = pRecord + 1;
+  pReader->offset += recordLen;
+  return true;
+}
+
+void locCaptureReaderClose(locCaptureReaderT *pReader)
+{
+  if (NULL != pReader->base)
+  {
+    munmap((void *)pReader->base, pReader->size);
+    pReader->base = NULL;
+  }
+  if (pReader->fd >= 0)
+  {
+    close(pReader->fd);
+    pReader->fd = -1;
+  }
+}
@@ -0,0 +1,116 @@
+/* Copyright (c) 2014, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation, nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LOC_API_V02_CAPTURE_H
+#define LOC_API_V02_CAPTURE_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/** Capture file of raw QMI LOC indications, as received by
+    locClientIndCb() before decoding. The file is a header followed by
+    records, each record 8 byte aligned so the file can be mmap'ed and
+    walked in place:
+
+      locCaptureFileHeaderT
+      locCaptureRecordT, payload[len], padding to 8 bytes
+      ...
+
+    Capture and replay are enabled by QMI_CAPTURE_FILE and
+    QMI_REPLAY_FILE in gps.conf. Nothing is captured while replaying. */
+
+#define LOC_CAPTURE_MAGIC   (0x50434c51) /* "QLCP" */
+#define LOC_CAPTURE_VERSION (1)
+#define LOC_CAPTURE_ALIGN(len) (((len) + 7) & ~((uint32_t)7))
+
+typedef struct
+{
+  uint32_t magic;
+  uint32_t version;
+  // CLOCK_MONOTONIC time the capture started
+  uint64_t startNs;
+} locCaptureFileHeaderT;
+
+typedef struct
+{
+  // CLOCK_MONOTONIC time the indication was received
+  uint64_t timestampNs;
+  uint32_t msgId;
+  // length of the encoded payload that follows
+  uint32_t len;
+} locCaptureRecordT;
+
+typedef struct
+{
+  int            fd;
+  const uint8_t *base;
+  size_t         size;
+  size_t         offset;
+} locCaptureReaderT;
+
+/** locCaptureInd
+    @brief queues an encoded indication for the capture file, if capture
+           is enabled; the file is written from a capture thread. Safe to
+           call from any thread. */
+extern void locCaptureInd(uint32_t msgId, const void *pBuf, uint32_t len);
+
+/** locCaptureGetReplayFile
+    @brief gets the capture file to replay, from gps.conf
+    @param [out] pRealTime  true to replay with the captured timing,
+                            false to replay as fast as possible
+    @return the file name, or NULL if replay is not enabled */
+extern const char* locCaptureGetReplayFile(bool *pRealTime);
+
+/** locCaptureReaderOpen
+    @brief maps a capture file for reading
+    @return true if the file was mapped and its header is valid */
+extern bool locCaptureReaderOpen(locCaptureReaderT *pReader,
+                                 const char *pFileName);
+
+/** locCaptureReaderNext
+    @brief gets the next complete record; a record cut short at the end
+           of the file, as left by a crash during capture, ends the walk
+    @return true if a record was returned */
+extern bool locCaptureReaderNext(locCaptureReaderT *pReader,
+                                 const locCaptureRecordT **ppRecord,
+                                 const void **ppPayload);
+
+/** locCaptureReaderClose
+    @brief unmaps the capture file */
+extern void locCaptureReaderClose(locCaptureReaderT *pReader);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LOC_API_V02_CAPTURE_H */
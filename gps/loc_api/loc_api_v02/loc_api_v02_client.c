@@ -46,6 +46,9 @@
 
 
 #include "loc_api_v02_client.h"
+#include "loc_api_v02_sim.h"
+#include "loc_api_v02_capture.h"
+#include <loc_fix_trace.h>
 #include "loc_util_log.h"
 
 #ifdef LOC_UTIL_TARGET_OFF_TARGET
@@ -601,6 +604,10 @@ struct locClientCbDataStructT
   //QCCI handle for this control point
   qmi_client_type userHandle;
 
+  // simulated service in place of QCCI, userHandle then holds the
+  // same pointer so the handle checks below still apply
+  locClientSimType *pSim;
+
   // callbacks registered by the clients
   locClientEventIndCbType eventCallback;
   locClientRespIndCbType respCallback;
@@ -828,6 +835,82 @@ static void locClientErrorCb
 }
 
 
+/** locClientDispatchInd
+ *  @brief sends a decoded indication to the event or the response
+ *         callback of the client
+ *  @param [in] pCallbackData
+ *  @param [in] msg_id
+ *  @param [in] indBuffer
+ *  @param [in] indType */
+
+static void locClientDispatchInd
+(
+ locClientCallbackDataType      *pCallbackData,
+ unsigned int                   msg_id,
+ void                           *indBuffer,
+ locClientIndEnumT              indType
+)
+{
+  if(eventIndType == indType)
+  {
+    locClientEventIndUnionType eventIndUnion;
+
+    /* copy the eventCallback function pointer from the callback
+     * data to local variable. This is to protect against the race
+     * condition between open/close and indication callback.
+     */
+    locClientEventIndCbType localEventCallback =
+        pCallbackData->eventCallback;
+
+    // dummy event
+    eventIndUnion.pPositionReportEvent =
+        (qmiLocEventPositionReportIndMsgT_v02 *)indBuffer;
+
+    /* call the event callback
+     * To avoid calling the eventCallback after locClientClose
+     * is called, check pCallbackData->eventCallback again here
+     */
+    if((NULL != localEventCallback) &&
+       (NULL != pCallbackData->eventCallback))
+    {
+      localEventCallback(
+          (locClientHandleType)pCallbackData,
+          msg_id,
+          eventIndUnion,
+          pCallbackData->pClientCookie);
+    }
+  }
+  else if(respIndType == indType)
+  {
+    locClientRespIndUnionType respIndUnion;
+
+    /* copy the respCallback function pointer from the callback
+     * data to local variable. This is to protect against the race
+     * condition between open/close and indication callback.
+     */
+    locClientRespIndCbType localRespCallback =
+        pCallbackData->respCallback;
+
+    // dummy to suppress compiler warnings
+    respIndUnion.pDeleteAssistDataInd =
+        (qmiLocDeleteAssistDataIndMsgT_v02 *)indBuffer;
+
+    /* call the response callback
+     * To avoid calling the respCallback after locClientClose
+     * is called, check pCallbackData->respCallback again here
+     */
+    if((NULL != localRespCallback) &&
+       (NULL != pCallbackData->respCallback))
+    {
+      localRespCallback(
+          (locClientHandleType)pCallbackData,
+          msg_id,
+          respIndUnion,
+          pCallbackData->pClientCookie);
+    }
+  }
+}
+
 /** locClientIndCb
  *  @brief handles the indications sent from the service, if a
  *         response indication was received then the it is sent
@@ -873,6 +956,17 @@ static void locClientIndCb
         user_handle, pCallbackData->userHandle);
     return;
   }
+
+  // position reports are traced from here up to location_cb, so the
+  // trace includes the decode and the conversion
+  if(QMI_LOC_EVENT_POSITION_REPORT_IND_V02 == msg_id)
+  {
+    loc_fix_trace_begin();
+  }
+
+  // record the indication as received, for later replay
+  locCaptureInd((uint32_t)msg_id, ind_buf, ind_buf_len);
+
   // Get the indication size and type ( eventInd or respInd)
   if( true == locClientGetSizeAndTypeByIndId(msg_id, &indSize, &indType))
   {
@@ -884,6 +978,7 @@ static void locClientIndCb
     if(NULL == indBuffer)
     {
       LOC_LOGE("%s:%d]: memory allocation failed\n", __func__, __LINE__);
+      loc_fix_trace_clear();
       return;
     }
 
@@ -904,64 +999,7 @@ static void locClientIndCb
 
     if( rc == QMI_NO_ERR )
     {
-      if(eventIndType == indType)
-      {
-        locClientEventIndUnionType eventIndUnion;
-
-        /* copy the eventCallback function pointer from the callback
-         * data to local variable. This is to protect against the race
-         * condition between open/close and indication callback.
-         */
-        locClientEventIndCbType localEventCallback =
-            pCallbackData->eventCallback;
-
-        // dummy event
-        eventIndUnion.pPositionReportEvent =
-            (qmiLocEventPositionReportIndMsgT_v02 *)indBuffer;
-
-        /* call the event callback
-         * To avoid calling the eventCallback after locClientClose
-         * is called, check pCallbackData->eventCallback again here
-         */
-        if((NULL != localEventCallback) &&
-           (NULL != pCallbackData->eventCallback))
-        {
-          localEventCallback(
-              (locClientHandleType)pCallbackData,
-              msg_id,
-              eventIndUnion,
-              pCallbackData->pClientCookie);
-        }
-      }
-      else if(respIndType == indType)
-      {
-        locClientRespIndUnionType respIndUnion;
-
-        /* copy the respCallback function pointer from the callback
-         * data to local variable. This is to protect against the race
-         * condition between open/close and indication callback.
-         */
-        locClientRespIndCbType localRespCallback =
-            pCallbackData->respCallback;
-
-        // dummy to suppress compiler warnings
-        respIndUnion.pDeleteAssistDataInd =
-            (qmiLocDeleteAssistDataIndMsgT_v02 *)indBuffer;
-
-        /* call the response callback
-         * To avoid calling the respCallback after locClientClose
-         * is called, check pCallbackData->respCallback again here
-         */
-        if((NULL != localRespCallback) &&
-           (NULL != pCallbackData->respCallback))
-        {
-          localRespCallback(
-              (locClientHandleType)pCallbackData,
-              msg_id,
-              respIndUnion,
-              pCallbackData->pClientCookie);
-        }
-      }
+      locClientDispatchInd(pCallbackData, msg_id, indBuffer, indType);
     }
     else
     {
@@ -978,9 +1016,47 @@ static void locClientIndCb
     LOC_LOGE("%s:%d]: Error indication not found %d\n",
                   __func__, __LINE__,(uint32_t)msg_id);
   }
+  loc_fix_trace_clear();
   return;
 }
 
+/** locClientSimIndCb
+ *  @brief handles the indications sent from the simulated service,
+ *         these are already decoded
+ *  @param [in] pCbData
+ *  @param [in] indId
+ *  @param [in] pIndBuffer */
+
+static void locClientSimIndCb
+(
+ void                           *pCbData,
+ uint32_t                       indId,
+ void                           *pIndBuffer
+)
+{
+  locClientIndEnumT indType;
+  size_t indSize = 0;
+  locClientCallbackDataType* pCallbackData =
+      (locClientCallbackDataType *)pCbData;
+
+  // check callback data
+  if(NULL == pCallbackData ||(pCallbackData != pCallbackData->pMe))
+  {
+    LOC_LOGE("%s:%d]: invalid callback data", __func__, __LINE__);
+    return;
+  }
+
+  if( true == locClientGetSizeAndTypeByIndId(indId, &indSize, &indType))
+  {
+    if(QMI_LOC_EVENT_POSITION_REPORT_IND_V02 == indId)
+    {
+      loc_fix_trace_begin();
+    }
+    locClientDispatchInd(pCallbackData, indId, pIndBuffer, indType);
+    loc_fix_trace_clear();
+  }
+}
+
 
 /** locClientRegisterEventMask
  *  @brief registers the event mask with loc service
@@ -1515,6 +1591,19 @@ static locClientStatusEnumType locClientQmiCtrlPointInit(
   // instances of this service
   qmi_service_info serviceInfo;
 
+  if (locClientSimEnabled())
+  {
+    locClientSimType *pSim = locClientSimOpen(locClientSimIndCb,
+                                              (void *)pLocClientCbData);
+    if (NULL == pSim)
+    {
+      return eLOC_CLIENT_FAILURE_INTERNAL;
+    }
+    pLocClientCbData->pSim = pSim;
+    pLocClientCbData->userHandle = (qmi_client_type)pSim;
+    return eLOC_CLIENT_SUCCESS;
+  }
+
   do
   {
     qmi_client_error_type rc = QMI_NO_ERR;
@@ -1871,7 +1960,14 @@ locClientStatusEnumType locClientClose(
   EXIT_LOG_CALLFLOW(%s, "loc client close");
 
   // release the handle
-  rc = qmi_client_release(pCallbackData->userHandle);
+  if (NULL != pCallbackData->pSim)
+  {
+    locClientSimClose(pCallbackData->pSim);
+  }
+  else
+  {
+    rc = qmi_client_release(pCallbackData->userHandle);
+  }
   if(QMI_NO_ERR != rc )
   {
     LOC_LOGW("%s:%d]: qmi_client_release error %d for client %p\n",
@@ -1957,6 +2053,19 @@ locClientStatusEnumType locClientSendReq(
   // back from the modem, to avoid confusing log order. We trust
   // that the QMI framework is robust.
   EXIT_LOG_CALLFLOW(%s, loc_get_v02_event_name(reqId));
+  if (NULL != pCallbackData->pSim)
+  {
+    status = locClientSimSendReq(pCallbackData->pSim, reqId, pReqData);
+    if(eLOC_CLIENT_SUCCESS == status &&
+        QMI_LOC_REG_EVENTS_REQ_V02 == reqId &&
+        NULL != reqPayload.pRegEventsReq)
+    {
+      pCallbackData->eventRegMask =
+        (locClientEventMaskType)(reqPayload.pRegEventsReq->eventRegMask);
+    }
+    return(status);
+  }
+
   rc = qmi_client_send_msg_sync(
       pCallbackData->userHandle,
       reqId,
@@ -2062,6 +2171,19 @@ locClientStatusEnumType locClientSupportMsgCheck(
      return eLOC_CLIENT_FAILURE_GENERAL;
    }
 
+  if (NULL != pCallbackData->pSim)
+  {
+    // the simulated service supports every message asked about
+    uint32_t maxCheckedMsgsSavedNum = sizeof(supportedMsgChecked)<<3;
+    uint32_t num = msgArrayLength < maxCheckedMsgsSavedNum ?
+                   msgArrayLength : maxCheckedMsgsSavedNum;
+    supportedMsgChecked = (num < maxCheckedMsgsSavedNum) ?
+                          (((uint64_t)1 << num) - 1) : ~(uint64_t)0;
+    *supportedMsg = supportedMsgChecked;
+    isCheckedAlready = true;
+    return eLOC_CLIENT_SUCCESS;
+  }
+
   // NEXT call goes out to modem. We log the callflow before it
   // actually happens to ensure the this comes before resp callflow
   // back from the modem, to avoid confusing log order. We trust
@@ -2109,6 +2231,81 @@ locClientStatusEnumType locClientSupportMsgCheck(
   }
 }
 
+/** locClientInjectInd
+  @brief Decodes an encoded indication, as captured by locClientIndCb(),
+         and delivers it to the callbacks of a client as if the service
+         had sent it. The message is decoded with the IDL of the service
+         directly, so no QCCI client is needed.
+  @param [in] handle     Handle returned by the locClientOpen() function.
+  @param [in] indId      ID of the indication.
+  @param [in] pIndBuf    Encoded indication.
+  @param [in] indBufLen  Length of the encoded indication.
+
+  @return
+  One of the following error codes:
+  - 0 (eLOC_CLIENT_SUCCESS) -- On success.
+  - Non-zero error code (see \ref locClientStatusEnumType) -- On failure.
+*/
+
+locClientStatusEnumType locClientInjectInd(
+  locClientHandleType handle,
+  uint32_t            indId,
+  const void*         pIndBuf,
+  uint32_t            indBufLen)
+{
+  locClientIndEnumT indType;
+  size_t indSize = 0;
+  int32_t rc = QMI_NO_ERR;
+  void *indBuffer = NULL;
+  locClientCallbackDataType *pCallbackData =
+        (locClientCallbackDataType *)handle;
+
+  // check the input handle for sanity
+  if(NULL == pCallbackData ||
+     NULL == pCallbackData->userHandle ||
+     pCallbackData != pCallbackData->pMe )
+  {
+    LOC_LOGE("%s:%d]: invalid handle \n", __func__, __LINE__);
+    return(eLOC_CLIENT_FAILURE_INVALID_HANDLE);
+  }
+
+  if(true != locClientGetSizeAndTypeByIndId(indId, &indSize, &indType))
+  {
+    return(eLOC_CLIENT_FAILURE_INVALID_PARAMETER);
+  }
+
+  indBuffer = calloc(1, indSize);
+  if(NULL == indBuffer)
+  {
+    LOC_LOGE("%s:%d]: memory allocation failed\n", __func__, __LINE__);
+    return(eLOC_CLIENT_FAILURE_INTERNAL);
+  }
+
+  if(indBufLen > 0)
+  {
+    rc = qmi_idl_message_decode(
+        loc_get_service_object_v02(),
+        QMI_IDL_INDICATION,
+        (uint16_t)indId,
+        pIndBuf,
+        indBufLen,
+        indBuffer,
+        indSize);
+  }
+
+  if(QMI_NO_ERR != rc)
+  {
+    LOC_LOGE("%s:%d]: Error decoding indication %d\n",
+             __func__, __LINE__, rc);
+    free(indBuffer);
+    return(eLOC_CLIENT_FAILURE_INTERNAL);
+  }
+
+  locClientDispatchInd(pCallbackData, indId, indBuffer, indType);
+  free(indBuffer);
+  return(eLOC_CLIENT_SUCCESS);
+}
+
 /** locClientGetSizeByRespIndId
  *  @brief Get the size of the response indication structure,
  *         from a specified id
@@ -1669,6 +1669,31 @@ extern bool locClientGetSizeByRespIndId(
   uint32_t respIndId,
   size_t *pRespIndSize);
 
+/*=============================================================================
+    locClientInjectInd */
+/** Decodes an encoded indication, as captured by locClientIndCb(), and
+    delivers it to the callbacks of a client as if the service had sent it.
+    Used to replay captured traffic.
+
+  @param[in] handle     Handle returned by the locClientOpen() function.
+  @param[in] indId      ID of the indication.
+  @param[in] pIndBuf    Encoded indication.
+  @param[in] indBufLen  Length of the encoded indication.
+
+  @return
+  One of the following error codes:
+  - 0 (eLOC_CLIENT_SUCCESS) -- On success.
+  - Non-zero error code (see \ref locClientStatusEnumType) -- On failure.
+
+  @dependencies
+  None.
+*/
+extern locClientStatusEnumType locClientInjectInd(
+  locClientHandleType handle,
+  uint32_t            indId,
+  const void*         pIndBuf,
+  uint32_t            indBufLen);
+
 /** locClientRegisterEventMask
  *  @brief registers the event mask with loc service
  *  @param [in] clientHandle
@@ -0,0 +1,632 @@
+/* Copyright (c) 2014, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation, nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <loc_cfg.h>
+#include "loc_api_v02_client.h"
+#include "loc_api_v02_sim.h"
+
+/* Logging */
+// Uncomment to log verbose logs
+#define LOG_NDEBUG 1
+
+// log debug logs
+#define LOG_NDDEBUG 1
+#define LOG_TAG "LocSvc_api_v02"
+#include "loc_util_log.h"
+
+#define GPS_CONF_FILE "/etc/gps.conf"
+
+// pending response indications per client
+#define LOC_CLIENT_SIM_RESP_QUEUE_SIZE 32
+
+/* gps.conf settings for the simulated service, all periods in ms,
+   a period of 0 disables that indication */
+typedef struct
+{
+  uint32_t QMI_SIM_ENABLED;
+  uint32_t QMI_SIM_RESP_DELAY_MS;
+  uint32_t QMI_SIM_FIX_PERIOD_MS;
+  uint32_t QMI_SIM_SV_PERIOD_MS;
+  uint32_t QMI_SIM_NMEA_PERIOD_MS;
+  uint32_t QMI_SIM_MEAS_PERIOD_MS;
+  uint32_t QMI_SIM_ATL_PERIOD_MS;
+  uint32_t QMI_SIM_NUM_SV;
+  double   QMI_SIM_LATITUDE;
+  double   QMI_SIM_LONGITUDE;
+  double   QMI_SIM_ACCURACY;
+} locClientSimConfigType;
+
+static locClientSimConfigType simConf;
+static pthread_once_t simConfOnce = PTHREAD_ONCE_INIT;
+
+static const loc_param_s_type simConfTable[] =
+{
+  {"QMI_SIM_ENABLED",        &simConf.QMI_SIM_ENABLED,        NULL, 'n'},
+  {"QMI_SIM_RESP_DELAY_MS",  &simConf.QMI_SIM_RESP_DELAY_MS,  NULL, 'n'},
+  {"QMI_SIM_FIX_PERIOD_MS",  &simConf.QMI_SIM_FIX_PERIOD_MS,  NULL, 'n'},
+  {"QMI_SIM_SV_PERIOD_MS",   &simConf.QMI_SIM_SV_PERIOD_MS,   NULL, 'n'},
+  {"QMI_SIM_NMEA_PERIOD_MS", &simConf.QMI_SIM_NMEA_PERIOD_MS, NULL, 'n'},
+  {"QMI_SIM_MEAS_PERIOD_MS", &simConf.QMI_SIM_MEAS_PERIOD_MS, NULL, 'n'},
+  {"QMI_SIM_ATL_PERIOD_MS",  &simConf.QMI_SIM_ATL_PERIOD_MS,  NULL, 'n'},
+  {"QMI_SIM_NUM_SV",         &simConf.QMI_SIM_NUM_SV,         NULL, 'n'},
+  {"QMI_SIM_LATITUDE",       &simConf.QMI_SIM_LATITUDE,       NULL, 'f'},
+  {"QMI_SIM_LONGITUDE",      &simConf.QMI_SIM_LONGITUDE,      NULL, 'f'},
+  {"QMI_SIM_ACCURACY",       &simConf.QMI_SIM_ACCURACY,       NULL, 'f'},
+};
+
+typedef struct
+{
+  uint32_t indId;
+  int64_t  dueMs;
+} locClientSimRespType;
+
+struct locClientSimStructT
+{
+  pthread_t               thread;
+  pthread_mutex_t         lock;
+  pthread_cond_t          cond;
+  bool                    running;
+
+  locClientSimIndCbType   indCb;
+  void                   *pCbData;
+
+  // state the service keeps for the client, protected by lock
+  locClientEventMaskType  eventRegMask;
+  bool                    inSession;
+  uint32_t                fixPeriodMs;
+  uint32_t                fixId;
+  uint32_t                atlHandle;
+  bool                    atlOpen;
+
+  int64_t                 nextFixMs;
+  int64_t                 nextSvMs;
+  int64_t                 nextNmeaMs;
+  int64_t                 nextMeasMs;
+  int64_t                 nextAtlMs;
+
+  uint32_t                respHead;
+  uint32_t                respCount;
+  locClientSimRespType    resp[LOC_CLIENT_SIM_RESP_QUEUE_SIZE];
+};
+
+static void locClientSimReadConf(void)
+{
+  memset(&simConf, 0, sizeof(simConf));
+  simConf.QMI_SIM_RESP_DELAY_MS = 5;
+  simConf.QMI_SIM_SV_PERIOD_MS = 1000;
+  simConf.QMI_SIM_NMEA_PERIOD_MS = 1000;
+  simConf.QMI_SIM_NUM_SV = 12;
+  simConf.QMI_SIM_LATITUDE = 32.8988;
+  simConf.QMI_SIM_LONGITUDE = -117.2069;
+  simConf.QMI_SIM_ACCURACY = 5.0;
+
+  UTIL_READ_CONF(GPS_CONF_FILE, simConfTable);
+
+  if (simConf.QMI_SIM_NUM_SV > QMI_LOC_SV_INFO_LIST_MAX_SIZE_V02)
+  {
+    simConf.QMI_SIM_NUM_SV = QMI_LOC_SV_INFO_LIST_MAX_SIZE_V02;
+  }
+}
+
+static int64_t locClientSimNowMs(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* true if the periodic indication is due, in which case the next due
+   time is advanced; a consumer that falls behind skips, not bursts */
+static bool locClientSimIsDue(int64_t *pNextMs, uint32_t periodMs,
+                              int64_t nowMs)
+{
+  if (0 == periodMs || nowMs < *pNextMs)
+  {
+    return false;
+  }
+  *pNextMs += periodMs;
+  if (*pNextMs <= nowMs)
+  {
+    *pNextMs = nowMs + periodMs;
+  }
+  return true;
+}
+
+static void locClientSimEarliest(int64_t *pWakeMs, int64_t nextMs,
+                                 uint32_t periodMs)
+{
+  if (0 != periodMs && nextMs < *pWakeMs)
+  {
+    *pWakeMs = nextMs;
+  }
+}
+
+static void locClientSimDeliver(locClientSimType *pSim, uint32_t indId,
+                                void *pIndBuffer)
+{
+  if (NULL != pSim->indCb)
+  {
+    pSim->indCb(pSim->pCbData, indId, pIndBuffer);
+  }
+}
+
+/* all response indications start with a status, so a zeroed one
+   reports success */
+static void locClientSimSendResp(locClientSimType *pSim, uint32_t indId)
+{
+  size_t indSize = 0;
+  void *pInd;
+
+  if (!locClientGetSizeByRespIndId(indId, &indSize))
+  {
+    return;
+  }
+  pInd = calloc(1, indSize);
+  if (NULL == pInd)
+  {
+    LOC_LOGE("%s:%d]: memory allocation failed\n", __func__, __LINE__);
+    return;
+  }
+  locClientSimDeliver(pSim, indId, pInd);
+  free(pInd);
+}
+
+static void locClientSimSendPosition(locClientSimType *pSim, uint32_t fixId)
+{
+  qmiLocEventPositionReportIndMsgT_v02 *pInd =
+    (qmiLocEventPositionReportIndMsgT_v02 *)calloc(1, sizeof(*pInd));
+  struct timespec ts;
+
+  if (NULL == pInd)
+  {
+    LOC_LOGE("%s:%d]: memory allocation failed\n", __func__, __LINE__);
+    return;
+  }
+  clock_gettime(CLOCK_REALTIME, &ts);
+
+  pInd->sessionStatus = eQMI_LOC_SESS_STATUS_SUCCESS_V02;
+  pInd->latitude_valid = 1;
+  pInd->latitude = simConf.QMI_SIM_LATITUDE;
+  pInd->longitude_valid = 1;
+  pInd->longitude = simConf.QMI_SIM_LONGITUDE;
+  pInd->horUncCircular_valid = 1;
+  pInd->horUncCircular = (float)simConf.QMI_SIM_ACCURACY;
+  pInd->horReliability_valid = 1;
+  pInd->horReliability = eQMI_LOC_RELIABILITY_NOT_SET_V02;
+  pInd->altitudeWrtEllipsoid_valid = 1;
+  pInd->altitudeWrtEllipsoid = 100;
+  pInd->speedHorizontal_valid = 1;
+  pInd->speedHorizontal = 0;
+  pInd->technologyMask_valid = 1;
+  pInd->technologyMask = QMI_LOC_POS_TECH_MASK_SATELLITE_V02;
+  pInd->timestampUtc_valid = 1;
+  pInd->timestampUtc = (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+  pInd->fixId_valid = 1;
+  pInd->fixId = fixId;
+
+  locClientSimDeliver(pSim, QMI_LOC_EVENT_POSITION_REPORT_IND_V02, pInd);
+  free(pInd);
+}
+
+static void locClientSimSendSv(locClientSimType *pSim)
+{
+  qmiLocEventGnssSvInfoIndMsgT_v02 *pInd =
+    (qmiLocEventGnssSvInfoIndMsgT_v02 *)calloc(1, sizeof(*pInd));
+  uint32_t i;
+
+  if (NULL == pInd)
+  {
+    LOC_LOGE("%s:%d]: memory allocation failed\n", __func__, __LINE__);
+    return;
+  }
+
+  pInd->svList_valid = 1;
+  pInd->svList_len = simConf.QMI_SIM_NUM_SV;
+  for (i = 0; i < pInd->svList_len; i++)
+  {
+    qmiLocSvInfoStructT_v02 *pSv = &pInd->svList[i];
+    pSv->validMask = QMI_LOC_SV_INFO_MASK_VALID_SYSTEM_V02 |
+                     QMI_LOC_SV_INFO_MASK_VALID_GNSS_SVID_V02 |
+                     QMI_LOC_SV_INFO_MASK_VALID_PROCESS_STATUS_V02 |
+                     QMI_LOC_SV_INFO_MASK_VALID_ELEVATION_V02 |
+                     QMI_LOC_SV_INFO_MASK_VALID_AZIMUTH_V02 |
+                     QMI_LOC_SV_INFO_MASK_VALID_SNR_V02;
+    pSv->system = eQMI_LOC_SV_SYSTEM_GPS_V02;
+    pSv->gnssSvId = (uint16_t)(i + 1);
+    pSv->svStatus = eQMI_LOC_SV_STATUS_TRACK_V02;
+    pSv->elevation = (float)(10 + (i * 7) % 80);
+    pSv->azimuth = (float)((i * 30) % 360);
+    pSv->snr = (float)(25 + (i * 3) % 20);
+  }
+
+  locClientSimDeliver(pSim, QMI_LOC_EVENT_GNSS_SV_INFO_IND_V02, pInd);
+  free(pInd);
+}
+
+static void locClientSimSendNmea(locClientSimType *pSim)
+{
+  qmiLocEventNmeaIndMsgT_v02 ind;
+  uint8_t checksum = 0;
+  size_t len;
+  size_t i;
+
+  memset(&ind, 0, sizeof(ind));
+  len = snprintf(ind.nmea, sizeof(ind.nmea),
+                 "$GPGGA,,%09.4f,%c,%010.4f,%c,1,%02u,1.0,100.0,M,,M,,",
+                 simConf.QMI_SIM_LATITUDE < 0 ?
+                   -simConf.QMI_SIM_LATITUDE * 100 :
+                   simConf.QMI_SIM_LATITUDE * 100,
+                 simConf.QMI_SIM_LATITUDE < 0 ? 'S' : 'N',
+                 simConf.QMI_SIM_LONGITUDE < 0 ?
+                   -simConf.QMI_SIM_LONGITUDE * 100 :
+                   simConf.QMI_SIM_LONGITUDE * 100,
+                 simConf.QMI_SIM_LONGITUDE < 0 ? 'W' : 'E',
+                 simConf.QMI_SIM_NUM_SV);
+  if (len >= sizeof(ind.nmea))
+  {
+    len = sizeof(ind.nmea) - 1;
+  }
+  for (i = 1; i < len; i++)
+  {
+    checksum ^= (uint8_t)ind.nmea[i];
+  }
+  snprintf(ind.nmea + len, sizeof(ind.nmea) - len, "*%02X\r\n", checksum);
+
+  locClientSimDeliver(pSim, QMI_LOC_EVENT_NMEA_IND_V02, &ind);
+}
+
+static void locClientSimSendMeas(locClientSimType *pSim)
+{
+  qmiLocEventGnssSvMeasInfoIndMsgT_v02 *pInd =
+    (qmiLocEventGnssSvMeasInfoIndMsgT_v02 *)calloc(1, sizeof(*pInd));
+  uint32_t i;
+
+  if (NULL == pInd)
+  {
+    LOC_LOGE("%s:%d]: memory allocation failed\n", __func__, __LINE__);
+    return;
+  }
+
+  pInd->seqNum = 1;
+  pInd->maxMessageNum = 1;
+  pInd->system = eQMI_LOC_SV_SYSTEM_GPS_V02;
+  pInd->svMeasurement_valid = 1;
+  pInd->svMeasurement_len =
+    simConf.QMI_SIM_NUM_SV < QMI_LOC_SV_MEAS_LIST_MAX_SIZE_V02 ?
+    simConf.QMI_SIM_NUM_SV : QMI_LOC_SV_MEAS_LIST_MAX_SIZE_V02;
+  for (i = 0; i < pInd->svMeasurement_len; i++)
+  {
+    qmiLocSVMeasurementStructT_v02 *pMeas = &pInd->svMeasurement[i];
+    pMeas->gnssSvId = (uint16_t)(i + 1);
+    pMeas->svStatus = eQMI_LOC_SV_STATUS_TRACK_V02;
+    pMeas->validMeasStatusMask = QMI_LOC_MASK_MEAS_STATUS_SM_STAT_BIT_VALID_V02 |
+                                 QMI_LOC_MASK_MEAS_STATUS_VEL_STAT_BIT_VALID_V02;
+    pMeas->measurementStatus = QMI_LOC_MASK_MEAS_STATUS_SM_VALID_V02;
+    pMeas->CNo = (uint16_t)((25 + (i * 3) % 20) * 10);
+    pMeas->svTimeSpeed.svTimeSubMs = 0.5f;
+    pMeas->svTimeSpeed.dopplerShift = (float)(i * 100) - 500;
+  }
+
+  locClientSimDeliver(pSim, QMI_LOC_EVENT_GNSS_MEASUREMENT_REPORT_IND_V02, pInd);
+  free(pInd);
+}
+
+static void locClientSimSendAtl(locClientSimType *pSim, uint32_t connHandle,
+                                bool open)
+{
+  qmiLocEventLocationServerConnectionReqIndMsgT_v02 ind;
+
+  memset(&ind, 0, sizeof(ind));
+  ind.connHandle = connHandle;
+  ind.requestType = open ? eQMI_LOC_SERVER_REQUEST_OPEN_V02 :
+                           eQMI_LOC_SERVER_REQUEST_CLOSE_V02;
+  ind.wwanType = eQMI_LOC_WWAN_TYPE_INTERNET_V02;
+
+  locClientSimDeliver(pSim, QMI_LOC_EVENT_LOCATION_SERVER_CONNECTION_REQ_IND_V02,
+                      &ind);
+}
+
+static void* locClientSimThread(void *arg)
+{
+  locClientSimType *pSim = (locClientSimType *)arg;
+
+  pthread_mutex_lock(&pSim->lock);
+  while (pSim->running)
+  {
+    int64_t nowMs = locClientSimNowMs();
+    int64_t wakeMs = nowMs + 1000;
+    locClientEventMaskType mask = pSim->eventRegMask;
+
+    // indications are delivered without the lock held, as the client
+    // may send the next request from within the callback
+    if (pSim->respCount > 0)
+    {
+      locClientSimRespType *pResp = &pSim->resp[pSim->respHead];
+      if (pResp->dueMs <= nowMs)
+      {
+        uint32_t indId = pResp->indId;
+        pSim->respHead = (pSim->respHead + 1) % LOC_CLIENT_SIM_RESP_QUEUE_SIZE;
+        pSim->respCount--;
+        pthread_mutex_unlock(&pSim->lock);
+        locClientSimSendResp(pSim, indId);
+        pthread_mutex_lock(&pSim->lock);
+        continue;
+      }
+      wakeMs = pResp->dueMs;
+    }
+
+    if (pSim->inSession)
+    {
+      if (locClientSimIsDue(&pSim->nextFixMs, pSim->fixPeriodMs, nowMs))
+      {
+        uint32_t fixId = pSim->fixId++;
+        if (mask & QMI_LOC_EVENT_MASK_POSITION_REPORT_V02)
+        {
+          pthread_mutex_unlock(&pSim->lock);
+          locClientSimSendPosition(pSim, fixId);
+          pthread_mutex_lock(&pSim->lock);
+        }
+        continue;
+      }
+      if (locClientSimIsDue(&pSim->nextSvMs,
+                            simConf.QMI_SIM_SV_PERIOD_MS, nowMs))
+      {
+        if (mask & QMI_LOC_EVENT_MASK_GNSS_SV_INFO_V02)
+        {
+          pthread_mutex_unlock(&pSim->lock);
+          locClientSimSendSv(pSim);
+          pthread_mutex_lock(&pSim->lock);
+        }
+        continue;
+      }
+      if (locClientSimIsDue(&pSim->nextNmeaMs,
+                            simConf.QMI_SIM_NMEA_PERIOD_MS, nowMs))
+      {
+        if (mask & QMI_LOC_EVENT_MASK_NMEA_V02)
+        {
+          pthread_mutex_unlock(&pSim->lock);
+          locClientSimSendNmea(pSim);
+          pthread_mutex_lock(&pSim->lock);
+        }
+        continue;
+      }
+      if (locClientSimIsDue(&pSim->nextMeasMs,
+                            simConf.QMI_SIM_MEAS_PERIOD_MS, nowMs))
+      {
+        if (mask & QMI_LOC_EVENT_MASK_GNSS_MEASUREMENT_REPORT_V02)
+        {
+          pthread_mutex_unlock(&pSim->lock);
+          locClientSimSendMeas(pSim);
+          pthread_mutex_lock(&pSim->lock);
+        }
+        continue;
+      }
+      if (locClientSimIsDue(&pSim->nextAtlMs,
+                            simConf.QMI_SIM_ATL_PERIOD_MS, nowMs))
+      {
+        // alternate between opening a connection and closing it
+        bool open = !pSim->atlOpen;
+        uint32_t connHandle = open ? ++pSim->atlHandle : pSim->atlHandle;
+        pSim->atlOpen = open;
+        if (mask & QMI_LOC_EVENT_MASK_LOCATION_SERVER_CONNECTION_REQ_V02)
+        {
+          pthread_mutex_unlock(&pSim->lock);
+          locClientSimSendAtl(pSim, connHandle, open);
+          pthread_mutex_lock(&pSim->lock);
+        }
+        continue;
+      }
+
+      locClientSimEarliest(&wakeMs, pSim->nextFixMs, pSim->fixPeriodMs);
+      locClientSimEarliest(&wakeMs, pSim->nextSvMs,
+                           simConf.QMI_SIM_SV_PERIOD_MS);
+      locClientSimEarliest(&wakeMs, pSim->nextNmeaMs,
+                           simConf.QMI_SIM_NMEA_PERIOD_MS);
+      locClientSimEarliest(&wakeMs, pSim->nextMeasMs,
+                           simConf.QMI_SIM_MEAS_PERIOD_MS);
+      locClientSimEarliest(&wakeMs, pSim->nextAtlMs,
+                           simConf.QMI_SIM_ATL_PERIOD_MS);
+    }
+
+    if (wakeMs > nowMs)
+    {
+      struct timespec ts;
+      // convert the monotonic wake time to the realtime clock
+      // pthread_cond_timedwait() uses
+      int64_t waitMs = wakeMs - nowMs;
+      clock_gettime(CLOCK_REALTIME, &ts);
+      ts.tv_sec += waitMs / 1000;
+      ts.tv_nsec += (waitMs % 1000) * 1000000;
+      if (ts.tv_nsec >= 1000000000)
+      {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+      }
+      pthread_cond_timedwait(&pSim->cond, &pSim->lock, &ts);
+    }
+  }
+  pthread_mutex_unlock(&pSim->lock);
+  return NULL;
+}
+
+bool locClientSimEnabled(void)
+{
+  pthread_once(&simConfOnce, locClientSimReadConf);
+  return (0 != simConf.QMI_SIM_ENABLED);
+}
+
+locClientSimType* locClientSimOpen(locClientSimIndCbType indCb, void *pCbData)
+{
+  locClientSimType *pSim;
+
+  pthread_once(&simConfOnce, locClientSimReadConf);
+
+  pSim = (locClientSimType *)calloc(1, sizeof(*pSim));
+  if (NULL == pSim)
+  {
+    LOC_LOGE("%s:%d]: memory allocation failed\n", __func__, __LINE__);
+    return NULL;
+  }
+
+  pthread_mutex_init(&pSim->lock, NULL);
+  pthread_cond_init(&pSim->cond, NULL);
+  pSim->indCb = indCb;
+  pSim->pCbData = pCbData;
+  pSim->fixPeriodMs = 1000;
+  pSim->running = true;
+
+  if (0 != pthread_create(&pSim->thread, NULL, locClientSimThread, pSim))
+  {
+    LOC_LOGE("%s:%d]: failed to create simulator thread\n",
+             __func__, __LINE__);
+    pthread_cond_destroy(&pSim->cond);
+    pthread_mutex_destroy(&pSim->lock);
+    free(pSim);
+    return NULL;
+  }
+
+  LOC_LOGI("%s:%d]: simulated QMI LOC service opened %p\n",
+           __func__, __LINE__, pSim);
+  return pSim;
+}
+
+void locClientSimClose(locClientSimType *pSim)
+{
+  if (NULL == pSim)
+  {
+    return;
+  }
+
+  pthread_mutex_lock(&pSim->lock);
+  pSim->running = false;
+  pthread_cond_signal(&pSim->cond);
+  pthread_mutex_unlock(&pSim->lock);
+
+  // never joined from the simulator thread itself, which is the only
+  // place the indication callback runs
+  if (!pthread_equal(pSim->thread, pthread_self()))
+  {
+    pthread_join(pSim->thread, NULL);
+  }
+  else
+  {
+    pthread_detach(pSim->thread);
+    return;
+  }
+
+  pthread_cond_destroy(&pSim->cond);
+  pthread_mutex_destroy(&pSim->lock);
+  free(pSim);
+}
+
+locClientStatusEnumType locClientSimSendReq(
+    locClientSimType *pSim,
+    uint32_t reqId,
+    const void *pReqData)
+{
+  size_t indSize = 0;
+  int64_t nowMs = locClientSimNowMs();
+
+  if (NULL == pSim)
+  {
+    return eLOC_CLIENT_FAILURE_INVALID_HANDLE;
+  }
+
+  pthread_mutex_lock(&pSim->lock);
+
+  switch (reqId)
+  {
+    case QMI_LOC_REG_EVENTS_REQ_V02:
+      if (NULL != pReqData)
+      {
+        pSim->eventRegMask =
+          ((const qmiLocRegEventsReqMsgT_v02 *)pReqData)->eventRegMask;
+      }
+      break;
+
+    case QMI_LOC_START_REQ_V02:
+    {
+      const qmiLocStartReqMsgT_v02 *pStart =
+        (const qmiLocStartReqMsgT_v02 *)pReqData;
+      pSim->fixPeriodMs = simConf.QMI_SIM_FIX_PERIOD_MS;
+      if (0 == pSim->fixPeriodMs)
+      {
+        pSim->fixPeriodMs = (NULL != pStart && pStart->minInterval_valid &&
+                             pStart->minInterval > 0) ?
+                            pStart->minInterval : 1000;
+      }
+      if (!pSim->inSession)
+      {
+        pSim->inSession = true;
+        pSim->nextFixMs = nowMs + pSim->fixPeriodMs;
+        pSim->nextSvMs = nowMs + simConf.QMI_SIM_SV_PERIOD_MS;
+        pSim->nextNmeaMs = nowMs + simConf.QMI_SIM_NMEA_PERIOD_MS;
+        pSim->nextMeasMs = nowMs + simConf.QMI_SIM_MEAS_PERIOD_MS;
+        pSim->nextAtlMs = nowMs + simConf.QMI_SIM_ATL_PERIOD_MS;
+      }
+      break;
+    }
+
+    case QMI_LOC_STOP_REQ_V02:
+      pSim->inSession = false;
+      break;
+
+    default:
+      break;
+  }
+
+  // same message id is used for the request and its response indication
+  if (locClientGetSizeByRespIndId(reqId, &indSize))
+  {
+    if (pSim->respCount < LOC_CLIENT_SIM_RESP_QUEUE_SIZE)
+    {
+      uint32_t tail = (pSim->respHead + pSim->respCount) %
+                      LOC_CLIENT_SIM_RESP_QUEUE_SIZE;
+      pSim->resp[tail].indId = reqId;
+      pSim->resp[tail].dueMs = nowMs + simConf.QMI_SIM_RESP_DELAY_MS;
+      pSim->respCount++;
+    }
+    else
+    {
+      LOC_LOGE("%s:%d]: response queue full, dropping ind %u\n",
+               __func__, __LINE__, reqId);
+    }
+  }
+
+  pthread_cond_signal(&pSim->cond);
+  pthread_mutex_unlock(&pSim->lock);
+
+  return eLOC_CLIENT_SUCCESS;
+}
@@ -0,0 +1,89 @@
+/* Copyright (c) 2014, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation, nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LOC_API_V02_SIM_H
+#define LOC_API_V02_SIM_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#include <stdbool.h>
+#include <stdint.h>
+#include "loc_api_v02_client.h"
+
+/** Simulated QMI LOC service, used by loc_api_v02_client.c in place of the
+    QCCI transport when QMI_SIM_ENABLED is set in gps.conf. It acknowledges
+    every request, answers the ones that have a response indication, and
+    while a session is running emits position, SV, NMEA, measurement and
+    ATL indications at the periods configured in gps.conf. */
+
+typedef struct locClientSimStructT locClientSimType;
+
+/** locClientSimIndCbType
+    Delivers an already decoded indication from the simulated service.
+    Called from the simulator thread. */
+typedef void (*locClientSimIndCbType)(
+    void *pCbData,
+    uint32_t indId,
+    void *pIndBuffer);
+
+/** locClientSimEnabled
+    @return true if the simulated service is to be used */
+extern bool locClientSimEnabled(void);
+
+/** locClientSimOpen
+    @brief starts a simulated service instance for one client
+    @param [in] indCb    callback for indications
+    @param [in] pCbData  passed back to indCb
+    @return the instance, or NULL on failure */
+extern locClientSimType* locClientSimOpen(
+    locClientSimIndCbType indCb,
+    void *pCbData);
+
+/** locClientSimClose
+    @brief stops the simulator thread and frees the instance. No
+           indication is delivered after this returns. */
+extern void locClientSimClose(locClientSimType *pSim);
+
+/** locClientSimSendReq
+    @brief hands a request to the simulated service
+    @param [in] pSim     instance returned by locClientSimOpen()
+    @param [in] reqId    message ID of the request
+    @param [in] pReqData request payload, can be NULL
+    @return eLOC_CLIENT_SUCCESS, as the real service would ack it */
+extern locClientStatusEnumType locClientSimSendReq(
+    locClientSimType *pSim,
+    uint32_t reqId,
+    const void *pReqData);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LOC_API_V02_SIM_H */
@@ -23,7 +23,8 @@ LOCAL_SRC_FILES += \
     LocTimer.cpp \
     LocThread.cpp \
     MsgTask.cpp \
-    loc_misc_utils.cpp
+    loc_misc_utils.cpp \
+    loc_fix_trace.cpp
 
 LOCAL_CFLAGS += \
      -fno-short-enums \
@@ -54,10 +55,12 @@ LOCAL_COPY_HEADERS:= \
    loc_target.h \
    loc_timer.h \
    LocSharedLock.h \
+   LocSpscRing.h \
    platform_lib_abstractions/platform_lib_includes.h \
    platform_lib_abstractions/platform_lib_time.h \
    platform_lib_abstractions/platform_lib_macros.h \
-   loc_misc_utils.h
+   loc_misc_utils.h \
+   loc_fix_trace.h
 
 LOCAL_MODULE := libgps.utils
 LOCAL_CLANG := false
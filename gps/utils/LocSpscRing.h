@@ -0,0 +1,90 @@
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation, nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#ifndef __LOC_SPSC_RING__
+#define __LOC_SPSC_RING__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <cutils/atomic.h>
+
+// A bounded ring of fixed size slots, for handing items from exactly one
+// producer thread to exactly one consumer thread without a lock or a heap
+// allocation per item. The producer fills a slot in place between claim()
+// and publish(); the consumer reads it in place between peek() and
+// release(). When the ring is full the new item is dropped, as the
+// consumer may be reading the oldest one; getDropped() counts those.
+// A ring of count 0, or one whose allocation failed, drops everything.
+class LocSpscRing {
+    uint8_t* const mSlots;
+    const size_t mSlotSize;
+    const int32_t mCount;
+    // next slot to publish, written by the producer only
+    volatile int32_t mHead;
+    // next slot to release, written by the consumer only
+    volatile int32_t mTail;
+    volatile int32_t mDropped;
+    inline uint8_t* slot(int32_t index) const {
+        return mSlots + (size_t)((uint32_t)index % (uint32_t)mCount) * mSlotSize;
+    }
+public:
+    inline LocSpscRing(size_t slotSize, int32_t count) :
+        mSlots((uint8_t*)calloc(count, slotSize)),
+        mSlotSize(slotSize), mCount(NULL == mSlots ? 0 : count),
+        mHead(0), mTail(0), mDropped(0) {}
+    inline ~LocSpscRing() { free(mSlots); }
+
+    // producer: the slot to fill in, or NULL if the ring is full, in
+    // which case the item is counted as dropped.
+    inline void* claim() {
+        if ((uint32_t)mHead - (uint32_t)android_atomic_acquire_load(&mTail) >=
+            (uint32_t)mCount) {
+            android_atomic_inc(&mDropped);
+            return NULL;
+        }
+        return slot(mHead);
+    }
+    // producer: makes the slot returned by claim() visible to the consumer
+    inline void publish() { android_atomic_release_store(mHead + 1, &mHead); }
+
+    // consumer: the oldest published slot, or NULL if the ring is empty
+    inline void* peek() const {
+        return (android_atomic_acquire_load(&mHead) == mTail) ?
+            NULL : slot(mTail);
+    }
+    // consumer: hands the slot returned by peek() back to the producer
+    inline void release() { android_atomic_release_store(mTail + 1, &mTail); }
+
+    // the number of items dropped so far
+    inline int32_t getDropped() const {
+        return android_atomic_acquire_load(&mDropped);
+    }
+};
+
+#endif //__LOC_SPSC_RING__
@@ -0,0 +1,334 @@
+/* Copyright (c) 2014, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation, nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <log_util.h>
+#include <loc_cfg.h>
+#include <loc_fix_trace.h>
+
+#define LOG_NDDEBUG 0
+#define LOG_TAG "LocSvc_fix_trace"
+
+#define GPS_CONF_FILE "/etc/gps.conf"
+
+// traces in flight; a fix still queued after this many newer ones is lost
+#define FIX_TRACE_SLOTS       64
+// log2 buckets of microseconds, the last one takes everything above
+#define FIX_TRACE_BUCKETS     24
+
+typedef struct {
+    uint32_t id;
+    int64_t stamp_ns[LOC_FIX_TRACE_STAGE_MAX];
+} loc_fix_trace_slot;
+
+typedef struct {
+    uint32_t count;
+    uint32_t bucket[FIX_TRACE_BUCKETS];
+    int64_t max_ns;
+} loc_fix_trace_histogram;
+
+typedef struct {
+    uint32_t FIX_TRACE_ENABLED;
+    char FIX_TRACE_FILE[LOC_MAX_PARAM_STRING + 1];
+    uint32_t FIX_TRACE_LOG_COUNT;
+    uint32_t FIX_TRACE_MAX_SIZE_KB;
+} loc_fix_trace_config;
+
+// name of the time spent before reaching each stage
+static const char* const stage_names[LOC_FIX_TRACE_STAGE_MAX] = {
+    "ind receive",
+    "qmi decode",
+    "LocApi convert",
+    "adapter fan-out",
+    "MsgTask queue",
+    "proc to cb",
+    "location_cb",
+};
+
+static loc_fix_trace_config trace_conf;
+static pthread_once_t trace_once = PTHREAD_ONCE_INIT;
+static pthread_key_t trace_current_key;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static loc_fix_trace_slot trace_slots[FIX_TRACE_SLOTS];
+static uint32_t trace_next_id = 0;
+// histograms of each stage, and of the whole path in the last entry
+static loc_fix_trace_histogram trace_histograms[LOC_FIX_TRACE_STAGE_MAX + 1];
+static uint32_t trace_count = 0;
+static FILE* trace_file = NULL;
+static uint64_t trace_file_size = 0;
+
+static const loc_param_s_type trace_conf_table[] =
+{
+    {"FIX_TRACE_ENABLED",     &trace_conf.FIX_TRACE_ENABLED,     NULL, 'n'},
+    {"FIX_TRACE_FILE",        &trace_conf.FIX_TRACE_FILE,        NULL, 's'},
+    {"FIX_TRACE_LOG_COUNT",   &trace_conf.FIX_TRACE_LOG_COUNT,   NULL, 'n'},
+    {"FIX_TRACE_MAX_SIZE_KB", &trace_conf.FIX_TRACE_MAX_SIZE_KB, NULL, 'n'},
+};
+
+static int64_t loc_fix_trace_now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void loc_fix_trace_init()
+{
+    memset(&trace_conf, 0, sizeof(trace_conf));
+    trace_conf.FIX_TRACE_LOG_COUNT = 100;
+    trace_conf.FIX_TRACE_MAX_SIZE_KB = 4096;
+    UTIL_READ_CONF(GPS_CONF_FILE, trace_conf_table);
+
+    if (0 == trace_conf.FIX_TRACE_ENABLED) {
+        return;
+    }
+    if (0 != pthread_key_create(&trace_current_key, NULL)) {
+        LOC_LOGE("%s:%d]: pthread_key_create failed", __func__, __LINE__);
+        trace_conf.FIX_TRACE_ENABLED = 0;
+        return;
+    }
+
+    if ('\0' != trace_conf.FIX_TRACE_FILE[0]) {
+        trace_file = fopen(trace_conf.FIX_TRACE_FILE, "w");
+        if (NULL == trace_file) {
+            LOC_LOGE("%s:%d]: fopen %s failed", __func__, __LINE__,
+                     trace_conf.FIX_TRACE_FILE);
+        } else {
+            // JSON array format; the closing ']' is optional to both
+            // chrome://tracing and Perfetto, so the file is always valid
+            int pid = getpid();
+            int len = fprintf(trace_file, "[\n");
+            for (int i = 0; i < LOC_FIX_TRACE_STAGE_MAX; i++) {
+                len += fprintf(trace_file,
+                               "{\"name\":\"thread_name\",\"ph\":\"M\","
+                               "\"pid\":%d,\"tid\":%d,"
+                               "\"args\":{\"name\":\"%s\"}},\n",
+                               pid, i, i > 0 ? stage_names[i] : "fix");
+            }
+            trace_file_size = len;
+        }
+    }
+    LOC_LOGI("%s:%d]: fix latency tracing enabled, trace file %s",
+             __func__, __LINE__,
+             NULL != trace_file ? trace_conf.FIX_TRACE_FILE : "none");
+}
+
+static inline bool loc_fix_trace_enabled()
+{
+    pthread_once(&trace_once, loc_fix_trace_init);
+    return 0 != trace_conf.FIX_TRACE_ENABLED;
+}
+
+static inline loc_fix_trace_slot* loc_fix_trace_slot_of(uint32_t id)
+{
+    loc_fix_trace_slot* slot = &trace_slots[id % FIX_TRACE_SLOTS];
+    return (0 != id && slot->id == id) ? slot : NULL;
+}
+
+static void loc_fix_trace_add(loc_fix_trace_histogram* histogram,
+                              int64_t ns)
+{
+    int64_t us = ns / 1000;
+    int bucket = 0;
+
+    while (us > 1 && bucket < FIX_TRACE_BUCKETS - 1) {
+        us >>= 1;
+        bucket++;
+    }
+    histogram->bucket[bucket]++;
+    histogram->count++;
+    if (ns > histogram->max_ns) {
+        histogram->max_ns = ns;
+    }
+}
+
+// upper bound of the bucket holding the given percentile, in us
+static uint32_t loc_fix_trace_percentile(const loc_fix_trace_histogram* histogram,
+                                         uint32_t pct)
+{
+    uint32_t rank = (histogram->count * pct + 99) / 100;
+    uint32_t seen = 0;
+
+    for (int i = 0; i < FIX_TRACE_BUCKETS; i++) {
+        seen += histogram->bucket[i];
+        if (seen >= rank) {
+            return 2u << i;
+        }
+    }
+    return 2u << (FIX_TRACE_BUCKETS - 1);
+}
+
+static void loc_fix_trace_log()
+{
+    for (int i = 1; i <= LOC_FIX_TRACE_STAGE_MAX; i++) {
+        const loc_fix_trace_histogram* histogram = &trace_histograms[i];
+        if (0 == histogram->count) {
+            continue;
+        }
+        LOC_LOGI("%s:%d]: %-16s n %u p50 <%u us p90 <%u us p99 <%u us max %lld us",
+                 __func__, __LINE__,
+                 i < LOC_FIX_TRACE_STAGE_MAX ? stage_names[i] : "total",
+                 histogram->count,
+                 loc_fix_trace_percentile(histogram, 50),
+                 loc_fix_trace_percentile(histogram, 90),
+                 loc_fix_trace_percentile(histogram, 99),
+                 (long long)(histogram->max_ns / 1000));
+    }
+    if (NULL != trace_file) {
+        fflush(trace_file);
+    }
+}
+
+static void loc_fix_trace_export(uint32_t id, const int64_t* stamp_ns,
+                                 int first, int last)
+{
+    static int pid = getpid();
+    uint64_t max_size = (uint64_t)trace_conf.FIX_TRACE_MAX_SIZE_KB * 1024;
+    int prev = first;
+
+    if (NULL == trace_file || trace_file_size >= max_size) {
+        return;
+    }
+
+    // the whole fix on track 0, each stage on a track of its own
+    trace_file_size += fprintf(trace_file,
+                               "{\"name\":\"fix\",\"ph\":\"X\",\"pid\":%d,"
+                               "\"tid\":0,\"ts\":%lld.%03d,\"dur\":%lld.%03d,"
+                               "\"args\":{\"id\":%u}},\n",
+                               pid,
+                               (long long)(stamp_ns[first] / 1000),
+                               (int)(stamp_ns[first] % 1000),
+                               (long long)((stamp_ns[last] - stamp_ns[first]) / 1000),
+                               (int)((stamp_ns[last] - stamp_ns[first]) % 1000),
+                               id);
+    for (int i = first + 1; i <= last; i++) {
+        if (0 == stamp_ns[i]) {
+            continue;
+        }
+        trace_file_size += fprintf(trace_file,
+                                   "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,"
+                                   "\"tid\":%d,\"ts\":%lld.%03d,\"dur\":%lld.%03d,"
+                                   "\"args\":{\"id\":%u}},\n",
+                                   stage_names[i], pid, i,
+                                   (long long)(stamp_ns[prev] / 1000),
+                                   (int)(stamp_ns[prev] % 1000),
+                                   (long long)((stamp_ns[i] - stamp_ns[prev]) / 1000),
+                                   (int)((stamp_ns[i] - stamp_ns[prev]) % 1000),
+                                   id);
+        prev = i;
+    }
+    if (trace_file_size >= max_size) {
+        LOC_LOGW("%s:%d]: trace file full at %llu bytes", __func__, __LINE__,
+                 (unsigned long long)trace_file_size);
+        fflush(trace_file);
+    }
+}
+
+uint32_t loc_fix_trace_begin(void)
+{
+    uint32_t id;
+    loc_fix_trace_slot* slot;
+
+    if (!loc_fix_trace_enabled()) {
+        return 0;
+    }
+
+    do {
+        id = __sync_add_and_fetch(&trace_next_id, 1);
+    } while (0 == id);
+
+    slot = &trace_slots[id % FIX_TRACE_SLOTS];
+    memset(slot->stamp_ns, 0, sizeof(slot->stamp_ns));
+    slot->stamp_ns[LOC_FIX_TRACE_RECEIVE] = loc_fix_trace_now_ns();
+    slot->id = id;
+    pthread_setspecific(trace_current_key, (void*)(uintptr_t)id);
+    return id;
+}
+
+uint32_t loc_fix_trace_current(void)
+{
+    if (!loc_fix_trace_enabled()) {
+        return 0;
+    }
+    return (uint32_t)(uintptr_t)pthread_getspecific(trace_current_key);
+}
+
+void loc_fix_trace_clear(void)
+{
+    if (loc_fix_trace_enabled()) {
+        pthread_setspecific(trace_current_key, NULL);
+    }
+}
+
+void loc_fix_trace_stamp(uint32_t id, loc_fix_trace_stage stage)
+{
+    loc_fix_trace_slot* slot = loc_fix_trace_slot_of(id);
+
+    if (NULL != slot && stage < LOC_FIX_TRACE_STAGE_MAX) {
+        slot->stamp_ns[stage] = loc_fix_trace_now_ns();
+    }
+}
+
+void loc_fix_trace_end(uint32_t id)
+{
+    loc_fix_trace_slot* slot = loc_fix_trace_slot_of(id);
+    int64_t stamp_ns[LOC_FIX_TRACE_STAGE_MAX];
+    int prev = LOC_FIX_TRACE_RECEIVE;
+
+    if (NULL == slot) {
+        return;
+    }
+    memcpy(stamp_ns, slot->stamp_ns, sizeof(stamp_ns));
+    slot->id = 0;
+    if (0 == stamp_ns[LOC_FIX_TRACE_CB_RETURN] ||
+        0 == stamp_ns[LOC_FIX_TRACE_RECEIVE]) {
+        return;
+    }
+
+    pthread_mutex_lock(&trace_lock);
+    for (int i = LOC_FIX_TRACE_RECEIVE + 1; i < LOC_FIX_TRACE_STAGE_MAX; i++) {
+        if (0 != stamp_ns[i]) {
+            loc_fix_trace_add(&trace_histograms[i], stamp_ns[i] - stamp_ns[prev]);
+            prev = i;
+        }
+    }
+    loc_fix_trace_add(&trace_histograms[LOC_FIX_TRACE_STAGE_MAX],
+                      stamp_ns[LOC_FIX_TRACE_CB_RETURN] -
+                      stamp_ns[LOC_FIX_TRACE_RECEIVE]);
+    loc_fix_trace_export(id, stamp_ns, LOC_FIX_TRACE_RECEIVE,
+                         LOC_FIX_TRACE_CB_RETURN);
+    if (0 != trace_conf.FIX_TRACE_LOG_COUNT &&
+        0 == ++trace_count % trace_conf.FIX_TRACE_LOG_COUNT) {
+        loc_fix_trace_log();
+    }
+    pthread_mutex_unlock(&trace_lock);
+}
@@ -0,0 +1,115 @@
+/* Copyright (c) 2014, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation, nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#ifndef _LOC_FIX_TRACE_H_
+#define _LOC_FIX_TRACE_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+  Stages a position report is stamped at on its way from the QMI
+  indication to location_cb. The time spent in each stage is the time
+  from the stamp before it. Stages are in the order the fix passes them.
+ */
+typedef enum {
+    LOC_FIX_TRACE_RECEIVE = 0,    // indication received by locClientIndCb
+    LOC_FIX_TRACE_LOC_API,        // LocApiV02::reportPosition
+    LOC_FIX_TRACE_FAN_OUT,        // LocApiBase::reportPosition
+    LOC_FIX_TRACE_ENQUEUE,        // LocEngReportPosition sent to MsgTask
+    LOC_FIX_TRACE_DEQUEUE,        // LocEngReportPosition::proc
+    LOC_FIX_TRACE_CB_ENTER,       // location_cb called
+    LOC_FIX_TRACE_CB_RETURN,      // location_cb returned
+    LOC_FIX_TRACE_STAGE_MAX
+} loc_fix_trace_stage;
+
+/*===========================================================================
+FUNCTION loc_fix_trace_begin
+
+DESCRIPTION:
+    Starts a trace for a position report as it is received, if FIX_TRACE_ENABLED
+    is set in gps.conf, and makes it the current trace of the calling thread
+    so the stages reached synchronously can be stamped without passing the
+    trace ID down.
+
+RETURN VALUE
+    uint32_t trace ID, 0 if tracing is disabled
+
+===========================================================================*/
+uint32_t loc_fix_trace_begin(void);
+
+/*===========================================================================
+FUNCTION loc_fix_trace_current
+
+RETURN VALUE
+    uint32_t the current trace ID of the calling thread, 0 if none.
+    Messages carry this ID to the thread they are handled on.
+
+===========================================================================*/
+uint32_t loc_fix_trace_current(void);
+
+/*===========================================================================
+FUNCTION loc_fix_trace_clear
+
+DESCRIPTION:
+    Clears the current trace of the calling thread, once the report has
+    left it.
+
+===========================================================================*/
+void loc_fix_trace_clear(void);
+
+/*===========================================================================
+FUNCTION loc_fix_trace_stamp
+
+DESCRIPTION:
+    Stamps a stage of a trace with the CLOCK_MONOTONIC time. Does nothing
+    for trace ID 0, or for a trace that has been overwritten by newer ones.
+
+===========================================================================*/
+void loc_fix_trace_stamp(uint32_t id, loc_fix_trace_stage stage);
+
+/*===========================================================================
+FUNCTION loc_fix_trace_end
+
+DESCRIPTION:
+    Ends a trace. A trace that reached location_cb is added to the latency
+    histograms, which are logged every FIX_TRACE_LOG_COUNT fixes, and
+    written to FIX_TRACE_FILE as Chrome trace events. Traces of reports
+    that were not delivered are dropped.
+
+===========================================================================*/
+void loc_fix_trace_end(uint32_t id);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //_LOC_FIX_TRACE_H_
@@ -31,6 +31,8 @@
 #include <log_util.h>
 #include <loc_misc_utils.h>
 #include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #define LOG_NDDEBUG 0
 #define LOG_TAG "LocSvc_misc_utils"
@@ -112,3 +114,71 @@ void loc_util_trim_space(char *org_string)
 err:
     return;
 }
+
+uint32_t loc_util_crc32(uint32_t crc, const void *data, size_t length)
+{
+    const uint8_t *ptr = (const uint8_t *)data;
+
+    crc = ~crc;
+    while (length--) {
+        crc ^= *ptr++;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+int loc_util_write_file_atomic(const char *file_name, const void *data,
+                               size_t length, int mode)
+{
+    char tmp_name[256];
+    const char *ptr = (const char *)data;
+    size_t written = 0;
+    int fd = -1;
+    int ret = -1;
+
+    if (file_name == NULL || (data == NULL && length > 0)) {
+        LOC_LOGE("%s:%d]: NULL parameters", __func__, __LINE__);
+        goto err;
+    }
+
+    if (snprintf(tmp_name, sizeof(tmp_name), "%s.tmp", file_name) >=
+        (int)sizeof(tmp_name)) {
+        LOC_LOGE("%s:%d]: file name too long: %s", __func__, __LINE__, file_name);
+        goto err;
+    }
+
+    fd = open(tmp_name, O_WRONLY | O_CREAT | O_TRUNC, mode);
+    if (fd < 0) {
+        LOC_LOGE("%s:%d]: open %s failed", __func__, __LINE__, tmp_name);
+        goto err;
+    }
+
+    while (written < length) {
+        ssize_t n = write(fd, ptr + written, length - written);
+        if (n <= 0) {
+            LOC_LOGE("%s:%d]: write %s failed", __func__, __LINE__, tmp_name);
+            close(fd);
+            unlink(tmp_name);
+            goto err;
+        }
+        written += n;
+    }
+
+    if (fsync(fd) < 0) {
+        LOC_LOGE("%s:%d]: sync %s failed", __func__, __LINE__, tmp_name);
+        close(fd);
+        unlink(tmp_name);
+        goto err;
+    }
+
+    if (close(fd) < 0 || rename(tmp_name, file_name) < 0) {
+        LOC_LOGE("%s:%d]: commit %s failed", __func__, __LINE__, file_name);
+        unlink(tmp_name);
+        goto err;
+    }
+    ret = 0;
+err:
+    return ret;
+}
@@ -29,6 +29,9 @@
 #ifndef _LOC_MISC_UTILS_H_
 #define _LOC_MISC_UTILS_H_
 
+#include <stddef.h>
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -92,6 +95,45 @@ SIDE EFFECTS
    N/A
 ===========================================================================*/
 void loc_util_trim_space(char *org_string);
+
+/*===========================================================================
+FUNCTION loc_util_crc32
+
+DESCRIPTION
+   Computes the IEEE 802.3 CRC-32 of a buffer. Pass 0 as the initial crc,
+   or the result of a previous call to checksum data in pieces.
+
+DEPENDENCIES
+   N/A
+
+RETURN VALUE
+   uint32_t crc of the buffer
+
+SIDE EFFECTS
+   N/A
+===========================================================================*/
+uint32_t loc_util_crc32(uint32_t crc, const void *data, size_t length);
+
+/*===========================================================================
+FUNCTION loc_util_write_file_atomic
+
+DESCRIPTION
+   Writes a buffer to file_name such that a reader never observes a partially
+   written file. The data goes to a temporary file next to file_name, which is
+   synced and then renamed over file_name. The file is created with the given
+   mode. Missing parent directories are not created.
+
+DEPENDENCIES
+   N/A
+
+RETURN VALUE
+   0 on success, -1 on failure
+
+SIDE EFFECTS
+   file_name is replaced
+===========================================================================*/
+int loc_util_write_file_atomic(const char *file_name, const void *data,
+                               size_t length, int mode);
 #ifdef __cplusplus
 }
 #endif